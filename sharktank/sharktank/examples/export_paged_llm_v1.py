@@ -6,6 +6,8 @@
 
 """Export support for the PagedLLMV1 protocol of models."""
 
+from typing import Any, Optional
+
 import json
 import torch
 
@@ -17,6 +19,23 @@ from sharktank.types import *
 # TODO: Should be using a base class with the protocol supported.
 from ..models.llama.llama import LlamaModelConfig, PagedLlamaModelV1
 
+# Quantized KV cache dtypes and the matching runtime (HAL) element type names.
+KV_CACHE_DTYPES = {
+    "int8": (torch.int8, "INT_8"),
+    "float8_e4m3fnuz": (torch.float8_e4m3fnuz, "FLOAT_8_E4M3_FNUZ"),
+}
+
+
+def set_parameter_scope(theta: Theta, scope: str):
+    """Retags the externalized tensors of a theta to load from `scope`."""
+    for tensor in theta.flatten().values():
+        for t in tensor.globals.values():
+            ext_trait = ExternalTensorTrait.get(t)
+            if ext_trait is not None:
+                ExternalTensorTrait(
+                    external_name=ext_trait.external_name, external_scope=scope
+                ).set(t)
+
 
 def main():
     from ..utils import cli
@@ -36,9 +55,69 @@ def main():
     parser.add_argument(
         "--bs",
         help="Comma-separated batch size(s) to generate, e.g. `4` or `2,4`",
-        type=lambda arg: [int(bs) for bs in arg.split(",")],
+        type=lambda arg: [int(bs) for bs in arg.split(",") if bs],
         default="4",
     )
+    parser.add_argument(
+        "--dynamic-batch-size",
+        help="Also export {name}_bs_dyn entry-points with a dynamic batch size of "
+        "up to N, which run any batch size without padding (paged cache only). "
+        "The --bs batch sizes (which may be empty) are then specialized fast paths",
+        type=int,
+        default=0,
+    )
+    parser.add_argument(
+        "--chunked-prefill",
+        help="Also export prefill_chunk_bs{N} entry-points (paged cache only)",
+        action="store_true",
+    )
+    parser.add_argument(
+        "--prefill-last-logits",
+        help="Return only the logits of each row's last position from prefill",
+        action="store_true",
+    )
+    parser.add_argument(
+        "--sampling",
+        help="Also export sample_bs{N} entry-points to sample tokens on device",
+        action="store_true",
+    )
+    parser.add_argument(
+        "--speculate-k",
+        help="Also export verify_bs{N} entry-points which check K speculated "
+        "tokens per row against the model (paged cache only)",
+        type=int,
+        default=0,
+    )
+    parser.add_argument(
+        "--module-name",
+        help="Name of the exported module. A draft model for speculative "
+        "decoding is served from the module set of the model it drafts for, so "
+        "it must be exported under a different name",
+        default="module",
+    )
+    parser.add_argument(
+        "--parameter-scope",
+        help="Scope to load the model parameters from. A draft model's "
+        "parameters are served alongside those of the model it drafts for, so "
+        "they must be exported under a different scope",
+    )
+    parser.add_argument(
+        "--kv-cache-dtype",
+        help="Quantized dtype to store paged KV cache pages in",
+        choices=list(KV_CACHE_DTYPES.keys()),
+    )
+    parser.add_argument(
+        "--paged-attention-kernel",
+        help="Decode with the fused paged attention kernel, reading K/V pages "
+        "in place (paged cache only)",
+        action="store_true",
+    )
+    parser.add_argument(
+        "--flash-attention",
+        help="Prefill with the tiled flash attention kernel, computing masks "
+        "from sequence lengths on device",
+        action="store_true",
+    )
     parser.add_argument(
         "--verbose",
         help="Include verbose logging",
@@ -50,21 +129,62 @@ def main():
 
     hp = configs.LlamaHParams.from_gguf_props(dataset.properties)
     llama_config = LlamaModelConfig(hp)
-    llama_config.kv_cache_type = "direct" if args.bs == [1] else "paged"
-    model = PagedLlamaModelV1(dataset.root_theta, llama_config)
+    # Only the paged KV cache can be batched dynamically.
+    llama_config.kv_cache_type = (
+        "direct" if args.bs == [1] and args.dynamic_batch_size == 0 else "paged"
+    )
+    if args.dynamic_batch_size == 1:
+        raise ValueError("--dynamic-batch-size must be at least 2")
+    if args.kv_cache_dtype is not None:
+        if llama_config.kv_cache_type != "paged":
+            raise ValueError("--kv-cache-dtype requires a paged KV cache")
+        llama_config.kv_cache_dtype = KV_CACHE_DTYPES[args.kv_cache_dtype][0]
+    if args.paged_attention_kernel:
+        if llama_config.kv_cache_type != "paged":
+            raise ValueError("--paged-attention-kernel requires a paged KV cache")
+        llama_config.use_paged_attention_kernel = True
+    llama_config.use_flash_attention = args.flash_attention
+    theta = dataset.root_theta
+    if args.parameter_scope is not None:
+        set_parameter_scope(theta, args.parameter_scope)
+    if isinstance(theta.tensor("token_embd", "weight"), ShardedTensor):
+        # Shards would all be placed on the one device the program runs on.
+        raise ValueError("Exporting a sharded dataset is not supported")
+    model = PagedLlamaModelV1(theta, llama_config)
+
+    def allocate_paged_cache_state() -> list[torch.Tensor]:
+        return model.cache.allocate(
+            page_count=hp.context_length // llama_config.block_seq_stride
+        )
 
-    def generate_params_json(hp, prefill_bs: list[int], decode_bs: list[int]):
-        return {
-            "module_name": "module",
+    def generate_params_json(
+        hp,
+        prefill_bs: list[int],
+        decode_bs: list[int],
+        prefill_chunk_bs: list[int],
+    ):
+        config = {
+            "module_name": args.module_name,
             "module_abi_version": 1,
             "max_seq_len": hp.context_length,
             "attn_head_count": hp.attention_head_count,
             "attn_head_dim": hp.attn_head_dim,
             "prefill_batch_sizes": prefill_bs,
             "decode_batch_sizes": decode_bs,
+            "prefill_chunk_batch_sizes": prefill_chunk_bs,
+            "dynamic_batch_size": args.dynamic_batch_size,
             "transformer_block_count": hp.block_count,
             "block_seq_stride": llama_config.block_seq_stride,
+            "prefill_last_logits": args.prefill_last_logits,
+            "sampling": args.sampling,
+            "verify_chunk_len": args.speculate_k + 1 if args.speculate_k > 0 else 0,
         }
+        if args.parameter_scope is not None:
+            config["parameter_scope"] = args.parameter_scope
+        if args.kv_cache_dtype is not None:
+            config["attn_dtype"] = KV_CACHE_DTYPES[args.kv_cache_dtype][1]
+            config["attn_scale_dtype"] = "FLOAT_32"
+        return config
 
     # Unrolling cache updates by batch row makes dynamo sad without an
     # override. There may be a better way to do this.
@@ -75,7 +195,31 @@ def main():
 
     fxb = FxProgramsBuilder(model)
 
-    def generate_batch_prefill(bs: int):
+    def chunked_attention_mask(
+        model, tokens, start_positions, seq_lens, seq_block_ids
+    ) -> Optional[torch.Tensor]:
+        # Flash attention computes the mask from the positions instead.
+        if args.flash_attention:
+            return None
+        return model.chunked_attention_mask(
+            start_positions,
+            seq_lens,
+            tokens.shape[1],
+            seq_block_ids.shape[1] * model.cache.block_seq_stride,
+        )
+
+    def batch_spec(bs: Optional[int]) -> tuple[int, dict[int, Any], str]:
+        """Returns the example batch size, the dynamic shape of batch dimensions
+        and the entry-point suffix for a batch size (or a dynamic one if None).
+        """
+        if bs is not None:
+            return bs, {}, f"bs{bs}"
+        # Example sizes of 0 and 1 would specialize the dimension.
+        batch_dim = torch.export.Dim("batch", max=args.dynamic_batch_size)
+        return 2, {0: batch_dim}, "bs_dyn"
+
+    def generate_batch_prefill(bs: Optional[int]):
+        bs, batch, suffix = batch_spec(bs)
         tokens = torch.empty(bs, 64, dtype=torch.int64)
         seq_lens = torch.empty(bs, dtype=torch.int64)
         seq_block_ids = torch.empty(bs, 4, dtype=torch.int64)
@@ -85,11 +229,9 @@ def main():
         sl_dim = llama_config.block_seq_stride * block_dim
 
         if model.config.kv_cache_type == "paged":
-            cache_state = model.cache.allocate(
-                page_count=hp.context_length // llama_config.block_seq_stride
-            )
+            cache_state = allocate_paged_cache_state()
             page_dim = torch.export.Dim("page")
-            cache_state_dynamic_shapes = [{0: page_dim}]
+            cache_state_dynamic_shapes = len(cache_state) * [{0: page_dim}]
         elif model.config.kv_cache_type == "direct":
             cache_state = model.cache.allocate(bs=1)
             # Direct cache dimensions:
@@ -100,32 +242,38 @@ def main():
             raise NotImplementedError(f"Unsupported KV cache type: {type(model.cache)}")
 
         dynamic_shapes = {
-            "tokens": {1: sl_dim},
-            "seq_lens": {},
-            "seq_block_ids": {1: block_dim},
+            "tokens": {**batch, 1: sl_dim},
+            "seq_lens": batch,
+            "seq_block_ids": {**batch, 1: block_dim},
             "cache_state": cache_state_dynamic_shapes,
         }
 
-        print(f"Exporting prefill_bs{bs}")
+        print(f"Exporting prefill_{suffix}")
 
         @fxb.export_program(
-            name=f"prefill_bs{bs}",
+            name=f"prefill_{suffix}",
             args=(tokens, seq_lens, seq_block_ids, cache_state),
             dynamic_shapes=dynamic_shapes,
         )
         def _(model, tokens, seq_lens, seq_block_ids, cache_state):
-            sl = tokens.shape[1]
-            input_mask = model.input_mask(seq_lens, sl)
-            attention_mask = model.attention_mask(input_mask)
+            attention_mask = None
+            if not args.flash_attention:
+                sl = tokens.shape[1]
+                input_mask = model.input_mask(seq_lens, sl)
+                attention_mask = model.attention_mask(input_mask)
             logits = model.prefill(
                 tokens,
                 attention_mask=attention_mask,
                 seq_block_ids=seq_block_ids,
                 cache_state=cache_state,
+                seq_lens=seq_lens,
             )
+            if args.prefill_last_logits:
+                logits = model.last_position_logits(logits, seq_lens)
             return logits
 
-    def generate_batch_decode(bs: int):
+    def generate_batch_decode(bs: Optional[int]):
+        bs, batch, suffix = batch_spec(bs)
         tokens = torch.ones(bs, 1, dtype=torch.int64)
         seq_lens = torch.ones(bs, dtype=torch.int64)
         start_positions = torch.ones(bs, dtype=torch.int64)
@@ -135,11 +283,9 @@ def main():
         )
 
         if model.config.kv_cache_type == "paged":
-            cache_state = model.cache.allocate(
-                page_count=hp.context_length // llama_config.block_seq_stride
-            )
+            cache_state = allocate_paged_cache_state()
             page_dim = torch.export.Dim("page")
-            cache_state_dynamic_shapes = [{0: page_dim}]
+            cache_state_dynamic_shapes = len(cache_state) * [{0: page_dim}]
         elif model.config.kv_cache_type == "direct":
             cache_state = model.cache.allocate(bs=1)
             # Direct cache dimensions:
@@ -150,17 +296,17 @@ def main():
             raise NotImplementedError(f"Unsupported KV cache type: {type(model.cache)}")
 
         dynamic_shapes = {
-            "tokens": {},
-            "seq_lens": {},
-            "start_positions": {},
-            "seq_block_ids": {1: block_dim},
+            "tokens": batch,
+            "seq_lens": batch,
+            "start_positions": batch,
+            "seq_block_ids": {**batch, 1: block_dim},
             "cache_state": cache_state_dynamic_shapes,
         }
 
-        print(f"Exporting decode_bs{bs}")
+        print(f"Exporting decode_{suffix}")
 
         @fxb.export_program(
-            name=f"decode_bs{bs}",
+            name=f"decode_{suffix}",
             args=(
                 tokens,
                 seq_lens,
@@ -191,12 +337,153 @@ def main():
             )
             return logits
 
-    bsizes = []
-    for bs in args.bs:
+    def generate_batch_prefill_chunk(bs: Optional[int]):
+        bs, batch, suffix = batch_spec(bs)
+        tokens = torch.empty(bs, 64, dtype=torch.int64)
+        start_positions = torch.zeros(bs, dtype=torch.int64)
+        seq_lens = torch.empty(bs, dtype=torch.int64)
+        seq_block_ids = torch.empty(bs, 8, dtype=torch.int64)
+        block_dim = torch.export.Dim(
+            "block", max=(hp.context_length - 1) // llama_config.block_seq_stride
+        )
+        chunk_dim = torch.export.Dim("chunk", max=hp.context_length - 1)
+        cache_state = allocate_paged_cache_state()
+        page_dim = torch.export.Dim("page")
+
+        dynamic_shapes = {
+            "tokens": {**batch, 1: chunk_dim},
+            "start_positions": batch,
+            "seq_lens": batch,
+            "seq_block_ids": {**batch, 1: block_dim},
+            "cache_state": len(cache_state) * [{0: page_dim}],
+        }
+
+        print(f"Exporting prefill_chunk_{suffix}")
+
+        @fxb.export_program(
+            name=f"prefill_chunk_{suffix}",
+            args=(tokens, start_positions, seq_lens, seq_block_ids, cache_state),
+            dynamic_shapes=dynamic_shapes,
+        )
+        def _(model, tokens, start_positions, seq_lens, seq_block_ids, cache_state):
+            attention_mask = chunked_attention_mask(
+                model, tokens, start_positions, seq_lens, seq_block_ids
+            )
+            logits = model.prefill_chunk(
+                tokens,
+                attention_mask=attention_mask,
+                start_positions=start_positions,
+                seq_lens=seq_lens,
+                seq_block_ids=seq_block_ids,
+                cache_state=cache_state,
+            )
+            return logits
+
+    def generate_batch_verify(bs: Optional[int]):
+        bs, batch, suffix = batch_spec(bs)
+        # Each row holds its last accepted token followed by the speculated ones.
+        verify_len = args.speculate_k + 1
+        tokens = torch.empty(bs, verify_len, dtype=torch.int64)
+        start_positions = torch.zeros(bs, dtype=torch.int64)
+        seq_lens = torch.empty(bs, dtype=torch.int64)
+        seq_block_ids = torch.empty(bs, 8, dtype=torch.int64)
+        block_dim = torch.export.Dim(
+            "block", max=(hp.context_length - 1) // llama_config.block_seq_stride
+        )
+        cache_state = allocate_paged_cache_state()
+        page_dim = torch.export.Dim("page")
+
+        dynamic_shapes = {
+            "tokens": batch,
+            "start_positions": batch,
+            "seq_lens": batch,
+            "seq_block_ids": {**batch, 1: block_dim},
+            "cache_state": len(cache_state) * [{0: page_dim}],
+        }
+
+        print(f"Exporting verify_{suffix}")
+
+        @fxb.export_program(
+            name=f"verify_{suffix}",
+            args=(tokens, start_positions, seq_lens, seq_block_ids, cache_state),
+            dynamic_shapes=dynamic_shapes,
+        )
+        def _(model, tokens, start_positions, seq_lens, seq_block_ids, cache_state):
+            attention_mask = chunked_attention_mask(
+                model, tokens, start_positions, seq_lens, seq_block_ids
+            )
+            logits = model.prefill_chunk(
+                tokens,
+                attention_mask=attention_mask,
+                start_positions=start_positions,
+                seq_lens=seq_lens,
+                seq_block_ids=seq_block_ids,
+                cache_state=cache_state,
+            )
+            # Only the greedy next token after each position is read back.
+            return torch.argmax(logits, dim=-1)
+
+    def generate_batch_sample(bs: Optional[int]):
+        bs, batch, suffix = batch_spec(bs)
+        vocab_size = dataset.root_theta.tensor("output", "weight").shape[0]
+        logits = torch.empty(bs, 1, vocab_size, dtype=llama_config.activation_dtype)
+        temperature = torch.zeros(bs, dtype=torch.float32)
+        top_k = torch.zeros(bs, dtype=torch.int64)
+        top_p = torch.ones(bs, dtype=torch.float32)
+        uniform = torch.zeros(bs, dtype=torch.float32)
+
+        dynamic_shapes = {
+            "logits": batch,
+            "temperature": batch,
+            "top_k": batch,
+            "top_p": batch,
+            "uniform": batch,
+        }
+
+        print(f"Exporting sample_{suffix}")
+
+        @fxb.export_program(
+            name=f"sample_{suffix}",
+            args=(logits, temperature, top_k, top_p, uniform),
+            dynamic_shapes=dynamic_shapes,
+        )
+        def _(model, logits, temperature, top_k, top_p, uniform):
+            return model.sample_tokens(
+                logits[:, 0, :],
+                temperature=temperature,
+                top_k=top_k,
+                top_p=top_p,
+                uniform=uniform,
+            )
+
+    if args.chunked_prefill and model.config.kv_cache_type != "paged":
+        raise ValueError("--chunked-prefill requires a paged KV cache")
+    if args.speculate_k > 0 and model.config.kv_cache_type != "paged":
+        raise ValueError("--speculate-k requires a paged KV cache")
+
+    if not args.bs and args.dynamic_batch_size == 0:
+        raise ValueError("No batch sizes to export")
+
+    def generate_batch(bs: Optional[int]):
         generate_batch_prefill(bs)
         generate_batch_decode(bs)
+        if args.chunked_prefill:
+            generate_batch_prefill_chunk(bs)
+        if args.sampling:
+            generate_batch_sample(bs)
+        if args.speculate_k > 0:
+            generate_batch_verify(bs)
+
+    bsizes = []
+    for bs in args.bs:
+        generate_batch(bs)
         bsizes.append(bs)
-    config = generate_params_json(hp, bsizes, bsizes)
+    # A single set of entry-points with a dynamic batch dimension serves all
+    # other batch sizes.
+    if args.dynamic_batch_size > 0:
+        generate_batch(None)
+    chunk_bsizes = bsizes if args.chunked_prefill else []
+    config = generate_params_json(hp, bsizes, bsizes, chunk_bsizes)
     print("GENERATED!")
 
     if args.verbose:
@@ -204,7 +491,7 @@ def main():
             print(f"EXPORT {name}:\n{ep}")
 
     print("Exporting")
-    output = export(fxb)
+    output = export(fxb, module_name=args.module_name)
     print(f"Saving to '{args.output_mlir}'")
     output.save_mlir(args.output_mlir)
     json.dump(config, open(args.output_config, "w"))
@@ -0,0 +1,31 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Fuses the projections of an LLM dataset which share their input.
+
+The Q/K/V and FFN gate/up weights of each llama attention block are
+concatenated, so that the model computes each group with one matmul.
+"""
+
+from ..transforms.dataset import FuseProjectionsTransform
+from ..types import *
+
+
+def main(raw_args=None):
+    from ..utils import cli
+
+    parser = cli.create_parser()
+    cli.add_input_dataset_options(parser)
+    cli.add_output_dataset_options(parser)
+    args = cli.parse(parser, args=raw_args)
+    dataset = cli.get_input_dataset(args)
+
+    dataset.root_theta = FuseProjectionsTransform()(dataset.root_theta)
+    dataset.save(args.output_irpa_file, io_report_callback=print)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,33 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Converts an LLM dataset (typically GGUF) to IRPA with pre-packed weights.
+
+Quantized weights are unpacked once into the planar layouts that the kernels
+consume, so that loading the IRPA file and running the kernels does no
+unpacking at runtime. Q4_K planes stay bit packed, as its kernel consumes
+them, and are only unpacked on access by the generic dequantizing fallback.
+"""
+
+from ..transforms.dataset import PackQuantizedTransform
+from ..types import *
+
+
+def main(raw_args=None):
+    from ..utils import cli
+
+    parser = cli.create_parser()
+    cli.add_input_dataset_options(parser)
+    cli.add_output_dataset_options(parser)
+    args = cli.parse(parser, args=raw_args)
+    dataset = cli.get_input_dataset(args)
+
+    dataset.transform(PackQuantizedTransform())
+    dataset.save(args.output_irpa_file, io_report_callback=print)
+
+
+if __name__ == "__main__":
+    main()
@@ -8,11 +8,13 @@
 
 from typing import Optional
 
+import contextlib
 import math
 import sys
 
 import torch
 
+from .. import ops
 from ..layers import *
 from ..types import *
 
@@ -32,6 +34,10 @@ class TorchGenerator:
         page_cache_size: int = 128,
         # Need to look at the model more for this.
         end_token: int = 2,
+        temperature: float = 0.0,
+        top_k: int = 0,
+        top_p: float = 1.0,
+        seed: Optional[int] = None,
     ):
         self.model = model
         self.tokenizer = tokenizer
@@ -41,6 +47,13 @@ class TorchGenerator:
             self.shared_cache_state = None
         self.free_pages = list(range(1, 128))
         self.end_token = end_token
+        # Sampling parameters applied to every row (temperature 0 is greedy).
+        self.temperature = temperature
+        self.top_k = top_k
+        self.top_p = top_p
+        self.rng = torch.Generator()
+        if seed is not None:
+            self.rng.manual_seed(seed)
 
     @property
     def block_seq_stride(self) -> int:
@@ -100,6 +113,23 @@ class Batch:
                 row.append(self.parent.alloc_page())
             self.seq_block_ids.append(row)
 
+    def sample_tokens(self, logits: torch.Tensor) -> torch.Tensor:
+        """Samples [bs, 1] next tokens on device from [bs, 1, vocab] logits."""
+        parent = self.parent
+        device = parent.model.device
+        bs = logits.shape[0]
+
+        def row_param(value, dtype):
+            return torch.full([bs], value, dtype=dtype, device=device)
+
+        return parent.model.sample_tokens(
+            logits[:, 0, :],
+            temperature=row_param(parent.temperature, torch.float32),
+            top_k=row_param(parent.top_k, torch.int64),
+            top_p=row_param(parent.top_p, torch.float32),
+            uniform=torch.rand([bs], generator=parent.rng).to(device=device),
+        )
+
     @property
     def done(self) -> bool:
         return len(self.done_result_indices) == self.bs
@@ -151,15 +181,13 @@ class Batch:
             cache_state=self.cache_state,
         )
 
-        # TODO: Generalize the sampling and don't make it swap on/off cpu.
-        # TODO: Normalize the output of extract_tokens_from_logits into
-        # tensor [bs, 1].
-        tokens = torch.tensor(
-            model.extract_tokens_from_logits(logits, self.seq_lens)
-        ).unsqueeze(1)
+        # Only the sampled tokens leave the device.
+        tokens = self.sample_tokens(
+            model.last_position_logits(logits, self.seq_lens)
+        )
         print(f":: Prefill results:\n{tokens.tolist()}")
         self.add_result_token(tokens)
-        self.next_tokens = tokens.to(device=model.device)
+        self.next_tokens = tokens
 
     def decode(self):
         model = self.parent.model
@@ -186,12 +214,7 @@ class Batch:
             cache_state=self.cache_state,
         )
         trace_tensor("decode.logits", logits)
-        # TODO: Normalize the output of extract_tokens_from_logits into
-        # tensor [bs, 1].
-        tokens = torch.tensor(
-            model.extract_tokens_from_logits(logits, [1] * self.bs),
-            device=self.parent.model.device,
-        ).unsqueeze(1)
+        tokens = self.sample_tokens(logits)
         self.add_result_token(tokens)
         self.next_tokens = tokens
 
@@ -213,6 +236,38 @@ def main():
         help="DType to use for activations in the model",
         default="float32",
     )
+    parser.add_argument(
+        "--temperature",
+        help="Sampling temperature (0 for greedy decoding)",
+        type=float,
+        default=0.0,
+    )
+    parser.add_argument(
+        "--top-k", help="Sample from the k most likely tokens", type=int, default=0
+    )
+    parser.add_argument(
+        "--top-p",
+        help="Sample from the most likely tokens of this probability mass",
+        type=float,
+        default=1.0,
+    )
+    parser.add_argument("--seed", help="Sampling random seed", type=int)
+    parser.add_argument(
+        "--paged-attention-kernel",
+        help="Decode with the fused paged attention kernel (paged cache only)",
+        action="store_true",
+    )
+    parser.add_argument(
+        "--freeze-dispatch",
+        help="Resolve op dispatch once per call site and argument types, shapes and "
+        "layouts (see ops.freeze_dispatch)",
+        action="store_true",
+    )
+    parser.add_argument(
+        "--profile-dispatch",
+        help="Print a profile of op dispatch after generating",
+        action="store_true",
+    )
     cli.add_input_dataset_options(parser)
     cli.add_tokenizer_options(parser)
     args = cli.parse(parser)
@@ -231,23 +286,42 @@ def main():
         device=device,
         activation_dtype=activation_dtype,
         attention_dtype=activation_dtype,
+        use_paged_attention_kernel=args.paged_attention_kernel,
     )
     model = PagedLlamaModelV1(dataset.root_theta, config)
-    generator = TorchGenerator(model, tokenizer)
+    generator = TorchGenerator(
+        model,
+        tokenizer,
+        temperature=args.temperature,
+        top_k=args.top_k,
+        top_p=args.top_p,
+        seed=args.seed,
+    )
 
     print(f":: Prompting:")
     for prompt in prompts:
         print(f"    {prompt.encode()}")
 
-    batch = generator.begin_batch(prompts)
-    print(f":: Prompt tokens: {batch.token_ids}")
-    batch.prefill()
-    print(batch.detokenize())
-
-    while not batch.done:
-        batch.decode()
-        print(f":: Result tokens: {batch.results}")
-        batch.print_current_results()
+    with contextlib.ExitStack() as stack:
+        if args.freeze_dispatch:
+            stack.enter_context(ops.freeze_dispatch())
+        profile = None
+        if args.profile_dispatch:
+            profile = stack.enter_context(ops.profile_dispatch())
+
+        batch = generator.begin_batch(prompts)
+        print(f":: Prompt tokens: {batch.token_ids}")
+        batch.prefill()
+        print(batch.detokenize())
+
+        while not batch.done:
+            batch.decode()
+            print(f":: Result tokens: {batch.results}")
+            batch.print_current_results()
+
+    if profile is not None:
+        print(f":: Dispatch profile:")
+        print(profile.report())
 
 
 if __name__ == "__main__":
@@ -0,0 +1,93 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+r"""Quantizes the weights of an LLM dataset with dynamically computed scales.
+
+Each `--rule PATTERN=SCHEME` quantizes the tensors whose names match the
+regular expression with a scheme of:
+
+* `tensor`: one scale per tensor.
+* `channel`: one scale per output feature (dim 0).
+* `blockN`: one scale per N samples of the innermost dim (e.g. `block32`).
+
+The first matching rule applies. Tensors are quantized in parallel and
+streamed to the output as they are done. For example:
+
+```
+python -m sharktank.examples.quantize_llm_dataset \
+  --irpa-file llama.irpa --output-irpa-file llama_i8.irpa \
+  --rule '^blk\..*\.attn_.*\.weight$=channel' \
+  --rule '^blk\..*\.ffn_.*\.weight$=block32'
+```
+"""
+
+import os
+import re
+
+import torch
+
+from ..transforms.dataset import QuantizeTransform
+from ..types import *
+
+
+def _parse_scheme(scheme: str, dtype: torch.dtype) -> DynamicScaledQuantizer:
+    if scheme == "tensor":
+        return DynamicScaledQuantizer(dtype=dtype)
+    if scheme == "channel":
+        return DynamicScaledQuantizer(dtype=dtype, axis=0)
+    m = re.fullmatch(r"block([0-9]+)", scheme)
+    if m:
+        return DynamicScaledQuantizer(dtype=dtype, block_size=int(m.group(1)))
+    raise ValueError(f"Unknown quantization scheme '{scheme}'")
+
+
+def main(raw_args=None):
+    from ..utils import cli
+
+    parser = cli.create_parser()
+    cli.add_input_dataset_options(parser)
+    cli.add_output_dataset_options(parser)
+    parser.add_argument(
+        "--rule",
+        action="append",
+        required=True,
+        help="PATTERN=SCHEME quantization rule (can be repeated)",
+    )
+    parser.add_argument(
+        "--dtype", default="int8", help="DType of the quantized samples"
+    )
+    parser.add_argument(
+        "--device", help="Torch device to quantize on (defaults to the CPU)"
+    )
+    parser.add_argument(
+        "--max-workers",
+        type=int,
+        default=os.cpu_count() or 1,
+        help="Number of tensors to quantize in parallel",
+    )
+    args = cli.parse(parser, args=raw_args)
+    dataset = cli.get_input_dataset(args)
+
+    dtype = getattr(torch, args.dtype)
+    assert isinstance(dtype, torch.dtype)
+    rules = []
+    for rule in args.rule:
+        pattern, sep, scheme = rule.rpartition("=")
+        if not sep:
+            raise ValueError(f"Expected a PATTERN=SCHEME rule but got '{rule}'")
+        rules.append((pattern, _parse_scheme(scheme, dtype)))
+
+    tr = QuantizeTransform(rules, device=args.device)
+    dataset.save(
+        args.output_irpa_file,
+        io_report_callback=print,
+        transform=tr,
+        max_workers=args.max_workers,
+    )
+
+
+if __name__ == "__main__":
+    main()
@@ -9,7 +9,13 @@
 This is an ad-hoc transformation which operates on the layer structure of
 weights of an LLM by converting the RHS of all eligible layers to a sharded
 form.
+
+Tensors are streamed from the (memory mapped) input to the per-rank output
+archives, sharded on `--max-workers` threads, so that datasets larger than
+memory can be sharded.
 """
+import os
+
 from ...transforms.dataset import MmtRHSShardingTransform
 from ...types import *
 
@@ -23,15 +29,26 @@ def main(raw_args=None):
     parser.add_argument(
         "--num-shards", type=int, required=True, help="Number of shards to split"
     )
+    parser.add_argument(
+        "--max-workers",
+        type=int,
+        default=os.cpu_count() or 1,
+        help="Number of tensors to shard in parallel",
+    )
     args = cli.parse(parser, args=raw_args)
     dataset = cli.get_input_dataset(args)
 
     tr = MmtRHSShardingTransform(
         r"^blk\.[0-9]+\.(attn_k|attn_q|attn_v|ffn_gate|ffn_up|ffn_down)\.weight$",
-        num_shards=8,
+        num_shards=args.num_shards,
+    )
+    dataset.save(
+        args.output_irpa_file,
+        io_report_callback=print,
+        transform=tr,
+        max_workers=args.max_workers,
+        streaming=True,
     )
-    dataset.transform(tr)
-    dataset.save(args.output_irpa_file, io_report_callback=print)
 
 
 if __name__ == "__main__":
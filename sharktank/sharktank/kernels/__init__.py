@@ -11,3 +11,7 @@ from .mmt_super_block_scaled_offset_q4 import *
 from .batch_matmul_transpose_b import *
 from .conv_2d_nchw_fchw import *
 from .pooling_nchw_sum import *
+from .mmt_block_scaled_gemv import *
+from .paged_attention_decode import *
+from .flash_attention import *
+from .qconv_2d import *
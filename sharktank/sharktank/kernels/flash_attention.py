@@ -0,0 +1,148 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from .base import *
+
+import math
+
+import torch
+
+__all__ = [
+    "FLASH_ATTENTION_TILE",
+    "flash_attention",
+    "flash_attention_causal",
+]
+
+# Number of key positions processed per step of the online softmax.
+FLASH_ATTENTION_TILE = 64
+
+
+def _select_flash_attention(ksel: KernelSelection, op_name: str, causal: bool):
+    q_desc = ksel.arg_tensor(0)  # Shape [bs, head_count, sl, head_dim]
+    k_desc = ksel.arg_tensor(1)  # Shape [bs, head_count_kv, kv_sl, head_dim]
+    v_desc = ksel.arg_tensor(2)  # Shape [bs, head_count_kv, kv_sl, head_dim]
+
+    # q arg
+    torch._check(
+        len(q_desc.t.shape) == 4 and q_desc.t.dtype.is_floating_point,
+        lambda: f"{op_name} arg 'q': Expected 4d floating point tensor (got {q_desc.t.shape} {q_desc.t.dtype})",
+    )
+    q_bs, head_count, _, head_dim = q_desc.t.shape
+
+    # k, v args
+    for name, desc in [("k", k_desc), ("v", v_desc)]:
+        torch._check(
+            len(desc.t.shape) == 4 and desc.t.dtype == q_desc.t.dtype,
+            lambda: f"{op_name} arg '{name}': Expected 4d tensor of {q_desc.t.dtype} (got {desc.t.shape} {desc.t.dtype})",
+        )
+    kv_bs, head_count_kv, _, kv_head_dim = k_desc.t.shape
+    torch._check(
+        kv_bs == q_bs and kv_head_dim == head_dim and head_count % head_count_kv == 0,
+        lambda: f"{op_name} arg 'k': Incorrect shape (got {k_desc.t.shape} for q {q_desc.t.shape})",
+    )
+    torch._check(
+        list(v_desc.t.shape) == list(k_desc.t.shape),
+        lambda: f"{op_name}: K/V shapes must match ({k_desc.t.shape} vs {v_desc.t.shape})",
+    )
+
+    # start_positions, seq_lens args
+    if causal:
+        for i, name in [(3, "start_positions"), (4, "seq_lens")]:
+            desc = ksel.arg_tensor(i)
+            torch._check(
+                len(desc.t.shape) == 1
+                and desc.t.shape[0] == q_bs
+                and desc.t.dtype == torch.int64,
+                lambda: f"{op_name} arg '{name}': Expected [bs] int64 (got {desc.t.shape} {desc.t.dtype})",
+            )
+
+    # Specialize on head counts and head dim.
+    q_desc.specialize_dims(1, 3)
+    k_desc.specialize_dims(1, 3)
+    v_desc.specialize_dims(1, 3)
+
+    # Shape bs, head_count, sl, head_dim
+    result_desc = ksel.return_new_tensor(list(q_desc.t.shape), dtype=q_desc.t.dtype)
+    result_desc.specialize_dims(1, 3)
+
+
+def _generate_flash_attention(kb: KernelBuilder, causal: bool):
+    q = kb.arg_value(0)
+    q_tensor_type = RankedTensorType(q.type)
+    k = kb.arg_value(1)
+    k_tensor_type = RankedTensorType(k.type)
+
+    _, head_count, _, head_dim = q_tensor_type.shape
+    _, head_count_kv, _, _ = k_tensor_type.shape
+    dtype_str = str(q_tensor_type.element_type)
+
+    op_name = "flash_attention_causal" if causal else "flash_attention"
+    target_function_name = (
+        f"sharktank_{op_name}_{head_count}_{head_count_kv}_{head_dim}_{dtype_str}"
+    )
+    target_function = inline_template_function(
+        kb,
+        "flash_attention.mlir",
+        target_function_name,
+        kernel_name=target_function_name,
+        causal=causal,
+        head_count=head_count,
+        head_count_kv=head_count_kv,
+        rep=head_count // head_count_kv,
+        head_dim=head_dim,
+        tile=FLASH_ATTENTION_TILE,
+        scale=repr(1.0 / math.sqrt(head_dim)),
+        dtype=dtype_str,
+    )
+    kb.yield_results(*call_function(target_function, *kb.arg_bindings))
+
+
+@CustomOp.register(library=LIBRARY)
+class flash_attention(CustomOp):
+    """Attention with a tiled, online softmax (flash attention).
+
+    Keys and values are processed in tiles of FLASH_ATTENTION_TILE positions,
+    keeping a running max, sum of exponentials and rescaled output per query,
+    so the `[bs, heads, sl, kv_sl]` score tensor is never materialized and
+    memory is linear in the sequence lengths. Query heads are grouped by the
+    kv head they share, so GQA does not expand K/V.
+
+    * `q`: `[bs, head_count, sl, head_dim]`
+    * `k`, `v`: `[bs, head_count_kv, kv_sl, head_dim]`
+
+    Returns `[bs, head_count, sl, head_dim]`, with scores scaled by
+    `1 / sqrt(head_dim)` and accumulated in f32. The kernel will be
+    specialized for the head counts, head dim and dtype.
+    """
+
+    signature = "flash_attention(Tensor q, Tensor k, Tensor v) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_flash_attention(ksel, "flash_attention", causal=False)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_flash_attention(kb, causal=False)
+
+
+@CustomOp.register(library=LIBRARY)
+class flash_attention_causal(CustomOp):
+    """flash_attention with causal and length masking computed in the kernel.
+
+    * `start_positions`: `[bs]` position of the first query of each row, which
+      attends to `k`/`v` positions up to and including its own.
+    * `seq_lens`: `[bs]` number of valid `k`/`v` positions of each row.
+
+    Other arguments are as for flash_attention. Queries with no valid position
+    produce zeros.
+    """
+
+    signature = "flash_attention_causal(Tensor q, Tensor k, Tensor v, Tensor start_positions, Tensor seq_lens) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_flash_attention(ksel, "flash_attention_causal", causal=True)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_flash_attention(kb, causal=True)
@@ -0,0 +1,203 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from .base import *
+
+import torch
+
+__all__ = [
+    "GEMV_MAX_M",
+    "mmt_block_scaled_offset_q4_unsigned_gemv",
+    "mmt_block_scaled_offset_q8_gemv",
+    "mmt_block_scaled_q8_gemv",
+]
+
+# Largest number of LHS rows (M) that the GEMV kernels are specialized for.
+GEMV_MAX_M = 8
+
+
+def _select_gemv(ksel: KernelSelection, op_name: str, has_m: bool, packed_i4: bool):
+    a_desc = ksel.arg_tensor(0)  # Shape [b, m, k]
+    d_desc = ksel.arg_tensor(1)  # Shape [N, K // BLOCK_SIZE, 1]
+    # Shape [N, K // BLOCK_SIZE, BLOCK_SIZE (// 2 if packed_i4)]
+    qs_desc = ksel.arg_tensor(2)
+
+    # a arg
+    *batch_dims, a_m, a_k = a_desc.t.shape
+    torch._check(
+        a_desc.t.dtype.is_floating_point,
+        lambda: f"{op_name} arg 'a': Expected floating point (got {a_desc.t.dtype})",
+    )
+    torch._check(
+        len(batch_dims) == 1,
+        lambda: f"{op_name} arg 'a': Expected 3d tensor (got {a_desc.t.shape})",
+    )
+    torch._check(
+        a_m <= GEMV_MAX_M,
+        lambda: f"{op_name} arg 'a': Expected at most {GEMV_MAX_M} rows (got {a_m})",
+    )
+
+    # qs arg
+    qs_n, qs_group0, qs_bs, *rest = qs_desc.t.shape
+    block_size = qs_bs * 2 if packed_i4 else qs_bs
+    torch._check(
+        len(rest) == 0 and (qs_group0 * block_size) == a_k,
+        lambda: f"{op_name} arg 'qs': Incorrect shape (got {qs_desc.t.shape})",
+    )
+
+    # d and m args
+    scale_descs = [("d", d_desc)]
+    if has_m:
+        scale_descs.append(("m", ksel.arg_tensor(3)))
+    for name, desc in scale_descs:
+        n, group0, one, *rest = desc.t.shape
+        torch._check(
+            len(rest) == 0 and (group0 * block_size) == a_k and one == 1 and n == qs_n,
+            lambda: f"{op_name} arg '{name}': Incorrect shape (got {desc.t.shape})",
+        )
+        torch._check(
+            desc.t.dtype == d_desc.t.dtype,
+            lambda: f"{op_name} arg '{name}': Incorrect dtype (got {desc.t.dtype})",
+        )
+
+    # Specialize on M, K, N, BS
+    a_desc.specialize_dims(-1, -2)
+    for _, desc in scale_descs:
+        desc.specialize_all_dims()
+    qs_desc.specialize_all_dims()
+
+    # Shape batch, m, n
+    c_desc = ksel.return_new_tensor(batch_dims + [a_m, qs_n], dtype=a_desc.t.dtype)
+    c_desc.specialize_dims(-1, -2)
+
+
+def _generate_gemv(
+    kb: KernelBuilder, op_name: str, has_m: bool, packed_i4: bool, signed: bool
+):
+    a = kb.arg_value(0)
+    a_tensor_type = RankedTensorType(a.type)
+    d = kb.arg_value(1)
+    d_tensor_type = RankedTensorType(d.type)
+    qs = kb.arg_value(2)
+    qs_tensor_type = RankedTensorType(qs.type)
+
+    _, m, k = a_tensor_type.shape
+    n, group0, bs_i8 = qs_tensor_type.shape
+    bs = bs_i8 * 2 if packed_i4 else bs_i8
+    a_type_str = str(a_tensor_type.element_type)
+    scale_type_str = str(d_tensor_type.element_type)
+
+    target_function_name = (
+        f"sharktank_{op_name}_{m}_{n}_{k}_{bs}_{a_type_str}_{scale_type_str}"
+    )
+    target_function = inline_template_function(
+        kb,
+        "mmt_block_scaled_gemv.mlir",
+        target_function_name,
+        kernel_name=target_function_name,
+        m=m,
+        n=n,
+        k=k,
+        bs=bs,
+        bs_i8=bs_i8,
+        group0=group0,
+        lowp_type="i4" if packed_i4 else "i8",
+        signed=signed,
+        has_m=has_m,
+        a_type=a_type_str,
+        scale_type=scale_type_str,
+    )
+    kb.yield_results(*call_function(target_function, *kb.arg_bindings))
+
+
+@CustomOp.register(library=LIBRARY)
+class mmt_block_scaled_q8_gemv(CustomOp):
+    """mmt_block_scaled_q8 specialized for few LHS rows, as in decode.
+
+    * `a`: `[B, M, K]` with a static M of at most GEMV_MAX_M
+    * `d`: `[N, K // BLOCK_SIZE, 1]`
+    * `qs`: `[N, K // BLOCK_SIZE, BLOCK_SIZE]` (of int8)
+
+    Weights are dequantized inside the reduction rather than materialized.
+    The kernel will be specialized for all values of M, N, K and LHS dtype.
+    """
+
+    signature = "mmt_block_scaled_q8_gemv(Tensor a, Tensor d, Tensor qs) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_gemv(ksel, "mmt_block_scaled_q8_gemv", has_m=False, packed_i4=False)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_gemv(
+            kb, "mmt_block_scaled_q8_gemv", has_m=False, packed_i4=False, signed=True
+        )
+
+
+@CustomOp.register(library=LIBRARY)
+class mmt_block_scaled_offset_q8_gemv(CustomOp):
+    """mmt_block_scaled_q8_gemv with a pre-scaled offset `m` per block.
+
+    * `m`: `[N, K // BLOCK_SIZE, 1]` of the dtype of `d`
+
+    Other arguments are as for mmt_block_scaled_q8_gemv.
+    """
+
+    signature = (
+        "mmt_block_scaled_offset_q8_gemv("
+        "Tensor a, Tensor d, Tensor qs, Tensor m"
+        ") -> (Tensor)"
+    )
+
+    def select(self, ksel: KernelSelection):
+        _select_gemv(
+            ksel, "mmt_block_scaled_offset_q8_gemv", has_m=True, packed_i4=False
+        )
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_gemv(
+            kb,
+            "mmt_block_scaled_offset_q8_gemv",
+            has_m=True,
+            packed_i4=False,
+            signed=True,
+        )
+
+
+@CustomOp.register(library=LIBRARY)
+class mmt_block_scaled_offset_q4_unsigned_gemv(CustomOp):
+    """mmt_block_scaled_offset_q4_unsigned specialized for few LHS rows.
+
+    * `a`: `[B, M, K]` with a static M of at most GEMV_MAX_M
+    * `d`: `[N, K // BLOCK_SIZE, 1]`
+    * `qs`: `[N, K // BLOCK_SIZE, BLOCK_SIZE // 2]` (of uint8)
+    * `m`: `[N, K // BLOCK_SIZE, 1]`
+
+    Weights are dequantized inside the reduction rather than materialized.
+    The kernel will be specialized for all values of M, N, K and LHS dtype.
+    """
+
+    signature = (
+        "mmt_block_scaled_offset_q4_unsigned_gemv("
+        "Tensor a, Tensor d, Tensor qs, Tensor m"
+        ") -> (Tensor)"
+    )
+
+    def select(self, ksel: KernelSelection):
+        _select_gemv(
+            ksel,
+            "mmt_block_scaled_offset_q4_unsigned_gemv",
+            has_m=True,
+            packed_i4=True,
+        )
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_gemv(
+            kb,
+            "mmt_block_scaled_offset_q4_unsigned_gemv",
+            has_m=True,
+            packed_i4=True,
+            signed=False,
+        )
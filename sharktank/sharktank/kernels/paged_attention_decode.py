@@ -0,0 +1,194 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from .base import *
+
+import math
+
+import torch
+
+__all__ = [
+    "paged_attention_decode",
+    "paged_attention_decode_scaled",
+]
+
+
+def _select_paged_attention_decode(
+    ksel: KernelSelection, op_name: str, scaled: bool
+):
+    q_desc = ksel.arg_tensor(0)  # Shape [bs, head_count, head_dim]
+    table_desc = ksel.arg_tensor(1)  # Shape [S, stride, head_count_kv, head_dim]
+    arg_index = 2
+    if scaled:
+        scales_desc = ksel.arg_tensor(arg_index)  # Shape [S, head_count_kv]
+        arg_index += 1
+    k_ids_desc = ksel.arg_tensor(arg_index)  # Shape [bs, block_count]
+    v_ids_desc = ksel.arg_tensor(arg_index + 1)  # Shape [bs, block_count]
+    seq_lens_desc = ksel.arg_tensor(arg_index + 2)  # Shape [bs]
+
+    # q arg
+    torch._check(
+        len(q_desc.t.shape) == 3,
+        lambda: f"{op_name} arg 'q': Expected 3d tensor (got {q_desc.t.shape})",
+    )
+    q_bs, head_count, head_dim = q_desc.t.shape
+
+    # page_table arg
+    torch._check(
+        len(table_desc.t.shape) == 4,
+        lambda: f"{op_name} arg 'page_table': Expected 4d tensor (got {table_desc.t.shape})",
+    )
+    _, stride, head_count_kv, table_head_dim = table_desc.t.shape
+    torch._check(
+        table_head_dim == head_dim and head_count % head_count_kv == 0,
+        lambda: f"{op_name} arg 'page_table': Incorrect shape (got {table_desc.t.shape} for q {q_desc.t.shape})",
+    )
+    if scaled:
+        torch._check(
+            table_desc.t.dtype.is_floating_point or table_desc.t.dtype.is_signed,
+            lambda: f"{op_name} arg 'page_table': Expected fp or signed dtype (got {table_desc.t.dtype})",
+        )
+        torch._check(
+            len(scales_desc.t.shape) == 2
+            and scales_desc.t.shape[1] == head_count_kv
+            and scales_desc.t.dtype == torch.float32,
+            lambda: f"{op_name} arg 'page_scales': Expected [subblock_count, {head_count_kv}] float32 (got {scales_desc.t.shape} {scales_desc.t.dtype})",
+        )
+    else:
+        torch._check(
+            table_desc.t.dtype == q_desc.t.dtype,
+            lambda: f"{op_name} arg 'page_table': Expected dtype {q_desc.t.dtype} (got {table_desc.t.dtype})",
+        )
+
+    # k_page_ids, v_page_ids args
+    for name, ids_desc in [
+        ("k_page_ids", k_ids_desc),
+        ("v_page_ids", v_ids_desc),
+    ]:
+        torch._check(
+            len(ids_desc.t.shape) == 2
+            and ids_desc.t.shape[0] == q_bs
+            and ids_desc.t.dtype == torch.int64,
+            lambda: f"{op_name} arg '{name}': Expected [bs, block_count] int64 (got {ids_desc.t.shape} {ids_desc.t.dtype})",
+        )
+    torch._check(
+        k_ids_desc.t.shape[1] == v_ids_desc.t.shape[1],
+        lambda: f"{op_name}: K/V page id shapes must match ({k_ids_desc.t.shape} vs {v_ids_desc.t.shape})",
+    )
+
+    # seq_lens arg
+    torch._check(
+        len(seq_lens_desc.t.shape) == 1
+        and seq_lens_desc.t.shape[0] == q_bs
+        and seq_lens_desc.t.dtype == torch.int64,
+        lambda: f"{op_name} arg 'seq_lens': Expected [bs] int64 (got {seq_lens_desc.t.shape} {seq_lens_desc.t.dtype})",
+    )
+
+    # Specialize on head counts, head dim and stride.
+    q_desc.specialize_dims(-1, -2)
+    table_desc.specialize_dims(-1, -2, -3)
+    if scaled:
+        scales_desc.specialize_dims(-1)
+
+    # Shape bs, head_count, head_dim
+    result_desc = ksel.return_new_tensor(
+        [q_bs, head_count, head_dim], dtype=q_desc.t.dtype
+    )
+    result_desc.specialize_dims(-1, -2)
+
+
+def _generate_paged_attention_decode(kb: KernelBuilder, scaled: bool):
+    q = kb.arg_value(0)
+    q_tensor_type = RankedTensorType(q.type)
+    table = kb.arg_value(1)
+    table_tensor_type = RankedTensorType(table.type)
+
+    _, head_count, head_dim = q_tensor_type.shape
+    _, stride, head_count_kv, _ = table_tensor_type.shape
+    dtype_str = str(q_tensor_type.element_type)
+    table_dtype_str = str(table_tensor_type.element_type)
+
+    template_file = "paged_attention_decode.mlir"
+    if scaled:
+        target_function_name = (
+            f"sharktank_paged_attention_decode_scaled_{head_count}_{head_count_kv}"
+            f"_{head_dim}_{stride}_{table_dtype_str}_{dtype_str}"
+        )
+    else:
+        target_function_name = (
+            f"sharktank_paged_attention_decode_{head_count}_{head_count_kv}"
+            f"_{head_dim}_{stride}_{dtype_str}"
+        )
+
+    target_function = inline_template_function(
+        kb,
+        template_file,
+        target_function_name,
+        scaled=scaled,
+        head_count=head_count,
+        head_count_kv=head_count_kv,
+        rep=head_count // head_count_kv,
+        head_dim=head_dim,
+        stride=stride,
+        scale=repr(1.0 / math.sqrt(head_dim)),
+        dtype=dtype_str,
+        table_dtype=table_dtype_str,
+    )
+    kb.yield_results(*call_function(target_function, *kb.arg_bindings))
+
+
+@CustomOp.register(library=LIBRARY)
+class paged_attention_decode(CustomOp):
+    """Single position attention which reads K/V pages in place.
+
+    This is flash-decoding over a paged cache: K/V rows are gathered directly
+    from the page table by page id (never materialized linearly), partial
+    softmax statistics and outputs are computed per page and then combined by
+    rescaling against the global max. Query heads are grouped by the kv head
+    they share, so GQA does not expand K/V.
+
+    * `q`: `[bs, head_count, head_dim]`
+    * `page_table`: `[subblock_count, block_seq_stride, head_count_kv, head_dim]`
+    * `k_page_ids`, `v_page_ids`: `[bs, block_count]` of subblock indices into
+      `page_table` holding the K and V rows of each sequence, in order.
+    * `seq_lens`: `[bs]` number of valid positions of each sequence.
+
+    Returns `[bs, head_count, head_dim]`. The kernel will be specialized for
+    the head counts, head dim, block stride and dtype.
+    """
+
+    signature = "paged_attention_decode(Tensor q, Tensor page_table, Tensor k_page_ids, Tensor v_page_ids, Tensor seq_lens) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_paged_attention_decode(ksel, "paged_attention_decode", scaled=False)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_paged_attention_decode(kb, scaled=False)
+
+
+@CustomOp.register(library=LIBRARY)
+class paged_attention_decode_scaled(CustomOp):
+    """paged_attention_decode over quantized (int8 or fp8) pages.
+
+    * `page_table`: `[subblock_count, block_seq_stride, head_count_kv, head_dim]`
+      of quantized values.
+    * `page_scales`: `[subblock_count, head_count_kv]` float32 dequantization
+      scale of each subblock and kv head.
+
+    Other arguments are as for paged_attention_decode. Since a scale is
+    constant over a page, it is applied to the per-page scores and partial
+    outputs rather than to every K/V element.
+    """
+
+    signature = "paged_attention_decode_scaled(Tensor q, Tensor page_table, Tensor page_scales, Tensor k_page_ids, Tensor v_page_ids, Tensor seq_lens) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_paged_attention_decode(
+            ksel, "paged_attention_decode_scaled", scaled=True
+        )
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_paged_attention_decode(kb, scaled=True)
@@ -0,0 +1,233 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from .base import *
+
+import torch
+
+__all__ = [
+    "qconv_2d_nchw_fchw",
+    "qconv_2d_nhwc_hwcf",
+    "qconv_2d_norm_silu_nchw_fchw",
+    "qconv_2d_norm_silu_nhwc_hwcf",
+]
+
+# Dimension indices of (h, w, c) in inputs and (kh, kw, c, f) in weights.
+_LAYOUT_DIMS = {
+    "nchw": ((2, 3, 1), (2, 3, 1, 0)),
+    "nhwc": ((1, 2, 3), (0, 1, 2, 3)),
+}
+
+
+def _select_qconv_2d(
+    ksel: KernelSelection, op_name: str, layout: str, norm_silu: bool
+):
+    (h_dim, w_dim, c_dim), (kh_dim, kw_dim, kc_dim, f_dim) = _LAYOUT_DIMS[layout]
+    input_desc = ksel.arg_tensor(0)
+    arg = 1
+    if norm_silu:
+        norm_scale_desc = ksel.arg_tensor(1)  # Shape [n, c]
+        norm_shift_desc = ksel.arg_tensor(2)  # Shape [n, c]
+        input_scale_desc = ksel.arg_tensor(3)  # Shape [1]
+        arg = 4
+    input_zp_desc = ksel.arg_tensor(arg)  # Shape [1]
+    weights_desc = ksel.arg_tensor(arg + 1)
+    weight_zp_desc = ksel.arg_tensor(arg + 2)  # Shape [f]
+    bias_desc = ksel.arg_tensor(arg + 3)  # Shape [f]
+    rescale_desc = ksel.arg_tensor(arg + 4)  # Shape [f]
+    padding = ksel.attr_list_int(arg + 5).v
+    strides = ksel.attr_list_int(arg + 6).v
+    dilations = ksel.attr_list_int(arg + 7).v
+
+    # input arg
+    input_shape = input_desc.t.shape
+    if norm_silu:
+        torch._check(
+            len(input_shape) == 4 and input_desc.t.dtype.is_floating_point,
+            lambda: f"{op_name} arg 'input': Expected 4d floating point tensor (got {input_shape} {input_desc.t.dtype})",
+        )
+        n, c = input_shape[0], input_shape[c_dim]
+        for name, desc in [
+            ("norm_scale", norm_scale_desc),
+            ("norm_shift", norm_shift_desc),
+        ]:
+            torch._check(
+                list(desc.t.shape) == [n, c] and desc.t.dtype == torch.float32,
+                lambda: f"{op_name} arg '{name}': Expected [{n}, {c}] float32 (got {desc.t.shape} {desc.t.dtype})",
+            )
+        torch._check(
+            list(input_scale_desc.t.shape) == [1]
+            and input_scale_desc.t.dtype == torch.float32,
+            lambda: f"{op_name} arg 'input_scale': Expected [1] float32 (got {input_scale_desc.t.shape} {input_scale_desc.t.dtype})",
+        )
+    else:
+        torch._check(
+            len(input_shape) == 4 and input_desc.t.dtype == torch.int8,
+            lambda: f"{op_name} arg 'input': Expected 4d int8 tensor (got {input_shape} {input_desc.t.dtype})",
+        )
+    torch._check(
+        list(input_zp_desc.t.shape) == [1] and input_zp_desc.t.dtype == torch.int32,
+        lambda: f"{op_name} arg 'input_zp': Expected [1] int32 (got {input_zp_desc.t.shape} {input_zp_desc.t.dtype})",
+    )
+
+    # weights args
+    weights_shape = weights_desc.t.shape
+    torch._check(
+        len(weights_shape) == 4
+        and weights_desc.t.dtype == torch.int8
+        and weights_shape[kc_dim] == input_shape[c_dim],
+        lambda: f"{op_name} arg 'weights': Expected 4d int8 tensor of {input_shape[c_dim]} input channels (got {weights_shape} {weights_desc.t.dtype})",
+    )
+    f = weights_shape[f_dim]
+    for name, desc in [("weight_zp", weight_zp_desc), ("bias", bias_desc)]:
+        torch._check(
+            list(desc.t.shape) == [f] and desc.t.dtype == torch.int32,
+            lambda: f"{op_name} arg '{name}': Expected [{f}] int32 (got {desc.t.shape} {desc.t.dtype})",
+        )
+    torch._check(
+        list(rescale_desc.t.shape) == [f] and rescale_desc.t.dtype.is_floating_point,
+        lambda: f"{op_name} arg 'rescale': Expected [{f}] floating point tensor (got {rescale_desc.t.shape} {rescale_desc.t.dtype})",
+    )
+    for name, v in [
+        ("padding", padding),
+        ("strides", strides),
+        ("dilations", dilations),
+    ]:
+        torch._check(
+            len(v) == 2,
+            lambda: f"{op_name} requires exactly 2 {name}; {name}: {v}",
+        )
+
+    # convolution shape math
+    kh, kw = weights_shape[kh_dim], weights_shape[kw_dim]
+    h_pad = input_shape[h_dim] + 2 * padding[0]
+    w_pad = input_shape[w_dim] + 2 * padding[1]
+    h_out = (h_pad - dilations[0] * (kh - 1) - 1) // strides[0] + 1
+    w_out = (w_pad - dilations[1] * (kw - 1) - 1) // strides[1] + 1
+    if layout == "nchw":
+        result_shape = [input_shape[0], f, h_out, w_out]
+    else:
+        result_shape = [input_shape[0], h_out, w_out, f]
+    ksel.return_new_tensor(result_shape, dtype=rescale_desc.t.dtype)
+
+
+def _generate_qconv_2d(
+    ksel: KernelSelection, kb: KernelBuilder, op_name: str, layout: str, norm_silu: bool
+):
+    input = kb.arg_value(0)
+    input_tensor_type = RankedTensorType(input.type)
+    attrs_start = 9 if norm_silu else 6
+    padding = ksel.arg_descs[attrs_start].v
+    strides = ksel.arg_descs[attrs_start + 1].v
+    dilations = ksel.arg_descs[attrs_start + 2].v
+    input_dtype_str = str(input_tensor_type.element_type)
+    rescale = kb.arg_value(attrs_start - 1)
+    out_dtype_str = str(RankedTensorType(rescale.type).element_type)
+
+    spec = "_".join(str(i) for i in (*padding, *strides, *dilations))
+    target_function_name = (
+        f"sharktank_{op_name}_{spec}_{input_dtype_str}_{out_dtype_str}"
+    )
+    target_function = inline_template_function(
+        kb,
+        "qconv_2d.mlir",
+        target_function_name,
+        kernel_name=target_function_name,
+        layout=layout,
+        norm_silu=norm_silu,
+        padding_H=padding[0],
+        padding_W=padding[1],
+        strides_H=strides[0],
+        strides_W=strides[1],
+        dilations_H=dilations[0],
+        dilations_W=dilations[1],
+        input_dtype=input_dtype_str,
+        out_dtype=out_dtype_str,
+    )
+    kb.yield_results(*call_function(target_function, *kb.arg_bindings))
+
+
+@CustomOp.register(library=LIBRARY)
+class qconv_2d_nchw_fchw(CustomOp):
+    """int8 convolution with zero points, bias and dequantization fused.
+
+    * `input`: `[n, c, h, w]` int8 quantized inputs, which are padded in the
+      kernel with the input zero point.
+    * `input_zp`: `[1]` int32 zero point of the input.
+    * `weights`: `[f, c, kh, kw]` int8 quantized weights.
+    * `weight_zp`: `[f]` int32 zero points of the weights.
+    * `bias`: `[f]` int32 bias, quantized to the output scale.
+    * `rescale`: `[f]` output scale, whose dtype is the result dtype.
+
+    Computes `rescale * (sum((input - input_zp) * (weights - weight_zp)) +
+    bias)` with an int32 accumulator, which the unfused path computes with
+    separate zero point correction reductions and a dequantizing pass. The
+    kernel will be specialized for the padding, strides, dilations and dtypes.
+    """
+
+    signature = "qconv_2d_nchw_fchw(Tensor input, Tensor input_zp, Tensor weights, Tensor weight_zp, Tensor bias, Tensor rescale, int[] padding, int[] strides, int[] dilations) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_qconv_2d(ksel, "qconv_2d_nchw_fchw", "nchw", norm_silu=False)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_qconv_2d(ksel, kb, "qconv_2d_nchw_fchw", "nchw", norm_silu=False)
+
+
+@CustomOp.register(library=LIBRARY)
+class qconv_2d_nhwc_hwcf(CustomOp):
+    """qconv_2d_nchw_fchw for channels last `[n, h, w, c]` inputs and
+    `[kh, kw, c, f]` weights, producing `[n, h, w, f]`.
+    """
+
+    signature = "qconv_2d_nhwc_hwcf(Tensor input, Tensor input_zp, Tensor weights, Tensor weight_zp, Tensor bias, Tensor rescale, int[] padding, int[] strides, int[] dilations) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_qconv_2d(ksel, "qconv_2d_nhwc_hwcf", "nhwc", norm_silu=False)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_qconv_2d(ksel, kb, "qconv_2d_nhwc_hwcf", "nhwc", norm_silu=False)
+
+
+@CustomOp.register(library=LIBRARY)
+class qconv_2d_norm_silu_nchw_fchw(CustomOp):
+    """qconv_2d_nchw_fchw of `silu(input * norm_scale + norm_shift)`, which
+    is quantized in the kernel.
+
+    * `input`: `[n, c, h, w]` floating point inputs.
+    * `norm_scale`, `norm_shift`: `[n, c]` float32 normalization, which is
+      group norm with its statistics and affine folded per channel.
+    * `input_scale`: `[1]` float32 scale to quantize by, as for `input_zp`.
+
+    Other arguments are as for qconv_2d_nchw_fchw.
+    """
+
+    signature = "qconv_2d_norm_silu_nchw_fchw(Tensor input, Tensor norm_scale, Tensor norm_shift, Tensor input_scale, Tensor input_zp, Tensor weights, Tensor weight_zp, Tensor bias, Tensor rescale, int[] padding, int[] strides, int[] dilations) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_qconv_2d(ksel, "qconv_2d_norm_silu_nchw_fchw", "nchw", norm_silu=True)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_qconv_2d(
+            ksel, kb, "qconv_2d_norm_silu_nchw_fchw", "nchw", norm_silu=True
+        )
+
+
+@CustomOp.register(library=LIBRARY)
+class qconv_2d_norm_silu_nhwc_hwcf(CustomOp):
+    """qconv_2d_norm_silu_nchw_fchw for channels last layouts, as for
+    qconv_2d_nhwc_hwcf.
+    """
+
+    signature = "qconv_2d_norm_silu_nhwc_hwcf(Tensor input, Tensor norm_scale, Tensor norm_shift, Tensor input_scale, Tensor input_zp, Tensor weights, Tensor weight_zp, Tensor bias, Tensor rescale, int[] padding, int[] strides, int[] dilations) -> (Tensor)"
+
+    def select(self, ksel: KernelSelection):
+        _select_qconv_2d(ksel, "qconv_2d_norm_silu_nhwc_hwcf", "nhwc", norm_silu=True)
+
+    def generate(self, ksel: KernelSelection, kb: KernelBuilder):
+        _generate_qconv_2d(
+            ksel, kb, "qconv_2d_norm_silu_nhwc_hwcf", "nhwc", norm_silu=True
+        )
@@ -0,0 +1,265 @@
+// Copyright 2024 Advanced Micro Devices, Inc
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+{% set accum_type = "f32" %}
+
+{#- Whether key position %kj of the tile is valid for query %qi of row %b.
+    Defines %valid. -#}
+{% macro causal_valid(start_position, seq_len) -%}
+      %qi = linalg.index 3 : index
+      %kj = linalg.index 4 : index
+      %qi_i64 = arith.index_cast %qi : index to i64
+      %k_pos = arith.addi %j0, %kj : index
+      %k_pos_i64 = arith.index_cast %k_pos : index to i64
+      %q_pos_i64 = arith.addi {{start_position}}, %qi_i64 : i64
+      %not_future = arith.cmpi sle, %k_pos_i64, %q_pos_i64 : i64
+      %in_seq = arith.cmpi slt, %k_pos_i64, {{seq_len}} : i64
+      %valid = arith.andi %not_future, %in_seq : i1
+{%- endmacro %}
+
+!dtype = {{dtype}}
+!accum_type = {{accum_type}}
+!q_tensor_type = tensor<?x{{head_count}}x?x{{head_dim}}x!dtype>
+!qexp_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x{{head_dim}}x!dtype>
+!kv_tensor_type = tensor<?x{{head_count_kv}}x?x{{head_dim}}x!dtype>
+!positions_tensor_type = tensor<?xi64>
+!scores_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x?x!accum_type>
+!stat_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x!accum_type>
+!accum_out_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x{{head_dim}}x!accum_type>
+!result_exp_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x{{head_dim}}x!dtype>
+!result_tensor_type = tensor<?x{{head_count}}x?x{{head_dim}}x!dtype>
+
+module {
+
+util.func private @{{kernel_name}}(
+    %q: !q_tensor_type, %k: !kv_tensor_type, %v: !kv_tensor_type
+{%- if causal %},
+    %start_positions: !positions_tensor_type, %seq_lens: !positions_tensor_type
+{%- endif %})
+    -> !result_tensor_type {
+  %zero = arith.constant 0.0 : !accum_type
+  // Finite so that fully masked tiles rescale with a zero weight, not NaN.
+  %masked = arith.constant -3.0e+38 : !accum_type
+  %scale = arith.constant {{scale}} : !accum_type
+  %c0 = arith.constant 0 : index
+  %c2 = arith.constant 2 : index
+  %c_tile = arith.constant {{tile}} : index
+  %bs = tensor.dim %q, %c0 : !q_tensor_type
+  %sl = tensor.dim %q, %c2 : !q_tensor_type
+  %kv_sl = tensor.dim %k, %c2 : !kv_tensor_type
+
+  // Group query heads by the kv head they share (GQA) without expanding K/V.
+  %qexp = tensor.expand_shape %q [[0], [1, 2], [3], [4]] output_shape [%bs, {{head_count_kv}}, {{rep}}, %sl, {{head_dim}}] : !q_tensor_type into !qexp_tensor_type
+
+  // Running max, sum of exponentials and unnormalized output of each query.
+  %stat_empty = tensor.empty(%bs, %sl) : !stat_tensor_type
+  %max_init = linalg.fill ins(%masked: !accum_type) outs(%stat_empty: !stat_tensor_type) -> !stat_tensor_type
+  %sum_init = linalg.fill ins(%zero: !accum_type) outs(%stat_empty: !stat_tensor_type) -> !stat_tensor_type
+  %accum_out_empty = tensor.empty(%bs, %sl) : !accum_out_tensor_type
+  %accum_out_init = linalg.fill ins(%zero: !accum_type) outs(%accum_out_empty: !accum_out_tensor_type) -> !accum_out_tensor_type
+
+  %accum_out, %max, %sum = scf.for %j0 = %c0 to %kv_sl step %c_tile
+      iter_args(%accum_out_i = %accum_out_init, %max_i = %max_init, %sum_i = %sum_init)
+      -> (!accum_out_tensor_type, !stat_tensor_type, !stat_tensor_type) {
+    %tile = affine.min affine_map<(d0)[s0] -> ({{tile}}, s0 - d0)>(%j0)[%kv_sl]
+    %k_tile = tensor.extract_slice %k[0, 0, %j0, 0] [%bs, {{head_count_kv}}, %tile, {{head_dim}}] [1, 1, 1, 1] : !kv_tensor_type to !kv_tensor_type
+    %v_tile = tensor.extract_slice %v[0, 0, %j0, 0] [%bs, {{head_count_kv}}, %tile, {{head_dim}}] [1, 1, 1, 1] : !kv_tensor_type to !kv_tensor_type
+
+    // Scores of the tile.
+    // d0 = b, d1 = kv head, d2 = rep, d3 = query, d4 = tile key, d5 = dim (r)
+    %scores_empty = tensor.empty(%bs, %sl, %tile) : !scores_tensor_type
+    %scores_fill = linalg.fill ins(%zero: !accum_type) outs(%scores_empty: !scores_tensor_type) -> !scores_tensor_type
+    %scores = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3, d5)>,
+            affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d4, d5)>,
+            affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3, d4)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel", "reduction"] }
+        ins(%qexp, %k_tile : !qexp_tensor_type, !kv_tensor_type)
+        outs(%scores_fill : !scores_tensor_type) {
+    ^bb0(%q_element: !dtype, %k_element: !dtype, %out: !accum_type):
+    {% if dtype == accum_type %}
+        %mul = arith.mulf %q_element, %k_element : !accum_type
+    {% else %}
+        %q_element_ext = arith.extf %q_element : !dtype to !accum_type
+        %k_element_ext = arith.extf %k_element : !dtype to !accum_type
+        %mul = arith.mulf %q_element_ext, %k_element_ext : !accum_type
+    {% endif %}
+        %add = arith.addf %mul, %out : !accum_type
+        linalg.yield %add : !accum_type
+    } -> !scores_tensor_type
+
+    // Scale (and mask).
+    %scores_masked_empty = tensor.empty(%bs, %sl, %tile) : !scores_tensor_type
+    %scores_masked = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+    {% if causal %}
+            affine_map<(d0, d1, d2, d3, d4) -> (d0)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0)>,
+    {% endif %}
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel"] }
+    {% if causal %}
+        ins(%scores, %start_positions, %seq_lens : !scores_tensor_type, !positions_tensor_type, !positions_tensor_type)
+        outs(%scores_masked_empty : !scores_tensor_type) {
+    ^bb0(%score: !accum_type, %start_position: i64, %seq_len: i64, %out: !accum_type):
+      {{ causal_valid("%start_position", "%seq_len") }}
+        %scaled = arith.mulf %score, %scale : !accum_type
+        %selected = arith.select %valid, %scaled, %masked : !accum_type
+        linalg.yield %selected : !accum_type
+    {% else %}
+        ins(%scores : !scores_tensor_type)
+        outs(%scores_masked_empty : !scores_tensor_type) {
+    ^bb0(%score: !accum_type, %out: !accum_type):
+        %scaled = arith.mulf %score, %scale : !accum_type
+        linalg.yield %scaled : !accum_type
+    {% endif %}
+    } -> !scores_tensor_type
+
+    // New running max, including the tile.
+    %max_next = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction"] }
+        ins(%scores_masked : !scores_tensor_type)
+        outs(%max_i : !stat_tensor_type) {
+    ^bb0(%score: !accum_type, %out: !accum_type):
+        %m = arith.maximumf %score, %out : !accum_type
+        linalg.yield %m : !accum_type
+    } -> !stat_tensor_type
+
+    // Exponentials of the tile against the new max. Masked positions are
+    // zeroed rather than relying on exp underflow, which does not happen
+    // while every position seen so far is masked.
+    %probs_empty = tensor.empty(%bs, %sl, %tile) : !scores_tensor_type
+    %probs = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>,
+    {% if causal %}
+            affine_map<(d0, d1, d2, d3, d4) -> (d0)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0)>,
+    {% endif %}
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel"] }
+    {% if causal %}
+        ins(%scores_masked, %max_next, %start_positions, %seq_lens : !scores_tensor_type, !stat_tensor_type, !positions_tensor_type, !positions_tensor_type)
+        outs(%probs_empty : !scores_tensor_type) {
+    ^bb0(%score: !accum_type, %max_element: !accum_type, %start_position: i64, %seq_len: i64, %out: !accum_type):
+      {{ causal_valid("%start_position", "%seq_len") }}
+        %shifted = arith.subf %score, %max_element : !accum_type
+        %exp = math.exp %shifted : !accum_type
+        %selected = arith.select %valid, %exp, %zero : !accum_type
+        linalg.yield %selected : !accum_type
+    {% else %}
+        ins(%scores_masked, %max_next : !scores_tensor_type, !stat_tensor_type)
+        outs(%probs_empty : !scores_tensor_type) {
+    ^bb0(%score: !accum_type, %max_element: !accum_type, %out: !accum_type):
+        %shifted = arith.subf %score, %max_element : !accum_type
+        %exp = math.exp %shifted : !accum_type
+        linalg.yield %exp : !accum_type
+    {% endif %}
+    } -> !scores_tensor_type
+
+    // Rescale the running sum by exp(max - max_next) and add the tile's.
+    %sum_rescaled_empty = tensor.empty(%bs, %sl) : !stat_tensor_type
+    %sum_rescaled = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+            affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+            affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+            affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel"] }
+        ins(%sum_i, %max_i, %max_next : !stat_tensor_type, !stat_tensor_type, !stat_tensor_type)
+        outs(%sum_rescaled_empty : !stat_tensor_type) {
+    ^bb0(%sum_element: !accum_type, %max_element: !accum_type, %max_next_element: !accum_type, %out: !accum_type):
+        %shifted = arith.subf %max_element, %max_next_element : !accum_type
+        %weight = math.exp %shifted : !accum_type
+        %mul = arith.mulf %weight, %sum_element : !accum_type
+        linalg.yield %mul : !accum_type
+    } -> !stat_tensor_type
+    %sum_next = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction"] }
+        ins(%probs : !scores_tensor_type)
+        outs(%sum_rescaled : !stat_tensor_type) {
+    ^bb0(%prob: !accum_type, %out: !accum_type):
+        %add = arith.addf %prob, %out : !accum_type
+        linalg.yield %add : !accum_type
+    } -> !stat_tensor_type
+
+    // Likewise rescale the running output and add the tile's.
+    // d0 = b, d1 = kv head, d2 = rep, d3 = query, d4 = dim
+    %accum_out_rescaled_empty = tensor.empty(%bs, %sl) : !accum_out_tensor_type
+    %accum_out_rescaled = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>,
+            affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel"] }
+        ins(%accum_out_i, %max_i, %max_next : !accum_out_tensor_type, !stat_tensor_type, !stat_tensor_type)
+        outs(%accum_out_rescaled_empty : !accum_out_tensor_type) {
+    ^bb0(%accum_element: !accum_type, %max_element: !accum_type, %max_next_element: !accum_type, %out: !accum_type):
+        %shifted = arith.subf %max_element, %max_next_element : !accum_type
+        %weight = math.exp %shifted : !accum_type
+        %mul = arith.mulf %weight, %accum_element : !accum_type
+        linalg.yield %mul : !accum_type
+    } -> !accum_out_tensor_type
+    // d0 = b, d1 = kv head, d2 = rep, d3 = query, d4 = dim, d5 = tile key (r)
+    %accum_out_next = linalg.generic {
+        indexing_maps = [
+            affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3, d5)>,
+            affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d5, d4)>,
+            affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3, d4)>],
+        iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel", "reduction"] }
+        ins(%probs, %v_tile : !scores_tensor_type, !kv_tensor_type)
+        outs(%accum_out_rescaled : !accum_out_tensor_type) {
+    ^bb0(%prob: !accum_type, %v_element: !dtype, %out: !accum_type):
+    {% if dtype == accum_type %}
+        %mul = arith.mulf %prob, %v_element : !accum_type
+    {% else %}
+        %v_element_ext = arith.extf %v_element : !dtype to !accum_type
+        %mul = arith.mulf %prob, %v_element_ext : !accum_type
+    {% endif %}
+        %add = arith.addf %mul, %out : !accum_type
+        linalg.yield %add : !accum_type
+    } -> !accum_out_tensor_type
+
+    scf.yield %accum_out_next, %max_next, %sum_next : !accum_out_tensor_type, !stat_tensor_type, !stat_tensor_type
+  }
+
+  // Normalize and cast. Queries without any valid position produce zeros.
+  %result_exp_empty = tensor.empty(%bs, %sl) : !result_exp_tensor_type
+  %result_exp = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel"] }
+      ins(%accum_out, %sum : !accum_out_tensor_type, !stat_tensor_type)
+      outs(%result_exp_empty : !result_exp_tensor_type) {
+  ^bb0(%accum_element: !accum_type, %sum_element: !accum_type, %out: !dtype):
+      %div = arith.divf %accum_element, %sum_element : !accum_type
+      %empty_row = arith.cmpf oeq, %sum_element, %zero : !accum_type
+      %normalized = arith.select %empty_row, %zero, %div : !accum_type
+    {% if dtype == accum_type %}
+      linalg.yield %normalized : !dtype
+    {% else %}
+      %normalized_trunc = arith.truncf %normalized : !accum_type to !dtype
+      linalg.yield %normalized_trunc : !dtype
+    {% endif %}
+  } -> !result_exp_tensor_type
+
+  %result = tensor.collapse_shape %result_exp [[0], [1, 2], [3], [4]] : !result_exp_tensor_type into !result_tensor_type
+  util.return %result : !result_tensor_type
+}
+
+}
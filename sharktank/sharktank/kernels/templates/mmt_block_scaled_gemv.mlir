@@ -0,0 +1,106 @@
+// Copyright 2024 Advanced Micro Devices, Inc
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+{% set accum_type = "f32" %}
+
+!lowp_type = {{lowp_type}}
+!a_type = {{a_type}}
+!scale_type = {{scale_type}}
+!accum_type = {{accum_type}}
+!a_tensor_type = tensor<?x{{m}}x{{k}}x!a_type>
+!aexp_tensor_type = tensor<?x{{m}}x{{group0}}x{{bs}}x!a_type>
+{% if lowp_type == "i4" %}
+!qs_raw_tensor_type = tensor<{{n}}x{{group0}}x{{bs_i8}}xi8>
+{% endif %}
+!qs_tensor_type = tensor<{{n}}x{{group0}}x{{bs}}x!lowp_type>
+!d_tensor_type = tensor<{{n}}x{{group0}}x1x!scale_type>
+!accum_tensor_type = tensor<?x{{m}}x{{n}}x!accum_type>
+!c_tensor_type = tensor<?x{{m}}x{{n}}x!a_type>
+
+module {
+
+util.func private @{{kernel_name}}(
+    %a: !a_tensor_type, %d: !d_tensor_type,
+{% if lowp_type == "i4" %}
+    %qs_raw: !qs_raw_tensor_type{% else %}
+    %qs: !qs_tensor_type{% endif %}{% if has_m %}, %m: !d_tensor_type{% endif %})
+    -> !c_tensor_type {
+  %zero = arith.constant 0.0: !accum_type
+  %c0 = arith.constant 0 : index
+  %batch0_dim = tensor.dim %a, %c0 : !a_tensor_type
+
+{% if lowp_type == "i4" %}
+  // Cast qs_raw from i8 to lowp type.
+  %qs = flow.tensor.bitcast %qs_raw : !qs_raw_tensor_type -> !qs_tensor_type
+{% endif %}
+
+  // Expand %a to have the same blocked reduction structure.
+  %aexp = tensor.expand_shape %a [[0], [1], [2, 3]] output_shape [%batch0_dim,{{m}},{{group0}},{{bs}}] : !a_tensor_type into !aexp_tensor_type
+
+  // Grouped, batch mm which dequantizes each weight in the reduction. With
+  // few LHS rows the matmul is bound by reading the weights, which are read
+  // once in their quantized form rather than materialized dequantized.
+  %result_empty = tensor.empty(%batch0_dim) : !accum_tensor_type
+  %result_fill = linalg.fill ins(%zero: !accum_type) outs(%result_empty: !accum_tensor_type) -> !accum_tensor_type
+  %result = linalg.generic {
+      indexing_maps = [
+          // d0 = b, d1 = m, d2 = n, d3 = group0 (r), d4 = block (r)
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d3, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d2, d3, 0)>,
+{% if has_m %}
+          affine_map<(d0, d1, d2, d3, d4) -> (d2, d3, 0)>,
+{% endif %}
+          affine_map<(d0, d1, d2, d3, d4) -> (d2, d3, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2)>],
+      iterator_types = ["parallel", "parallel", "parallel", "reduction", "reduction"] }
+      ins(%aexp, %d, {% if has_m %}%m, {% endif %}%qs : !aexp_tensor_type, !d_tensor_type, {% if has_m %}!d_tensor_type, {% endif %}!qs_tensor_type)
+      outs(%result_fill : !accum_tensor_type) {
+  ^bb0(%a_element: !a_type, %d_element: !scale_type, {% if has_m %}%m_element: !scale_type, {% endif %}%q_element: !lowp_type, %out: !accum_type):
+    {% if signed %}
+      %q_element_ext = arith.extsi %q_element : !lowp_type to i32
+      %q_element_fp = arith.sitofp %q_element_ext : i32 to !accum_type
+    {% else %}
+      %q_element_ext = arith.extui %q_element : !lowp_type to i32
+      %q_element_fp = arith.uitofp %q_element_ext : i32 to !accum_type
+    {% endif %}
+    {% if scale_type == accum_type %}
+    {% set d_value = "%d_element" %}
+    {% else %}
+      %d_element_ext = arith.extf %d_element : !scale_type to !accum_type
+    {% set d_value = "%d_element_ext" %}
+    {% endif %}
+      %b_element_scaled = arith.mulf %q_element_fp, {{d_value}} : !accum_type
+    {% if has_m %}
+    {% if scale_type == accum_type %}
+    {% set m_value = "%m_element" %}
+    {% else %}
+      %m_element_ext = arith.extf %m_element : !scale_type to !accum_type
+    {% set m_value = "%m_element_ext" %}
+    {% endif %}
+      %b_element = arith.addf %b_element_scaled, {{m_value}} : !accum_type
+    {% set b_value = "%b_element" %}
+    {% else %}
+    {% set b_value = "%b_element_scaled" %}
+    {% endif %}
+    {% if a_type == accum_type %}
+      %bmm_mul = arith.mulf %a_element, {{b_value}} : !accum_type
+    {% else %}
+      %a_element_ext = arith.extf %a_element : !a_type to !accum_type
+      %bmm_mul = arith.mulf %a_element_ext, {{b_value}} : !accum_type
+    {% endif %}
+      %bmm_accum = arith.addf %bmm_mul, %out : !accum_type
+      linalg.yield %bmm_accum : !accum_type
+  } -> !accum_tensor_type
+
+  // Cast.
+  %result_cast_empty = tensor.empty(%batch0_dim) : !c_tensor_type
+  %result_cast = linalg.copy
+    ins(%result : !accum_tensor_type)
+    outs(%result_cast_empty : !c_tensor_type) -> !c_tensor_type
+  util.return %result_cast : !c_tensor_type
+}
+
+}
@@ -0,0 +1,294 @@
+// Copyright 2024 Advanced Micro Devices, Inc
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+{% set accum_type = "f32" %}
+{% if scaled %}
+{% set function_name = "sharktank_paged_attention_decode_scaled_%s_%s_%s_%s_%s_%s" % (head_count, head_count_kv, head_dim, stride, table_dtype, dtype) %}
+{% else %}
+{% set function_name = "sharktank_paged_attention_decode_%s_%s_%s_%s_%s" % (head_count, head_count_kv, head_dim, stride, dtype) %}
+{% endif %}
+
+{#- Extends a (non accumulator typed) K/V table element. -#}
+{% macro ext_table_element(result, value) -%}
+{% if table_dtype.startswith("i") %}
+      {{result}} = arith.sitofp {{value}} : !table_dtype to !accum_type
+{% else %}
+      {{result}} = arith.extf {{value}} : !table_dtype to !accum_type
+{% endif %}
+{%- endmacro %}
+
+!dtype = {{dtype}}
+!table_dtype = {{table_dtype}}
+!accum_type = {{accum_type}}
+!q_tensor_type = tensor<?x{{head_count}}x{{head_dim}}x!dtype>
+!qexp_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x{{head_dim}}x!dtype>
+!table_tensor_type = tensor<?x{{stride}}x{{head_count_kv}}x{{head_dim}}x!table_dtype>
+!table_scales_tensor_type = tensor<?x{{head_count_kv}}xf32>
+!ids_tensor_type = tensor<?x?xi64>
+!seq_lens_tensor_type = tensor<?xi64>
+!scores_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x{{stride}}x!accum_type>
+!page_stat_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x!accum_type>
+!page_out_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x?x{{head_dim}}x!accum_type>
+!stat_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x!accum_type>
+!accum_out_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x{{head_dim}}x!accum_type>
+!result_exp_tensor_type = tensor<?x{{head_count_kv}}x{{rep}}x{{head_dim}}x!dtype>
+!result_tensor_type = tensor<?x{{head_count}}x{{head_dim}}x!dtype>
+
+module {
+
+util.func private @{{function_name}}(
+    %q: !q_tensor_type, %table: !table_tensor_type,
+{% if scaled %}
+    %table_scales: !table_scales_tensor_type,
+{% endif %}
+    %k_ids: !ids_tensor_type, %v_ids: !ids_tensor_type,
+    %seq_lens: !seq_lens_tensor_type)
+    -> !result_tensor_type {
+  %zero = arith.constant 0.0 : !accum_type
+  // Finite so that fully masked pages combine with a zero weight, not NaN.
+  %masked = arith.constant -3.0e+38 : !accum_type
+  %scale = arith.constant {{scale}} : !accum_type
+  %c0 = arith.constant 0 : index
+  %c1 = arith.constant 1 : index
+  %c_stride = arith.constant {{stride}} : index
+  %bs = tensor.dim %q, %c0 : !q_tensor_type
+  %nb = tensor.dim %k_ids, %c1 : !ids_tensor_type
+
+  // Group query heads by the kv head they share (GQA) without expanding K/V.
+  %qexp = tensor.expand_shape %q [[0], [1, 2], [3]] output_shape [%bs, {{head_count_kv}}, {{rep}}, {{head_dim}}] : !q_tensor_type into !qexp_tensor_type
+
+  // Scaled, masked scores, reading K in place from the pages.
+  // d0 = b, d1 = kv head, d2 = rep, d3 = page, d4 = page position, d5 = dim (r)
+  %scores_empty = tensor.empty(%bs, %nb) : !scores_tensor_type
+  %scores_fill = linalg.fill ins(%zero: !accum_type) outs(%scores_empty: !scores_tensor_type) -> !scores_tensor_type
+  %scores = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d5)>,
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d3)>,
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3, d4)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel", "reduction"] }
+      ins(%qexp, %k_ids : !qexp_tensor_type, !ids_tensor_type)
+      outs(%scores_fill : !scores_tensor_type) {
+  ^bb0(%q_element: !dtype, %k_id: i64, %out: !accum_type):
+      %kv_head = linalg.index 1 : index
+      %pos = linalg.index 4 : index
+      %dim = linalg.index 5 : index
+      %k_index = arith.index_cast %k_id : i64 to index
+      %k_element = tensor.extract %table[%k_index, %pos, %kv_head, %dim] : !table_tensor_type
+    {% if dtype == accum_type %}
+    {% set q_ext = "%q_element" %}
+    {% else %}
+    {% set q_ext = "%q_element_ext" %}
+      %q_element_ext = arith.extf %q_element : !dtype to !accum_type
+    {% endif %}
+    {% if table_dtype == accum_type %}
+    {% set k_ext = "%k_element" %}
+    {% else %}
+    {% set k_ext = "%k_element_ext" %}
+      {{ ext_table_element("%k_element_ext", "%k_element") }}
+    {% endif %}
+      %mul = arith.mulf {{q_ext}}, {{k_ext}} : !accum_type
+      %add = arith.addf %mul, %out : !accum_type
+      linalg.yield %add : !accum_type
+  } -> !scores_tensor_type
+
+  // The K page scale is constant over a page, so it scales the dot product.
+  %scores_masked_empty = tensor.empty(%bs, %nb) : !scores_tensor_type
+  %scores_masked = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d3)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel"] }
+      ins(%scores, %seq_lens, %k_ids : !scores_tensor_type, !seq_lens_tensor_type, !ids_tensor_type)
+      outs(%scores_masked_empty : !scores_tensor_type) {
+  ^bb0(%score: !accum_type, %seq_len: i64, %k_id: i64, %out: !accum_type):
+      %page = linalg.index 3 : index
+      %pos = linalg.index 4 : index
+      %page_base = arith.muli %page, %c_stride : index
+      %seq_pos = arith.addi %page_base, %pos : index
+      %seq_pos_i64 = arith.index_cast %seq_pos : index to i64
+      %valid = arith.cmpi slt, %seq_pos_i64, %seq_len : i64
+    {% if scaled %}
+      %kv_head = linalg.index 1 : index
+      %k_index = arith.index_cast %k_id : i64 to index
+      %k_scale = tensor.extract %table_scales[%k_index, %kv_head] : !table_scales_tensor_type
+      %page_scale = arith.mulf %k_scale, %scale : !accum_type
+      %scaled = arith.mulf %score, %page_scale : !accum_type
+    {% else %}
+      %scaled = arith.mulf %score, %scale : !accum_type
+    {% endif %}
+      %selected = arith.select %valid, %scaled, %masked : !accum_type
+      linalg.yield %selected : !accum_type
+  } -> !scores_tensor_type
+
+  // Per-page softmax statistics: max and sum of exponentials.
+  %page_stat_empty = tensor.empty(%bs, %nb) : !page_stat_tensor_type
+  %page_max_fill = linalg.fill ins(%masked: !accum_type) outs(%page_stat_empty: !page_stat_tensor_type) -> !page_stat_tensor_type
+  %page_max = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction"] }
+      ins(%scores_masked : !scores_tensor_type)
+      outs(%page_max_fill : !page_stat_tensor_type) {
+  ^bb0(%score: !accum_type, %out: !accum_type):
+      %max = arith.maximumf %score, %out : !accum_type
+      linalg.yield %max : !accum_type
+  } -> !page_stat_tensor_type
+
+  %page_sum_fill = linalg.fill ins(%zero: !accum_type) outs(%page_stat_empty: !page_stat_tensor_type) -> !page_stat_tensor_type
+  %page_sum = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction"] }
+      ins(%scores_masked, %page_max : !scores_tensor_type, !page_stat_tensor_type)
+      outs(%page_sum_fill : !page_stat_tensor_type) {
+  ^bb0(%score: !accum_type, %max: !accum_type, %out: !accum_type):
+      %shifted = arith.subf %score, %max : !accum_type
+      %exp = math.exp %shifted : !accum_type
+      %add = arith.addf %exp, %out : !accum_type
+      linalg.yield %add : !accum_type
+  } -> !page_stat_tensor_type
+
+  // Per-page partial outputs, reading V in place from the pages. Masked
+  // positions are skipped so that uninitialized cache rows cannot produce NaN.
+  // d0 = b, d1 = kv head, d2 = rep, d3 = page, d4 = dim, d5 = page position (r)
+  %page_out_empty = tensor.empty(%bs, %nb) : !page_out_tensor_type
+  %page_out_fill = linalg.fill ins(%zero: !accum_type) outs(%page_out_empty: !page_out_tensor_type) -> !page_out_tensor_type
+  %page_out = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3, d5)>,
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3)>,
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d3)>,
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0)>,
+          affine_map<(d0, d1, d2, d3, d4, d5) -> (d0, d1, d2, d3, d4)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "parallel", "reduction"] }
+      ins(%scores_masked, %page_max, %v_ids, %seq_lens : !scores_tensor_type, !page_stat_tensor_type, !ids_tensor_type, !seq_lens_tensor_type)
+      outs(%page_out_fill : !page_out_tensor_type) {
+  ^bb0(%score: !accum_type, %max: !accum_type, %v_id: i64, %seq_len: i64, %out: !accum_type):
+      %kv_head = linalg.index 1 : index
+      %page = linalg.index 3 : index
+      %dim = linalg.index 4 : index
+      %pos = linalg.index 5 : index
+      %page_base = arith.muli %page, %c_stride : index
+      %seq_pos = arith.addi %page_base, %pos : index
+      %seq_pos_i64 = arith.index_cast %seq_pos : index to i64
+      %valid = arith.cmpi slt, %seq_pos_i64, %seq_len : i64
+      %v_index = arith.index_cast %v_id : i64 to index
+      %v_element = tensor.extract %table[%v_index, %pos, %kv_head, %dim] : !table_tensor_type
+      %shifted = arith.subf %score, %max : !accum_type
+      %exp = math.exp %shifted : !accum_type
+    {% if table_dtype == accum_type %}
+      %mul = arith.mulf %exp, %v_element : !accum_type
+    {% else %}
+      {{ ext_table_element("%v_element_ext", "%v_element") }}
+      %mul = arith.mulf %exp, %v_element_ext : !accum_type
+    {% endif %}
+      %add = arith.addf %mul, %out : !accum_type
+      %selected = arith.select %valid, %add, %out : !accum_type
+      linalg.yield %selected : !accum_type
+  } -> !page_out_tensor_type
+
+  // Combine pages: rescale each page's partials by exp(page_max - max).
+  %stat_empty = tensor.empty(%bs) : !stat_tensor_type
+  %max_fill = linalg.fill ins(%masked: !accum_type) outs(%stat_empty: !stat_tensor_type) -> !stat_tensor_type
+  %max = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2)>],
+      iterator_types = ["parallel", "parallel", "parallel", "reduction"] }
+      ins(%page_max : !page_stat_tensor_type)
+      outs(%max_fill : !stat_tensor_type) {
+  ^bb0(%page_max_element: !accum_type, %out: !accum_type):
+      %m = arith.maximumf %page_max_element, %out : !accum_type
+      linalg.yield %m : !accum_type
+  } -> !stat_tensor_type
+
+  %sum_fill = linalg.fill ins(%zero: !accum_type) outs(%stat_empty: !stat_tensor_type) -> !stat_tensor_type
+  %sum = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2)>],
+      iterator_types = ["parallel", "parallel", "parallel", "reduction"] }
+      ins(%page_max, %page_sum, %max : !page_stat_tensor_type, !page_stat_tensor_type, !stat_tensor_type)
+      outs(%sum_fill : !stat_tensor_type) {
+  ^bb0(%page_max_element: !accum_type, %page_sum_element: !accum_type, %max_element: !accum_type, %out: !accum_type):
+      %shifted = arith.subf %page_max_element, %max_element : !accum_type
+      %weight = math.exp %shifted : !accum_type
+      %mul = arith.mulf %weight, %page_sum_element : !accum_type
+      %add = arith.addf %mul, %out : !accum_type
+      linalg.yield %add : !accum_type
+  } -> !stat_tensor_type
+
+  // The V page scale is likewise applied to each page's partial output.
+  // The scales of pages past the sequence length are selected away before
+  // the multiply, since unwritten pages may have NaN scales.
+  // d0 = b, d1 = kv head, d2 = rep, d3 = dim, d4 = page (r)
+  %accum_out_empty = tensor.empty(%bs) : !accum_out_tensor_type
+  %accum_out_fill = linalg.fill ins(%zero: !accum_type) outs(%accum_out_empty: !accum_out_tensor_type) -> !accum_out_tensor_type
+  %accum_out = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d4, d3)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d4)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0)>,
+          affine_map<(d0, d1, d2, d3, d4) -> (d0, d1, d2, d3)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction"] }
+      ins(%page_out, %page_max, %max, %v_ids, %seq_lens : !page_out_tensor_type, !page_stat_tensor_type, !stat_tensor_type, !ids_tensor_type, !seq_lens_tensor_type)
+      outs(%accum_out_fill : !accum_out_tensor_type) {
+  ^bb0(%page_out_element: !accum_type, %page_max_element: !accum_type, %max_element: !accum_type, %v_id: i64, %seq_len: i64, %out: !accum_type):
+      %shifted = arith.subf %page_max_element, %max_element : !accum_type
+    {% if scaled %}
+      %kv_head = linalg.index 1 : index
+      %page = linalg.index 4 : index
+      %page_base = arith.muli %page, %c_stride : index
+      %page_base_i64 = arith.index_cast %page_base : index to i64
+      %valid = arith.cmpi slt, %page_base_i64, %seq_len : i64
+      %v_index = arith.index_cast %v_id : i64 to index
+      %v_scale = tensor.extract %table_scales[%v_index, %kv_head] : !table_scales_tensor_type
+      %v_scale_valid = arith.select %valid, %v_scale, %zero : !accum_type
+      %exp = math.exp %shifted : !accum_type
+      %weight = arith.mulf %exp, %v_scale_valid : !accum_type
+    {% else %}
+      %weight = math.exp %shifted : !accum_type
+    {% endif %}
+      %mul = arith.mulf %weight, %page_out_element : !accum_type
+      %add = arith.addf %mul, %out : !accum_type
+      linalg.yield %add : !accum_type
+  } -> !accum_out_tensor_type
+
+  // Normalize and cast.
+  %result_exp_empty = tensor.empty(%bs) : !result_exp_tensor_type
+  %result_exp = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel"] }
+      ins(%accum_out, %sum : !accum_out_tensor_type, !stat_tensor_type)
+      outs(%result_exp_empty : !result_exp_tensor_type) {
+  ^bb0(%accum_element: !accum_type, %sum_element: !accum_type, %out: !dtype):
+      %div = arith.divf %accum_element, %sum_element : !accum_type
+    {% if dtype == accum_type %}
+      linalg.yield %div : !dtype
+    {% else %}
+      %div_trunc = arith.truncf %div : !accum_type to !dtype
+      linalg.yield %div_trunc : !dtype
+    {% endif %}
+  } -> !result_exp_tensor_type
+
+  %result = tensor.collapse_shape %result_exp [[0], [1, 2], [3]] : !result_exp_tensor_type into !result_tensor_type
+  util.return %result : !result_tensor_type
+}
+
+}
@@ -0,0 +1,183 @@
+// Copyright 2024 Advanced Micro Devices, Inc
+//
+// Licensed under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+{% if layout == "nchw" %}
+{% set h_dim, w_dim, kh_dim, kw_dim, f_dim = 2, 3, 2, 3, 0 %}
+{% else %}
+{% set h_dim, w_dim, kh_dim, kw_dim, f_dim = 1, 2, 0, 1, 3 %}
+{% endif %}
+{% set q_input = "%q" if norm_silu else "%input" %}
+
+!input_dtype = {{input_dtype}}
+!out_dtype = {{out_dtype}}
+!input_tensor_type = tensor<?x?x?x?x!input_dtype>
+!q_tensor_type = tensor<?x?x?x?xi8>
+!weights_tensor_type = tensor<?x?x?x?xi8>
+!channel_tensor_type = tensor<?xi32>
+!rescale_tensor_type = tensor<?x!out_dtype>
+!accum_tensor_type = tensor<?x?x?x?xi32>
+!out_tensor_type = tensor<?x?x?x?x!out_dtype>
+
+module {
+
+util.func private @{{kernel_name}}(
+    %input: !input_tensor_type,
+{% if norm_silu %}
+    %norm_scale: tensor<?x?xf32>, %norm_shift: tensor<?x?xf32>, %input_scale: tensor<1xf32>,
+{% endif %}
+    %input_zp: tensor<1xi32>, %weights: !weights_tensor_type,
+    %weight_zp: !channel_tensor_type, %bias: !channel_tensor_type,
+    %rescale: !rescale_tensor_type)
+    -> !out_tensor_type {
+  %c0 = arith.constant 0 : index
+  %c1 = arith.constant 1 : index
+  %c2 = arith.constant 2 : index
+  %c3 = arith.constant 3 : index
+  %zero = arith.constant 0 : i32
+  %zp = tensor.extract %input_zp[%c0] : tensor<1xi32>
+
+{% if norm_silu %}
+  // Prologue: normalize with the folded group norm statistics and affine,
+  // apply SiLU and quantize, so that the float activations are read once.
+  %one = arith.constant 1.0 : f32
+  %q_min = arith.constant -128.0 : f32
+  %q_max = arith.constant 127.0 : f32
+  %scale = tensor.extract %input_scale[%c0] : tensor<1xf32>
+  %zp_f32 = arith.sitofp %zp : i32 to f32
+  %in_d0 = tensor.dim %input, %c0 : !input_tensor_type
+  %in_d1 = tensor.dim %input, %c1 : !input_tensor_type
+  %in_d2 = tensor.dim %input, %c2 : !input_tensor_type
+  %in_d3 = tensor.dim %input, %c3 : !input_tensor_type
+  %q_empty = tensor.empty(%in_d0, %in_d1, %in_d2, %in_d3) : !q_tensor_type
+  %q = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+  {% if layout == "nchw" %}
+          affine_map<(d0, d1, d2, d3) -> (d0, d1)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d1)>,
+  {% else %}
+          affine_map<(d0, d1, d2, d3) -> (d0, d3)>,
+          affine_map<(d0, d1, d2, d3) -> (d0, d3)>,
+  {% endif %}
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel"] }
+      ins(%input, %norm_scale, %norm_shift : !input_tensor_type, tensor<?x?xf32>, tensor<?x?xf32>)
+      outs(%q_empty : !q_tensor_type) {
+  ^bb0(%x: !input_dtype, %a: f32, %b: f32, %out: i8):
+  {% if input_dtype == "f32" %}
+      %normalized = arith.mulf %x, %a : f32
+  {% else %}
+      %x_f32 = arith.extf %x : !input_dtype to f32
+      %normalized = arith.mulf %x_f32, %a : f32
+  {% endif %}
+      %shifted = arith.addf %normalized, %b : f32
+      %neg = arith.negf %shifted : f32
+      %exp = math.exp %neg : f32
+      %denom = arith.addf %one, %exp : f32
+      %silu = arith.divf %shifted, %denom : f32
+      %scaled = arith.mulf %silu, %scale : f32
+      %offset = arith.addf %scaled, %zp_f32 : f32
+      %rounded = math.roundeven %offset : f32
+      %clamped_low = arith.maximumf %rounded, %q_min : f32
+      %clamped = arith.minimumf %clamped_low, %q_max : f32
+      %quantized = arith.fptosi %clamped : f32 to i8
+      linalg.yield %quantized : i8
+  } -> !q_tensor_type
+{% endif %}
+
+  // Pad with the input zero point, which is the quantization of 0.
+  %zp_i8 = arith.trunci %zp : i32 to i8
+{% if layout == "nchw" %}
+  %padded = tensor.pad {{q_input}} low[0, 0, {{padding_H}}, {{padding_W}}] high[0, 0, {{padding_H}}, {{padding_W}}] {
+{% else %}
+  %padded = tensor.pad {{q_input}} low[0, {{padding_H}}, {{padding_W}}, 0] high[0, {{padding_H}}, {{padding_W}}, 0] {
+{% endif %}
+  ^bb0(%i0: index, %i1: index, %i2: index, %i3: index):
+    tensor.yield %zp_i8 : i8
+  } : !q_tensor_type to !q_tensor_type
+
+  %n = tensor.dim %padded, %c0 : !q_tensor_type
+  %h_pad = tensor.dim %padded, %c{{h_dim}} : !q_tensor_type
+  %w_pad = tensor.dim %padded, %c{{w_dim}} : !q_tensor_type
+  %f = tensor.dim %weights, %c{{f_dim}} : !weights_tensor_type
+  %kh = tensor.dim %weights, %c{{kh_dim}} : !weights_tensor_type
+  %kw = tensor.dim %weights, %c{{kw_dim}} : !weights_tensor_type
+  %h_out = affine.apply affine_map<()[s0, s1] -> ((s0 - (s1 - 1) * {{dilations_H}} - 1) floordiv {{strides_H}} + 1)>()[%h_pad, %kh]
+  %w_out = affine.apply affine_map<()[s0, s1] -> ((s0 - (s1 - 1) * {{dilations_W}} - 1) floordiv {{strides_W}} + 1)>()[%w_pad, %kw]
+{% if layout == "nchw" %}
+  %accum_empty = tensor.empty(%n, %f, %h_out, %w_out) : !accum_tensor_type
+{% else %}
+  %accum_empty = tensor.empty(%n, %h_out, %w_out, %f) : !accum_tensor_type
+{% endif %}
+  %accum_fill = linalg.fill ins(%zero: i32) outs(%accum_empty: !accum_tensor_type) -> !accum_tensor_type
+
+  // Convolve, subtracting the zero points of both operands in the inner
+  // product rather than correcting the result with extra reductions.
+  // d0 = n, d1 = f, d2 = h_out, d3 = w_out, d4 = c (r), d5 = kh (r), d6 = kw (r)
+  %accum = linalg.generic {
+      indexing_maps = [
+  {% if layout == "nchw" %}
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d0, d4, d2 * {{strides_H}} + d5 * {{dilations_H}}, d3 * {{strides_W}} + d6 * {{dilations_W}})>,
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d1, d4, d5, d6)>,
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d1)>,
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d0, d1, d2, d3)>],
+  {% else %}
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d0, d2 * {{strides_H}} + d5 * {{dilations_H}}, d3 * {{strides_W}} + d6 * {{dilations_W}}, d4)>,
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d5, d6, d4, d1)>,
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d1)>,
+          affine_map<(d0, d1, d2, d3, d4, d5, d6) -> (d0, d2, d3, d1)>],
+  {% endif %}
+      iterator_types = ["parallel", "parallel", "parallel", "parallel", "reduction", "reduction", "reduction"] }
+      ins(%padded, %weights, %weight_zp : !q_tensor_type, !weights_tensor_type, !channel_tensor_type)
+      outs(%accum_fill : !accum_tensor_type) {
+  ^bb0(%x: i8, %w: i8, %w_zp: i32, %out: i32):
+      %x_i32 = arith.extsi %x : i8 to i32
+      %x_centered = arith.subi %x_i32, %zp : i32
+      %w_i32 = arith.extsi %w : i8 to i32
+      %w_centered = arith.subi %w_i32, %w_zp : i32
+      %mul = arith.muli %x_centered, %w_centered : i32
+      %add = arith.addi %mul, %out : i32
+      linalg.yield %add : i32
+  } -> !accum_tensor_type
+
+  // Epilogue: add the integer bias and dequantize to the output dtype.
+{% if layout == "nchw" %}
+  %result_empty = tensor.empty(%n, %f, %h_out, %w_out) : !out_tensor_type
+{% else %}
+  %result_empty = tensor.empty(%n, %h_out, %w_out, %f) : !out_tensor_type
+{% endif %}
+  %result = linalg.generic {
+      indexing_maps = [
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>,
+  {% if layout == "nchw" %}
+          affine_map<(d0, d1, d2, d3) -> (d1)>,
+          affine_map<(d0, d1, d2, d3) -> (d1)>,
+  {% else %}
+          affine_map<(d0, d1, d2, d3) -> (d3)>,
+          affine_map<(d0, d1, d2, d3) -> (d3)>,
+  {% endif %}
+          affine_map<(d0, d1, d2, d3) -> (d0, d1, d2, d3)>],
+      iterator_types = ["parallel", "parallel", "parallel", "parallel"] }
+      ins(%accum, %bias, %rescale : !accum_tensor_type, !channel_tensor_type, !rescale_tensor_type)
+      outs(%result_empty : !out_tensor_type) {
+  ^bb0(%acc: i32, %b: i32, %s: !out_dtype, %out: !out_dtype):
+      %biased = arith.addi %acc, %b : i32
+      %biased_f32 = arith.sitofp %biased : i32 to f32
+  {% if out_dtype == "f32" %}
+      %y = arith.mulf %biased_f32, %s : f32
+      linalg.yield %y : f32
+  {% else %}
+      %s_f32 = arith.extf %s : !out_dtype to f32
+      %y = arith.mulf %biased_f32, %s_f32 : f32
+      %y_trunc = arith.truncf %y : f32 to !out_dtype
+      linalg.yield %y_trunc : !out_dtype
+  {% endif %}
+  } -> !out_tensor_type
+
+  util.return %result : !out_tensor_type
+}
+
+}
@@ -10,7 +10,7 @@ from .kv_cache import BaseKVCache, DirectKVCache, PagedKVCache
 from .causal_llm import BaseCausalLMModel
 from .linear import LinearLayer
 from .norm import RMSNormLayer
-from .rotary_embedding import RotaryEmbeddingLayer
+from .rotary_embedding import RotaryEmbeddingLayer, apply_rotary_embedding
 from .token_embedding import TokenEmbeddingLayer
 
 from . import configs
@@ -13,7 +13,7 @@ from ..types import (
     InferenceTensor,
     Theta,
 )
-from ..utils import debugging
+from ..utils import debugging, tracing
 
 __all__ = [
     "LinearLayer",
@@ -67,6 +67,13 @@ class ThetaLayer(BaseLayer):
         super().__init__()
         self.theta = theta
 
+    def __call__(self, *args, **kwargs):
+        # Forwards are traced as spans named by the layer class, if tracing.
+        if tracing.get_tracer() is None:
+            return super().__call__(*args, **kwargs)
+        with tracing.span(type(self).__name__, "layer"):
+            return super().__call__(*args, **kwargs)
+
     def theta_tensor(self, name: str) -> InferenceTensor:
         # TODO: We may need to do some bookkeeping here to ensure export
         # tracks all of these.
@@ -8,7 +8,7 @@ from typing import Optional
 
 import torch
 
-from ..types import Theta
+from ..types import ShardedTensor, Theta
 from .base import (
     ThetaLayer,
 )
@@ -49,6 +49,11 @@ class BaseCausalLMModel(ThetaLayer):
     def _assert_device(self, *ts: torch.Tensor, dtype: Optional[torch.dtype] = None):
         if self.device is not None:
             for t in ts:
+                if isinstance(t, ShardedTensor):
+                    self._assert_device(
+                        *(shard.as_torch() for shard in t.shards), dtype=dtype
+                    )
+                    continue
                 assert (
                     t.device == self.device
                 ), f"Expected tensor to be on device {self.device} but it is on {t.device}"
@@ -127,6 +132,35 @@ class BaseCausalLMModel(ThetaLayer):
         numeric_mask.masked_fill_(boolean_mask, self._maximally_negative_value(dtype))
         return numeric_mask.to(self.device)
 
+    def chunked_attention_mask(
+        self,
+        # [bs] of integers
+        start_positions: torch.Tensor,
+        # [bs] of integers
+        seq_lens: torch.Tensor,
+        chunk_len: int,
+        kv_seq_len: int,
+    ):
+        """Generates a [bs, 1, chunk_len, kv_seq_len] mask for a prefill chunk.
+
+        Query i of row b is at position start_positions[b] + i and attends
+        causally to all earlier positions of the row (including those already
+        in the cache) that are below seq_lens[b].
+        """
+        dtype = self.attention_dtype
+        query_positions = start_positions[:, None, None] + torch.arange(
+            0, chunk_len, 1, device=self.device
+        )[None, :, None]
+        key_positions = torch.arange(0, kv_seq_len, 1, device=self.device)[
+            None, None, :
+        ]
+        boolean_mask = (key_positions > query_positions) | (
+            key_positions >= seq_lens[:, None, None]
+        )
+        numeric_mask = torch.zeros_like(boolean_mask, dtype=dtype)
+        numeric_mask.masked_fill_(boolean_mask, self._maximally_negative_value(dtype))
+        return numeric_mask.unsqueeze(1).to(self.device)
+
     def extract_tokens_from_logits(
         self, logits: torch.Tensor, seq_lens: list[int]
     ) -> list[int]:
@@ -144,3 +178,60 @@ class BaseCausalLMModel(ThetaLayer):
             step_logits = logits[batch, seq_len - 1]
             results.append(torch.argmax(step_logits))
         return results
+
+    def last_position_logits(
+        self,
+        # [bs, batch_seq_len, vocab]
+        logits: torch.Tensor,
+        # [bs] of integers
+        seq_lens: torch.Tensor,
+    ) -> torch.Tensor:
+        """Gathers the logits of each row's last valid position as [bs, 1, vocab].
+
+        Unlike `extract_tokens_from_logits`, this stays within tensor ops so that
+        it can be exported, letting prefill return only what is needed to sample
+        the next token.
+        """
+        bs, _, vocab = logits.shape
+        index = (seq_lens - 1).clamp_min(0).view(bs, 1, 1).expand(bs, 1, vocab)
+        return torch.gather(logits, 1, index)
+
+    def sample_tokens(
+        self,
+        # [bs, vocab]
+        logits: torch.Tensor,
+        *,
+        # [bs] softmax temperature, where <= 0 selects the argmax (greedy).
+        temperature: torch.Tensor,
+        # [bs] number of most likely tokens to sample from (<= 0 for all).
+        top_k: torch.Tensor,
+        # [bs] smallest mass of most likely tokens to sample from (1.0 for all).
+        top_p: torch.Tensor,
+        # [bs] uniform random samples in [0, 1) from the caller's RNG.
+        uniform: torch.Tensor,
+    ) -> torch.Tensor:
+        """Samples a token for each row with per-row parameters, as [bs, 1] int64.
+
+        The randomness is supplied as one uniform sample per row, which keeps the
+        computation deterministic (and exportable) with the RNG left to the host.
+        Rows are sampled by inverse transform over the renormalized distribution
+        of the tokens kept by top-k and top-p.
+        """
+        bs, vocab = logits.shape
+        logits = logits.to(torch.float32)
+        greedy_tokens = torch.argmax(logits, dim=-1, keepdim=True)
+
+        scaled = logits / temperature.to(torch.float32).clamp_min(1e-6)[:, None]
+        sorted_logits, sorted_tokens = torch.sort(scaled, dim=-1, descending=True)
+        probs = torch.softmax(sorted_logits, dim=-1)
+
+        # The most likely token is always kept.
+        ranks = torch.arange(vocab, device=logits.device)[None, :]
+        k = torch.where(top_k > 0, top_k, vocab)[:, None]
+        mass_before = torch.cumsum(probs, dim=-1) - probs
+        keep = (ranks < k) & (mass_before < top_p.to(torch.float32)[:, None])
+        cdf = torch.cumsum(torch.where(keep, probs, 0.0), dim=-1)
+        threshold = uniform.to(torch.float32)[:, None] * cdf[:, -1:]
+        choice = torch.sum(cdf <= threshold, dim=-1, keepdim=True)
+        sampled_tokens = torch.gather(sorted_tokens, 1, choice.clamp_max(vocab - 1))
+        return torch.where(temperature[:, None] > 0, sampled_tokens, greedy_tokens)
@@ -18,6 +18,9 @@ import math
 
 import torch
 
+from .. import kernels
+from .rotary_embedding import apply_rotary_embedding
+from ..types import SplitPrimitiveTensor, StaticScaledQuantizer, TensorScaledLayout
 from ..utils.debugging import trace_tensor
 
 __all__ = [
@@ -138,6 +141,24 @@ class PagedKVCache(BaseKVCache):
     Note that the internal page structure matches the organization of the
     model, allowing contiguous individual local reads and writes at a sub-block
     granularity if indexing deeply into the structure.
+
+    If a `cache_dtype` different from `dtype` is given (int8 or an fp8 type),
+    pages are stored quantized and the state carries a second, float32 slab of
+    per-page-per-head dequantization scales:
+        [page_count, transformer_block_count * cache_partition_count * heads]
+
+    Writes requantize each touched sub-block as a whole: positions written
+    earlier by the same sequence are dequantized and requantized with the
+    new page scale, which never shrinks. They round trip exactly while the
+    scale is unchanged and otherwise pick up one more rounding error per
+    scale increase. Positions at or beyond the written range are zeroed.
+    Reads and the fused decode kernel dequantize with the page scales.
+
+    With a `shard_count` > 1, the attention heads are partitioned across
+    tensor parallel shards: every shard has its own page table of
+    `attn_head_count // shard_count` heads, indexed by the same page ids.
+    allocate() then returns SplitPrimitiveTensors of the per-shard slabs, and
+    each shard accesses its slabs through the unsharded `shard_cache`.
     """
 
     def __init__(
@@ -149,10 +170,17 @@ class PagedKVCache(BaseKVCache):
         cache_partition_count: int = 2,
         block_seq_stride: int = 16,
         dtype: torch.dtype = torch.float32,
+        cache_dtype: Optional[torch.dtype] = None,
         device: Optional[torch.device] = None,
+        shard_count: int = 1,
     ):
+        assert (
+            attn_head_count % shard_count == 0
+        ), f"Cannot split {attn_head_count} heads into {shard_count} shards"
         self.transformer_block_count = transformer_block_count
-        self.attn_head_count = attn_head_count
+        self.shard_count = shard_count
+        # Heads of each shard's page table.
+        self.attn_head_count = attn_head_count // shard_count
         self.attn_head_dim = attn_head_dim
         self.cache_partition_count = cache_partition_count
         self.block_seq_stride = block_seq_stride
@@ -166,12 +194,72 @@ class PagedKVCache(BaseKVCache):
             self.attn_head_dim,
         ]
         self.page_slab_flat_dim = math.prod(self.sub_page_dims)
+        self.page_scale_flat_dim = (
+            self.transformer_block_count
+            * self.cache_partition_count
+            * self.attn_head_count
+        )
         self.device = device
         self.dtype = dtype
+        self.cache_dtype = cache_dtype if cache_dtype is not None else dtype
+        if self.is_quantized:
+            assert (
+                self.cache_dtype.is_floating_point or self.cache_dtype.is_signed
+            ), f"Quantized KV cache dtype must be fp or signed but got {cache_dtype}"
+
+        # The unsharded cache over the page table of a single shard.
+        self.shard_cache = self
+        if self.is_sharded:
+            self.shard_cache = PagedKVCache(
+                transformer_block_count=transformer_block_count,
+                attn_head_count=self.attn_head_count,
+                attn_head_dim=attn_head_dim,
+                cache_partition_count=cache_partition_count,
+                block_seq_stride=block_seq_stride,
+                dtype=dtype,
+                cache_dtype=self.cache_dtype,
+                device=device,
+            )
+
+    @property
+    def is_quantized(self) -> bool:
+        return self.cache_dtype != self.dtype
+
+    @property
+    def is_sharded(self) -> bool:
+        return self.shard_count > 1
+
+    def shard_state(self, state: list, shard: int) -> list[torch.Tensor]:
+        """Returns the slabs of one shard from a sharded state."""
+        if not self.is_sharded:
+            return state
+        return [t.shards[shard].as_torch() for t in state]
+
+    def flatten_sharded_state(self, state: list) -> list[torch.Tensor]:
+        """Flattens a sharded state into its per-shard slabs, grouped by
+        slab. Exported programs take the slabs as separate arguments, which
+        keeps the program's signature per shard, though every shard still
+        executes on the same device."""
+        if not self.is_sharded:
+            return state
+        return [shard.as_torch() for t in state for shard in t.shards]
+
+    def unflatten_sharded_state(self, flat_state: list[torch.Tensor]) -> list:
+        """Inverse of flatten_sharded_state()."""
+        if not self.is_sharded:
+            return flat_state
+        assert len(flat_state) % self.shard_count == 0
+        return [
+            SplitPrimitiveTensor(shard_dim=1, ts=flat_state[i : i + self.shard_count])
+            for i in range(0, len(flat_state), self.shard_count)
+        ]
 
     def unflatten_page_table(self, state: list[torch.Tensor]) -> torch.Tensor:
         """Unflattens the 2D page table to a 6D tensor."""
-        assert len(state) == 1, f"Expected 1-element state. Got: {len(state)}"
+        state_count = 2 if self.is_quantized else 1
+        assert (
+            len(state) == state_count
+        ), f"Expected {state_count}-element state. Got: {len(state)}"
         page_slab = state[0]
         return page_slab.reshape(
             [
@@ -184,6 +272,19 @@ class PagedKVCache(BaseKVCache):
             ]
         )
 
+    def unflatten_scale_table(self, state: list[torch.Tensor]) -> torch.Tensor:
+        """Unflattens the 2D scale table of a quantized cache to a 4D tensor of
+        [page, transformer block, cache partition, head]."""
+        assert self.is_quantized and len(state) == 2
+        return state[1].reshape(
+            [
+                -1,
+                self.transformer_block_count,
+                self.cache_partition_count,
+                self.attn_head_count,
+            ]
+        )
+
     @property
     def pad_sequence_stride(self) -> int:
         return self.block_seq_stride
@@ -192,13 +293,30 @@ class PagedKVCache(BaseKVCache):
         """Allocates tensor state for a page table for the given capacity in
         pages.
         """
-        return [
+        if self.is_sharded:
+            shard_states = [
+                self.shard_cache.allocate(page_count) for _ in range(self.shard_count)
+            ]
+            return [
+                SplitPrimitiveTensor(shard_dim=1, ts=list(slabs))
+                for slabs in zip(*shard_states)
+            ]
+        state = [
             torch.empty(
                 [page_count, self.page_slab_flat_dim],
-                dtype=self.dtype,
+                dtype=self.cache_dtype,
                 device=self.device,
             )
         ]
+        if self.is_quantized:
+            state.append(
+                torch.empty(
+                    [page_count, self.page_scale_flat_dim],
+                    dtype=torch.float32,
+                    device=self.device,
+                )
+            )
+        return state
 
     def read(
         self,
@@ -248,6 +366,9 @@ class PagedKVCache(BaseKVCache):
         base_subblock_ids = page_ids * page_stride + (
             transformer_block_index * transformer_block_stride
         )
+        if self.is_quantized:
+            # [page * attn_layer * cache_partition, attn_head_count]
+            subblock_scales = self.unflatten_scale_table(state).flatten(0, 2)
 
         def read_cache_partition(index: int, into_partition: torch.Tensor):
             subblock_ids = (
@@ -261,17 +382,69 @@ class PagedKVCache(BaseKVCache):
             # copy of the sub-blocks by collapsing the first two dims so we have
             # a linear list.
             # TODO: Can be rewritten into inplace with out= on index_select.
-            selected = (
-                torch.index_select(subblock_table, 0, subblock_ids.flatten(0, 1))
-                .unflatten(0, blocked_shape[0:2])
-                .flatten(1, 2)
+            selected = torch.index_select(
+                subblock_table, 0, subblock_ids.flatten(0, 1)
             )
+            if self.is_quantized:
+                scales = torch.index_select(
+                    subblock_scales, 0, subblock_ids.flatten(0, 1)
+                )
+                selected = TensorScaledLayout(
+                    shape=list(selected.shape),
+                    d=scales[:, None, :, None],
+                    qs=selected,
+                    dtype=self.dtype,
+                ).dequant()
+            selected = selected.unflatten(0, blocked_shape[0:2]).flatten(1, 2)
             # trace_tensor("kv.selected", selected)
             into_partition[...] = selected
 
         for index, read_into_partition in enumerate(read_into_partitions):
             read_cache_partition(index, read_into_partition)
 
+    def attend_decode(
+        self,
+        state: list[torch.Tensor],
+        # [bs, attn_head_count * n_rep, attn_head_dim]
+        q: torch.Tensor,
+        *,
+        transformer_block_index: int,
+        # [bs]
+        seq_lens: torch.Tensor,
+        # [bs, max_seqlen // block_pos_stride]
+        page_ids: torch.Tensor,
+    ) -> torch.Tensor:
+        """Attends single position queries over the cached K/V in place.
+
+        Unlike read(), this does not materialize the K/V state: the fused
+        `paged_attention_decode` kernel gathers rows directly from the pages.
+        Only positions below seq_lens are attended. Query heads may be a
+        multiple of the cache's heads (GQA). Requires a K/V partitioned cache.
+        Quantized pages are dequantized inside the kernel.
+        """
+        assert self.cache_partition_count == 2
+        page_table = self.unflatten_page_table(state)  # 6D
+        subblock_table = page_table.flatten(start_dim=0, end_dim=2)
+        page_stride = self.transformer_block_count * self.cache_partition_count
+        transformer_block_stride = self.cache_partition_count
+        k_subblock_ids = page_ids * page_stride + (
+            transformer_block_index * transformer_block_stride
+        )
+        v_subblock_ids = k_subblock_ids + 1
+        if self.is_quantized:
+            subblock_scales = self.unflatten_scale_table(state).flatten(0, 2)
+            return kernels.paged_attention_decode_scaled(
+                q,
+                subblock_table,
+                subblock_scales,
+                k_subblock_ids,
+                v_subblock_ids,
+                seq_lens,
+            )
+        return kernels.paged_attention_decode(
+            q, subblock_table, k_subblock_ids, v_subblock_ids, seq_lens
+        )
+
     def write_timestep(
         self,
         state: list[torch.Tensor],
@@ -283,31 +456,239 @@ class PagedKVCache(BaseKVCache):
         seq_positions: torch.Tensor,
         # [bs, max_seqlen // block_pos_stride]
         page_ids: torch.Tensor,
+        # [bs, 1, 1, attn_head_dim // 2, 2]
+        k_rotary_mask: Optional[torch.Tensor] = None,
     ):
         """Writes a single batched timestep across all cache partitions.
 
-        Note that this internally loops over the batch size, which cannot be
-        dynamic.
+        All rows and partitions are written by a single scatter, so the batch
+        size may be dynamic. If `k_rotary_mask` is given (from
+        `RotaryEmbeddingLayer.compute_batch_mask`), the K partition is written
+        rotary embedded: the rotation produces the scattered rows, so K is not
+        separately rotated and then copied into the cache.
         """
-        device = self.device
+        if k_rotary_mask is not None:
+            cache_partitions = [
+                apply_rotary_embedding(cache_partitions[0], k_rotary_mask),
+                *cache_partitions[1:],
+            ]
+        if self.is_quantized:
+            self._write_quantized(
+                state,
+                cache_partitions,
+                transformer_block_index=transformer_block_index,
+                start_positions=seq_positions,
+                seq_lens=seq_positions + 1,
+                page_ids=page_ids,
+            )
+            return
         page_table = self.unflatten_page_table(state)  # 6D
         bs, *_ = seq_positions.shape
         assert len(cache_partitions) == self.cache_partition_count
-        for i in range(bs):
-            position = seq_positions[i]
-            # TODO: Let's clamp to the allowable range so that we don't need
-            # an assert.
-            page_id = page_ids[i, :].index_select(0, position // self.block_seq_stride)
-            page_offset = position % self.block_seq_stride
-            for partition_index in range(self.cache_partition_count):
-                cache_partition = cache_partitions[partition_index]
-                indices = (
-                    page_id,
-                    torch.tensor([transformer_block_index], device=device),
-                    torch.tensor([partition_index], device=device),
-                    page_offset.unsqueeze(0),
-                )
-                page_table.index_put_(indices=indices, values=cache_partition[i, 0])
+        # TODO: Let's clamp to the allowable range so that we don't need
+        # an assert.
+        page_id = torch.gather(
+            page_ids, 1, (seq_positions // self.block_seq_stride).unsqueeze(1)
+        )
+        page_offset = (seq_positions % self.block_seq_stride).unsqueeze(1)
+        self._scatter_partitions(
+            page_table,
+            # [bs, 1, attn_head_count, attn_head_dim] each
+            cache_partitions,
+            transformer_block_index=transformer_block_index,
+            page_id=page_id,
+            page_offset=page_offset,
+        )
+
+    def _scatter_partitions(
+        self,
+        page_table: torch.Tensor,
+        # List of [bs, sl, attn_head_count, attn_head_dim]
+        cache_partitions: list[torch.Tensor],
+        *,
+        transformer_block_index: int,
+        # [bs, sl]
+        page_id: torch.Tensor,
+        # [bs, sl]
+        page_offset: torch.Tensor,
+    ):
+        """Scatters rows of all cache partitions into the page table with one
+        index_put_ over a [bs, sl, partition] index grid."""
+        partition_count = self.cache_partition_count
+        bs, sl = page_id.shape
+        grid_shape = [bs, sl, partition_count]
+        partition_index = torch.arange(
+            partition_count, device=page_id.device
+        ).expand(grid_shape)
+        indices = (
+            page_id.unsqueeze(2).expand(grid_shape),
+            torch.full_like(partition_index, transformer_block_index),
+            partition_index,
+            page_offset.unsqueeze(2).expand(grid_shape),
+        )
+        # [bs, sl, partition, attn_head_count, attn_head_dim]
+        values = torch.stack(cache_partitions, dim=2)
+        page_table.index_put_(indices=indices, values=values)
+
+    def write_range(
+        self,
+        state: list[torch.Tensor],
+        # List of [bs, chunk_len, attn_head_count, attn_head_dim]
+        cache_partitions: list[torch.Tensor],
+        *,
+        transformer_block_index: int,
+        # [bs]
+        start_positions: torch.Tensor,
+        # [bs]
+        seq_lens: torch.Tensor,
+        # [bs, max_seqlen // block_pos_stride]
+        page_ids: torch.Tensor,
+    ):
+        """Writes a batch of position ranges across all cache partitions.
+
+        Row i of each cache partition holds positions starting at
+        start_positions[i], of which those below seq_lens[i] are written.
+        Padding positions are redirected onto the row's last valid position
+        (with its value) so that pages past the valid range are never touched.
+        Every row must have seq_lens[i] > start_positions[i].
+        """
+        if self.is_quantized:
+            self._write_quantized(
+                state,
+                cache_partitions,
+                transformer_block_index=transformer_block_index,
+                start_positions=start_positions,
+                seq_lens=seq_lens,
+                page_ids=page_ids,
+            )
+            return
+        page_table = self.unflatten_page_table(state)  # 6D
+        bs, chunk_len, *_ = cache_partitions[0].shape
+        assert len(cache_partitions) == self.cache_partition_count
+
+        # [bs, chunk_len] index of the chunk row written at each position.
+        chunk_index = torch.arange(chunk_len, device=page_ids.device).unsqueeze(0)
+        last_index = (seq_lens - start_positions - 1).unsqueeze(1)
+        chunk_index = torch.minimum(chunk_index, last_index).clamp(min=0)
+        positions = start_positions.unsqueeze(1) + chunk_index
+        page_id = torch.gather(page_ids, 1, positions // self.block_seq_stride)
+        page_offset = positions % self.block_seq_stride
+
+        gather_index = chunk_index[:, :, None, None].expand(
+            bs, chunk_len, self.attn_head_count, self.attn_head_dim
+        )
+        self._scatter_partitions(
+            page_table,
+            [torch.gather(p, 1, gather_index) for p in cache_partitions],
+            transformer_block_index=transformer_block_index,
+            page_id=page_id,
+            page_offset=page_offset,
+        )
+
+    def _write_quantized(
+        self,
+        state: list[torch.Tensor],
+        # List of [bs, chunk_len, attn_head_count, attn_head_dim]
+        cache_partitions: list[torch.Tensor],
+        *,
+        transformer_block_index: int,
+        # [bs]
+        start_positions: torch.Tensor,
+        # [bs]
+        seq_lens: torch.Tensor,
+        # [bs, max_seqlen // block_pos_stride]
+        page_ids: torch.Tensor,
+        block_count: Optional[int] = None,
+    ):
+        """Writes positions [start_positions, seq_lens) of each row to a
+        quantized page table by requantizing every touched sub-block.
+
+        `block_count` is the number of pages touched per row. It defaults to
+        the most that chunk_len contiguous positions can span.
+        """
+        page_table = self.unflatten_page_table(state)  # 6D
+        scale_table = self.unflatten_scale_table(state)  # 4D
+        bs, chunk_len, *_ = cache_partitions[0].shape
+        assert len(cache_partitions) == self.cache_partition_count
+        device = page_ids.device
+        stride = self.block_seq_stride
+        if block_count is None:
+            block_count = (chunk_len + stride - 2) // stride + 1
+
+        # [bs, block_count] pages touched by each row. Slots past the row's
+        # last page are clamped onto it and rewrite identical contents.
+        block_index = (start_positions // stride).unsqueeze(1) + torch.arange(
+            block_count, device=device
+        )
+        block_index = torch.minimum(block_index, ((seq_lens - 1) // stride)[:, None])
+        page_id = torch.gather(page_ids, 1, block_index)
+        partition_count = self.cache_partition_count
+        grid_shape = [bs, block_count, partition_count]
+        partition_index = torch.arange(partition_count, device=device).expand(
+            grid_shape
+        )
+        indices = (
+            page_id.unsqueeze(2).expand(grid_shape),
+            torch.full_like(partition_index, transformer_block_index),
+            partition_index,
+        )
+
+        # [bs, block_count, stride] sequence position of every page entry.
+        positions = (block_index * stride).unsqueeze(2) + torch.arange(
+            stride, device=device
+        )
+        is_old = (positions < start_positions[:, None, None])[:, :, None, :, None, None]
+        is_new = (positions < seq_lens[:, None, None])[:, :, None, :, None, None]
+
+        # [bs, block_count, partition, stride, attn_head_count, attn_head_dim]
+        old_scales = scale_table[indices]
+        old = TensorScaledLayout(
+            shape=grid_shape + [stride, self.attn_head_count, self.attn_head_dim],
+            d=old_scales[:, :, :, None, :, None],
+            qs=page_table[indices],
+            dtype=torch.float32,
+        ).dequant()
+        chunk_index = (positions - start_positions[:, None, None]).clamp(
+            0, chunk_len - 1
+        )
+        # [bs, chunk_len, partition, attn_head_count, attn_head_dim]
+        new = torch.stack(cache_partitions, dim=2).to(torch.float32)
+        new = new[torch.arange(bs, device=device)[:, None, None], chunk_index]
+        new = new.permute(0, 1, 3, 2, 4, 5)
+        # Selecting (rather than masking arithmetically) keeps stale or
+        # uninitialized entries, which may be NaN, out of the result.
+        merged = torch.where(
+            is_old, old, torch.where(is_new, new, torch.zeros_like(new))
+        )
+
+        # [bs, block_count, partition, attn_head_count] dequantization scales.
+        # Pages continued from an earlier write never shrink their scale, so
+        # their earlier positions only lose precision when new values exceed
+        # the page's range.
+        if self.cache_dtype.is_floating_point:
+            finfo = torch.finfo(self.cache_dtype)
+            qmax, eps = finfo.max, finfo.eps
+        else:
+            qmax, eps = torch.iinfo(self.cache_dtype).max, 1e-6
+        scales = merged.abs().amax(dim=(3, 5)).clamp(eps) / qmax
+        continued = (block_index * stride < start_positions[:, None])[:, :, None, None]
+        scales = torch.where(continued, torch.maximum(scales, old_scales), scales)
+
+        # Quantize with the scale along a single flattened page-head axis.
+        quantizer = StaticScaledQuantizer(
+            scale=(1.0 / scales).flatten(),
+            reciprocal_scale=scales.flatten(),
+            axis=0,
+            dtype=self.cache_dtype,
+        )
+        qs = (
+            quantizer.quantize(merged.transpose(3, 4).flatten(0, 3))
+            .unpack()
+            .qs.unflatten(0, list(scales.shape))
+            .transpose(3, 4)
+        )
+        page_table.index_put_(indices=indices, values=qs)
+        scale_table.index_put_(indices=indices, values=scales)
 
     def write(
         self,
@@ -322,9 +703,23 @@ class PagedKVCache(BaseKVCache):
         This is the inverse of the linear read. The same caveat applies if the
         in-place scatter cannot be fused.
         """
+        bs, block_seq_len, *_ = page_ids.shape
+        if self.is_quantized:
+            start_positions = torch.zeros(
+                [bs], dtype=torch.int64, device=page_ids.device
+            )
+            self._write_quantized(
+                state,
+                cache_partitions,
+                transformer_block_index=transformer_block_index,
+                start_positions=start_positions,
+                seq_lens=start_positions + block_seq_len * self.block_seq_stride,
+                page_ids=page_ids,
+                block_count=block_seq_len,
+            )
+            return
         page_table = self.unflatten_page_table(state)  # 6D
 
-        bs, block_seq_len, *_ = page_ids.shape
         # Blocks dim 1,2 according to the configured block stride.
         blocked_shape = [
             bs,
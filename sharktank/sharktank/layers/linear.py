@@ -20,6 +20,7 @@ from ..types import (
 )
 
 __all__ = [
+    "FusedLinearLayer",
     "LinearLayer",
 ]
 
@@ -77,3 +78,22 @@ class LinearLayer(ThetaLayer):
         if isinstance(y, QuantizedTensor):
             y = y.unpack().dequant()
         return y
+
+
+class FusedLinearLayer(LinearLayer):
+    """LinearLayer over the concatenated output features of several linear
+    layers which share their input, as fused by `FuseProjectionsTransform`.
+
+    Computes all projections with one matmul and returns the output of each,
+    given the output feature counts of the fused layers.
+    """
+
+    def __init__(self, theta: Theta, *, split_sizes: list[int], **kwargs):
+        super().__init__(theta, **kwargs)
+        assert (
+            sum(split_sizes) == self.weight.shape[0]
+        ), f"Split sizes {split_sizes} do not cover {self.weight.shape[0]} features"
+        self.split_sizes = split_sizes
+
+    def forward(self, x) -> tuple[torch.Tensor, ...]:
+        return torch.split(super().forward(x), self.split_sizes, dim=-1)
@@ -11,8 +11,35 @@ import torch
 from .base import BaseLayer
 
 
+__all__ = [
+    "RotaryEmbeddingLayer",
+    "apply_rotary_embedding",
+]
+
+
+def apply_rotary_embedding(x: torch.Tensor, table: torch.Tensor) -> torch.Tensor:
+    """Rotates the interleaved pairs of the last dim of `x` by `table`.
+
+    `table` holds real-valued (cos, sin) pairs in its last dim and must
+    broadcast against `x.unflatten(-1, (-1, 2))`. The rotation is computed in
+    the table's dtype and returned as the dtype of `x`.
+    """
+    pairs = x.unflatten(-1, (-1, 2))
+    x_even, x_odd = pairs[..., 0], pairs[..., 1]
+    cos, sin = table[..., 0], table[..., 1]
+    rotated = torch.stack(
+        [x_even * cos - x_odd * sin, x_even * sin + x_odd * cos], dim=-1
+    )
+    return rotated.flatten(-2).type_as(x)
+
+
 class RotaryEmbeddingLayer(BaseLayer):
-    """Computes a rotary embedding in the style popularized by llama (RoPE)."""
+    """Computes a rotary embedding in the style popularized by llama (RoPE).
+
+    The embedding is kept as a real-valued table of (cos, sin) pairs rather
+    than as complex numbers, which export poorly, and applied by
+    `apply_rotary_embedding`.
+    """
 
     def __init__(
         self,
@@ -29,23 +56,22 @@ class RotaryEmbeddingLayer(BaseLayer):
         )
 
     def forward(self, *, xq: torch.Tensor, xk: torch.Tensor, start_index: int):
-        # xq_, xk_ shape: bs, sl, _, dim
-        # freqs_cis shape: max_sl, dim
-        xq_ = torch.view_as_complex(xq.reshape(*xq.shape[:-1], -1, 2))
-        xk_ = torch.view_as_complex(xk.reshape(*xk.shape[:-1], -1, 2))
-        _, sl, _, dim = xq_.shape
+        # xq, xk shape: bs, sl, _, dim
+        # table shape: max_sl, dim // 2, 2
+        _, sl, _, dim = xq.shape
 
         # Offset the table based on starting position.
-        freqs_cis = self._table[start_index : start_index + sl, :]
-        assert freqs_cis.shape[-1] == dim
+        table = self._table[start_index : start_index + sl]
+        assert table.shape[-2] * 2 == dim
         assert (
-            freqs_cis.shape[0] >= sl
-        ), f"Sequence length longer than embedding table ({sl} vs {freqs_cis.shape[0]})"
+            table.shape[0] >= sl
+        ), f"Sequence length longer than embedding table ({sl} vs {table.shape[0]})"
 
-        broadcast_freqs_cis = freqs_cis[None, 0:sl, None, :]
-        xq_out = torch.view_as_real(xq_ * broadcast_freqs_cis).flatten(3)
-        xk_out = torch.view_as_real(xk_ * broadcast_freqs_cis).flatten(3)
-        return xq_out.type_as(xq), xk_out.type_as(xk)
+        broadcast_table = table[None, 0:sl, None]
+        return (
+            apply_rotary_embedding(xq, broadcast_table),
+            apply_rotary_embedding(xk, broadcast_table),
+        )
 
     def compute_batch_mask(
         self, start_positions: torch.Tensor, batch_seq_len: int
@@ -57,7 +83,8 @@ class RotaryEmbeddingLayer(BaseLayer):
             in the batch.
           batch_seq_len: The sequence length dimension of the batch.
         Returns:
-          Tensor of [bs, sl, 1, d] that will be later passed to apply_batch_mask.
+          Tensor of [bs, sl, 1, d // 2, 2] that will be later passed to
+          apply_batch_mask, or to `apply_rotary_embedding`.
         """
         self.trace_tensor("rope.start_positions", start_positions)
         positions_seq = torch.arange(0, batch_seq_len, device=self.device).unsqueeze(
@@ -65,11 +92,10 @@ class RotaryEmbeddingLayer(BaseLayer):
         ) + start_positions.unsqueeze(1)
         # Broadcast lookup to [b, ...].
         self.trace_tensor("rope.positions_seq", positions_seq)
-        freqs_cis = self._table[positions_seq]
+        table = self._table[positions_seq]
 
         # Unsqueeze a unit dim for attention heads.
-        broadcast_freqs_cis = freqs_cis.unsqueeze(2)
-        return broadcast_freqs_cis
+        return table.unsqueeze(2)
 
     def apply_batched_mask(
         self, *, xq: torch.Tensor, xk: torch.Tensor, mask: torch.Tensor
@@ -79,17 +105,9 @@ class RotaryEmbeddingLayer(BaseLayer):
         This does a more complicated indexing operation for cases when the each
         sequence in the batch has a potentially different start position.
 
-        positions should be of [bs, sl] and enumerate positions of all tokens.
+        mask should be from compute_batch_mask for the positions of all tokens.
         """
-        # xq_, xk_ shape: bs, sl, _, dim
-        # freqs_cis shape: max_sl, dim
-        xq_ = torch.view_as_complex(xq.reshape(*xq.shape[:-1], -1, 2))
-        xk_ = torch.view_as_complex(xk.reshape(*xk.shape[:-1], -1, 2))
-        _, sl, _, dim = xq_.shape
-
-        xq_out = torch.view_as_real(xq_ * mask).flatten(3)
-        xk_out = torch.view_as_real(xk_ * mask).flatten(3)
-        return xq_out.type_as(xq), xk_out.type_as(xk)
+        return apply_rotary_embedding(xq, mask), apply_rotary_embedding(xk, mask)
 
     def _create_rotary_embed_table(
         self,
@@ -103,5 +121,5 @@ class RotaryEmbeddingLayer(BaseLayer):
         )
         t = torch.arange(max_seqlen, device=freqs.device)
         freqs = torch.outer(t, freqs).float()
-        freqs_cis = torch.polar(torch.ones_like(freqs), freqs)
-        return freqs_cis
+        # [max_seqlen, dim // 2, 2] of (cos, sin).
+        return torch.stack([torch.cos(freqs), torch.sin(freqs)], dim=-1)
@@ -15,10 +15,12 @@ import torch.nn.functional as F
 
 from ...layers import *
 from ...types import *
+from ... import ops
 
 __all__ = [
     "LlamaModelConfig",
     "PagedLlamaModelV1",
+    "ShardedPagedLlamaAttentionBlock",
 ]
 
 ################################################################################
@@ -46,9 +48,33 @@ class LlamaModelConfig:
     # Dtype to use for attention.
     attention_dtype: torch.dtype = torch.float16
 
+    # Dtype that a paged KV cache stores K/V pages in. If set to a quantized
+    # type (int8 or fp8), pages carry per-page-per-head scales and are
+    # dequantized to attention_dtype on read. Defaults to attention_dtype.
+    kv_cache_dtype: Optional[torch.dtype] = None
+
+    # Whether decode steps with a paged cache use the fused
+    # paged_attention_decode kernel, which reads K/V pages in place, instead
+    # of materializing the K/V state and attending with generic matmuls.
+    use_paged_attention_kernel: bool = False
+
+    # Whether prefill attends with the tiled flash_attention kernel, which
+    # computes the causal and length masks rather than reading a
+    # [bs, 1, sl, kv_sl] mask and never materializes the attention scores.
+    # Prefill then takes seq_lens and no attention_mask.
+    use_flash_attention: bool = False
+
+    # Number of tensor parallel shards. If greater than one, the model theta
+    # must be sharded with `sharding.LlamaSharding` and the paged KV cache is
+    # partitioned by attention heads across shards.
+    tensor_parallelism_size: int = 1
+
     def create_kv_cache(self) -> BaseKVCache:
         hp = self.hp
         if self.kv_cache_type == "direct":
+            assert (
+                self.tensor_parallelism_size == 1
+            ), "Tensor parallelism requires a paged KV cache"
             return DirectKVCache(
                 block_seq_stride=self.block_seq_stride,
                 transformer_block_count=hp.block_count,
@@ -67,6 +93,8 @@ class LlamaModelConfig:
                 block_seq_stride=self.block_seq_stride,
                 device=self.device,
                 dtype=self.attention_dtype,
+                cache_dtype=self.kv_cache_dtype,
+                shard_count=self.tensor_parallelism_size,
             )
         else:
             raise NotImplementedError(f"kv_cache_type = {self.kv_cache_type}")
@@ -96,11 +124,22 @@ class PagedLlamaModelV1(BaseCausalLMModel):
     7. Iteratively invoke decode() for as long as there are sequences needing
        to be serviced.
 
+    Long prompts can instead be prefilled incrementally with prefill_chunk(),
+    which processes a slice of positions per sequence at an offset, attending
+    to earlier positions from the paged cache. A chunk of length one at a
+    sequence's current length is equivalent to a decode step, allowing prefill
+    chunks and decode rows to share an invocation.
+
     Various samplers and schedulers can be interleaved throughout.
+
+    With tensor parallelism, each attention block runs on every shard over
+    the shard's attention heads and FFN slice, and cache_state is the list of
+    SplitPrimitiveTensor slabs returned by the sharded cache's allocate().
     """
 
     def __init__(self, theta: Theta, config: LlamaModelConfig):
         hp = config.hp
+        tensor_parallelism_size = config.tensor_parallelism_size
         super().__init__(
             theta,
             context_length=config.hp.context_length,
@@ -112,9 +151,18 @@ class PagedLlamaModelV1(BaseCausalLMModel):
         self.hp = hp
         self.cache = config.create_kv_cache()
         self.activation_dtype = config.activation_dtype
+
+        def replicated_theta(name: str) -> Theta:
+            # Replicated layers run once, using the first shard's copy.
+            if tensor_parallelism_size == 1:
+                return theta(name)
+            return _shard_theta(theta(name), 0)
+
         self.add_module(
             "token_embedding",
-            TokenEmbeddingLayer(theta("token_embd"), dtype=config.activation_dtype),
+            TokenEmbeddingLayer(
+                replicated_theta("token_embd"), dtype=config.activation_dtype
+            ),
         )
         self.add_module(
             "attention_embedding",
@@ -127,14 +175,20 @@ class PagedLlamaModelV1(BaseCausalLMModel):
         self.add_module(
             "output_norm",
             RMSNormLayer(
-                theta("output_norm"), epsilon=self.hp.attention_layer_norm_rms_epsilon
+                replicated_theta("output_norm"),
+                epsilon=self.hp.attention_layer_norm_rms_epsilon,
             ),
         )
-        self.add_module("output_lm_head", LinearLayer(theta("output")))
+        self.add_module("output_lm_head", LinearLayer(replicated_theta("output")))
 
+        block_class = (
+            PagedLlamaAttentionBlock
+            if tensor_parallelism_size == 1
+            else ShardedPagedLlamaAttentionBlock
+        )
         self.attn_blocks = nn.ModuleList(
             [
-                PagedLlamaAttentionBlock(
+                block_class(
                     theta("blk", n),
                     block_index=n,
                     cache=self.cache,
@@ -142,6 +196,8 @@ class PagedLlamaModelV1(BaseCausalLMModel):
                     head_dim=hp.attn_head_dim,
                     head_count_kv=hp.attention_head_count_kv,
                     rms_epsilon=hp.attention_layer_norm_rms_epsilon,
+                    use_paged_attention_kernel=config.use_paged_attention_kernel,
+                    use_flash_attention=config.use_flash_attention,
                 )
                 for n in range(hp.block_count)
             ]
@@ -153,13 +209,17 @@ class PagedLlamaModelV1(BaseCausalLMModel):
         tokens: torch.Tensor,
         *,
         # [1, 1, batch_seq_len, batch_seq_len]
-        attention_mask: torch.Tensor,
+        attention_mask: Optional[torch.Tensor] = None,
         # [bs, batch_seq_len // block_seq_stride]
         seq_block_ids: torch.Tensor,
         cache_state: list[torch.Tensor],
+        # [bs] of sequence lengths, in place of the mask with flash attention
+        seq_lens: Optional[torch.Tensor] = None,
     ):
+        self._assert_attention_args(attention_mask, seq_lens)
         self._assert_device(tokens)
-        self._assert_device(attention_mask, dtype=self.activation_dtype)
+        if attention_mask is not None:
+            self._assert_device(attention_mask, dtype=self.activation_dtype)
         self._assert_device(seq_block_ids)
         self._assert_device(*cache_state, dtype=self.activation_dtype)
         h = self.token_embedding(tokens)
@@ -174,8 +234,81 @@ class PagedLlamaModelV1(BaseCausalLMModel):
                 embedding=self.attention_embedding,
                 start_index=0,
                 attention_mask=attention_mask,
+                prefill_seq_lens=seq_lens,
+                cache_state=cache_state,
+                seq_block_ids=seq_block_ids,
+            )
+            self.trace_tensor(f"llama.attn_block.{block_idx}.output", h)
+
+        h = self.output_norm(h)
+        logits = self.output_lm_head(h)
+        return logits
+
+    def prefill_chunk(
+        self,
+        # [bs, chunk_len]
+        tokens: torch.Tensor,
+        *,
+        # [bs, 1, chunk_len, batch_seq_len]
+        attention_mask: Optional[torch.Tensor] = None,
+        # [bs] of positions of the first token of each row
+        start_positions: torch.Tensor,
+        # [bs] of sequence lengths through the end of each row's chunk
+        seq_lens: torch.Tensor,
+        # [bs, batch_seq_len // block_seq_stride]
+        seq_block_ids: torch.Tensor,
+        cache_state: list[torch.Tensor],
+    ):
+        """Prefills positions [start_positions, seq_lens) of each sequence.
+
+        Returns logits for every chunk position. The block table must cover
+        start_positions + chunk_len positions of every row.
+        """
+        assert self.cache.is_paged, "Chunked prefill requires a paged cache"
+        self._assert_attention_args(attention_mask, seq_lens)
+        self._assert_device(tokens)
+        if attention_mask is not None:
+            self._assert_device(attention_mask, dtype=self.activation_dtype)
+        self._assert_device(start_positions)
+        self._assert_device(seq_lens)
+        self._assert_device(*cache_state, dtype=self.activation_dtype)
+        bs, chunk_len = tokens.shape
+        embedding_batch_mask = self.attention_embedding.compute_batch_mask(
+            start_positions, batch_seq_len=chunk_len
+        )
+        self.trace_tensor("llama.embedding_batch_mask", embedding_batch_mask)
+
+        # Temporaries to materialize each block's K/V state from the cache.
+        xk_temp = torch.empty(
+            [
+                bs,
+                self.context_length,
+                self.cache.attn_head_count,
+                self.hp.attn_head_dim,
+            ],
+            dtype=self.config.activation_dtype,
+            device=self.device,
+        )
+        xv_temp = torch.empty_like(xk_temp)
+
+        h = self.token_embedding(tokens)
+        self.trace_tensor("llama.token_embedding", h)
+
+        # Iterate over attention blocks.
+        for block_idx, block in enumerate(self.attn_blocks):
+            if block_idx == 0:
+                self.trace_tensor(f"llama.attn_block.{block_idx}.input", h)
+            h = block(
+                h,
+                start_positions=start_positions,
+                seq_lens=seq_lens,
+                embedding=self.attention_embedding,
+                embedding_batch_mask=embedding_batch_mask,
+                attention_mask=attention_mask,
                 cache_state=cache_state,
                 seq_block_ids=seq_block_ids,
+                xk_temp=xk_temp,
+                xv_temp=xv_temp,
             )
             self.trace_tensor(f"llama.attn_block.{block_idx}.output", h)
 
@@ -183,6 +316,15 @@ class PagedLlamaModelV1(BaseCausalLMModel):
         logits = self.output_lm_head(h)
         return logits
 
+    def _assert_attention_args(
+        self, attention_mask: Optional[torch.Tensor], seq_lens: Optional[torch.Tensor]
+    ):
+        """Prefill takes a mask, or sequence lengths with flash attention."""
+        if self.config.use_flash_attention:
+            assert seq_lens is not None, "Flash attention prefill requires seq_lens"
+        else:
+            assert attention_mask is not None, "Prefill requires an attention_mask"
+
     def decode(
         self,
         # [bs, 1]
@@ -209,12 +351,12 @@ class PagedLlamaModelV1(BaseCausalLMModel):
         self.trace_tensor("llama.embedding_batch_mask", embedding_batch_mask)
 
         # Allocate per-block temporary K/V tensors. These temporaries hold
-        # one block's K/V state for the maximum context length.
+        # one block's K/V state of one shard for the maximum context length.
         xk_temp = torch.empty(
             [
                 bs,
                 self.context_length,
-                self.hp.attention_head_count_kv,
+                self.cache.attn_head_count,
                 self.hp.attn_head_dim,
             ],
             dtype=self.config.activation_dtype,
@@ -224,7 +366,7 @@ class PagedLlamaModelV1(BaseCausalLMModel):
             [
                 bs,
                 self.context_length,
-                self.hp.attention_head_count_kv,
+                self.cache.attn_head_count,
                 self.hp.attn_head_dim,
             ],
             dtype=self.config.activation_dtype,
@@ -275,20 +417,43 @@ class PagedLlamaAttentionBlock(ThetaLayer):
         head_dim: int,
         head_count_kv: int,
         rms_epsilon: float,
+        use_paged_attention_kernel: bool = False,
+        use_flash_attention: bool = False,
     ):
         super().__init__(theta)
         self.add_module(
             "attn_norm", RMSNormLayer(theta("attn_norm"), epsilon=rms_epsilon)
         )
-        self.add_module("attn_q", LinearLayer(theta("attn_q")))
-        self.add_module("attn_k", LinearLayer(theta("attn_k")))
-        self.add_module("attn_v", LinearLayer(theta("attn_v")))
+        # The Q/K/V and FFN gate/up projections may each have been fused into
+        # one layer by FuseProjectionsTransform.
+        self.fused_qkv = "attn_qkv" in theta.keys
+        if self.fused_qkv:
+            kv_dim = head_count_kv * head_dim
+            self.add_module(
+                "attn_qkv",
+                FusedLinearLayer(
+                    theta("attn_qkv"),
+                    split_sizes=[head_count * head_dim, kv_dim, kv_dim],
+                ),
+            )
+        else:
+            self.add_module("attn_q", LinearLayer(theta("attn_q")))
+            self.add_module("attn_k", LinearLayer(theta("attn_k")))
+            self.add_module("attn_v", LinearLayer(theta("attn_v")))
         self.add_module("attn_output", LinearLayer(theta("attn_output")))
         self.add_module(
             "ffn_norm", RMSNormLayer(theta("ffn_norm"), epsilon=rms_epsilon)
         )
-        self.add_module("ffn_gate", LinearLayer(theta("ffn_gate")))
-        self.add_module("ffn_up", LinearLayer(theta("ffn_up")))
+        self.fused_ffn_gate_up = "ffn_gate_up" in theta.keys
+        if self.fused_ffn_gate_up:
+            ffn_dim = theta.tensor("ffn_gate_up", "weight").shape[0] // 2
+            self.add_module(
+                "ffn_gate_up",
+                FusedLinearLayer(theta("ffn_gate_up"), split_sizes=[ffn_dim, ffn_dim]),
+            )
+        else:
+            self.add_module("ffn_gate", LinearLayer(theta("ffn_gate")))
+            self.add_module("ffn_up", LinearLayer(theta("ffn_up")))
         self.add_module("ffn_down", LinearLayer(theta("ffn_down")))
 
         self.block_index = block_index
@@ -296,8 +461,15 @@ class PagedLlamaAttentionBlock(ThetaLayer):
         self.head_count = head_count
         self.head_dim = head_dim
         self.head_count_kv = head_count_kv
+        self.use_paged_attention_kernel = use_paged_attention_kernel
+        self.use_flash_attention = use_flash_attention
 
-    def forward(
+    def forward(self, h: torch.Tensor, **kwargs):
+        """Applies the block. Takes the arguments of attention_output()."""
+        h = h + self.attention_output(h, **kwargs)
+        return h + self.feed_forward(h)
+
+    def attention_output(
         self,
         h: torch.Tensor,
         *,
@@ -306,110 +478,224 @@ class PagedLlamaAttentionBlock(ThetaLayer):
         seq_block_ids: torch.Tensor,
         start_index: Optional[int] = None,
         start_positions: Optional[torch.Tensor] = None,
+        seq_lens: Optional[torch.Tensor] = None,
         attention_mask: Optional[torch.Tensor] = None,
+        prefill_seq_lens: Optional[torch.Tensor] = None,
         embedding_batch_mask: Optional[torch.Tensor] = None,
         cache_state: list[torch.Tensor] = None,
         xk_temp: Optional[torch.Tensor] = None,
         xv_temp: Optional[torch.Tensor] = None,
     ):
+        """Returns the projected self attention output of the block, without
+        the residual."""
         assert bool(start_index is not None) ^ bool(embedding_batch_mask is not None)
 
         x = self.attn_norm(h)
 
-        bs, batch_seq_len, feature_dim = x.shape
-        assert feature_dim == self.head_count * self.head_dim
+        bs, batch_seq_len, _ = x.shape
 
-        xq = self.attn_q(x)
-        xk = self.attn_k(x)
-        xv = self.attn_v(x)
+        if self.fused_qkv:
+            xq, xk, xv = self.attn_qkv(x)
+        else:
+            xq = self.attn_q(x)
+            xk = self.attn_k(x)
+            xv = self.attn_v(x)
+        assert xq.shape[-1] == self.head_count * self.head_dim
 
         xq = xq.view(bs, batch_seq_len, self.head_count, self.head_dim)
         xk = xk.view(bs, batch_seq_len, self.head_count_kv, self.head_dim)
         xv = xv.view(bs, batch_seq_len, self.head_count_kv, self.head_dim)
 
+        # A paged decode step only reads K back from the cache, so K is rotated
+        # as write_timestep stores it rather than in a separate pass.
+        paged_decode = (
+            self.cache.is_paged and start_positions is not None and seq_lens is None
+        )
+        k_rotary_mask = None
         # Fast path to start_index based embedding lookup if available.
         # Falls back to a slower position based index lookup.
         if start_index is not None:
             xq, xk = embedding.forward(xq=xq, xk=xk, start_index=start_index)
+        elif paged_decode:
+            xq = apply_rotary_embedding(xq, embedding_batch_mask)
+            k_rotary_mask = embedding_batch_mask
         else:
             xq, xk = embedding.apply_batched_mask(
                 xq=xq, xk=xk, mask=embedding_batch_mask
             )
 
-        # Full sequence length.
-        kv_seq_len = seq_block_ids.shape[1] * self.cache.block_seq_stride
-
-        if self.cache.is_paged:
-            xk, xv = self.transact_cache_paged(
+        if self.use_paged_attention_kernel and paged_decode:
+            # Decode with the fused kernel, which reads K/V pages in place.
+            attn_output = self.attend_paged_decode(
+                xq=xq,
                 xk_cache_update=xk,
                 xv_cache_update=xv,
                 seq_block_ids=seq_block_ids,
-                kv_seq_len=kv_seq_len,
-                start_positions=start_positions,
-                cache_state=cache_state,
-                xk_temp=xk_temp,
-                xv_temp=xv_temp,
-            )
-        elif self.cache.is_direct:
-            xk, xv = self.transact_cache_direct(
-                xk_cache_update=xk,
-                xv_cache_update=xv,
                 start_positions=start_positions,
-                kv_seq_len=kv_seq_len,
                 cache_state=cache_state,
+                k_rotary_mask=k_rotary_mask,
             )
         else:
-            raise NotImplementedError(f"Unsupported KV cache type: {type(self.cache)}")
-
-        # Expand kv heads for GQA.
-        gqa_n_rep = self.head_count // self.head_count_kv
-        assert gqa_n_rep > 0
-        if gqa_n_rep > 1:
-
-            def repeat_kv(x: torch.Tensor) -> torch.Tensor:
-                bs, slen, n_kv_heads, head_dim = x.shape
-                return (
-                    x.unsqueeze(-2)
-                    .expand(bs, slen, n_kv_heads, gqa_n_rep, head_dim)
-                    .reshape(bs, slen, n_kv_heads * gqa_n_rep, head_dim)
+            # Full sequence length.
+            kv_seq_len = seq_block_ids.shape[1] * self.cache.block_seq_stride
+
+            if self.cache.is_paged:
+                xk, xv = self.transact_cache_paged(
+                    xk_cache_update=xk,
+                    xv_cache_update=xv,
+                    seq_block_ids=seq_block_ids,
+                    kv_seq_len=kv_seq_len,
+                    start_positions=start_positions,
+                    seq_lens=seq_lens,
+                    cache_state=cache_state,
+                    xk_temp=xk_temp,
+                    xv_temp=xv_temp,
+                    k_rotary_mask=k_rotary_mask,
+                )
+            elif self.cache.is_direct:
+                assert seq_lens is None, "Chunked prefill requires a paged cache"
+                xk, xv = self.transact_cache_direct(
+                    xk_cache_update=xk,
+                    xv_cache_update=xv,
+                    start_positions=start_positions,
+                    kv_seq_len=kv_seq_len,
+                    cache_state=cache_state,
+                )
+            else:
+                raise NotImplementedError(
+                    f"Unsupported KV cache type: {type(self.cache)}"
                 )
 
-            xk = repeat_kv(xk)
-            xv = repeat_kv(xv)
-
-        # Tranpose into [bs, heads, sl, dim]
-        xq = xq.transpose(1, 2)
-        keys = xk.transpose(1, 2)
-        values = xv.transpose(1, 2)
+            if self.use_flash_attention and (
+                seq_lens is not None or prefill_seq_lens is not None
+            ):
+                # Prefill with the masks computed by the kernel.
+                attn_output = self.attend_flash(
+                    xq=xq,
+                    xk=xk,
+                    xv=xv,
+                    start_positions=start_positions,
+                    seq_lens=seq_lens if seq_lens is not None else prefill_seq_lens,
+                )
+                return self.attn_output(attn_output)
+
+            # Expand kv heads for GQA.
+            gqa_n_rep = self.head_count // self.head_count_kv
+            assert gqa_n_rep > 0
+            if gqa_n_rep > 1:
+
+                def repeat_kv(x: torch.Tensor) -> torch.Tensor:
+                    bs, slen, n_kv_heads, head_dim = x.shape
+                    return (
+                        x.unsqueeze(-2)
+                        .expand(bs, slen, n_kv_heads, gqa_n_rep, head_dim)
+                        .reshape(bs, slen, n_kv_heads * gqa_n_rep, head_dim)
+                    )
+
+                xk = repeat_kv(xk)
+                xv = repeat_kv(xv)
+
+            # Tranpose into [bs, heads, sl, dim]
+            xq = xq.transpose(1, 2)
+            keys = xk.transpose(1, 2)
+            values = xv.transpose(1, 2)
+
+            # Flash attention.
+            attn_weights = torch.matmul(xq, keys.transpose(2, 3)) / math.sqrt(
+                self.head_dim
+            )
+            self.assert_not_nan(attn_weights)
 
-        # Flash attention.
-        attn_weights = torch.matmul(xq, keys.transpose(2, 3)) / math.sqrt(self.head_dim)
-        self.assert_not_nan(attn_weights)
+            # Apply attention mask.
+            self.trace_tensor("attn_weights", attn_weights, values=False)
+            if attention_mask is not None:
+                # self.trace_tensor("attn_mask", attention_mask)
+                attn_weights = attn_weights + attention_mask
 
-        # Apply attention mask.
-        self.trace_tensor("attn_weights", attn_weights, values=False)
-        if attention_mask is not None:
-            # self.trace_tensor("attn_mask", attention_mask)
-            attn_weights = attn_weights + attention_mask
-
-        attn_weights = F.softmax(attn_weights.float(), dim=-1).type_as(xq)
-        attn_output = torch.matmul(attn_weights, values)  # (bs, heads, slen, head_dim)
-        attn_output = attn_output.transpose(1, 2).reshape(bs, batch_seq_len, -1)
+            attn_weights = F.softmax(attn_weights.float(), dim=-1).type_as(xq)
+            # (bs, heads, slen, head_dim)
+            attn_output = torch.matmul(attn_weights, values)
+            attn_output = attn_output.transpose(1, 2).reshape(bs, batch_seq_len, -1)
 
         # Project.
-        attn_output = self.attn_output(attn_output)
-
-        # Remainder of the block.
-        h = h + attn_output
+        return self.attn_output(attn_output)
 
-        # Feed forward network.
+    def feed_forward(self, h: torch.Tensor) -> torch.Tensor:
+        """Returns the feed forward network output, without the residual."""
         ffn_input = self.ffn_norm(h)
-        ffn_gate = F.silu(self.ffn_gate(ffn_input))
-        ffn_up = self.ffn_up(ffn_input)
-        ffn_down = self.ffn_down(ffn_gate * ffn_up)
-        final_output = h + ffn_down
+        if self.fused_ffn_gate_up:
+            ffn_gate, ffn_up = self.ffn_gate_up(ffn_input)
+        else:
+            ffn_gate = self.ffn_gate(ffn_input)
+            ffn_up = self.ffn_up(ffn_input)
+        return self.ffn_down(F.silu(ffn_gate) * ffn_up)
 
-        return final_output
+    def attend_flash(
+        self,
+        *,
+        xq: torch.Tensor,
+        xk: torch.Tensor,
+        xv: torch.Tensor,
+        start_positions: Optional[torch.Tensor],
+        seq_lens: torch.Tensor,
+    ) -> torch.Tensor:
+        """Causally attends prefill queries at start_positions (or 0) to the
+        first seq_lens K/V positions, without expanding kv heads.
+
+        Returns [bs, batch_seq_len, head_count * head_dim].
+        """
+        bs, batch_seq_len, _, _ = xq.shape
+        attn_output = ops.scaled_dot_product_attention(
+            xq.transpose(1, 2),
+            xk.transpose(1, 2),
+            xv.transpose(1, 2),
+            is_causal=True,
+            start_positions=start_positions,
+            seq_lens=seq_lens,
+        )
+        return attn_output.transpose(1, 2).reshape(bs, batch_seq_len, -1)
+
+    def attend_paged_decode(
+        self,
+        *,
+        xq: torch.Tensor,
+        xk_cache_update: torch.Tensor,
+        xv_cache_update: torch.Tensor,
+        cache_state: list[torch.Tensor],
+        # [bs, batch_seq_len // block_seq_stride]
+        seq_block_ids: torch.Tensor,
+        start_positions: torch.Tensor,
+        k_rotary_mask: Optional[torch.Tensor] = None,
+    ) -> torch.Tensor:
+        """Writes the decode step's K/V and attends over the paged cache.
+
+        Attends to the same positions as the materializing decode path. K is
+        rotated by `k_rotary_mask`, if given, as it is written.
+        Returns [bs, 1, head_count * head_dim].
+        """
+        cache = self.cache.paged
+        bs, batch_seq_len, _, _ = xq.shape
+        assert batch_seq_len == 1
+        # The step's token is cached at its position, as for prefill rows.
+        cache.write_timestep(
+            cache_state,
+            cache_partitions=[
+                xk_cache_update,
+                xv_cache_update,
+            ],
+            transformer_block_index=self.block_index,
+            seq_positions=start_positions,
+            page_ids=seq_block_ids,
+            k_rotary_mask=k_rotary_mask,
+        )
+        attn_output = cache.attend_decode(
+            cache_state,
+            xq[:, 0, ...],
+            transformer_block_index=self.block_index,
+            seq_lens=start_positions + 1,
+            page_ids=seq_block_ids,
+        )
+        return attn_output.reshape(bs, batch_seq_len, -1)
 
     def transact_cache_direct(
         self,
@@ -430,16 +716,15 @@ class PagedLlamaAttentionBlock(ThetaLayer):
             cache_v[:, :batch_seq_len] = xv_cache_update
             return xk_cache_update, xv_cache_update
         else:
-            # Decode. Write a single timestep.
-            # TODO: This needs to be reworked with index ops.
+            # Decode. Write a single timestep of every row with one scatter.
             assert xk_cache_update.shape[1] == 1
             assert xv_cache_update.shape[1] == 1
-            max_start_pos = 0
-            for row_index in range(bs):
-                row_start_pos = start_positions[row_index].item()
-                max_start_pos = max(row_start_pos, max_start_pos)
-                cache_k[row_index, row_start_pos] = xk_cache_update[row_index, 0]
-                cache_v[row_index, row_start_pos] = xv_cache_update[row_index, 0]
+            indices = (
+                torch.arange(bs, device=start_positions.device),
+                start_positions,
+            )
+            cache_k.index_put_(indices=indices, values=xk_cache_update[:, 0])
+            cache_v.index_put_(indices=indices, values=xv_cache_update[:, 0])
             return cache_k[:, :kv_seq_len], cache_v[:, :kv_seq_len]
 
     def transact_cache_paged(
@@ -452,8 +737,11 @@ class PagedLlamaAttentionBlock(ThetaLayer):
         seq_block_ids: torch.Tensor,
         kv_seq_len: int,
         start_positions: Optional[torch.Tensor] = None,
+        seq_lens: Optional[torch.Tensor] = None,
         xk_temp: Optional[torch.Tensor] = None,
         xv_temp: Optional[torch.Tensor] = None,
+        # Rotates the decode step's K as it is written, if given.
+        k_rotary_mask: Optional[torch.Tensor] = None,
     ):
         cache = self.cache.paged
         # Manage the cache.
@@ -473,22 +761,41 @@ class PagedLlamaAttentionBlock(ThetaLayer):
             # use a memory efficient attention kernel that can do indirect
             # reads, skipping this materialization. This path is taken for
             # a decode step.
+            # Chunked prefill (seq_lens given) is the same but writes a range
+            # of rows per sequence.
             assert xk_temp is not None and xv_temp is not None
-            assert xk_cache_update.shape[1] == 1
-            assert xv_cache_update.shape[1] == 1
             assert kv_seq_len == seq_block_ids.shape[1] * cache.block_seq_stride
 
-            # Write our one updated cache row into the cache.
-            cache.write_timestep(
-                cache_state,
-                cache_partitions=[
-                    xk_cache_update,
-                    xv_cache_update,
-                ],
-                transformer_block_index=self.block_index,
-                seq_positions=start_positions + 1,
-                page_ids=seq_block_ids,
-            )
+            if seq_lens is not None:
+                # Write the chunk's updated cache rows into the cache.
+                cache.write_range(
+                    cache_state,
+                    cache_partitions=[
+                        xk_cache_update,
+                        xv_cache_update,
+                    ],
+                    transformer_block_index=self.block_index,
+                    start_positions=start_positions,
+                    seq_lens=seq_lens,
+                    page_ids=seq_block_ids,
+                )
+            else:
+                assert xk_cache_update.shape[1] == 1
+                assert xv_cache_update.shape[1] == 1
+
+                # Write our one updated cache row into the cache, at the
+                # token's position as for prefill and chunk rows.
+                cache.write_timestep(
+                    cache_state,
+                    cache_partitions=[
+                        xk_cache_update,
+                        xv_cache_update,
+                    ],
+                    transformer_block_index=self.block_index,
+                    seq_positions=start_positions,
+                    page_ids=seq_block_ids,
+                    k_rotary_mask=k_rotary_mask,
+                )
 
             # Restore from the cache.
             cache.read(
@@ -509,3 +816,79 @@ class PagedLlamaAttentionBlock(ThetaLayer):
             xk = xk_temp[:, 0:kv_seq_len, ...]
             xv = xv_temp[:, 0:kv_seq_len, ...]
             return xk, xv
+
+
+class ShardedPagedLlamaAttentionBlock(ThetaLayer):
+    """Tensor parallel PagedLlamaAttentionBlock over a theta sharded with
+    `sharding.PagedLlamaAttentionBlockSharding`.
+
+    Each shard runs an unsharded block over its slice of the attention heads
+    and of the FFN, reading and writing its own page table. The attention
+    output and FFN down projections of the shards are partial sums, which get
+    reduced before adding the residual. The shards are not placed on devices
+    of their own: they run one after another wherever their tensors live.
+    """
+
+    def __init__(
+        self,
+        theta: Theta,
+        *,
+        block_index: int,
+        cache: PagedKVCache,
+        head_count: int,
+        head_dim: int,
+        head_count_kv: int,
+        rms_epsilon: float,
+        use_paged_attention_kernel: bool = False,
+        use_flash_attention: bool = False,
+    ):
+        super().__init__(theta)
+        assert cache.is_paged and cache.is_sharded
+        shard_count = cache.shard_count
+        assert head_count % shard_count == 0 and head_count_kv % shard_count == 0
+        self.cache = cache
+        self.shard_count = shard_count
+        self.shards = nn.ModuleList(
+            [
+                PagedLlamaAttentionBlock(
+                    _shard_theta(theta, i),
+                    block_index=block_index,
+                    cache=cache.shard_cache,
+                    head_count=head_count // shard_count,
+                    head_dim=head_dim,
+                    head_count_kv=head_count_kv // shard_count,
+                    rms_epsilon=rms_epsilon,
+                    use_paged_attention_kernel=use_paged_attention_kernel,
+                    use_flash_attention=use_flash_attention,
+                )
+                for i in range(shard_count)
+            ]
+        )
+
+    def forward(self, h: torch.Tensor, *, cache_state: list, **kwargs):
+        # The K/V temporaries, if any, are scratch reused by every shard.
+        attn_output = ops.sharded_sum(
+            UnreducedTensor(
+                ts=[
+                    shard.attention_output(
+                        h, cache_state=self.cache.shard_state(cache_state, i), **kwargs
+                    )
+                    for i, shard in enumerate(self.shards)
+                ]
+            )
+        )
+        h = h + attn_output
+        ffn_down = ops.sharded_sum(
+            UnreducedTensor(ts=[shard.feed_forward(h) for shard in self.shards])
+        )
+        return h + ffn_down
+
+
+def _shard_theta(theta: Theta, shard: int) -> Theta:
+    """Returns the theta of a single shard of a sharded theta."""
+    return Theta(
+        {
+            name: t.shards[shard] if isinstance(t, ShardedTensor) else t
+            for name, t in theta.flatten().items()
+        }
+    )
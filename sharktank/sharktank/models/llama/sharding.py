@@ -0,0 +1,97 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Specifications describing how the Llama model is sharded."""
+
+from ...types.sharding import *
+from ...types import QuantizedTensor, Theta
+from ... import ops
+
+
+class PagedLlamaAttentionBlockSharding(ThetaLayerSharding):
+    """Megatron style tensor parallel sharding of an attention block.
+
+    The Q/K/V and FFN gate/up projections are split by output features, so
+    that each shard holds a contiguous range of attention heads and of the
+    FFN hidden dim. The attention output and FFN down projections are split
+    by input features and produce partial sums reduced across shards.
+    """
+
+    def __init__(self, shard_count: int):
+        super(Sharding).__init__()
+        self.shard_count = shard_count
+
+    def theta_sharding(self) -> ThetaSharding:
+        result = ThetaSharding(
+            {
+                "attn_norm": RmsNormReplicatedSharding(
+                    self.shard_count
+                ).theta_sharding(),
+                "ffn_norm": RmsNormReplicatedSharding(
+                    self.shard_count
+                ).theta_sharding(),
+            }
+        )
+        for name in ["attn_q", "attn_k", "attn_v", "ffn_gate", "ffn_up"]:
+            result[name] = LinearReplicatedInputSplitWeightAndBiasSharding(
+                self.shard_count
+            ).theta_sharding()
+        for name in ["attn_output", "ffn_down"]:
+            result[name] = LinearSplitReductionDimSharding(
+                self.shard_count
+            ).theta_sharding()
+        return result
+
+
+class LlamaSharding(ThetaLayerSharding):
+    """Shards the attention blocks of a Llama model and replicates the token
+    embedding, output norm and output head."""
+
+    def __init__(self, shard_count: int, block_count: int):
+        super(Sharding).__init__()
+        self.shard_count = shard_count
+        self.block_count = block_count
+
+    def theta_sharding(self) -> ThetaSharding:
+        return ThetaSharding(
+            {
+                "token_embd": TokenEmbeddingLayerReplicatedSharding(
+                    self.shard_count
+                ).theta_sharding(),
+                "blk": ThetaSharding(
+                    {
+                        f"{i}": PagedLlamaAttentionBlockSharding(
+                            self.shard_count
+                        ).theta_sharding()
+                        for i in range(self.block_count)
+                    }
+                ),
+                "output_norm": RmsNormReplicatedSharding(
+                    self.shard_count
+                ).theta_sharding(),
+                "output": LinearReplicatedWeightAndBiasSharding(
+                    self.shard_count
+                ).theta_sharding(),
+            }
+        )
+
+
+def shard_theta(theta: Theta, shard_count: int, block_count: int) -> Theta:
+    """Shards an unsharded Llama theta for tensor parallelism.
+
+    Tensors must be unquantized, as quantized layouts do not yet reshard, and
+    projections must not be fused by FuseProjectionsTransform.
+    """
+    quantized = [
+        name for name, t in theta.flatten().items() if isinstance(t, QuantizedTensor)
+    ]
+    if quantized:
+        raise ValueError(
+            f"Cannot shard quantized tensors (such as {quantized[0]}) for "
+            "tensor parallelism: quantized layouts do not reshard. Shard an "
+            "unquantized dataset instead."
+        )
+    return ops.reshard(theta, LlamaSharding(shard_count, block_count))
@@ -419,8 +419,8 @@ class AttentionLayer(ThetaLayer):
         value = value.view(bs, -1, self.heads, head_dim).transpose(1, 2)
 
         # the output of sdp = (batch, num_heads, seq_len, head_dim)
-        hidden_states = torch.nn.functional.scaled_dot_product_attention(
-            query, key, value, attn_mask=attention_mask, dropout_p=0.0, is_causal=False
+        hidden_states = ops.scaled_dot_product_attention(
+            query, key, value, attention_mask
         )
 
         hidden_states = hidden_states.transpose(1, 2).reshape(bs, -1, inner_dim)
@@ -455,6 +455,7 @@ class ResnetBlock2D(ThetaLayer):
         self.norm2 = GroupNormLayer(theta("norm2"), num_groups=groups, eps=eps)
         self.conv2 = Conv2DLayer(theta("conv2"), padding=(1, 1))
         self.nonlinearity = ACTIVATION_FUNCTIONS[non_linearity]
+        self.fuse_norm_silu = non_linearity in ("silu", "swish")
         self.output_scale_factor = output_scale_factor
 
         self.time_emb_proj = None
@@ -469,10 +470,9 @@ class ResnetBlock2D(ThetaLayer):
             self.conv_shortcut = Conv2DLayer(theta("conv_shortcut"), padding=(0, 0))
 
     def forward(self, input_tensor: torch.Tensor, temb: torch.Tensor) -> torch.Tensor:
-        hidden_states = input_tensor
-        hidden_states = self.norm1(hidden_states)
-        hidden_states = ops.elementwise(self.nonlinearity, hidden_states)
-        hidden_states = self.conv1(hidden_states)
+        hidden_states = self.norm_nonlinearity_conv(
+            self.norm1, self.conv1, input_tensor
+        )
 
         assert self.time_emb_proj is not None
         if self.time_emb_proj is not None:
@@ -480,9 +480,9 @@ class ResnetBlock2D(ThetaLayer):
             temb = self.time_emb_proj(temb)[:, :, None, None]
             hidden_states = ops.elementwise(torch.add, hidden_states, temb)
 
-        hidden_states = self.norm2(hidden_states)
-        hidden_states = ops.elementwise(self.nonlinearity, hidden_states)
-        hidden_states = self.conv2(hidden_states)
+        hidden_states = self.norm_nonlinearity_conv(
+            self.norm2, self.conv2, hidden_states
+        )
 
         if self.conv_shortcut is not None:
             input_tensor = self.conv_shortcut(input_tensor)
@@ -493,6 +493,33 @@ class ResnetBlock2D(ThetaLayer):
 
         return output_tensor
 
+    def norm_nonlinearity_conv(
+        self, norm: "GroupNormLayer", conv: Conv2DLayer, x: torch.Tensor
+    ) -> torch.Tensor:
+        """Applies norm, the nonlinearity and conv, as one op for SiLU so that
+        the (quantized) conv can fuse the steps."""
+        if (
+            not self.fuse_norm_silu
+            or conv.premul_input is not None
+            or conv.qdq_input is not None
+        ):
+            x = norm(x)
+            x = ops.elementwise(self.nonlinearity, x)
+            return conv(x)
+        return ops.group_norm_silu_conv2d(
+            x,
+            norm.theta.tensor("weight"),
+            norm.theta.tensor("bias"),
+            conv.weight,
+            conv.bias,
+            num_groups=norm.num_groups,
+            eps=norm.eps,
+            input_quantizer=conv.q_input,
+            stride=conv.stride,
+            padding=conv.padding,
+            dilation=conv.dilation,
+        )
+
 
 ################################################################################
 # Utility layers.
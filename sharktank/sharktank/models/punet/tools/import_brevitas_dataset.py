@@ -21,7 +21,9 @@ params.safetensors adjacent to the HF config.json file.
 """
 from typing import Optional
 
+from concurrent.futures import ThreadPoolExecutor
 import json
+import os
 from pathlib import Path
 import safetensors
 import torch
@@ -138,7 +140,7 @@ def apply_per_layer_quant(
     # Spot check that things look sane.
     weight_dequant = weight_quant.unpack().dequant()
     weight_diff = weight.as_torch() - weight_dequant
-    print("WEIGHT_DIFF:", weight_diff)
+    print(f"{layer_name} WEIGHT_DIFF (max abs):", weight_diff.abs().max().item())
 
     # Bias/output scaling.
     bias = layer_theta.optional_tensor("bias")
@@ -157,7 +159,7 @@ def apply_per_layer_quant(
         # Spot check that things look sane.
         bias_dequant = bias_quant.unpack().dequant()
         bias_diff = bias.as_torch() - bias_dequant
-        print("BIAS_DIFF:", bias_diff)
+        print(f"{layer_name} BIAS_DIFF (max abs):", bias_diff.abs().max().item())
 
     # Input scaling.
     # Assume per tensor scaling of input.
@@ -196,6 +198,12 @@ def main():
         type=Path,
         help="Base parameters to initialize from (will be augmented with quantized)",
     )
+    parser.add_argument(
+        "--max-workers",
+        type=int,
+        default=os.cpu_count() or 1,
+        help="Number of layers to quantize in parallel",
+    )
     args = cli.parse(parser)
 
     config_json_path: Path = args.config_json
@@ -224,10 +232,22 @@ def main():
     # The quant_params_struct has quantization parameter structs keyed by full
     # layer name. We process each of these in turn to produce a per-layer
     # quantization scheme where no quantized tensors escape their layer.
+    # Layers are independent, so they are quantized in parallel (torch releases
+    # the GIL in its kernels) and their updates are merged in order.
+    def quantize_layer(item) -> dict[str, InferenceTensor]:
+        layer_name, qp = item
+        layer_tensors: dict[str, InferenceTensor] = {}
+        apply_per_layer_quant(quant_theta, layer_name, qp, layer_tensors)
+        return layer_tensors
+
     updated_tensors: dict[str, InferenceTensor] = {}
-    for layer_name, qp in quant_params_struct.items():
-        print(f"Applying per-layer quants: {layer_name}")
-        apply_per_layer_quant(quant_theta, layer_name, qp, updated_tensors)
+    with ThreadPoolExecutor(max_workers=args.max_workers) as executor:
+        for layer_name, layer_tensors in zip(
+            quant_params_struct.keys(),
+            executor.map(quantize_layer, quant_params_struct.items()),
+        ):
+            print(f"Applied per-layer quants: {layer_name}")
+            updated_tensors.update(layer_tensors)
 
     # Apply updates into a new Theta.
     theta = base_theta if base_theta is not None else quant_theta
@@ -17,6 +17,7 @@ and layouts.
 """
 
 from . import _registry
+from ._registry import DispatchProfile, freeze_dispatch, profile_dispatch
 from .signatures import *
 from .shape import *
 
@@ -9,16 +9,23 @@
 from typing import Any, Callable, Iterable, Optional, Union
 
 import collections
+import contextlib
 import inspect
 import functools
+import sys
+import time
 
 import torch
 from torch import Tensor
 from ..types import PrimitiveTensor, QuantizedTensor
+from ..utils import tracing
 
 __all__ = [
+    "DispatchProfile",
     "SignatureDispatcher",
+    "freeze_dispatch",
     "overridable",
+    "profile_dispatch",
     "unbox_tensor",
 ]
 
@@ -50,6 +57,136 @@ def _test_get_last_op_dispatch():
     return _TEST_LAST_OP_DISPATCH
 
 
+# When dispatch is frozen, each dispatcher remembers the override that the
+# first call from a call site with some dispatch key resolved to and tries it
+# first on later calls from that site with the same key. See freeze_dispatch().
+_FROZEN_DISPATCH = False
+
+# The active DispatchProfile, if any. See profile_dispatch().
+_DISPATCH_PROFILE: Optional["DispatchProfile"] = None
+
+
+@contextlib.contextmanager
+def freeze_dispatch():
+    """Resolves op dispatch once per call site for the duration of the context.
+
+    Eager runs of a model dispatch every op of every layer through the override
+    search, trying more specific overrides which decline with NotImplemented
+    before the one that applies. While frozen, the resolution of each op call
+    site is recorded per dispatch key: the type of each dispatched tensor
+    along with its shape, dtype and quantized layout, which is what overrides
+    decline on. Later calls from the site with the same key go straight to the
+    recorded override, skipping the override search. A site which sees
+    several weight layouts or shapes (e.g. a shared `LinearLayer`) records a
+    resolution per key, so freezing does not change which override is
+    selected as long as the other arguments passed at a call site do not vary
+    in a way that overrides decline on. An override which declines still
+    falls back to the full search.
+
+    Frozen dispatch is meant for eager execution and is not needed when
+    exporting, where dispatch happens once while tracing.
+    """
+    global _FROZEN_DISPATCH
+    prev = _FROZEN_DISPATCH
+    _FROZEN_DISPATCH = True
+    try:
+        yield
+    finally:
+        _FROZEN_DISPATCH = prev
+        if not prev:
+            for dispatcher in SignatureDispatcher._all:
+                dispatcher._thaw()
+
+
+class DispatchProfile:
+    """Accumulates dispatch statistics per (op, override).
+
+    Times are wall clock and inclusive of nested dispatches, with the self time
+    excluding them. Dequants counts QuantizedTensor arguments which the override
+    unboxed to a dequantized Tensor, which happens when an override registered
+    with `auto_dequant=True` is the one that applies and usually means that a
+    quantized layout lacks a specialized implementation.
+    """
+
+    Entry = collections.namedtuple(
+        "Entry", "op, override, calls, seconds, self_seconds, dequants"
+    )
+
+    def __init__(self):
+        # (op name, override name) -> [calls, seconds, self seconds, dequants]
+        self._stats: dict[tuple[str, str], list] = {}
+        # [nested seconds, dequants] of each dispatch in progress.
+        self._stack: list[list] = []
+
+    def dispatch(self, d: "SignatureDispatcher", trampoline, args, kwargs):
+        frame = [0.0, 0]
+        self._stack.append(frame)
+        start = time.perf_counter()
+        try:
+            selected_override, *results = trampoline(d, *args, **kwargs)
+        finally:
+            seconds = time.perf_counter() - start
+            self._stack.pop()
+            if self._stack:
+                self._stack[-1][0] += seconds
+        key = (d.__name__, selected_override.__name__)
+        stats = self._stats.get(key)
+        if stats is None:
+            stats = self._stats[key] = [0, 0.0, 0.0, 0]
+        stats[0] += 1
+        stats[1] += seconds
+        stats[2] += seconds - frame[0]
+        stats[3] += frame[1]
+        return selected_override, *results
+
+    def record_dequant(self):
+        if self._stack:
+            self._stack[-1][1] += 1
+
+    @property
+    def entries(self) -> list["DispatchProfile.Entry"]:
+        """Entries in decreasing order of self time."""
+        entries = [
+            DispatchProfile.Entry(op, override, *stats)
+            for (op, override), stats in self._stats.items()
+        ]
+        entries.sort(key=lambda e: e.self_seconds, reverse=True)
+        return entries
+
+    def report(self, limit: Optional[int] = None) -> str:
+        entries = self.entries[:limit]
+        lines = [
+            f"{'op':<32} {'override':<48} {'calls':>8} {'total ms':>10} "
+            f"{'self ms':>10} {'dequants':>8}"
+        ]
+        for e in entries:
+            lines.append(
+                f"{e.op:<32} {e.override:<48} {e.calls:>8} "
+                f"{e.seconds * 1000:>10.3f} {e.self_seconds * 1000:>10.3f} "
+                f"{e.dequants:>8}"
+            )
+        return "\n".join(lines)
+
+
+@contextlib.contextmanager
+def profile_dispatch():
+    """Profiles op dispatch for the duration of the context.
+
+    Usage:
+        with ops.profile_dispatch() as profile:
+            model.prefill(...)
+        print(profile.report())
+    """
+    global _DISPATCH_PROFILE
+    prev = _DISPATCH_PROFILE
+    profile = DispatchProfile()
+    _DISPATCH_PROFILE = profile
+    try:
+        yield profile
+    finally:
+        _DISPATCH_PROFILE = prev
+
+
 class SignatureDispatcher:
     """Replaces an overridable function with a tensor type base dispatcher.
 
@@ -65,17 +202,45 @@ class SignatureDispatcher:
         "_overrides",
         "_target_cache",
         "_trampoline",
+        "_frozen_call",
+        "_frozen_targets",
     ]
 
+    # All dispatchers, so that frozen state can be dropped together.
+    _all: list["SignatureDispatcher"] = []
+
     def __init__(self, sigf: Callable):
         self._target_cache = dict()
         self._trampoline: Optional[Callable] = None
         self._overrides: list[_TargetOverride] = []
+        # Frozen dispatch state. __call__ stashes [call site, None] for the
+        # trampoline's find_overrides, which always precedes any nested call,
+        # and which fills in the lookup key if the targets are not frozen yet.
+        self._frozen_call: Optional[list] = None
+        # (call site, dispatch key) -> targets with the override selected first
+        self._frozen_targets: dict[Any, tuple[Callable, ...]] = dict()
+        SignatureDispatcher._all.append(self)
 
     def __call__(self, *args, **kwargs):
         trampoline = self._trampoline
         assert trampoline is not None
-        selected_override, *results = trampoline(self, *args, **kwargs)
+        frozen_call = None
+        if _FROZEN_DISPATCH:
+            caller = sys._getframe(1)
+            frozen_call = self._frozen_call = [(caller.f_code, caller.f_lasti), None]
+        tracer = tracing.get_tracer()
+        if _DISPATCH_PROFILE is not None:
+            selected_override, *results = _DISPATCH_PROFILE.dispatch(
+                self, trampoline, args, kwargs
+            )
+        elif tracer is not None:
+            with tracer.span(self.__name__, "op") as span_args:
+                selected_override, *results = trampoline(self, *args, **kwargs)
+                span_args["override"] = selected_override.__name__
+        else:
+            selected_override, *results = trampoline(self, *args, **kwargs)
+        if frozen_call is not None and frozen_call[1] is not None:
+            self._freeze(frozen_call[1], selected_override)
         if _ENABLE_TEST_LAST_OP_DISPATCH:
             global _TEST_LAST_OP_DISPATCH
             _TEST_LAST_OP_DISPATCH = selected_override
@@ -108,20 +273,45 @@ class SignatureDispatcher:
             )
             self._overrides.sort(key=lambda v: v.salience)
             self._target_cache.clear()  # Need to recompute all targets
+            self._thaw()
             return f
 
         return decorator
 
     def find_overrides(self, tensors: tuple[Any, ...]) -> Iterable[Callable]:
         """Finds the most salient override for the given named tensors."""
+        frozen_call = None
+        if _FROZEN_DISPATCH and self._frozen_call is not None:
+            frozen_call = self._frozen_call
+            self._frozen_call = None
+            key = (frozen_call[0], tuple(_frozen_dispatch_key(t) for t in tensors))
+            frozen_targets = self._frozen_targets.get(key)
+            if frozen_targets is not None:
+                return frozen_targets
         type_spec = tuple(type(t) for t in tensors)
         found_targets = self._target_cache.get(type_spec)
         if found_targets is None:
             # Slow-path try to find it.
             found_targets = self._match_targets(type_spec)
             self._target_cache[type_spec] = found_targets
+        if frozen_call is not None:
+            # Let __call__ freeze the override selected from these.
+            frozen_call[1] = (key, found_targets)
         return reversed(found_targets)
 
+    def _freeze(self, resolution: tuple, selected_override: Callable):
+        key, found_targets = resolution
+        targets = tuple(reversed(found_targets))
+        if selected_override in targets:
+            targets = (selected_override,) + tuple(
+                t for t in targets if t is not selected_override
+            )
+        self._frozen_targets[key] = targets
+
+    def _thaw(self):
+        self._frozen_call = None
+        self._frozen_targets.clear()
+
     def fail(self, tensors: tuple[Any, ...]):
         spec = [type(t) for t in tensors]
         raise NotImplementedError(
@@ -160,6 +350,19 @@ class SignatureDispatcher:
         return targets
 
 
+def _frozen_dispatch_key(t: Any) -> Any:
+    """Key of a dispatched value for frozen dispatch, covering the properties
+    that overrides commonly decline on."""
+    if isinstance(t, Tensor):
+        return type(t), t.dtype, t.shape
+    if isinstance(t, QuantizedTensor):
+        return type(t), t.layout_type, tuple(t.shape)
+    shape = getattr(t, "shape", None)
+    if shape is not None:
+        return type(t), tuple(shape)
+    return type(t)
+
+
 def overridable(f):
     """Decorator to apply to overridable ops.
 
@@ -178,5 +381,7 @@ def unbox_tensor(t: Any) -> Tensor:
     elif isinstance(t, PrimitiveTensor):
         return t.as_torch()
     elif isinstance(t, QuantizedTensor):
+        if _DISPATCH_PROFILE is not None:
+            _DISPATCH_PROFILE.record_dequant()
         return t.unpack().dequant()
     raise ValueError(f"Expected a Tensor or PrimitiveTensor but got {type(t)}")
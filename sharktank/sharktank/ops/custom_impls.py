@@ -9,8 +9,14 @@ from torch import Tensor, dtype
 import torch.nn.functional as F
 
 from ..kernels import (
+    GEMV_MAX_M,
+    flash_attention,
+    flash_attention_causal,
     mmt_block_scaled_offset_q4_unsigned,
+    mmt_block_scaled_offset_q4_unsigned_gemv,
+    mmt_block_scaled_offset_q8_gemv,
     mmt_block_scaled_q8,
+    mmt_block_scaled_q8_gemv,
     mmtfp,
     mmt_super_block_scaled_offset_q4_unsigned,
 )
@@ -47,6 +53,25 @@ from .signatures import *
 # Quantized Matmul
 
 
+def _as_3d_lhs(lhs: Tensor) -> Tensor:
+    """Reshapes an LHS of any rank to the [B, M, K] expected by the kernels."""
+    if lhs.dim() == 3:
+        return lhs
+    if lhs.dim() == 2:
+        return lhs.unsqueeze(0)
+    return lhs.flatten(0, -3)
+
+
+def _is_gemv(lhs: Tensor) -> bool:
+    """Whether the (3d) LHS has few enough static rows for the GEMV kernels.
+
+    This is the shape of decode, where the matmul is bound by reading the
+    weights.
+    """
+    rows = lhs.shape[-2]
+    return isinstance(rows, int) and rows <= GEMV_MAX_M
+
+
 @matmul.override(Tensor, QuantizedTensor)
 def matmul_generic_tensor_block_scaled(
     lhs, rhs: QuantizedTensor, *, transpose_rhs: bool
@@ -64,8 +89,19 @@ def matmul_generic_tensor_block_scaled(
     if layout is not BlockScaledLayout:
         return NotImplemented
     rhs_unpacked = rhs.unpack()
-    assert rhs_unpacked.m is None, "NYI: Q8 block scaled with offset"
-    return mmt_block_scaled_q8(lhs, rhs_unpacked.d, rhs_unpacked.qs)
+    lhs_3d = _as_3d_lhs(lhs)
+    if rhs_unpacked.m is not None:
+        if not _is_gemv(lhs_3d):
+            # No GEMM kernel for an offset Q8 yet: dequantize generically.
+            return NotImplemented
+        result = mmt_block_scaled_offset_q8_gemv(
+            lhs_3d, rhs_unpacked.d, rhs_unpacked.qs, rhs_unpacked.m
+        )
+    elif _is_gemv(lhs_3d):
+        result = mmt_block_scaled_q8_gemv(lhs_3d, rhs_unpacked.d, rhs_unpacked.qs)
+    else:
+        result = mmt_block_scaled_q8(lhs_3d, rhs_unpacked.d, rhs_unpacked.qs)
+    return result.reshape(*lhs.shape[:-1], result.shape[-1])
 
 
 @matmul.override(Tensor, QuantizedTensor)
@@ -82,9 +118,16 @@ def matmul_generic_tensor_block_scaled_i4(
     rhs_unpacked = rhs.unpack()
     assert rhs_unpacked.m is not None, "NYI: Q4 without offset not"
     assert not rhs_unpacked.signed, "NYI: Q4 signed"
-    return mmt_block_scaled_offset_q4_unsigned(
-        a=lhs, d=rhs_unpacked.d, qs=rhs_unpacked.qs_bit_packed, m=rhs_unpacked.m
+    lhs_3d = _as_3d_lhs(lhs)
+    kernel = (
+        mmt_block_scaled_offset_q4_unsigned_gemv
+        if _is_gemv(lhs_3d)
+        else mmt_block_scaled_offset_q4_unsigned
     )
+    result = kernel(
+        a=lhs_3d, d=rhs_unpacked.d, qs=rhs_unpacked.qs_bit_packed, m=rhs_unpacked.m
+    )
+    return result.reshape(*lhs.shape[:-1], result.shape[-1])
 
 
 @matmul.override(Tensor, QuantizedTensor)
@@ -100,8 +143,8 @@ def matmul_generic_tensor_super_block_offset_scaled_4_6_i4(
     rhs_unpacked = rhs.unpack()
     sb_scales_hi, sb_scales_low = rhs_unpacked.sb_scales_bit_packed
     sb_mins_hi, sb_mins_low = rhs_unpacked.sb_mins_bit_packed
-    return mmt_super_block_scaled_offset_q4_unsigned(
-        lhs,
+    result = mmt_super_block_scaled_offset_q4_unsigned(
+        _as_3d_lhs(lhs),
         rhs_unpacked.d,
         rhs_unpacked.dmin,
         sb_scales_hi,
@@ -110,3 +153,39 @@ def matmul_generic_tensor_super_block_offset_scaled_4_6_i4(
         sb_mins_low,
         rhs_unpacked.qs_bit_packed,
     )
+    return result.reshape(*lhs.shape[:-1], result.shape[-1])
+
+
+# Attention
+
+
+@scaled_dot_product_attention.override(Tensor, Tensor, Tensor)
+def scaled_dot_product_attention_flash(
+    q, k, v, attn_mask, *, is_causal: bool, start_positions, seq_lens
+):
+    """Tiled attention which never materializes the scores.
+
+    Masks are computed in the kernel from the causal, start position and length
+    arguments. Reading an explicit mask falls back to the default.
+    """
+    q = unbox_tensor(q)
+    k = unbox_tensor(k)
+    v = unbox_tensor(v)
+    if not q.dtype.is_floating_point or not (q.dtype == k.dtype == v.dtype):
+        return NotImplemented
+    if not is_causal:
+        if seq_lens is not None:
+            return NotImplemented
+        return flash_attention(q, k, v)
+    bs = q.shape[0]
+    if start_positions is None:
+        start_positions = torch.zeros(bs, dtype=torch.int64, device=q.device)
+    if seq_lens is None:
+        seq_lens = torch.full((bs,), k.shape[2], dtype=torch.int64, device=q.device)
+    return flash_attention_causal(
+        q,
+        k,
+        v,
+        unbox_tensor(start_positions).to(torch.int64),
+        unbox_tensor(seq_lens).to(torch.int64),
+    )
@@ -9,11 +9,13 @@
 
 from typing import Optional, List
 
+import math
+
 import torch
 from torch import Tensor, dtype
 import torch.nn.functional as F
 
-from ..types import PrimitiveTensor, QuantizedTensor
+from ..types import AnyTensor, PrimitiveTensor, QuantizedTensor
 from ._registry import unbox_tensor
 from .signatures import *
 
@@ -95,6 +97,38 @@ def group_norm_affine_default(input, weight, bias, *, num_groups, eps):
     return F.group_norm(input, num_groups=num_groups, weight=weight, bias=bias, eps=eps)
 
 
+def group_norm_silu_conv2d_default(
+    input,
+    norm_weight,
+    norm_bias,
+    weight,
+    bias,
+    *,
+    num_groups,
+    eps,
+    input_quantizer,
+    stride,
+    padding,
+    dilation,
+):
+    x = group_norm_affine(input, norm_weight, norm_bias, num_groups=num_groups, eps=eps)
+    x = elementwise(F.silu, x)
+    if input_quantizer is not None:
+        x = input_quantizer.quantize(x)
+    y = conv2d(x, weight, bias, stride=stride, padding=padding, dilation=dilation)
+    if isinstance(y, QuantizedTensor):
+        y = y.unpack().dequant()
+    return y
+
+
+group_norm_silu_conv2d.override(Tensor, Tensor, Tensor, AnyTensor)(
+    group_norm_silu_conv2d_default
+)
+group_norm_silu_conv2d.override(Tensor, Tensor, Tensor, AnyTensor, AnyTensor)(
+    group_norm_silu_conv2d_default
+)
+
+
 @layer_norm.override(Tensor, Tensor, Tensor)
 def layer_norm_default(input, weight, bias, *, eps):
     input = unbox_tensor(input)
@@ -158,6 +192,51 @@ def permute(tensor: Tensor, dims: List[int]):
     return torch.permute(torch_tensor, dims)
 
 
+# Scaled dot product attention
+def scaled_dot_product_attention_default(
+    q, k, v, attn_mask, *, is_causal: bool, start_positions, seq_lens
+) -> Tensor:
+    """Reference attention, which materializes the scores of all positions."""
+    q = unbox_tensor(q)
+    k = unbox_tensor(k)
+    v = unbox_tensor(v)
+    bs, head_count, sl, head_dim = q.shape
+    kv_sl = k.shape[2]
+    gqa_n_rep = head_count // k.shape[1]
+    if gqa_n_rep > 1:
+        k = k.repeat_interleave(gqa_n_rep, dim=1)
+        v = v.repeat_interleave(gqa_n_rep, dim=1)
+
+    scores = torch.matmul(q.float(), k.float().transpose(2, 3)) / math.sqrt(head_dim)
+    if attn_mask is not None:
+        scores = scores + unbox_tensor(attn_mask).float()
+
+    # [bs, 1, sl, kv_sl] of attended positions.
+    valid = torch.ones(bs, 1, sl, kv_sl, dtype=torch.bool, device=q.device)
+    k_positions = torch.arange(kv_sl, device=q.device)
+    if is_causal:
+        q_positions = torch.arange(sl, device=q.device).unsqueeze(0)
+        if start_positions is not None:
+            q_positions = q_positions + unbox_tensor(start_positions).unsqueeze(1)
+        valid = valid & (k_positions <= q_positions.unsqueeze(-1)).unsqueeze(1)
+    if seq_lens is not None:
+        in_seq = k_positions.unsqueeze(0) < unbox_tensor(seq_lens).unsqueeze(1)
+        valid = valid & in_seq[:, None, None, :]
+    scores = scores.masked_fill(~valid, float("-inf"))
+
+    # Rows which attend to nothing are all NaN after the softmax.
+    weights = F.softmax(scores, dim=-1).nan_to_num(0.0)
+    return torch.matmul(weights, v.float()).to(q.dtype)
+
+
+scaled_dot_product_attention.override(Tensor, Tensor, Tensor)(
+    scaled_dot_product_attention_default
+)
+scaled_dot_product_attention.override(Tensor, Tensor, Tensor, Tensor)(
+    scaled_dot_product_attention_default
+)
+
+
 # Sharded default impls (do nothing).
 
 
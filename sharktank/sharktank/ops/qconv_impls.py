@@ -19,6 +19,7 @@ from ..types import (
     AnyTensor,
     QuantizedTensor,
     PlanarQuantizedTensor,
+    StaticScaledQuantizer,
     TensorScaledLayout,
 )
 from ..utils import debugging
@@ -28,6 +29,7 @@ from .signatures import (
     IntOrSequenceInt,
     conv2d,
     elementwise,
+    group_norm_silu_conv2d,
 )
 
 
@@ -67,21 +69,7 @@ def qconv2d_tensor_scaled_integer(
         return NotImplemented
 
     # Bias is both optional and may either be quantized or fp.
-    bias_qs = None
-    rescale_d = None
-    if bias is not None:
-        if isinstance(bias, QuantizedTensor):
-            bias_layout: TensorScaledLayout = bias.unpack()
-            if isinstance(bias_layout, TensorScaledLayout):
-                bias_qs = bias_layout.qs
-                # If a quantized bias is provided, use its scale as the output scale and
-                # add directly in integer. A quantized bias cannot be arbitrary and must
-                # be a symmetric quantization of the output scale. This is not verified
-                # and driven by the data.
-                # Broadcast the bias scale to the channels in the NCHW output.
-                rescale_d = bias_layout.d.reshape(1, -1, 1, 1)
-            else:
-                warnings.warn(f"unsupported qconv bias quantization: {bias_layout}")
+    bias_qs, rescale_d = _unpack_quantized_bias(bias)
 
     # Alias components (d=scale, qs=quantized samples, m=offset).
     if accum_dtype is None:
@@ -112,6 +100,26 @@ def qconv2d_tensor_scaled_integer(
     stride = _expand_int_to_2_tuple(stride)
     padding = _expand_int_to_2_tuple(padding)
     dilation = _expand_int_to_2_tuple(dilation)
+    if (
+        bias is not None
+        and bias_qs is None
+        and _can_fuse_qconv2d(input_qs, weight_qs, flat_input_d, flat_input_m)
+    ):
+        # With an fp bias the result is dequantized anyway, so use the fused
+        # kernel, which pads, corrects for the zero points and rescales in one
+        # pass.
+        y = _invoke_fused_qconv2d(
+            input_qs,
+            weight_qs,
+            *_fused_qconv2d_channel_args(
+                flat_input_m, weight_qs, flat_weight_m, bias_qs, rescale_d, input_dtype
+            ),
+            padding,
+            stride,
+            dilation,
+        )
+        return elementwise(torch.add, y, bias.reshape(-1, 1, 1))
+
     extended_padding_list = [item for item in padding for _ in range(2)]
     padded_input = _pad_last_2d(input_qs, extended_padding_list)
     y_qs = _invoke_int32_conv2d(
@@ -194,6 +202,194 @@ conv2d.override(QuantizedTensor, QuantizedTensor, AnyTensor)(
 )
 
 
+def group_norm_silu_qconv2d_tensor_scaled_integer(
+    input: AnyTensor,
+    norm_weight: AnyTensor,
+    norm_bias: AnyTensor,
+    weight: QuantizedTensor,
+    bias: Optional[AnyTensor] = None,
+    *,
+    num_groups: int,
+    eps: float,
+    input_quantizer,
+    stride: IntOrSequenceInt = 1,
+    padding: IntOrSequenceInt = 0,
+    dilation: IntOrSequenceInt = 1,
+):
+    """Fuses the normalization, SiLU and input quantization into the prologue of
+    the conv kernel.
+
+    Only the group norm statistics are reduced beforehand, and are folded with
+    the affine into a per channel scale and shift of each batch row.
+    """
+    if not debugging.flags.use_custom_int_conv_kernel:
+        return NotImplemented
+    if (
+        not isinstance(input_quantizer, StaticScaledQuantizer)
+        or input_quantizer.axis is not None
+        or input_quantizer.dtype != torch.int8
+    ):
+        return NotImplemented
+    if not issubclass(weight.layout_type, TensorScaledLayout):
+        return NotImplemented
+    weight_layout: TensorScaledLayout = weight.unpack()
+    weight_qs = weight_layout.qs
+    if weight_qs.dtype != torch.int8:
+        return NotImplemented
+    flat_weight_d, flat_weight_m = _flatten_weight_scale_offset_channels(
+        weight_layout.d, weight_layout.m
+    )
+    if flat_weight_d is None:
+        return NotImplemented
+    bias_qs, rescale_d = _unpack_quantized_bias(bias)
+
+    input = unbox_tensor(input)
+    if rescale_d is None:
+        rescale_d = input_quantizer.reciprocal_scale * flat_weight_d
+
+    # Fold the statistics and affine into x * norm_scale + norm_shift.
+    n, c = input.shape[0], input.shape[1]
+    grouped = input.to(torch.float32).reshape(n, num_groups, -1)
+    var, mean = torch.var_mean(grouped, dim=2, unbiased=False)
+    rstd = torch.rsqrt(var + eps)
+    channels_per_group = c // num_groups
+    rstd = rstd.repeat_interleave(channels_per_group, dim=1)
+    mean = mean.repeat_interleave(channels_per_group, dim=1)
+    norm_scale = unbox_tensor(norm_weight).to(torch.float32) * rstd
+    norm_shift = unbox_tensor(norm_bias).to(torch.float32) - mean * norm_scale
+
+    y = _invoke_fused_qconv2d(
+        input,
+        weight_qs,
+        *_fused_qconv2d_channel_args(
+            input_quantizer.offset,
+            weight_qs,
+            flat_weight_m,
+            bias_qs,
+            rescale_d,
+            input.dtype,
+        ),
+        _expand_int_to_2_tuple(padding),
+        _expand_int_to_2_tuple(stride),
+        _expand_int_to_2_tuple(dilation),
+        norm=(norm_scale, norm_shift, input_quantizer.scale.reshape(1).float()),
+    )
+    if bias is not None and bias_qs is None:
+        y = elementwise(torch.add, y, bias.reshape(-1, 1, 1))
+    return y
+
+
+group_norm_silu_conv2d.override(AnyTensor, AnyTensor, AnyTensor, QuantizedTensor)(
+    group_norm_silu_qconv2d_tensor_scaled_integer
+)
+group_norm_silu_conv2d.override(
+    AnyTensor, AnyTensor, AnyTensor, QuantizedTensor, AnyTensor
+)(group_norm_silu_qconv2d_tensor_scaled_integer)
+
+
+def _unpack_quantized_bias(bias):
+    """Returns the quantized samples and NCHW broadcast scale of a quantized bias,
+    or None, None for no bias or an fp bias."""
+    if bias is None or not isinstance(bias, QuantizedTensor):
+        return None, None
+    bias_layout: TensorScaledLayout = bias.unpack()
+    if not isinstance(bias_layout, TensorScaledLayout):
+        warnings.warn(f"unsupported qconv bias quantization: {bias_layout}")
+        return None, None
+    # If a quantized bias is provided, use its scale as the output scale and
+    # add directly in integer. A quantized bias cannot be arbitrary and must
+    # be a symmetric quantization of the output scale. This is not verified
+    # and driven by the data.
+    # Broadcast the bias scale to the channels in the NCHW output.
+    return bias_layout.qs, bias_layout.d.reshape(1, -1, 1, 1)
+
+
+def _can_fuse_qconv2d(input_qs, weight_qs, flat_input_d, flat_input_m) -> bool:
+    """Whether the fused kernel handles the operands: int8, with a per-tensor
+    scaled input."""
+    return (
+        debugging.flags.use_custom_int_conv_kernel
+        and input_qs.dtype == torch.int8
+        and weight_qs.dtype == torch.int8
+        and flat_input_d.numel() == 1
+        and (flat_input_m is None or flat_input_m.numel() == 1)
+    )
+
+
+def _fused_qconv2d_channel_args(
+    input_m, weight_qs, weight_m, bias_qs, rescale_d, dtype
+) -> tuple[torch.Tensor, torch.Tensor, torch.Tensor, torch.Tensor]:
+    """Returns the input_zp, weight_zp, bias and rescale arguments of the fused
+    kernel, broadcast to the output channels."""
+    f = weight_qs.shape[0]
+    if input_m is None:
+        input_zp = torch.zeros(1, dtype=torch.int32)
+    else:
+        input_zp = input_m.reshape(1).to(torch.int32)
+    if weight_m is None:
+        weight_zp = torch.zeros(f, dtype=torch.int32)
+    else:
+        weight_zp = weight_m.reshape(-1).to(torch.int32).expand(f).contiguous()
+    if bias_qs is None:
+        bias_qs = torch.zeros(f, dtype=torch.int32)
+    rescale = rescale_d.reshape(-1).to(dtype).expand(f).contiguous()
+    return input_zp, weight_zp, bias_qs.to(torch.int32), rescale
+
+
+def _invoke_fused_qconv2d(
+    input,
+    weight,
+    input_zp,
+    weight_zp,
+    bias,
+    rescale,
+    padding,
+    stride,
+    dilation,
+    *,
+    norm: Optional[tuple[torch.Tensor, torch.Tensor, torch.Tensor]] = None,
+):
+    """Invokes a fused int8 conv kernel on an NCHW input and FCHW weight,
+    returning the dequantized NCHW result.
+
+    With `norm` (norm_scale, norm_shift and input_scale), the input is float and
+    normalized, activated and quantized in the kernel. The kernel runs channels
+    last if flagged, in which case the permutes cancel out between the convs of
+    a model which runs channels last throughout.
+    """
+    nhwc = debugging.flags.use_nhwc_int_conv_kernel
+    if nhwc:
+        input = input.permute(0, 2, 3, 1).contiguous()
+        weight = weight.permute(2, 3, 1, 0).contiguous()
+        kernel = (
+            kernels.qconv_2d_nhwc_hwcf
+            if norm is None
+            else kernels.qconv_2d_norm_silu_nhwc_hwcf
+        )
+    else:
+        kernel = (
+            kernels.qconv_2d_nchw_fchw
+            if norm is None
+            else kernels.qconv_2d_norm_silu_nchw_fchw
+        )
+    norm_args = () if norm is None else norm
+    y = kernel(
+        input,
+        *norm_args,
+        input_zp,
+        weight,
+        weight_zp,
+        bias,
+        rescale,
+        list(padding),
+        list(stride),
+        list(dilation),
+    )
+    if nhwc:
+        y = y.permute(0, 3, 1, 2)
+    return y
+
+
 def _invoke_int32_conv2d(input, weight, bias, stride, dilation, *, accum_dtype):
     """Does a low level invocation of a conv2d integer kernel on an explicitly padded input.
 
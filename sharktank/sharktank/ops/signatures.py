@@ -11,7 +11,7 @@ from typing import Optional, Sequence, Union, List
 import torch
 import numbers
 from torch import Tensor, dtype
-from ..types import AnyTensor, ShardedTensor, Theta, sharding
+from ..types import AnyTensor, QuantizerTensor, ShardedTensor, Theta, sharding
 
 from ._registry import *
 
@@ -22,6 +22,7 @@ __all__ = [
     "embedding_lookup",
     "equal",
     "group_norm_affine",
+    "group_norm_silu_conv2d",
     "layer_norm",
     "linear",
     "matmul",
@@ -31,6 +32,7 @@ __all__ = [
     "reshard",
     "reshard_split",
     "reshard_like",
+    "scaled_dot_product_attention",
     "sharded_cat",
     "sharded_sum",
     "unshard",
@@ -216,6 +218,70 @@ def _group_norm_affine_trampoline(
         d.fail(tensors)
 
 
+@overridable
+def group_norm_silu_conv2d(
+    input: AnyTensor,
+    norm_weight: AnyTensor,
+    norm_bias: AnyTensor,
+    weight: AnyTensor,
+    bias: Optional[AnyTensor] = None,
+    *,
+    num_groups: int,
+    eps: float,
+    input_quantizer: Optional[QuantizerTensor] = None,
+    stride: IntOrSequenceInt = 1,
+    padding: IntOrSequenceInt = 0,
+    dilation: IntOrSequenceInt = 1,
+) -> AnyTensor:
+    """Applies group_norm_affine, SiLU and conv2d in sequence.
+
+    If provided, `input_quantizer` quantizes the activations before the conv.
+    Quantized results are dequantized. Implementations may fuse the
+    normalization and activation into the conv so that the activations are
+    not re-read at each step.
+    """
+    raise NotImplementedError
+
+
+@group_norm_silu_conv2d.trampoline
+def _group_norm_silu_conv2d_trampoline(
+    d: SignatureDispatcher,
+    input: AnyTensor,
+    norm_weight: AnyTensor,
+    norm_bias: AnyTensor,
+    weight: AnyTensor,
+    bias: Optional[AnyTensor] = None,
+    *,
+    num_groups: int,
+    eps: float,
+    input_quantizer: Optional[QuantizerTensor] = None,
+    stride: IntOrSequenceInt = 1,
+    padding: IntOrSequenceInt = 0,
+    dilation: IntOrSequenceInt = 1,
+):
+    tensors = [input, norm_weight, norm_bias, weight]
+    if bias is not None:
+        tensors.append(bias)
+    for override in d.find_overrides(tensors):
+        result = override(
+            input,
+            norm_weight,
+            norm_bias,
+            weight,
+            bias,
+            num_groups=num_groups,
+            eps=eps,
+            input_quantizer=input_quantizer,
+            stride=stride,
+            padding=padding,
+            dilation=dilation,
+        )
+        if result is not NotImplemented:
+            return override, result
+    else:
+        d.fail(tensors)
+
+
 @overridable
 def layer_norm(
     input: AnyTensor, weight: AnyTensor, bias: Optional[AnyTensor], *, eps: float
@@ -451,6 +517,67 @@ def _reshard_like_trampoline(
         d.fail(tensors)
 
 
+@overridable
+def scaled_dot_product_attention(
+    q: AnyTensor,
+    k: AnyTensor,
+    v: AnyTensor,
+    attn_mask: Optional[AnyTensor] = None,
+    *,
+    is_causal: bool = False,
+    start_positions: Optional[AnyTensor] = None,
+    seq_lens: Optional[AnyTensor] = None,
+) -> AnyTensor:
+    """Computes `softmax(q @ k.T / sqrt(head_dim) + attn_mask) @ v`.
+
+    Like torch.nn.functional.scaled_dot_product_attention without dropout, but
+    with masking which implementations can compute rather than read:
+
+    * `q`: `[bs, head_count, sl, head_dim]`
+    * `k`, `v`: `[bs, head_count_kv, kv_sl, head_dim]`, where `head_count_kv`
+      divides `head_count` (GQA). K/V heads are shared by consecutive query
+      heads, as if repeat-interleaved.
+    * `attn_mask`: Optional additive mask, broadcastable to
+      `[bs, head_count, sl, kv_sl]`.
+    * `is_causal`: Query `i` of row `b` only attends to positions up to
+      `start_positions[b] + i` (`start_positions` defaults to 0).
+    * `seq_lens`: Optional `[bs]` number of valid K/V positions of each row.
+
+    Queries which attend to no position produce zeros. Returns
+    `[bs, head_count, sl, head_dim]`.
+    """
+    raise NotImplementedError
+
+
+@scaled_dot_product_attention.trampoline
+def _scaled_dot_product_attention_trampoline(
+    d: SignatureDispatcher,
+    q: AnyTensor,
+    k: AnyTensor,
+    v: AnyTensor,
+    attn_mask: Optional[AnyTensor] = None,
+    *,
+    is_causal: bool = False,
+    start_positions: Optional[AnyTensor] = None,
+    seq_lens: Optional[AnyTensor] = None,
+):
+    tensors = (q, k, v) if attn_mask is None else (q, k, v, attn_mask)
+    for override in d.find_overrides(tensors):
+        result = override(
+            q,
+            k,
+            v,
+            attn_mask,
+            is_causal=is_causal,
+            start_positions=start_positions,
+            seq_lens=seq_lens,
+        )
+        if result is not NotImplemented:
+            return override, result
+    else:
+        d.fail(tensors)
+
+
 @overridable
 def sharded_cat(maybe_sharded: AnyTensor):
     """Concats all shards along the sharding dimension.
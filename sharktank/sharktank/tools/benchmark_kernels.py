@@ -0,0 +1,573 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Benchmarks sharktank kernels compiled through IREE.
+
+Sweeps shapes representative of Llama 7B/70B and punet for each kernel,
+compiles every case for a target, times it and reports the achieved TFLOPs
+and GB/s against the peak of the device. Results can be written as JSON to
+track regressions (e.g. across compiler bumps) over time.
+
+Usage:
+  python -m sharktank.tools.benchmark_kernels \\
+    --iree-hal-target-backends=rocm --iree-hip-target=gfx942 --driver=hip \\
+    --device-peak=mi300x --filter='llama7b' --output-json=results.json
+"""
+
+from typing import Callable, Optional
+
+import dataclasses
+from dataclasses import dataclass, field
+import importlib.metadata
+import json
+import math
+from pathlib import Path
+import re
+import statistics
+import sys
+import time
+
+import torch
+import torch.nn.functional as F
+
+from .. import kernels
+
+
+@dataclass
+class DevicePeak:
+    """Peak throughput of a device, used as the roofline.
+
+    `tflops` is keyed by the dtype of the kernel inputs, as devices have very
+    different peaks for each.
+    """
+
+    tflops: dict[str, float]
+    gbps: float
+
+    def peak_tflops(self, dtype: str) -> Optional[float]:
+        return self.tflops.get(dtype)
+
+
+# Dense (non-sparse) vendor peaks.
+DEVICE_PEAKS: dict[str, DevicePeak] = {
+    "mi300x": DevicePeak(
+        tflops={"float32": 163.4, "float16": 1307.4, "int8": 2614.9}, gbps=5300.0
+    ),
+    "mi250x": DevicePeak(
+        tflops={"float32": 95.7, "float16": 383.0, "int8": 383.0}, gbps=3276.8
+    ),
+}
+
+
+@dataclass
+class KernelBenchmarkCase:
+    """A kernel invocation of a fixed shape to benchmark.
+
+    Args are created lazily, as a full sweep would otherwise hold all of its
+    (large) inputs at once.
+    """
+
+    name: str
+    kernel: str
+    create_module: Callable[[], torch.nn.Module]
+    create_args: Callable[[], list[torch.Tensor]]
+    flops: int
+    # Dtype of the kernel inputs, which selects the peak throughput.
+    dtype: str
+    shapes: dict[str, list[int]] = field(default_factory=dict)
+
+
+class _KernelModule(torch.nn.Module):
+    def __init__(self, kernel: Callable, *attrs):
+        super().__init__()
+        self.kernel = kernel
+        self.attrs = attrs
+
+    def forward(self, *args):
+        return self.kernel(*args, *self.attrs)
+
+
+def _rand(shape: list[int], dtype: torch.dtype, scale: float = 1.0) -> torch.Tensor:
+    if dtype.is_floating_point:
+        return (torch.rand(shape, dtype=torch.float32) * scale).to(dtype)
+    return torch.randint(-8, 8, shape).to(dtype)
+
+
+# Projections of the attention blocks as (name, N, K). The fused QKV
+# projection of Llama 7B (32 heads of 128, no GQA) is three 4096 wide ones.
+_LLAMA_PROJECTIONS = {
+    "llama7b": [
+        ("attn_qkv", 3 * 4096, 4096),
+        ("ffn_up", 11008, 4096),
+        ("ffn_down", 4096, 11008),
+    ],
+    "llama70b": [
+        ("attn_q", 8192, 8192),
+        ("attn_kv", 1024, 8192),
+        ("ffn_up", 28672, 8192),
+        ("ffn_down", 8192, 28672),
+    ],
+}
+
+# Attention head counts and dims as (heads, head_dim).
+_LLAMA_ATTENTION = {
+    "llama7b": (32, 128),
+    "llama70b": (64, 128),
+}
+
+# The phases as (name, batch, M), where attention attends over a context
+# of M tokens in prefill and of _DECODE_CONTEXT tokens in decode.
+_LLAMA_PHASES = [
+    ("decode", 4, 1),
+    ("prefill", 1, 512),
+]
+_DECODE_CONTEXT = 2048
+
+# Resnet block convolutions of the punet as (C, H, W) at a batch of 2.
+_PUNET_CONVS = [
+    (320, 128, 128),
+    (640, 64, 64),
+    (1280, 32, 32),
+]
+
+
+def _mmtfp_cases() -> list[KernelBenchmarkCase]:
+    cases = []
+    for model, projections in _LLAMA_PROJECTIONS.items():
+        for proj, n, k in projections:
+            for phase, batch, m in _LLAMA_PHASES:
+                a_shape = [batch, m, k]
+                bT_shape = [n, k]
+                cases.append(
+                    KernelBenchmarkCase(
+                        name=f"mmtfp/{model}/{proj}/{phase}",
+                        kernel="mmtfp",
+                        create_module=lambda: _KernelModule(kernels.mmtfp),
+                        create_args=lambda a_shape=a_shape, bT_shape=bT_shape: [
+                            _rand(a_shape, torch.float16),
+                            _rand(bT_shape, torch.float16),
+                        ],
+                        flops=2 * batch * m * n * k,
+                        dtype="float16",
+                        shapes={"a": a_shape, "bT": bT_shape},
+                    )
+                )
+    return cases
+
+
+def _batch_matmul_transpose_b_cases() -> list[KernelBenchmarkCase]:
+    # The attention scores of each head, Q @ K^T.
+    cases = []
+    for model, (heads, head_dim) in _LLAMA_ATTENTION.items():
+        for phase, batch, m in _LLAMA_PHASES:
+            n = _DECODE_CONTEXT if phase == "decode" else m
+            lhs_shape = [batch * heads, m, head_dim]
+            rhs_shape = [batch * heads, n, head_dim]
+            cases.append(
+                KernelBenchmarkCase(
+                    name=f"batch_matmul_transpose_b/{model}/attn_scores/{phase}",
+                    kernel="batch_matmul_transpose_b",
+                    create_module=lambda: _KernelModule(
+                        kernels.batch_matmul_transpose_b
+                    ),
+                    create_args=lambda lhs_shape=lhs_shape, rhs_shape=rhs_shape: [
+                        _rand(lhs_shape, torch.float16),
+                        _rand(rhs_shape, torch.float16),
+                    ],
+                    flops=2 * batch * heads * m * n * head_dim,
+                    dtype="float16",
+                    shapes={"lhs": lhs_shape, "rhs": rhs_shape},
+                )
+            )
+    return cases
+
+
+def _block_scaled_args(
+    a_shape: list[int], n: int, k: int, block_size: int, *, packed_i4: bool, offset
+) -> Callable[[], list[torch.Tensor]]:
+    def create_args():
+        d = _rand([n, k // block_size, 1], torch.float16, 1.0 / 256)
+        if packed_i4:
+            qs = torch.randint(0, 256, [n, k // block_size, block_size // 2])
+            qs = qs.to(torch.uint8)
+        else:
+            qs = torch.randint(-128, 128, [n, k // block_size, block_size])
+            qs = qs.to(torch.int8)
+        args = [_rand(a_shape, torch.float16), d, qs]
+        if offset:
+            args.append(_rand([n, k // block_size, 1], torch.float16))
+        return args
+
+    return create_args
+
+
+def _super_block_scaled_args(
+    a_shape: list[int], n: int, k: int
+) -> Callable[[], list[torch.Tensor]]:
+    def create_args():
+        sb_count = k // 256
+
+        def u8(*shape):
+            return torch.randint(0, 256, [n, sb_count, *shape]).to(torch.uint8)
+
+        return [
+            _rand(a_shape, torch.float16),
+            _rand([n, sb_count, 1], torch.float16, 1.0 / 256),
+            _rand([n, sb_count, 1], torch.float16, 1.0 / 256),
+            u8(2),
+            u8(4),
+            u8(2),
+            u8(4),
+            u8(8, 16),
+        ]
+
+    return create_args
+
+
+def _block_scaled_mmt_cases() -> list[KernelBenchmarkCase]:
+    # Decode runs the GEMV specializations, which `ops.matmul` prefers for
+    # few rows, and prefill the general kernels.
+    variants = [
+        ("mmt_block_scaled_q8", "mmt_block_scaled_q8_gemv", 32, False, False),
+        (
+            "mmt_block_scaled_offset_q4_unsigned",
+            "mmt_block_scaled_offset_q4_unsigned_gemv",
+            32,
+            True,
+            True,
+        ),
+    ]
+    cases = []
+    for model, projections in _LLAMA_PROJECTIONS.items():
+        for proj, n, k in projections:
+            for phase, batch, m in _LLAMA_PHASES:
+                a_shape = [batch, m, k]
+                flops = 2 * batch * m * n * k
+                for gemm_name, gemv_name, bs, packed_i4, offset in variants:
+                    kernel_name = gemv_name if m <= kernels.GEMV_MAX_M else gemm_name
+                    kernel = getattr(kernels, kernel_name)
+                    cases.append(
+                        KernelBenchmarkCase(
+                            name=f"{kernel_name}/{model}/{proj}/{phase}",
+                            kernel=kernel_name,
+                            create_module=lambda kernel=kernel: _KernelModule(kernel),
+                            create_args=_block_scaled_args(
+                                a_shape, n, k, bs, packed_i4=packed_i4, offset=offset
+                            ),
+                            flops=flops,
+                            dtype="float16",
+                            shapes={"a": a_shape, "b": [n, k]},
+                        )
+                    )
+                kernel_name = "mmt_super_block_scaled_offset_q4_unsigned"
+                cases.append(
+                    KernelBenchmarkCase(
+                        name=f"{kernel_name}/{model}/{proj}/{phase}",
+                        kernel=kernel_name,
+                        create_module=lambda: _KernelModule(
+                            kernels.mmt_super_block_scaled_offset_q4_unsigned
+                        ),
+                        create_args=_super_block_scaled_args(a_shape, n, k),
+                        flops=flops,
+                        dtype="float16",
+                        shapes={"a": a_shape, "b": [n, k]},
+                    )
+                )
+    return cases
+
+
+def _conv_2d_nchw_fchw_cases() -> list[KernelBenchmarkCase]:
+    # The templates only support integer types, so these are the int8 convs
+    # of a quantized punet.
+    cases = []
+    for c, h, w in _PUNET_CONVS:
+        inputs_shape = [2, c, h, w]
+        weights_shape = [c, c, 3, 3]
+
+        def create_args(inputs_shape=inputs_shape, weights_shape=weights_shape):
+            inputs = F.pad(_rand(inputs_shape, torch.int8), [1, 1, 1, 1])
+            weights = _rand(weights_shape, torch.int8)
+            bias = _rand(weights_shape[0:1], torch.int8)
+            return [inputs, weights, bias]
+
+        cases.append(
+            KernelBenchmarkCase(
+                name=f"conv_2d_nchw_fchw/punet/resnet_{c}x{h}x{w}",
+                kernel="conv_2d_nchw_fchw",
+                create_module=lambda: _KernelModule(
+                    kernels.conv_2d_nchw_fchw, [1, 1], [1, 1]
+                ),
+                create_args=create_args,
+                flops=2 * 2 * c * h * w * c * 3 * 3,
+                dtype="int8",
+                shapes={"inputs": inputs_shape, "weights": weights_shape},
+            )
+        )
+    return cases
+
+
+def _pooling_nchw_sum_cases() -> list[KernelBenchmarkCase]:
+    # Downsampling 2x2 sum pools at the punet resolutions.
+    cases = []
+    for c, h, w in _PUNET_CONVS:
+        inputs_shape = [2, c, h, w]
+        cases.append(
+            KernelBenchmarkCase(
+                name=f"pooling_nchw_sum/punet/downsample_{c}x{h}x{w}",
+                kernel="pooling_nchw_sum",
+                create_module=lambda: _KernelModule(
+                    kernels.pooling_nchw_sum, [2, 2], [2, 2], [1, 1]
+                ),
+                create_args=lambda inputs_shape=inputs_shape: [
+                    _rand(inputs_shape, torch.int8)
+                ],
+                flops=2 * c * h * w,
+                dtype="int8",
+                shapes={"inputs": inputs_shape},
+            )
+        )
+    return cases
+
+
+def all_cases() -> list[KernelBenchmarkCase]:
+    return (
+        _mmtfp_cases()
+        + _batch_matmul_transpose_b_cases()
+        + _block_scaled_mmt_cases()
+        + _conv_2d_nchw_fchw_cases()
+        + _pooling_nchw_sum_cases()
+    )
+
+
+def roofline(
+    flops: int, nbytes: int, seconds: float, dtype: str, peak: Optional[DevicePeak]
+) -> dict:
+    """Reports achieved throughput of a kernel against the device roofline.
+
+    The bytes are the minimum traffic of the kernel (reading its inputs and
+    writing its results once), so the achieved GB/s are a lower bound.
+    """
+    report = {
+        "tflops": flops / seconds / 1e12,
+        "gbps": nbytes / seconds / 1e9,
+        "arithmetic_intensity": flops / nbytes,
+    }
+    if peak is None:
+        return report
+    peak_tflops = peak.peak_tflops(dtype)
+    memory_seconds = nbytes / (peak.gbps * 1e9)
+    compute_seconds = 0.0 if peak_tflops is None else flops / (peak_tflops * 1e12)
+    report.update(
+        {
+            "bound": "compute" if compute_seconds > memory_seconds else "memory",
+            "peak_tflops_fraction": (
+                None if peak_tflops is None else report["tflops"] / peak_tflops
+            ),
+            "peak_gbps_fraction": report["gbps"] / peak.gbps,
+            "roofline_fraction": max(compute_seconds, memory_seconds) / seconds,
+        }
+    )
+    return report
+
+
+def _nbytes(t) -> int:
+    return math.prod(t.shape) * t.dtype.itemsize
+
+
+class IreeKernelRunner:
+    """Compiles cases through IREE and times them on a device."""
+
+    def __init__(self, target_backends: list[str], extra_args: list[str], driver):
+        import iree.runtime as rt
+
+        self.target_backends = target_backends
+        self.extra_args = extra_args
+        self.config = rt.Config(driver)
+
+    def compile(self, case: KernelBenchmarkCase, args: list[torch.Tensor]) -> bytes:
+        from shark_turbine import aot
+        from iree.compiler import compile_str
+
+        ep = torch.export.export(case.create_module(), args=tuple(args))
+        output = aot.export(ep)
+        return compile_str(
+            str(output.mlir_module),
+            target_backends=self.target_backends,
+            extra_args=self.extra_args,
+        )
+
+    def time(
+        self, vmfb: bytes, args: list[torch.Tensor], *, warmup: int, iterations: int
+    ) -> tuple[list[float], int]:
+        """Returns the per-iteration seconds and the bytes of the results."""
+        import iree.runtime as rt
+
+        vm_module = rt.VmModule.copy_buffer(self.config.vm_instance, vmfb)
+        context = rt.SystemContext(config=self.config)
+        context.add_vm_module(vm_module)
+        main = context.modules.module["main"]
+        device_args = [
+            rt.asdevicearray(self.config.device, arg.numpy()) for arg in args
+        ]
+        for _ in range(warmup):
+            results = main(*device_args)
+        # Invocations through the system context wait for their results.
+        times = []
+        for _ in range(iterations):
+            start = time.perf_counter()
+            results = main(*device_args)
+            times.append(time.perf_counter() - start)
+        if not isinstance(results, (list, tuple)):
+            results = [results]
+        return times, sum(_nbytes(r) for r in results)
+
+
+def run_case(
+    runner: IreeKernelRunner,
+    case: KernelBenchmarkCase,
+    peak: Optional[DevicePeak],
+    *,
+    warmup: int,
+    iterations: int,
+) -> dict:
+    args = case.create_args()
+    vmfb = runner.compile(case, args)
+    times, result_bytes = runner.time(
+        vmfb, args, warmup=warmup, iterations=iterations
+    )
+    seconds = statistics.median(times)
+    nbytes = sum(_nbytes(arg) for arg in args) + result_bytes
+    return {
+        "name": case.name,
+        "kernel": case.kernel,
+        "dtype": case.dtype,
+        "shapes": case.shapes,
+        "flops": case.flops,
+        "bytes": nbytes,
+        "median_ms": seconds * 1e3,
+        "min_ms": min(times) * 1e3,
+        "mean_ms": statistics.mean(times) * 1e3,
+        **roofline(case.flops, nbytes, seconds, case.dtype, peak),
+    }
+
+
+def _package_version(name: str) -> Optional[str]:
+    try:
+        return importlib.metadata.version(name)
+    except importlib.metadata.PackageNotFoundError:
+        return None
+
+
+def main():
+    from ..utils import cli
+
+    parser = cli.create_parser(description="Benchmarks sharktank kernels")
+    parser.add_argument(
+        "--iree-hal-target-backends",
+        default="llvm-cpu",
+        help="IREE target backends to compile for",
+    )
+    parser.add_argument(
+        "--iree-compile-arg",
+        action="append",
+        default=[],
+        help="Extra flag for iree-compile (e.g. --iree-hip-target=gfx942)",
+    )
+    parser.add_argument("--driver", default="local-task", help="IREE runtime driver")
+    parser.add_argument(
+        "--device-peak",
+        choices=list(DEVICE_PEAKS.keys()),
+        help="Known device to report the roofline against",
+    )
+    parser.add_argument(
+        "--peak-tflops",
+        type=float,
+        help="Peak TFLOPs of the device for all dtypes (overrides --device-peak)",
+    )
+    parser.add_argument(
+        "--peak-gbps",
+        type=float,
+        help="Peak memory bandwidth of the device in GB/s",
+    )
+    parser.add_argument(
+        "--filter", type=str, help="Only runs cases whose name matches a regex"
+    )
+    parser.add_argument("--list", action="store_true", help="List cases and exit")
+    parser.add_argument("--warmup", type=int, default=3)
+    parser.add_argument("--iterations", type=int, default=20)
+    parser.add_argument("--output-json", type=Path, help="Write the results to JSON")
+    args, unknown_args = parser.parse_known_args()
+    # Unknown --iree-* flags are passed to the compiler as well.
+    for a in unknown_args:
+        if not a.startswith("--iree-"):
+            parser.error(f"unrecognized argument: {a}")
+
+    cases = all_cases()
+    if args.filter is not None:
+        cases = [c for c in cases if re.search(args.filter, c.name)]
+    if args.list:
+        for case in cases:
+            print(case.name)
+        return
+
+    peak = DEVICE_PEAKS.get(args.device_peak)
+    if args.peak_tflops is not None or args.peak_gbps is not None:
+        assert (
+            args.peak_tflops is not None and args.peak_gbps is not None
+        ), "--peak-tflops and --peak-gbps must be given together"
+        peak = DevicePeak(
+            tflops={c.dtype: args.peak_tflops for c in cases}, gbps=args.peak_gbps
+        )
+
+    extra_args = args.iree_compile_arg + unknown_args
+    runner = IreeKernelRunner(
+        args.iree_hal_target_backends.split(","), extra_args, args.driver
+    )
+    results = []
+    for case in cases:
+        print(f"{case.name}: ", end="", flush=True)
+        try:
+            result = run_case(
+                runner, case, peak, warmup=args.warmup, iterations=args.iterations
+            )
+        except Exception as e:
+            print(f"FAILED ({e})")
+            results.append({"name": case.name, "kernel": case.kernel, "error": str(e)})
+            continue
+        line = (
+            f"{result['median_ms']:.3f} ms, {result['tflops']:.2f} TFLOPs, "
+            f"{result['gbps']:.1f} GB/s"
+        )
+        if "roofline_fraction" in result:
+            line += (
+                f" ({result['roofline_fraction'] * 100:.1f}% of "
+                f"{result['bound']} roofline)"
+            )
+        print(line)
+        results.append(result)
+
+    if args.output_json is not None:
+        report = {
+            "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+            "target_backends": runner.target_backends,
+            "compile_args": extra_args,
+            "driver": args.driver,
+            "versions": {
+                name: _package_version(name)
+                for name in ["iree-compiler", "iree-runtime", "torch"]
+            },
+            "peak": None if peak is None else dataclasses.asdict(peak),
+            "results": results,
+        }
+        args.output_json.write_text(json.dumps(report, indent=2))
+        print(f"Wrote results to {args.output_json}")
+
+    if any("error" in r for r in results):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -44,10 +44,13 @@ def main():
     for key, value in config.properties.items():
         print(f"  {key} = {value} (of {type(value)})")
     print("Tensors:")
-    for tensor in config.root_theta.flatten().values():
+    # Filter by name first so that lazily loaded tensors which are not dumped
+    # are never materialized.
+    for tensor_name in config.root_theta.tensor_names():
         if args.tensor_regex is not None:
-            if not re.search(args.tensor_regex, tensor.name):
+            if not re.search(args.tensor_regex, tensor_name):
                 continue
+        tensor = config.root_theta.tensor(tensor_name)
         print(f"  {tensor}")
         if isinstance(tensor, PrimitiveTensor):
             torch_tensor = tensor.as_torch()
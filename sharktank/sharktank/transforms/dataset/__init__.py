@@ -4,4 +4,7 @@
 # See https://llvm.org/LICENSE.txt for license information.
 # SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+from .fusion import *
+from .packing import *
+from .quantization import *
 from .sharding import *
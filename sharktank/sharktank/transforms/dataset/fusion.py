@@ -0,0 +1,158 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from typing import Optional
+
+import torch
+
+from ...types import *
+from ...utils.logging import transform_logger as logger
+
+__all__ = [
+    "LLAMA_FUSED_PROJECTIONS",
+    "FuseProjectionsTransform",
+]
+
+# Fused layer names of the llama attention blocks and the layers they fuse,
+# in the order of their output features.
+LLAMA_FUSED_PROJECTIONS = {
+    "attn_qkv": ["attn_q", "attn_k", "attn_v"],
+    "ffn_gate_up": ["ffn_gate", "ffn_up"],
+}
+
+
+class FuseProjectionsTransform:
+    """Fuses linear layers that share their input into one layer.
+
+    For every sub-theta that has all layers of a group, the weights (and
+    biases) of the layers are concatenated along the output features into a
+    single layer named after the group. Quantized weights are fused plane by
+    plane, which covers layouts whose planes are all blocked by output
+    feature, like the block scaled Q4/Q8 layouts. Groups that cannot be fused
+    (e.g. per-tensor scaled weights or differing input premultipliers) are
+    left as they are.
+
+    Unlike tensor transforms, this transforms a whole Theta, as it has to see
+    all layers of a group at once.
+    """
+
+    def __init__(
+        self,
+        groups: dict[str, list[str]] = LLAMA_FUSED_PROJECTIONS,
+        *,
+        skip_on_unsupported: bool = True,
+    ):
+        self.groups = groups
+        self.skip_on_unsupported = skip_on_unsupported
+
+    def __call__(self, theta: Theta) -> Theta:
+        return Theta(self._transform_tree(theta, prefix=""))
+
+    def _transform_tree(self, theta: Theta, prefix: str) -> dict:
+        tree = {}
+        fused_members = set()
+        keys = theta.keys
+        for fused_name, members in self.groups.items():
+            if not all(m in keys for m in members):
+                continue
+            fused = self._fuse(
+                [theta(m) for m in members],
+                name=f"{prefix}{fused_name}",
+            )
+            if fused is None:
+                continue
+            tree[fused_name] = fused
+            fused_members.update(members)
+
+        for key in keys:
+            if key in fused_members:
+                continue
+            child = theta(key)
+            if isinstance(child, Theta):
+                tree[key] = self._transform_tree(child, prefix=f"{prefix}{key}.")
+            else:
+                tree[key] = child
+        return tree
+
+    def _fuse(self, layers: list[Theta], name: str) -> Optional[dict]:
+        key_set = set(layers[0].keys)
+        if any(set(layer.keys) != key_set for layer in layers):
+            return self._unsupported(name, "layers have different tensors")
+        if not key_set <= {"weight", "bias", "premul_input"}:
+            return self._unsupported(name, "layers have input quantizers")
+
+        fused = {}
+        if "premul_input" in key_set:
+            premul_input = layers[0].tensor("premul_input")
+            if not all(
+                torch.equal(
+                    layer.tensor("premul_input").as_torch(), premul_input.as_torch()
+                )
+                for layer in layers[1:]
+            ):
+                return self._unsupported(name, "input premultipliers differ")
+            fused["premul_input"] = premul_input
+        for tensor_name in ["weight", "bias"]:
+            if tensor_name not in key_set:
+                continue
+            fused_tensor = _concat_output_features(
+                [layer.tensor(tensor_name) for layer in layers],
+                name=f"{name}.{tensor_name}",
+            )
+            if fused_tensor is None:
+                return self._unsupported(name, f"unsupported {tensor_name} layout")
+            fused[tensor_name] = fused_tensor
+        logger.debug("Fusing %s from %d layers", name, len(layers))
+        return fused
+
+    def _unsupported(self, name: str, reason: str) -> None:
+        if not self.skip_on_unsupported:
+            raise ValueError(f"Cannot fuse {name}: {reason}")
+        logger.debug("Skipping fusion of %s: %s", name, reason)
+        return None
+
+    def __repr__(self):
+        return f"FuseProjectionsTransform(groups={self.groups})"
+
+
+def _concat_output_features(
+    ts: list[InferenceTensor], name: str
+) -> Optional[InferenceTensor]:
+    """Concatenates tensors along dim 0, the output features of a weight."""
+    if any(t.shape[1:] != ts[0].shape[1:] for t in ts):
+        return None
+    shape = [sum(t.shape[0] for t in ts)] + list(ts[0].shape[1:])
+    if all(isinstance(t, PrimitiveTensor) for t in ts):
+        return DefaultPrimitiveTensor(
+            name=name, data=torch.cat([t.as_torch() for t in ts])
+        )
+    if not all(isinstance(t, QuantizedTensor) for t in ts):
+        return None
+
+    layouts = [t.unpack() for t in ts]
+    layout_type = type(layouts[0])
+    metadata = layouts[0].metadata
+    if any(type(l) is not layout_type or l.metadata != metadata for l in layouts):
+        return None
+    planes = [l.planes for l in layouts]
+    plane_names = planes[0].keys()
+    fused_planes = {}
+    for plane_name in plane_names:
+        parts = []
+        for t, p in zip(ts, planes):
+            if p.keys() != plane_names:
+                return None
+            plane = p[plane_name]
+            # Only planes blocked by output feature can be concatenated.
+            if plane.dim() == 0 or plane.shape[0] != t.shape[0]:
+                return None
+            parts.append(plane)
+        fused_planes[plane_name] = torch.cat(parts)
+    return PlanarQuantizedTensor(
+        name=name,
+        shape=shape,
+        layout=layout_type.create(shape, metadata, fused_planes),
+    )
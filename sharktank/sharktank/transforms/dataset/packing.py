@@ -0,0 +1,54 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import torch
+
+from ...types import *
+from ...utils.logging import transform_logger as logger
+
+__all__ = [
+    "PackQuantizedTransform",
+]
+
+
+class PackQuantizedTransform:
+    """Repacks quantized tensors into their planar layouts.
+
+    Vendor packed tensors, like the GGUF Q4_K/Q8_0 structs, are unpacked on
+    every `unpack()`, which re-does the sample and scale folding of Q5_K/Q6_K
+    and the plane extraction of the others for every matmul of an eager run,
+    and yields strided views over the packed blocks. This unpacks each of them
+    once into a PlanarQuantizedTensor whose planes are contiguous and are
+    exactly the operands of the `mmt_*` kernels for the layout.
+
+    The planes of a layout are kept in the form its kernel consumes. For Q4_K
+    (`SuperBlockOffsetScaled_4_6_Layout`) that is bit packed: the 6 bit
+    sub-block scales and mins and the 4 bit samples stay packed, and only the
+    generic dequantizing fallback (`sb_scales`, `sb_mins` and `qs`) unpacks
+    them on access.
+
+    `Dataset.save` stores any quantized tensor in planar form already, so this
+    mostly matters for running a dataset in memory without a round trip
+    through a saved file. Tensors that are already planar, or are not
+    quantized, are kept.
+    """
+
+    def __call__(self, it: InferenceTensor):
+        if isinstance(it, PlanarQuantizedTensor) or not isinstance(
+            it, QuantizedTensor
+        ):
+            return it
+        layout = it.unpack()
+        planes = {k: v.contiguous() for k, v in layout.planes.items()}
+        packed_layout = type(layout).create(it.shape, layout.metadata, planes)
+        packed = PlanarQuantizedTensor(
+            name=it.name, shape=it.shape, layout=packed_layout
+        )
+        logger.debug("Packing tensor %r -> %r", it, packed)
+        return packed
+
+    def __repr__(self):
+        return "PackQuantizedTransform()"
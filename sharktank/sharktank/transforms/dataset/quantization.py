@@ -0,0 +1,64 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from typing import Optional, Union
+
+import re
+
+import torch
+
+from ...types import *
+from ...utils.logging import transform_logger as logger
+
+__all__ = [
+    "QuantizeTransform",
+]
+
+
+class QuantizeTransform:
+    """Quantizes floating point tensors matching a pattern with its quantizer.
+
+    `rules` are (pattern, quantizer) pairs, of which the first whose pattern
+    matches the tensor name applies, so that one pass can mix schemes (e.g.
+    per-channel attention and block scaled FFN weights). Tensors matching no
+    rule, or which are not floating point PrimitiveTensors, are kept.
+
+    If a `device` is given, tensors are quantized on it and the results are
+    moved back to the CPU.
+    """
+
+    def __init__(
+        self,
+        rules: list[tuple[Union[str, re.Pattern], QuantizerTensor]],
+        *,
+        device: Optional[Union[str, torch.device]] = None,
+    ):
+        self.rules = [(re.compile(p), q) for p, q in rules]
+        self.device = device
+
+    def __call__(self, it: InferenceTensor):
+        quantizer = self._find_quantizer(it.name)
+        if quantizer is None or not isinstance(it, PrimitiveTensor):
+            return it
+        t = it.as_torch()
+        if not t.dtype.is_floating_point:
+            return it
+        if self.device is not None:
+            t = t.to(device=self.device)
+        quantized = quantizer.quantize(t, name=it.name)
+        if self.device is not None:
+            quantized = quantized.to(device="cpu")
+        logger.debug("Quantizing tensor %r with %r", it, quantizer)
+        return quantized
+
+    def _find_quantizer(self, name: str) -> Optional[QuantizerTensor]:
+        for pattern, quantizer in self.rules:
+            if pattern.match(name):
+                return quantizer
+        return None
+
+    def __repr__(self):
+        return f"QuantizeTransform(rules={self.rules}, device={self.device})"
@@ -80,9 +80,13 @@ def _externalize_tensor(
     # Important: The annotation tag must be set on the actual leaf tensor
     # which is stored in the root theta. This means that any shaping or
     # data type massaging has to happen *before* annotating.
-    data_tensor = torch.tensor(data)
+    # The tensor aliases the file mapping instead of copying it, so loading
+    # only faults in what is touched and clean pages are shared (via the page
+    # cache) by every process that maps the same file. Shaping must therefore
+    # be a view.
+    data_tensor = torch.from_numpy(data)
     if logical_shape is not None:
-        data_tensor = data_tensor.reshape(logical_shape)
+        data_tensor = data_tensor.view(logical_shape)
     ExternalTensorTrait(external_name=name, external_scope="").set(data_tensor)
     return data_tensor
 
@@ -113,7 +117,13 @@ def _wrap_tensor(
 
 
 def load_file(gguf_path: Union[str, os.PathLike]) -> Dataset:
-    reader = GGUFReader(gguf_path)
+    """Loads a GGUF file as a Dataset whose tensors are backed by a mapping of
+    the file.
+
+    The file is mapped copy-on-write: tensors are writable (as torch expects)
+    but mutations stay private to the process and never reach the file.
+    """
+    reader = GGUFReader(gguf_path, "c")
     logger.info(
         "Loading gguf file %s (%d fields, %d tensors)",
         gguf_path,
@@ -24,6 +24,8 @@ from ..layout_utils import (
 __all__ = [
     "Q4_1",
     "Q4_K",
+    "Q5_K",
+    "Q6_K",
     "Q8_0",
 ]
 
@@ -217,17 +219,94 @@ def _unpack_gguf_i6_scale_mins(
     return d_high, d_low, m_high, m_low
 
 
-class Q5_K(QuantizedTensor[BlockScaledI4Layout]):
-    """"""
+def _unpack_gguf_k4_scale_mins(
+    raw: torch.Tensor,
+) -> tuple[torch.Tensor, torch.Tensor]:
+    # Unpacks the 6 bit scales and mins of a K super-block (12 bytes) into two
+    # linear uint8 tensors of 8 values each. This mirrors get_scale_min_k4 in
+    # ggml and is used where the sub-block scales are folded into planar
+    # per-block scales rather than kept bit-packed.
+    assert raw.dtype == torch.uint8
+    assert raw.size(-1) == 12
+    q_0_3 = raw[..., 0:4]
+    q_4_7 = raw[..., 4:8]
+    q_8_11 = raw[..., 8:12]
+    scales = torch.cat([q_0_3 & 0x3F, (q_8_11 & 0xF) | ((q_0_3 >> 6) << 4)], dim=-1)
+    mins = torch.cat([q_4_7 & 0x3F, (q_8_11 >> 4) | ((q_4_7 >> 6) << 4)], dim=-1)
+    return scales, mins
+
+
+class Q5_K(QuantizedTensor[BlockScaledLayout]):
+    """Implements the Q5_K quantization scheme.
+
+    ```
+    #define QK_K 256
+    #define K_SCALE_SIZE 12
+    typedef struct {
+        union {
+            struct {
+                ggml_half d;    // super-block scale for quantized scales
+                ggml_half dmin; // super-block scale for quantized mins
+            } GGML_COMMON_AGGR;
+            ggml_half2 dm;
+        };
+        uint8_t scales[K_SCALE_SIZE]; // scales and mins, quantized with 6 bits
+        uint8_t qh[QK_K/8];           // quants, high bit
+        uint8_t qs[QK_K/2];           // quants, low 4 bits
+    } block_q5_K;
+    ```
+
+    There is no 5 bit layout, so this unpacks to a BlockScaledLayout of 32
+    sample blocks with the unsigned 5 bit quants widened to int8. The super-block
+    scales are folded into the per-block `d` and `m` (pre-scaled and negated, as
+    in `d * qs + m`), which are rounded to f16.
+    """
 
     def __init__(
         self, *, raw: torch.Tensor, shape: list[int], name: str = UnnamedTensorName
     ):
-        super().__init__(name=name, shape=shape, layout_type=BlockScaledI4Layout)
+        super().__init__(name=name, shape=shape, layout_type=BlockScaledLayout)
         self.raw = raw
 
-    def unpack(self) -> BlockScaledI4Layout:
-        raise NotImplementedError
+    def unpack(self) -> BlockScaledLayout:
+        # Blocks are 88 i16s, so start there.
+        # [0] f16: d
+        # [1] f16: dmin
+        # [2:8] 12 * i8: 6 * i16: scales, mins
+        # [8:24] 32 * i8: 16 * i16: qh
+        # [24:88] 128 * i8: 64 * i16: qs
+        linear_blocks = self.raw.view(torch.int16).reshape(-1, 88)
+        # Reblock to the result shape, excluding the final dimension, which is
+        # expanded.
+        block_shape = self.shape[0:-1] + [-1, 88]
+        blocks = linear_blocks.reshape(block_shape)
+        d = blocks[..., 0:1].view(torch.float16)
+        dmin = blocks[..., 1:2].view(torch.float16)
+        scales, mins = _unpack_gguf_k4_scale_mins(blocks[..., 2:8].view(torch.uint8))
+        qh = blocks[..., 8:24].view(torch.uint8)
+        ql = blocks[..., 24:].view(torch.uint8)
+
+        # Each group of 64 samples takes the low nibbles and then the high
+        # nibbles of 32 bytes of `ql`, with the fifth bit of each taken from
+        # consecutive bit pairs of `qh`.
+        ql = ql.unflatten(dim=-1, sizes=(4, 32))
+        qh = qh.unsqueeze(-2)
+        shift = torch.arange(0, 8, 2, dtype=torch.uint8, device=qh.device)
+        shift = shift.unsqueeze(-1)
+        qs_low = (ql & 0xF) | (((qh >> shift) & 1) << 4)
+        qs_high = (ql >> 4) | (((qh >> (shift + 1)) & 1) << 4)
+        # [..., 4, 2, 32] -> [..., 8, 32] sub-blocks per super-block.
+        qs = torch.stack([qs_low, qs_high], dim=-2).view(torch.int8)
+        qs = qs.flatten(-3, -2)
+
+        d = (d.to(torch.float32) * scales.to(torch.float32)).to(torch.float16)
+        m = (-dmin.to(torch.float32) * mins.to(torch.float32)).to(torch.float16)
+        # Ungroup the super-blocks: [..., K // 32, 1] scales and offsets and
+        # [..., K // 32, 32] qs.
+        d = d.flatten(-2).unsqueeze(-1)
+        m = m.flatten(-2).unsqueeze(-1)
+        qs = qs.flatten(-3, -2)
+        return BlockScaledLayout(self.shape, d, qs, m=m)
 
     @property
     def globals(self):
@@ -237,17 +316,62 @@ class Q5_K(QuantizedTensor[BlockScaledI4Layout]):
         return f"Q5_K({self.name}, {self.shape})"
 
 
-class Q6_K(QuantizedTensor[BlockScaledI4Layout]):
-    """"""
+class Q6_K(QuantizedTensor[BlockScaledLayout]):
+    """Implements the Q6_K quantization scheme.
+
+    ```
+    #define QK_K 256
+    typedef struct {
+        uint8_t ql[QK_K/2];      // quants, lower 4 bits
+        uint8_t qh[QK_K/4];      // quants, upper 2 bits
+        int8_t  scales[QK_K/16]; // scales, quantized with 8 bits
+        ggml_half d;             // super-block scale
+    } block_q6_K;
+    ```
+
+    The 6 bit quants are signed by subtracting 32 and unpack to a
+    BlockScaledLayout of 16 sample blocks of int8. The super-block scale is
+    folded into the per-block `d`, which is rounded to f16.
+    """
 
     def __init__(
         self, *, raw: torch.Tensor, shape: list[int], name: str = UnnamedTensorName
     ):
-        super().__init__(name=name, shape=shape, layout_type=BlockScaledI4Layout)
+        super().__init__(name=name, shape=shape, layout_type=BlockScaledLayout)
         self.raw = raw
 
-    def unpack(self) -> BlockScaledI4Layout:
-        raise NotImplementedError
+    def unpack(self) -> BlockScaledLayout:
+        # Blocks are 105 i16s, so start there.
+        # [0:64] 128 * i8: 64 * i16: ql
+        # [64:96] 64 * i8: 32 * i16: qh
+        # [96:104] 16 * i8: 8 * i16: scales
+        # [104] f16: d
+        linear_blocks = self.raw.view(torch.int16).reshape(-1, 105)
+        # Reblock to the result shape, excluding the final dimension, which is
+        # expanded.
+        block_shape = self.shape[0:-1] + [-1, 105]
+        blocks = linear_blocks.reshape(block_shape)
+        ql = blocks[..., 0:64].view(torch.uint8)
+        qh = blocks[..., 64:96].view(torch.uint8)
+        scales = blocks[..., 96:104].view(torch.int8)
+        d = blocks[..., 104:105].view(torch.float16)
+
+        # Each half of the super-block (128 samples) is made of the low nibbles
+        # of its 64 bytes of `ql` followed by the high nibbles, with groups of
+        # 32 samples taking their upper two bits from consecutive bit pairs of
+        # its 32 bytes of `qh`.
+        ql = ql.unflatten(dim=-1, sizes=(2, 2, 32))
+        ql = torch.cat([ql & 0xF, ql >> 4], dim=-2)
+        qh = qh.unflatten(dim=-1, sizes=(2, 1, 32))
+        shift = torch.arange(0, 8, 2, dtype=torch.uint8, device=qh.device)
+        shift = shift.unsqueeze(-1)
+        qs = (ql | (((qh >> shift) & 3) << 4)).view(torch.int8) - 32
+        # Regroup to 16 sample blocks: [..., K // 16, 16].
+        qs = qs.flatten(-4).unflatten(dim=-1, sizes=(-1, 16))
+
+        d = (d.to(torch.float32) * scales.to(torch.float32)).to(torch.float16)
+        d = d.flatten(-2).unsqueeze(-1)
+        return BlockScaledLayout(self.shape, d, qs)
 
     @property
     def globals(self):
@@ -23,6 +23,7 @@ import torch
 from ..utils.io import ShardedArchiveBuilder
 
 from .layouts import (
+    BlockScaledLayout,
     TensorScaledLayout,
 )
 
@@ -328,6 +329,12 @@ class DynamicScaledQuantizer(QuantizerTensor):
     scale = finfo.max / amax.clamp(eps)
     ```
 
+    If an `axis` is given, `amax` is reduced over all other dims, producing a
+    per-axis (i.e. per-channel) `TensorScaledLayout`. If a `block_size` is
+    given, `amax` is reduced over blocks of that many samples of the innermost
+    dim, producing a `BlockScaledLayout`. Either way, the scales of the whole
+    tensor are computed in one vectorized pass.
+
     Note that this quantizer has only been used for testing and bringup, and
     it could use some more diligence done on the algorithm for determining
     scales in a dtype specific way.
@@ -337,17 +344,42 @@ class DynamicScaledQuantizer(QuantizerTensor):
         self,
         *,
         dtype: torch.dtype,
+        axis: Optional[int] = None,
+        block_size: Optional[int] = None,
         name: str = UnnamedTensorName,
     ):
         super().__init__(shape=(), name=name)
         self._dtype = dtype
+        self._axis = axis
+        self._block_size = block_size
         assert (
             dtype.is_floating_point or dtype.is_signed
         ), f"DynamicScaledQuantizer dtype must be fp or signed but got {dtype}"
+        assert (
+            axis is None or block_size is None
+        ), "DynamicScaledQuantizer can be per-axis or block scaled but not both"
 
     def _quantize_raw_tensor(self, t: torch.Tensor, *, name: str) -> QuantizedTensor:
         dtype = self._dtype
-        amax = torch.max(torch.abs(t))
+        shape = list(t.shape)
+        block_size = self._block_size
+        if block_size is not None:
+            assert (
+                shape[-1] % block_size == 0
+            ), f"Block size {block_size} does not divide the innermost dim of {shape}"
+            t = t.unflatten(-1, (-1, block_size))
+            amax = torch.amax(torch.abs(t), dim=-1, keepdim=True)
+        elif self._axis is not None:
+            axis = self._axis
+            assert axis >= 0 and axis < len(
+                shape
+            ), f"Per-axis scale {axis} out of bounds of shape {shape}"
+            reduction_dims = [i for i in range(len(shape)) if i != axis]
+            amax = torch.abs(t)
+            if reduction_dims:
+                amax = torch.amax(amax, dim=reduction_dims, keepdim=True)
+        else:
+            amax = torch.max(torch.abs(t))
         if dtype.is_floating_point:
             finfo = torch.finfo(dtype)
             scale = finfo.max / amax.clamp(finfo.eps)
@@ -359,7 +391,12 @@ class DynamicScaledQuantizer(QuantizerTensor):
             scale = iinfo.max / amax.clamp(eps)
             reciprocal_scale = 1.0 / scale
             qs = saturate_cast(t * scale, self.dtype, round_int=True)
-        shape = list(t.shape)
+        if block_size is not None:
+            return PlanarQuantizedTensor(
+                shape=shape,
+                name=name,
+                layout=BlockScaledLayout(shape, reciprocal_scale, qs),
+            )
         return PlanarQuantizedTensor(
             shape=shape,
             name=name,
@@ -368,6 +405,16 @@ class DynamicScaledQuantizer(QuantizerTensor):
             ),
         )
 
+    @property
+    def axis(self) -> Optional[int]:
+        """Returns the axis that is scaled or None."""
+        return self._axis
+
+    @property
+    def block_size(self) -> Optional[int]:
+        """Returns the number of samples per scale of block scaling or None."""
+        return self._block_size
+
     @property
     def dtype(self) -> torch.dtype:
         return self._dtype
@@ -388,9 +435,13 @@ class DynamicScaledQuantizer(QuantizerTensor):
         except KeyError as e:
             raise IOError("Missing property") from e
         dtype = _serialized_name_to_dtype(dtype_name)
+        axis = extra_properties.get("axis")
+        block_size = extra_properties.get("block_size")
         return cls(
             name=name,
             dtype=dtype,
+            axis=int(axis) if axis is not None else None,
+            block_size=int(block_size) if block_size is not None else None,
         )
 
     @property
@@ -400,6 +451,10 @@ class DynamicScaledQuantizer(QuantizerTensor):
     def add_to_archive(self, builder: ShardedArchiveBuilder) -> InferenceTensorMetadata:
         """Adds this tensor to the global archive."""
         extra_properties = {"dtype": _dtype_to_serialized_name(self._dtype)}
+        if self._axis is not None:
+            extra_properties["axis"] = self._axis
+        if self._block_size is not None:
+            extra_properties["block_size"] = self._block_size
         raw_tensors = {}
         return InferenceTensorMetadata(
             self.serialized_name(),
@@ -413,10 +468,17 @@ class DynamicScaledQuantizer(QuantizerTensor):
         return DynamicScaledQuantizer(
             name=self.name,
             dtype=self.dtype,
+            axis=self.axis,
+            block_size=self.block_size,
         )
 
     def __repr__(self):
-        return f"DynamicScaledQuantizer({self.name}) " f"-> dtype={self._dtype})"
+        r = f"DynamicScaledQuantizer({self.name}) "
+        if self._axis is not None:
+            r += f"along {self._axis} "
+        if self._block_size is not None:
+            r += f"in blocks of {self._block_size} "
+        return r + f"-> dtype={self._dtype})"
 
 
 def _norm_per_axis_param(
@@ -115,3 +115,65 @@ class LinearReplicatedInputSplitWeightAndBiasSharding(ThetaLayerSharding):
                 ),
             }
         )
+
+
+class LinearReplicatedWeightAndBiasSharding(ThetaLayerSharding):
+    def __init__(self, shard_count: int):
+        super(Sharding).__init__()
+        self.shard_count = shard_count
+
+    def theta_sharding(self) -> ThetaSharding:
+        return ThetaSharding(
+            {
+                "premul_input": Replicated(shard_count=self.shard_count),
+                "weight": Replicated(shard_count=self.shard_count),
+                "bias": Replicated(shard_count=self.shard_count),
+            }
+        )
+
+
+class LinearSplitReductionDimSharding(ThetaLayerSharding):
+    """Splits the weight along its reduction (input feature) dimension.
+
+    Each shard computes a partial product of its slice of the input features,
+    which must be sum-reduced across shards. There is no bias sharding, as it
+    must only be added once after the reduction.
+    """
+
+    def __init__(self, shard_count: int):
+        super(Sharding).__init__()
+        self.shard_count = shard_count
+
+    def theta_sharding(self) -> ThetaSharding:
+        return ThetaSharding(
+            {
+                "premul_input": Split(shard_count=self.shard_count, shard_dim=0),
+                "weight": Split(shard_count=self.shard_count, shard_dim=1),
+            }
+        )
+
+
+class RmsNormReplicatedSharding(ThetaLayerSharding):
+    def __init__(self, shard_count: int):
+        super(Sharding).__init__()
+        self.shard_count = shard_count
+
+    def theta_sharding(self) -> ThetaSharding:
+        return ThetaSharding(
+            {
+                "weight": Replicated(shard_count=self.shard_count),
+            }
+        )
+
+
+class TokenEmbeddingLayerReplicatedSharding(ThetaLayerSharding):
+    def __init__(self, shard_count: int):
+        super(Sharding).__init__()
+        self.shard_count = shard_count
+
+    def theta_sharding(self) -> ThetaSharding:
+        return ThetaSharding(
+            {
+                "weight": Replicated(shard_count=self.shard_count),
+            }
+        )
@@ -394,7 +394,9 @@ class QuantizedTensor(InferenceTensor, Generic[QuantizedLayoutT]):
         it should override this method to implement properly or raise
         NotImplementedError.
         """
-        return PlanarQuantizedTensor(self.name, self.shape, self.unpack())
+        return PlanarQuantizedTensor(
+            name=self.name, shape=self.shape, layout=self.unpack()
+        )
 
     def add_to_archive(self, builder: ShardedArchiveBuilder) -> InferenceTensorMetadata:
         """By default all QuantizedTensors serialize as a generic PlanarQuantizedTensor.
@@ -615,13 +617,13 @@ class ShardedTensorBase(ShardedTensor):
             extra_properties=extra_properties,
         )
 
-    @classmethod
     def _clone_with_globals(
         self, new_globals: dict[str, torch.Tensor]
     ) -> "InferenceTensor":
-        ts = []
-        for k in self.globals.keys():
-            ts.append(new_globals[ts[k]])
+        ts = [new_globals[k] for k in self.globals.keys()]
+        if self.shard_dim is None:
+            # Sub-classes without a shard dim do not take one.
+            return self.__class__(name=self.name, shape=self.shape, ts=ts)
         return self.__class__(
             name=self.name, shape=self.shape, shard_dim=self.shard_dim, ts=ts
         )
@@ -6,8 +6,12 @@
 
 from typing import Any, Callable, Optional, Union, Collection, Sequence, List
 
+from collections import deque
+from concurrent.futures import ThreadPoolExecutor
 import json
+import os
 from pathlib import Path
+from threading import Lock
 from types import NotImplementedType
 from dataclasses import dataclass
 import warnings
@@ -33,6 +37,7 @@ from .tensors import (
 
 __all__ = [
     "Dataset",
+    "LazyInferenceTensor",
     "Theta",
 ]
 
@@ -71,17 +76,60 @@ class InferenceTensorTransforms:
         return InferenceTensorTransforms.identity()
 
 
+class LazyInferenceTensor:
+    """Placeholder for a Theta leaf which is materialized on first access.
+
+    Theta accessors resolve placeholders transparently (and replace them in
+    the tree), so only the tensors that are used are ever loaded. Loading is
+    done at most once, even if accessed concurrently.
+    """
+
+    __slots__ = [
+        "name",
+        "_loader",
+        "_lock",
+        "_tensor",
+    ]
+
+    def __init__(self, name: str, loader: Callable[[], InferenceTensor]):
+        self.name = name
+        self._loader = loader
+        self._lock = Lock()
+        self._tensor: Optional[InferenceTensor] = None
+
+    def materialize(self) -> InferenceTensor:
+        with self._lock:
+            if self._tensor is None:
+                self._tensor = self._loader()
+                self._loader = None
+            return self._tensor
+
+    def __repr__(self):
+        state = "materialized" if self._tensor is not None else "unloaded"
+        return f"LazyInferenceTensor({self.name}, {state})"
+
+
 class Theta:
-    """Subset of parameter tensors used for inference."""
+    """Subset of parameter tensors used for inference.
+
+    Leaves may be given as LazyInferenceTensor placeholders, which are
+    materialized when first accessed.
+    """
 
     def __init__(
         self,
-        tensors: Union[Sequence[InferenceTensor], dict[str, dict | InferenceTensor]],
+        tensors: Union[
+            Sequence[InferenceTensor | LazyInferenceTensor],
+            dict[str, dict | InferenceTensor | LazyInferenceTensor],
+        ],
     ):
         if not isinstance(tensors, dict):
             tensors = {t.name: t for t in tensors}
         assert all(isinstance(k, str) for k in _all_keys(tensors))
-        assert all(isinstance(v, InferenceTensor) for v in _leaf_values(tensors))
+        assert all(
+            isinstance(v, (InferenceTensor, LazyInferenceTensor))
+            for v in _leaf_values(tensors)
+        )
         self._tree = _flat_to_nested_dict(tensors)
 
     def transform(self, *transforms: InferenceTensorTransform) -> "Theta":
@@ -108,6 +156,8 @@ class Theta:
         return self.transform(InferenceTensorTransforms.to_device(device))
 
     def flatten(self) -> dict[str, InferenceTensor]:
+        """Returns all tensors by fully qualified name, materializing any lazy
+        ones. Use `tensor_names()` to enumerate without loading."""
         results = {}
 
         def accum(prefix, child):
@@ -116,7 +166,23 @@ class Theta:
                 if isinstance(value, dict):
                     accum(new_prefix, value)
                 else:
-                    results[new_prefix] = value
+                    results[new_prefix] = _resolve_leaf(child, key)
+
+        accum("", self._tree)
+        return results
+
+    def tensor_names(self) -> list[str]:
+        """Returns the fully qualified names of all tensors without
+        materializing them."""
+        results = []
+
+        def accum(prefix, child):
+            for key, value in child.items():
+                new_prefix = f"{prefix}.{key}" if prefix else key
+                if isinstance(value, dict):
+                    accum(new_prefix, value)
+                else:
+                    results.append(new_prefix)
 
         accum("", self._tree)
         return results
@@ -142,8 +208,7 @@ class Theta:
                 f"Unknown parameter {name_path} (in Theta object "
                 f"containing {self.keys})"
             )
-        t = current_ts.get(str(last))
-        return t
+        return _resolve_leaf(current_ts, str(last))
 
     @property
     def keys(self) -> Collection[str]:
@@ -151,21 +216,30 @@ class Theta:
 
     @property
     def tensors(self) -> Collection[InferenceTensor]:
-        return [v for v in self._tree.values() if isinstance(v, InferenceTensor)]
+        return [
+            _resolve_leaf(self._tree, k)
+            for k, v in self._tree.items()
+            if not isinstance(v, dict)
+        ]
 
     @property
-    def tree(self) -> dict[str, dict | InferenceTensor]:
-        """The nested structure of named tensors."""
+    def tree(self) -> dict[str, dict | InferenceTensor | LazyInferenceTensor]:
+        """The nested structure of named tensors. Leaves which have not been
+        accessed yet may be LazyInferenceTensor placeholders."""
         return self._tree
 
     def __call__(self, *name_path: str | int) -> Union["Theta", InferenceTensor]:
         name_path = _norm_name_path(name_path)
+        parent_ts = None
         current_ts = self._tree
         try:
             for part in name_path:
+                parent_ts = current_ts
                 current_ts = current_ts[str(part)]
         except KeyError:
             raise KeyError(f"Sub-theta {name_path} not found (of {self._tree.keys()})")
+        if isinstance(current_ts, LazyInferenceTensor):
+            return _resolve_leaf(parent_ts, str(name_path[-1]))
         if isinstance(current_ts, InferenceTensor):
             return current_ts
         return Theta(current_ts)
@@ -179,16 +253,75 @@ class Theta:
         inference_tensor_metas: dict[str, InferenceTensorMetadata],
         *,
         io_report_callback: Optional[IOReportCallback] = None,
+        transform: Optional[InferenceTensorTransform] = None,
+        max_workers: int = 1,
     ):
-        """Adds tensors to the given archive builder."""
-        for inference_tensor in self.flatten().values():
-            if io_report_callback:
-                io_report_callback(f"Add {inference_tensor}")
-            name = inference_tensor.name
-            if name in inference_tensor_metas:
-                warnings.warn(f"Duplicate inference tensor added to archive: {name}")
-            meta = inference_tensor.add_to_archive(irpa)
-            inference_tensor_metas[name] = meta
+        """Adds tensors to the given archive builder.
+
+        If a `transform` is given, it is applied to each tensor on the way to
+        the archive instead of to a transformed Theta held in memory, on up to
+        `max_workers` threads. Tensors are added in order either way.
+        """
+        for inference_tensors in _map_tensor_transform(
+            transform, self.flatten().values(), max_workers=max_workers
+        ):
+            for inference_tensor in inference_tensors:
+                if io_report_callback:
+                    io_report_callback(f"Add {inference_tensor}")
+                name = inference_tensor.name
+                if name in inference_tensor_metas:
+                    warnings.warn(
+                        f"Duplicate inference tensor added to archive: {name}"
+                    )
+                meta = inference_tensor.add_to_archive(irpa)
+                inference_tensor_metas[name] = meta
+
+
+def _map_tensor_transform(
+    transform: Optional[InferenceTensorTransform],
+    tensors: Collection[InferenceTensor],
+    *,
+    max_workers: int,
+):
+    """Yields the list of results of `transform` for each of `tensors` in order.
+
+    With more than one worker, tensors are transformed on a thread pool (torch
+    releases the GIL in its kernels), keeping at most a couple of results per
+    worker in flight so that the results are not all held at once.
+    """
+
+    def apply(it: InferenceTensor) -> list[InferenceTensor]:
+        if transform is None:
+            return [it]
+        results = transform(it)
+        if results is None:
+            return []
+        if isinstance(results, InferenceTensor):
+            return [results]
+        return list(results)
+
+    if transform is None or max_workers <= 1:
+        yield from map(apply, tensors)
+        return
+
+    window = 2 * max_workers
+    with ThreadPoolExecutor(max_workers=max_workers) as executor:
+        pending = deque()
+        for it in tensors:
+            pending.append(executor.submit(apply, it))
+            if len(pending) >= window:
+                yield pending.popleft().result()
+        while pending:
+            yield pending.popleft().result()
+
+
+def _resolve_leaf(container: dict, key: str) -> Optional[InferenceTensor]:
+    """Returns the leaf container[key], materializing it in place if lazy."""
+    value = container.get(key)
+    if isinstance(value, LazyInferenceTensor):
+        value = value.materialize()
+        container[key] = value
+    return value
 
 
 def _flat_to_nested_dict(flat: dict[str, Any]) -> dict[str, Any]:
@@ -277,16 +410,36 @@ class Dataset:
         path: Union[str, Path],
         *,
         io_report_callback: Optional[IOReportCallback] = None,
+        transform: Optional[InferenceTensorTransform] = None,
+        max_workers: int = 1,
+        streaming: bool = False,
     ):
         """Saves a parameter archive consisting of properties and theta.
 
         By default, all quantized tensors in theta which do not have a custom
         packed serialization are converted to a generic planar form.
 
+        If a `transform` is given, the saved tensors are the result of it,
+        streamed as with `dataset.transform(...)` but without keeping the
+        transformed theta. See `Theta.add_tensors_to_archive`.
+
+        If `streaming`, each (transformed) tensor is also copied to a spill
+        file by the worker which produced it, so that the archive is built
+        without holding its data in memory. Together with a memory mapped
+        source, this saves datasets larger than memory. See
+        `ShardedArchiveBuilder`.
+
         Sufficient metadata is stored such that `load()` can reconstitute the
         Dataset.
         """
-        _dataset_save_helper(self, path, io_report_callback=io_report_callback)
+        _dataset_save_helper(
+            self,
+            path,
+            io_report_callback=io_report_callback,
+            transform=transform,
+            max_workers=max_workers,
+            streaming=streaming,
+        )
 
     @staticmethod
     def load(
@@ -294,10 +447,15 @@ class Dataset:
         *,
         file_type: Optional[str] = None,
         mmap: bool = True,
+        lazy: bool = True,
         device: Optional[Union[str, torch.device]] = None,
     ) -> "Dataset":
-        """Loads a dataset from a parameter archive constructed with save."""
-        ds = _dataset_load_helper(path, file_type=file_type, mmap=mmap)
+        """Loads a dataset from a parameter archive constructed with save.
+
+        If `lazy`, IRPA inference tensors are only materialized when first
+        accessed from the root theta.
+        """
+        ds = _dataset_load_helper(path, file_type=file_type, mmap=mmap, lazy=lazy)
         if device is not None:
             ds.to(device=device)
         return ds
@@ -404,7 +562,19 @@ class DatasetMetadata:
             )
             self.shard_ranks = tuple(shark_ranks_obj)
 
-    def load_tensors(self, entries: dict[str, ParameterArchiveEntry]):
+    def load_tensors(
+        self,
+        entries: dict[str, ParameterArchiveEntry],
+        *,
+        lazy: bool = False,
+        keep_alive: Any = None,
+    ):
+        """Loads inference tensors from the archive entries.
+
+        If `lazy`, tensors are added as LazyInferenceTensor placeholders, each
+        retaining `keep_alive` (i.e. the archives backing the entries). Their
+        component names are still validated here.
+        """
         # Load inference tensors.
         try:
             inference_tensors_entry = entries["__SHARK_INFERENCE_TENSORS__"]
@@ -418,25 +588,17 @@ class DatasetMetadata:
         inference_tensors = self.inference_tensors
         for tensor_name, tensor_meta_obj in inference_tensors_obj.items():
             tensor_meta = InferenceTensorMetadata.from_json(tensor_meta_obj)
-            # Map the raw_tensors dict to tensors from the archive.
-            raw_tensors = {}
+            # Map the raw_tensors dict to entries from the archive.
+            raw_entries = {}
             for local_name, global_name in tensor_meta.raw_tensors.items():
                 try:
-                    raw_entry = entries[global_name]
+                    raw_entries[local_name] = entries[global_name]
                 except KeyError as e:
                     raise IOError(
                         f"InferenceTensor missing one of its tensor components"
                     ) from e
-                raw_tensor = raw_entry.as_tensor()
-                # Tag the tensor as originating from external storage. This will
-                # make any subsequent compilation with it expect to load it from
-                # the same parameter archive.
-                ExternalTensorTrait(external_name=global_name, external_scope="").set(
-                    raw_tensor
-                )
-                raw_tensors[local_name] = raw_tensor
 
-            # Instantiate the tensor.
+            # Resolve the tensor class.
             try:
                 tensor_clazz = REGISTERED_INFERENCE_TENSOR_CLASSES[
                     tensor_meta.type_name
@@ -445,10 +607,32 @@ class DatasetMetadata:
                 raise IOError(
                     f"Unregistered InferenceTensor deserialization type"
                 ) from e
-            inference_tensor = tensor_clazz.create(
-                tensor_name, raw_tensors, tensor_meta.extra_properties
+
+            def create(
+                tensor_name=tensor_name,
+                tensor_meta=tensor_meta,
+                tensor_clazz=tensor_clazz,
+                raw_entries=raw_entries,
+                keep_alive=keep_alive,
+            ) -> InferenceTensor:
+                raw_tensors = {}
+                for local_name, raw_entry in raw_entries.items():
+                    raw_tensor = raw_entry.as_tensor()
+                    # Tag the tensor as originating from external storage. This
+                    # will make any subsequent compilation with it expect to load
+                    # it from the same parameter archive.
+                    ExternalTensorTrait(
+                        external_name=tensor_meta.raw_tensors[local_name],
+                        external_scope="",
+                    ).set(raw_tensor)
+                    raw_tensors[local_name] = raw_tensor
+                return tensor_clazz.create(
+                    tensor_name, raw_tensors, tensor_meta.extra_properties
+                )
+
+            inference_tensors[tensor_name] = (
+                LazyInferenceTensor(tensor_name, create) if lazy else create()
             )
-            inference_tensors[tensor_name] = inference_tensor
 
 
 def _dataset_save_helper(
@@ -456,14 +640,21 @@ def _dataset_save_helper(
     path: Union[str, Path],
     *,
     io_report_callback: Optional[IOReportCallback] = None,
+    transform: Optional[InferenceTensorTransform] = None,
+    max_workers: int = 1,
+    streaming: bool = False,
 ):
-    builder = ShardedArchiveBuilder(Path(path))
+    builder = ShardedArchiveBuilder(Path(path), spill=streaming)
+    if streaming:
+        transform = _spilling_transform(transform, builder)
     ds_meta = DatasetMetadata(dict(dataset.properties), {})
     # Add tensors.
     dataset.root_theta.add_tensors_to_archive(
         builder,
         ds_meta.inference_tensors,
         io_report_callback=io_report_callback,
+        transform=transform,
+        max_workers=max_workers,
     )
     ds_meta.shard_ranks = tuple(builder._rank_builders.keys())
 
@@ -475,11 +666,37 @@ def _dataset_save_helper(
     builder.commit()
 
 
+def _spilling_transform(
+    transform: Optional[InferenceTensorTransform], builder: ShardedArchiveBuilder
+) -> InferenceTensorTransform:
+    """Composes `transform` with spilling the globals of its results."""
+
+    def spill_globals(globals: dict[str, torch.Tensor]) -> dict[str, torch.Tensor]:
+        return {k: builder.spill_tensor(t) for k, t in globals.items()}
+
+    def spill(it: InferenceTensor) -> InferenceTensor:
+        if isinstance(it, QuantizedTensor):
+            # Packed tensors are saved in their planar form anyway.
+            it = it.to_planar()
+        return it.transform_globals(spill_globals)
+
+    def apply(it: InferenceTensor):
+        results = it if transform is None else transform(it)
+        if results is None:
+            return None
+        if isinstance(results, InferenceTensor):
+            return spill(results)
+        return [spill(r) for r in results]
+
+    return apply
+
+
 def _dataset_load_helper(
     path: Union[str, Path],
     *,
     file_type: Optional[str] = None,
     mmap: bool = True,
+    lazy: bool = True,
 ) -> Dataset:
     path = Path(path)
     suffixes = path.suffixes
@@ -488,28 +705,41 @@ def _dataset_load_helper(
 
         return gguf_interop.load_file(path)
     elif file_type == "irpa" or suffixes[-1] == ".irpa":
-        return _dataset_load_irpa(path, mmap=mmap)
+        return _dataset_load_irpa(path, mmap=mmap, lazy=lazy)
     else:
         raise IOError(
             f"Unknown file type '{''.join(path.suffixes)} for loading a Dataset"
         )
 
 
-def _dataset_load_irpa(path: Path, mmap: bool) -> Dataset:
+def _dataset_load_irpa(path: Path, mmap: bool, lazy: bool) -> Dataset:
     # Need to load in two phases: first read metadata from the root archive.
     meta = DatasetMetadata(properties={}, inference_tensors={})
     archive = ParameterArchive(path, mmap=mmap)
     entries = {k: v for k, v in archive.items()}
     meta.load_metadata(entries)
 
-    # Then we know what side-car rank archives should exist, so load those.
-    for rank in meta.shard_ranks:
-        rank_path = ShardedArchiveBuilder.path_for_rank(path, rank)
-        archive.load(rank_path, mmap=mmap)
+    # Then we know what side-car rank archives should exist, so load those
+    # concurrently, each into its own archive.
+    rank_paths = [
+        ShardedArchiveBuilder.path_for_rank(path, rank) for rank in meta.shard_ranks
+    ]
+    archives = [archive]
+    if rank_paths:
+        max_workers = min(len(rank_paths), os.cpu_count() or 1)
+        with ThreadPoolExecutor(max_workers=max_workers) as executor:
+            archives.extend(
+                executor.map(
+                    lambda rank_path: ParameterArchive(rank_path, mmap=mmap),
+                    rank_paths,
+                )
+            )
+        # Merge in rank order, after the root archive.
+        for rank_archive in archives[1:]:
+            entries.update(rank_archive.items())
 
     # Finally, load all inference tensors.
-    entries = {k: v for k, v in archive.items()}
-    meta.load_tensors(entries)
+    meta.load_tensors(entries, lazy=lazy, keep_alive=archives)
 
     # Note that there may be duplicates. Last wins.
     dataset = Dataset(meta.properties, Theta(meta.inference_tensors))
@@ -16,6 +16,7 @@ from typing import Sequence
 import torch
 
 from .logging import get_logger
+from . import tracing
 
 __all__ = []
 
@@ -31,10 +32,19 @@ class DebugFlags:
     enable_nan_checks: bool = False
     save_goldens_path: Optional[Path] = None
     golden_sequence_value: int = 0
+    # Traces record stats-only summaries (see tracing.summarize_tensor) rather
+    # than printing full reprs. With a tracer installed, they are recorded
+    # into its trace.
+    tensor_trace_stats: bool = False
+    # Installs a structured tracer saving a Chrome trace here at exit.
+    trace_path: Optional[Path] = None
+    trace_sample_rate: float = 1.0
 
     # Feature flags.
     use_custom_int_conv_kernel: bool = True
     use_custom_int_mm_kernel: bool = True
+    # Runs the fused int conv kernel channels last (NHWC/HWCF).
+    use_nhwc_int_conv_kernel: bool = False
 
     def set(self, part: str):
         m = re.match(SETTING_PART_PATTERN, part)
@@ -51,10 +61,18 @@ class DebugFlags:
             self.enable_nan_checks = logical_sense
         elif name == "save_goldens_path":
             self.save_goldens_path = Path(value)
+        elif name == "tensor_trace_stats":
+            self.tensor_trace_stats = logical_sense
+        elif name == "trace_path":
+            self.trace_path = Path(value)
+        elif name == "trace_sample_rate":
+            self.trace_sample_rate = float(value)
         elif name == "use_custom_int_conv_kernel":
             self.use_custom_int_conv_kernel = logical_sense
         elif name == "use_custom_int_mm_kernel":
             self.use_custom_int_mm_kernel = logical_sense
+        elif name == "use_nhwc_int_conv_kernel":
+            self.use_nhwc_int_conv_kernel = logical_sense
         else:
             logger.warn("Unrecognized %s flag: '%s'", FLAGS_ENV_NAME, name)
 
@@ -80,6 +98,8 @@ class DebugFlags:
 
 
 flags = DebugFlags.parse_from_env()
+if flags.trace_path:
+    tracing.configure(flags.trace_path, sample_rate=flags.trace_sample_rate)
 
 
 def trace_tensor(
@@ -99,6 +119,16 @@ def trace_tensors(
         if flags.save_goldens_path:
             _save_goldens(key, tensors)
         return
+    if flags.tensor_trace_stats:
+        tracer = tracing.get_tracer()
+        for name, t in tensors.items():
+            if t is None:
+                continue
+            if tracer is not None:
+                tracer.trace_tensor(f"{key}:{name}", t)
+            else:
+                print(f"::: TRACE {key}:{name} {tracing.summarize_tensor(t)}")
+        return
     if not flags.enable_tensor_trace:
         return
     for name, t in tensors.items():
@@ -4,7 +4,14 @@
 # See https://llvm.org/LICENSE.txt for license information.
 # SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+from typing import Optional
+
 from pathlib import Path
+import os
+import tempfile
+
+import numpy as np
+import torch
 
 from shark_turbine.aot import (
     ParameterArchiveBuilder,
@@ -17,12 +24,23 @@ class ShardedArchiveBuilder(ParameterArchiveBuilder):
     TODO: This currently collects all data in memory and commits at once. This
     can be made much more memory efficient for computed datasets by exposing
     a Python streaming save helper upstream and using that.
+
+    In the meantime, with `spill=True`, tensors passed through `spill_tensor()`
+    are copied into file-backed buffers in a temporary directory next to the
+    save path (and so on the same file system), which the OS can page out.
+    That way, datasets larger than memory can be transformed and saved, at the
+    cost of temporary disk space for a copy of the data until `commit()`.
     """
 
-    def __init__(self, save_path: Path):
+    def __init__(self, save_path: Path, *, spill: bool = False):
         super().__init__()
         self.save_path = save_path
         self._rank_builders: dict[int, ParameterArchiveBuilder] = {}
+        self._spill_dir: Optional[tempfile.TemporaryDirectory] = None
+        if spill:
+            self._spill_dir = tempfile.TemporaryDirectory(
+                prefix=f".{save_path.name}.spill.", dir=save_path.parent
+            )
 
     def for_rank(self, rank: int) -> ParameterArchiveBuilder:
         """Returns a ParameterArchiveBuilder for tensors specific to the given rank."""
@@ -32,11 +50,36 @@ class ShardedArchiveBuilder(ParameterArchiveBuilder):
         self._rank_builders[rank] = b
         return b
 
+    def spill_tensor(self, t: torch.Tensor) -> torch.Tensor:
+        """Returns a contiguous copy of `t` backed by a spill file.
+
+        If not spilling, `t` is returned as is. This may be called from any
+        thread.
+        """
+        if self._spill_dir is None:
+            return t
+        nbytes = t.numel() * t.element_size()
+        if nbytes == 0:
+            return t
+        fd, spill_path = tempfile.mkstemp(dir=self._spill_dir.name)
+        os.close(fd)
+        spill_buffer = np.memmap(spill_path, dtype=np.uint8, mode="w+", shape=(nbytes,))
+        spilled = torch.from_numpy(spill_buffer).view(t.dtype).reshape(t.shape)
+        spilled.copy_(t.detach())
+        return spilled
+
     def commit(self):
         """Performs final commit of all builders to disk."""
-        self.save(self.save_path)
-        for i, rank_builder in self._rank_builders.items():
-            rank_builder.save(ShardedArchiveBuilder.path_for_rank(self.save_path, i))
+        try:
+            self.save(self.save_path)
+            for i, rank_builder in self._rank_builders.items():
+                rank_builder.save(
+                    ShardedArchiveBuilder.path_for_rank(self.save_path, i)
+                )
+        finally:
+            if self._spill_dir is not None:
+                self._spill_dir.cleanup()
+                self._spill_dir = None
 
     @staticmethod
     def path_for_rank(path: Path, rank: int):
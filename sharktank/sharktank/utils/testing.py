@@ -9,7 +9,9 @@ import shutil
 import tempfile
 import unittest
 
+import torch
 
+from ..layers import configs
 from ..types import *
 
 
@@ -42,3 +44,36 @@ class MainRunnerTestBase(TempDirTestBase):
     def assertFileWritten(self, p: Path):
         self.assertTrue(p.exists(), msg=f"Expected file {p} was not created")
         self.assertGreater(p.stat().st_size, 0, msg=f"Expected file {p} had zero size")
+
+
+def make_rand_llama_theta(hp: configs.LlamaHParams, vocab_size: int) -> Theta:
+    """Creates an unquantized Llama theta of uniformly random weights in
+    [-0.5, 0.5)."""
+    dim = hp.embedding_length
+    q_dim = hp.attention_head_count * hp.attn_head_dim
+    kv_dim = hp.attention_head_count_kv * hp.attn_head_dim
+    ffn_dim = hp.feed_forward_length
+
+    def rand(*shape):
+        return DefaultPrimitiveTensor(data=torch.rand(shape) - 0.5)
+
+    tensors = {
+        "token_embd.weight": rand(vocab_size, dim),
+        "output_norm.weight": rand(dim),
+        "output.weight": rand(vocab_size, dim),
+    }
+    for i in range(hp.block_count):
+        tensors.update(
+            {
+                f"blk.{i}.attn_norm.weight": rand(dim),
+                f"blk.{i}.attn_q.weight": rand(q_dim, dim),
+                f"blk.{i}.attn_k.weight": rand(kv_dim, dim),
+                f"blk.{i}.attn_v.weight": rand(kv_dim, dim),
+                f"blk.{i}.attn_output.weight": rand(dim, q_dim),
+                f"blk.{i}.ffn_norm.weight": rand(dim),
+                f"blk.{i}.ffn_gate.weight": rand(ffn_dim, dim),
+                f"blk.{i}.ffn_up.weight": rand(ffn_dim, dim),
+                f"blk.{i}.ffn_down.weight": rand(dim, ffn_dim),
+            }
+        )
+    return Theta(tensors)
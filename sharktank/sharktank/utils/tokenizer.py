@@ -7,13 +7,16 @@
 """Simple helpers for accessing tokenizers of various kinds."""
 
 from abc import ABC, abstractmethod
-from typing import Optional, Union
+from typing import Optional, Sequence, Union
 
 import math
 import os
 
+import numpy as np
+
 __all__ = [
     "load_tokenizer",
+    "IncrementalDetokenizer",
     "InferenceTokenizer",
 ]
 
@@ -22,34 +25,57 @@ class InferenceTokenizer(ABC):
     """Simple inference tokenizer."""
 
     def encode(
-        self, texts: list[str], pad_to_multiple_of: int = 1, pad_token: int = 0
-    ) -> tuple[list[list[int]]]:
-        """Encodes a list of texts into a padded list of tokens.
-
-        Returns a list of list of tokens and a list of unpadded lengths.
+        self,
+        texts: list[str],
+        pad_to_multiple_of: int = 1,
+        pad_token: int = 0,
+        *,
+        out: Optional[np.ndarray] = None,
+    ) -> tuple[np.ndarray, list[int]]:
+        """Encodes a list of texts into a padded array of tokens.
+
+        Returns an int64 array of shape [len(texts), padded length] and a list
+        of unpadded lengths. If `out` is given (an int64 array of shape
+        [bs, max length] with bs >= len(texts)), the rows are written into it
+        and the returned array is a view of it, which saves allocating a new
+        array per call. The serving path does not use this: it tokenizes
+        requests as they arrive, before they are batched into the step's
+        transfer buffers, and copies their token ids in at each step.
         """
-        raw_rows = self._encode(texts)
-        max_length = 0
-        lengths: list[int] = []
-        for row in raw_rows:
-            lengths.append(len(row))
-            max_length = max(max_length, len(row))
+        rows = self.encode_rows(texts)
+        lengths = [len(row) for row in rows]
+        max_length = max(lengths, default=0)
         if pad_to_multiple_of > 1:
             max_length = int(
                 pad_to_multiple_of * math.ceil(max_length / pad_to_multiple_of)
             )
-        for row in raw_rows:
-            pad_count = max_length - len(row)
-            row.extend(pad_count * [pad_token])
-        return raw_rows, lengths
-
-    def decode(self, tokens: Union[list[list[int]]], lens: Optional[list[int]] = None):
-        """Decodes a list of tokens."""
+        if out is None:
+            tokens = np.full((len(rows), max_length), pad_token, dtype=np.int64)
+        else:
+            assert (
+                out.shape[0] >= len(rows) and out.shape[1] >= max_length
+            ), f"Output of shape {out.shape} cannot hold {len(rows)}x{max_length}"
+            tokens = out[0 : len(rows), 0:max_length]
+            tokens.fill(pad_token)
+        for i, row in enumerate(rows):
+            tokens[i, 0 : len(row)] = row
+        return tokens, lengths
+
+    def encode_rows(self, texts: list[str]) -> list[list[int]]:
+        """Encodes a list of texts into unpadded rows of tokens."""
+        return self._encode(texts)
+
+    def decode(
+        self,
+        tokens: Union[np.ndarray, Sequence[Sequence[int]]],
+        lens: Optional[list[int]] = None,
+    ):
+        """Decodes a list (or array) of rows of tokens."""
         if lens is not None:
-            tokens = list(tokens)
-            for i, row_length in enumerate(lens):
-                tokens[i] = tokens[i][0:row_length]
-        return self._decode(tokens)
+            tokens = [tokens[i][0:row_length] for i, row_length in enumerate(lens)]
+        return self._decode(
+            [row.tolist() if isinstance(row, np.ndarray) else row for row in tokens]
+        )
 
     @abstractmethod
     def _encode(self, texts: list[str]) -> list[list[int]]:
@@ -60,6 +86,65 @@ class InferenceTokenizer(ABC):
         ...
 
 
+class IncrementalDetokenizer:
+    """Detokenizes the tokens of a sequence as they are generated.
+
+    Tokenizers do not decode tokens independently: pieces merge with their
+    neighbours (i.e. leading spaces are dropped at the start of the text) and
+    a character can span several byte tokens. The text of new tokens is thus
+    the difference between decoding a short window of preceding tokens with
+    and without them, so that each step decodes a few tokens rather than the
+    whole sequence.
+
+    Use `step()`, or `add_tokens()` then `commit()` with the decoded windows
+    to batch the decoding of many sequences.
+    """
+
+    # Text of incomplete characters.
+    REPLACEMENT_CHAR = "\ufffd"
+
+    def __init__(self, prompt_token_ids: Sequence[int] = (), *, context: int = 5):
+        self.token_ids = list(prompt_token_ids)
+        self._prefix_offset = max(len(self.token_ids) - context, 0)
+        self._read_offset = len(self.token_ids)
+
+    def add_tokens(self, token_ids: Sequence[int]) -> tuple[list[int], list[int]]:
+        """Appends new tokens, returning the windows to decode for `commit()`.
+
+        Windows are the preceding tokens with and without the new (and any
+        uncommitted) tokens.
+        """
+        self.token_ids.extend(token_ids)
+        return (
+            self.token_ids[self._prefix_offset : self._read_offset],
+            self.token_ids[self._prefix_offset :],
+        )
+
+    def commit(self, prefix_text: str, text: str, final: bool = False) -> str:
+        """Returns the new text given the decoded windows of `add_tokens()`.
+
+        Tokens which do not yet form complete characters are held back until
+        a later step (or the `final` one).
+        """
+        if not final and (
+            len(text) <= len(prefix_text) or text.endswith(self.REPLACEMENT_CHAR)
+        ):
+            return ""
+        self._prefix_offset = self._read_offset
+        self._read_offset = len(self.token_ids)
+        return text[len(prefix_text) :]
+
+    def step(
+        self,
+        tokenizer: InferenceTokenizer,
+        token_ids: Sequence[int],
+        final: bool = False,
+    ) -> str:
+        """Appends new tokens and returns their text."""
+        prefix_text, text = tokenizer.decode(self.add_tokens(token_ids))
+        return self.commit(prefix_text, text, final)
+
+
 def load_tokenizer(*posargs, tokenizer_type: str = "transformers", **kwargs):
     if tokenizer_type == "transformers":
         return _create_transformers_tokenizer(*posargs, **kwargs)
@@ -0,0 +1,245 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Low overhead structured tracing in the Chrome trace event format.
+
+Spans (layer forwards, op dispatches, serving step phases) are recorded as
+complete ("X") events and tensor summaries as instant ("i") events, which
+chrome://tracing and Perfetto load directly. Nothing is recorded unless a
+process wide `Tracer` is installed with `configure()` (or the `trace_path`
+debug flag), so disabled tracing costs a global lookup per span.
+
+With a sample rate below 1, whether to record is decided once per outermost
+span of a thread and applies to everything nested in it, so that sampled
+spans are complete. Events recorded outside of any span are sampled
+individually. The event buffer is bounded: events past `max_events` are
+counted as dropped rather than recorded.
+
+This module does not import torch, so that serving can use it cheaply.
+"""
+
+from typing import Any, Iterator, Optional, Union
+
+import atexit
+from contextlib import contextmanager, nullcontext
+import json
+import os
+from pathlib import Path
+import random
+import threading
+import time
+
+__all__ = [
+    "Tracer",
+    "configure",
+    "get_tracer",
+    "install",
+    "record_span",
+    "span",
+    "summarize_tensor",
+]
+
+_TRACER: Optional["Tracer"] = None
+_NULL_SPAN = nullcontext({})
+
+
+def summarize_tensor(t) -> dict[str, Any]:
+    """Returns the shape, dtype, nan count and finite min/max of a tensor.
+
+    This reduces on the tensor's device and syncs to read the results back,
+    but unlike a repr does not transfer or format the values.
+    """
+    import torch
+
+    summary = {"shape": list(t.shape), "dtype": str(t.dtype)}
+    values = t.detach()
+    if values.numel() == 0:
+        return summary
+    if values.dtype == torch.bool:
+        values = values.to(torch.uint8)
+    if values.is_floating_point():
+        nans = torch.isnan(values)
+        nan_count = int(nans.sum().item())
+        summary["nan_count"] = nan_count
+        if nan_count == values.numel():
+            return summary
+        if nan_count:
+            values = values[~nans]
+    summary["min"] = values.min().item()
+    summary["max"] = values.max().item()
+    return summary
+
+
+class Tracer:
+    """Collects trace events of all threads of the process.
+
+    Timestamps are `time.perf_counter()` values, which callers that time
+    phases themselves may pass to `record_span`.
+    """
+
+    def __init__(
+        self,
+        *,
+        sample_rate: float = 1.0,
+        max_events: int = 1_000_000,
+        path: Optional[Union[str, Path]] = None,
+    ):
+        assert 0.0 <= sample_rate <= 1.0
+        self.sample_rate = sample_rate
+        self.max_events = max_events
+        self.path = Path(path) if path is not None else None
+        self.dropped_events = 0
+        self._events: list[dict] = []
+        self._lock = threading.Lock()
+        self._local = threading.local()
+        self._random = random.Random()
+        self._pid = os.getpid()
+        self._origin = time.perf_counter()
+
+    @property
+    def events(self) -> list[dict]:
+        with self._lock:
+            return list(self._events)
+
+    def _sample(self) -> bool:
+        return self.sample_rate >= 1.0 or self._random.random() < self.sample_rate
+
+    def _is_sampled(self) -> bool:
+        sampled = getattr(self._local, "sampled", None)
+        return self._sample() if sampled is None else sampled
+
+    def _append(self, event: dict):
+        event["pid"] = self._pid
+        event["tid"] = threading.get_native_id()
+        with self._lock:
+            if len(self._events) >= self.max_events:
+                self.dropped_events += 1
+            else:
+                self._events.append(event)
+
+    def _complete_event(
+        self, name: str, cat: str, start: float, end: float, args: dict
+    ) -> dict:
+        event = {
+            "name": name,
+            "cat": cat,
+            "ph": "X",
+            "ts": (start - self._origin) * 1e6,
+            "dur": (end - start) * 1e6,
+        }
+        if args:
+            event["args"] = args
+        return event
+
+    @contextmanager
+    def span(self, name: str, cat: str = "", **args) -> Iterator[dict]:
+        """Records the enclosed code as a span.
+
+        Yields the span's args, which the body may add to (e.g. with results
+        only known at its end).
+        """
+        local = self._local
+        sampled = getattr(local, "sampled", None)
+        is_root = sampled is None
+        if is_root:
+            sampled = local.sampled = self._sample()
+        start = time.perf_counter() if sampled else 0.0
+        try:
+            yield args
+        finally:
+            if sampled:
+                end = time.perf_counter()
+                self._append(self._complete_event(name, cat, start, end, args))
+            if is_root:
+                local.sampled = None
+
+    def record_span(
+        self, name: str, start: float, end: float, *, cat: str = "", **args
+    ):
+        """Records a span whose `time.perf_counter()` bounds were measured by
+        the caller, such as one spanning an `await`."""
+        if self._is_sampled():
+            self._append(self._complete_event(name, cat, start, end, args))
+
+    def _instant_event(self, name: str, cat: str, args: dict) -> dict:
+        return {
+            "name": name,
+            "cat": cat,
+            "ph": "i",
+            "s": "t",
+            "ts": (time.perf_counter() - self._origin) * 1e6,
+            "args": args,
+        }
+
+    def instant(self, name: str, *, cat: str = "", **args):
+        if self._is_sampled():
+            self._append(self._instant_event(name, cat, args))
+
+    def trace_tensor(self, key: str, t):
+        """Records a `summarize_tensor()` of `t`, computing it only if
+        sampled."""
+        if self._is_sampled():
+            self._append(self._instant_event(key, "tensor", summarize_tensor(t)))
+
+    def render(self) -> str:
+        with self._lock:
+            trace = {
+                "traceEvents": list(self._events),
+                "displayTimeUnit": "ms",
+                "otherData": {
+                    "sample_rate": self.sample_rate,
+                    "dropped_events": self.dropped_events,
+                },
+            }
+        return json.dumps(trace, default=str)
+
+    def save(self, path: Optional[Union[str, Path]] = None):
+        path = Path(path) if path is not None else self.path
+        assert path is not None, "No path to save the trace to"
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_text(self.render())
+
+
+def get_tracer() -> Optional[Tracer]:
+    return _TRACER
+
+
+def install(tracer: Optional[Tracer]) -> Optional[Tracer]:
+    """Installs (or with None, removes) the process wide tracer, returning
+    the previous one."""
+    global _TRACER
+    previous = _TRACER
+    _TRACER = tracer
+    return previous
+
+
+def configure(
+    path: Optional[Union[str, Path]] = None,
+    *,
+    sample_rate: float = 1.0,
+    max_events: int = 1_000_000,
+) -> Tracer:
+    """Installs a new process wide tracer. If `path` is given, the trace is
+    saved there at exit."""
+    tracer = Tracer(sample_rate=sample_rate, max_events=max_events, path=path)
+    install(tracer)
+    if path is not None:
+        atexit.register(tracer.save)
+    return tracer
+
+
+def span(name: str, cat: str = "", **args):
+    """Returns a `Tracer.span()` context of the installed tracer, if any."""
+    tracer = _TRACER
+    if tracer is None:
+        return _NULL_SPAN
+    return tracer.span(name, cat, **args)
+
+
+def record_span(name: str, start: float, end: float, *, cat: str = "", **args):
+    tracer = _TRACER
+    if tracer is not None:
+        tracer.record_span(name, start, end, cat=cat, **args)
@@ -0,0 +1,130 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import logging
+
+logging.basicConfig(level=logging.DEBUG)
+
+import unittest
+from parameterized import parameterized
+
+import torch
+
+from shark_turbine import aot
+from sharktank import kernels
+from sharktank.ops.default_impls import scaled_dot_product_attention_default
+
+
+def _reference(q, k, v, *, start_positions=None, seq_lens=None):
+    return scaled_dot_product_attention_default(
+        q,
+        k,
+        v,
+        None,
+        is_causal=start_positions is not None,
+        start_positions=start_positions,
+        seq_lens=seq_lens,
+    )
+
+
+class flash_attention_test(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(42)
+
+    @parameterized.expand(
+        [
+            (8, 8, torch.float32, 1e-4, 1e-4),
+            (8, 2, torch.float32, 1e-4, 1e-4),
+            (8, 2, torch.float16, 2e-2, 1e-2),
+        ]
+    )
+    def testBasic(self, head_count, head_count_kv, dtype, atol, rtol):
+        bs = 2
+        head_dim = 32
+        # Not a multiple of the tile, so that the last tile is partial.
+        sl = kernels.FLASH_ATTENTION_TILE * 2 + 5
+        q = torch.rand([bs, head_count, sl, head_dim]).to(dtype)
+        k = torch.rand([bs, head_count_kv, sl, head_dim]).to(dtype)
+        v = torch.rand([bs, head_count_kv, sl, head_dim]).to(dtype)
+        result = kernels.flash_attention(q, k, v)
+        ref = _reference(q, k, v)
+        torch.testing.assert_close(result, ref, atol=atol, rtol=rtol)
+
+    @parameterized.expand(
+        [
+            (torch.float32, 1e-4, 1e-4),
+            (torch.float16, 2e-2, 1e-2),
+        ]
+    )
+    def testCausalRagged(self, dtype, atol, rtol):
+        head_count = 8
+        head_count_kv = 2
+        head_dim = 32
+        sl = 24
+        kv_sl = kernels.FLASH_ATTENTION_TILE * 2
+        q = torch.rand([3, head_count, sl, head_dim]).to(dtype)
+        k = torch.rand([3, head_count_kv, kv_sl, head_dim]).to(dtype)
+        v = torch.rand([3, head_count_kv, kv_sl, head_dim]).to(dtype)
+        # A prefill, a chunk continuing a prefix across a tile boundary and a
+        # row shorter than its chunk (whose trailing queries attend to
+        # nothing).
+        start_positions = torch.tensor([0, 60, 70], dtype=torch.int64)
+        seq_lens = torch.tensor([sl, 60 + sl, 80], dtype=torch.int64)
+        result = kernels.flash_attention_causal(q, k, v, start_positions, seq_lens)
+        ref = _reference(q, k, v, start_positions=start_positions, seq_lens=seq_lens)
+        self.assertFalse(torch.isnan(result).any())
+        torch.testing.assert_close(result, ref, atol=atol, rtol=rtol)
+
+    def testIgnoresUninitializedRows(self):
+        q = torch.rand([1, 4, 8, 16])
+        k = torch.rand([1, 2, kernels.FLASH_ATTENTION_TILE * 2, 16])
+        v = torch.rand([1, 2, kernels.FLASH_ATTENTION_TILE * 2, 16])
+        # Rows past the valid length must not leak NaN into the result.
+        k[:, :, 8:] = float("nan")
+        v[:, :, 8:] = float("nan")
+        start_positions = torch.tensor([0], dtype=torch.int64)
+        seq_lens = torch.tensor([8], dtype=torch.int64)
+        result = kernels.flash_attention_causal(q, k, v, start_positions, seq_lens)
+        ref = _reference(q, k[:, :, :8], v[:, :, :8], start_positions=start_positions)
+        self.assertFalse(torch.isnan(result).any())
+        torch.testing.assert_close(result, ref, atol=1e-4, rtol=1e-4)
+
+    def testExportDynamicDims(self):
+        class MyModule(torch.nn.Module):
+            def forward(self, q, k, v, start_positions, seq_lens):
+                return kernels.flash_attention_causal(
+                    q, k, v, start_positions, seq_lens
+                )
+
+        mod = MyModule()
+        bs = torch.export.Dim("bs")
+        sl = torch.export.Dim("sl")
+        kv_sl = torch.export.Dim("kv_sl")
+        ep = torch.export.export(
+            mod,
+            args=(
+                torch.rand([2, 8, 16, 32], dtype=torch.float16),
+                torch.rand([2, 2, 64, 32], dtype=torch.float16),
+                torch.rand([2, 2, 64, 32], dtype=torch.float16),
+                torch.zeros([2], dtype=torch.int64),
+                torch.ones([2], dtype=torch.int64),
+            ),
+            dynamic_shapes={
+                "q": {0: bs, 2: sl},
+                "k": {0: bs, 2: kv_sl},
+                "v": {0: bs, 2: kv_sl},
+                "start_positions": {0: bs},
+                "seq_lens": {0: bs},
+            },
+        )
+        output = aot.export(ep)
+        output.verify()
+        asm = str(output.mlir_module)
+        self.assertIn("@sharktank_flash_attention_causal_8_2_32_f16", asm)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,117 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import logging
+
+logging.basicConfig(level=logging.DEBUG)
+
+import unittest
+from parameterized import parameterized
+
+import torch
+
+from shark_turbine import aot
+from sharktank import kernels
+from sharktank.types import layout_utils
+
+
+class mmt_block_scaled_gemv_test(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(42)
+
+    @parameterized.expand(
+        [
+            (1, torch.float32, torch.float32, torch.float32, 1e-3, 1e-5),
+            (1, torch.float32, torch.float16, torch.float32, 1e-3, 1e-5),
+            (4, torch.float16, torch.float16, torch.float32, 1e-3, 1e-5),
+        ]
+    )
+    def testQ8(self, m, a_dtype, d_dtype, ref_dtype, atol, rtol):
+        a = torch.rand([4, m, 3200], dtype=a_dtype) * 64
+        d = torch.rand([3200, 100, 1], dtype=d_dtype) * 64
+        qs = (torch.rand([3200, 100, 32], dtype=ref_dtype) * 32.0).to(torch.int8)
+        result = kernels.mmt_block_scaled_q8_gemv(a, d, qs)
+
+        # Dequantize and test with normal matmul.
+        # Tolerances are empirical and results are not expected to match exactly.
+        b = (d.to(ref_dtype) * qs.to(ref_dtype)).flatten(1)
+        ref = torch.matmul(a.to(ref_dtype), b.T.to(ref_dtype)).to(a_dtype)
+        torch.testing.assert_close(result, ref, atol=atol, rtol=rtol)
+
+    @parameterized.expand(
+        [
+            (1, torch.float32, torch.float32, torch.float32, 1e-2, 1e-3),
+            (8, torch.float16, torch.float16, torch.float32, 1e-2, 1e-3),
+        ]
+    )
+    def testOffsetQ8(self, m, a_dtype, d_dtype, ref_dtype, atol, rtol):
+        a = torch.rand([2, m, 512], dtype=a_dtype) / 16.0
+        d = torch.rand([256, 32, 1], dtype=d_dtype) / 16.0
+        qs = (torch.rand([256, 32, 16], dtype=ref_dtype) * 32.0).to(torch.int8)
+        offset = -torch.rand([256, 32, 1], dtype=d_dtype)
+        result = kernels.mmt_block_scaled_offset_q8_gemv(a, d, qs, offset)
+
+        b = (d.to(ref_dtype) * qs.to(ref_dtype) + offset.to(ref_dtype)).flatten(1)
+        ref = torch.matmul(a.to(ref_dtype), b.T.to(ref_dtype))
+        torch.testing.assert_close(result.to(ref_dtype), ref, atol=atol, rtol=rtol)
+
+    @parameterized.expand(
+        [
+            (1, torch.float32, torch.float32, torch.float32, 1e-2, 1e-3),
+            (2, torch.float16, torch.float16, torch.float32, 1e-2, 1e-3),
+        ]
+    )
+    def testOffsetQ4(self, m, a_dtype, d_dtype, ref_dtype, atol, rtol):
+        a = torch.rand([4, m, 3200], dtype=a_dtype) / 256.0
+        d = torch.rand([3200, 100, 1], dtype=d_dtype) / 256.0
+        qs = (torch.rand([3200, 100, 16], dtype=ref_dtype) * 255.0).to(torch.uint8)
+        offset = torch.rand([3200, 100, 1], dtype=d_dtype) + 16.0
+        result = kernels.mmt_block_scaled_offset_q4_unsigned_gemv(a, d, qs, offset)
+
+        qs_i8 = layout_utils.promote_linear_i4_block_to_i8(qs)
+        b = (d.to(ref_dtype) * qs_i8.to(ref_dtype) + offset.to(ref_dtype)).flatten(1)
+        ref = torch.matmul(a.to(ref_dtype), b.T.to(ref_dtype))
+        torch.testing.assert_close(result.to(ref_dtype), ref, atol=atol, rtol=rtol)
+
+    def testRejectsManyRows(self):
+        a = torch.rand([1, kernels.GEMV_MAX_M + 1, 64], dtype=torch.float32)
+        d = torch.rand([8, 2, 1], dtype=torch.float16)
+        qs = (torch.rand([8, 2, 32]) * 32.0).to(torch.int8)
+        with self.assertRaisesRegex(RuntimeError, "Expected at most"):
+            kernels.mmt_block_scaled_q8_gemv(a, d, qs)
+
+    def testExportDynamicBatch(self):
+        class MyModule(torch.nn.Module):
+            def forward(self, a, d, qs):
+                return kernels.mmt_block_scaled_q8_gemv(a, d, qs)
+
+        mod = MyModule()
+        batch = torch.export.Dim("batch")
+        ep = torch.export.export(
+            mod,
+            args=(
+                torch.rand([4, 1, 3200], dtype=torch.float32),
+                torch.rand([3200, 100, 1], dtype=torch.float16),
+                (torch.rand([3200, 100, 32], dtype=torch.float32) * 32.0).to(
+                    torch.int8
+                ),
+            ),
+            dynamic_shapes={
+                "a": {0: batch},
+                "d": {},
+                "qs": {},
+            },
+        )
+        output = aot.export(ep)
+        output.verify()
+        asm = str(output.mlir_module)
+        self.assertIn(
+            "@sharktank_mmt_block_scaled_q8_gemv_1_3200_3200_32_f32_f16", asm
+        )
+
+
+if __name__ == "__main__":
+    unittest.main()
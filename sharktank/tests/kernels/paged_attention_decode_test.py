@@ -0,0 +1,164 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import logging
+
+logging.basicConfig(level=logging.DEBUG)
+
+import math
+import unittest
+from parameterized import parameterized
+
+import torch
+
+from shark_turbine import aot
+from sharktank import kernels
+
+
+def _reference(q, table, k_ids, v_ids, seq_lens):
+    bs, head_count, head_dim = q.shape
+    _, stride, head_count_kv, _ = table.shape
+    n_rep = head_count // head_count_kv
+    keys = table[k_ids].flatten(1, 2).repeat_interleave(n_rep, dim=2)
+    values = table[v_ids].flatten(1, 2).repeat_interleave(n_rep, dim=2)
+    # [bs, heads, 1, sl]
+    scores = torch.einsum("bhd,bshd->bhs", q, keys).unsqueeze(2)
+    scores = scores / math.sqrt(head_dim)
+    positions = torch.arange(keys.shape[1])
+    mask = positions[None, :] >= seq_lens[:, None]
+    scores = scores.masked_fill(mask[:, None, None, :], float("-inf"))
+    weights = torch.softmax(scores.float(), dim=-1).to(q.dtype)
+    return torch.einsum("bhs,bshd->bhd", weights.squeeze(2), values)
+
+
+class paged_attention_decode_test(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(42)
+
+    @parameterized.expand(
+        [
+            (8, 8, torch.float32, 1e-4, 1e-4),
+            (8, 2, torch.float32, 1e-4, 1e-4),
+            (8, 2, torch.float16, 2e-2, 1e-2),
+        ]
+    )
+    def testGQA(self, head_count, head_count_kv, dtype, atol, rtol):
+        bs = 3
+        stride = 16
+        head_dim = 32
+        block_count = 4
+        subblock_count = 32
+        table = torch.rand([subblock_count, stride, head_count_kv, head_dim]).to(dtype)
+        q = torch.rand([bs, head_count, head_dim]).to(dtype)
+        ids = torch.randperm(subblock_count)[: 2 * bs * block_count]
+        k_ids = ids[: bs * block_count].reshape(bs, block_count)
+        v_ids = ids[bs * block_count :].reshape(bs, block_count)
+        # Ragged lengths, including one ending on a page boundary.
+        seq_lens = torch.tensor([1, 37, 48], dtype=torch.int64)
+        result = kernels.paged_attention_decode(q, table, k_ids, v_ids, seq_lens)
+        ref = _reference(q, table, k_ids, v_ids, seq_lens)
+        torch.testing.assert_close(result, ref, atol=atol, rtol=rtol)
+
+    def testIgnoresUninitializedRows(self):
+        table = torch.rand([8, 16, 2, 16])
+        # Rows past the valid length must not leak NaN into the result.
+        table[1, 8:] = float("nan")
+        q = torch.rand([1, 4, 16])
+        k_ids = torch.tensor([[0, 2]])
+        v_ids = torch.tensor([[1, 3]])
+        seq_lens = torch.tensor([8], dtype=torch.int64)
+        result = kernels.paged_attention_decode(q, table, k_ids, v_ids, seq_lens)
+        ref = _reference(q, table[:, 0:8], k_ids, v_ids, seq_lens)
+        self.assertFalse(torch.isnan(result).any())
+        torch.testing.assert_close(result, ref, atol=1e-4, rtol=1e-4)
+
+    @parameterized.expand(
+        [
+            (torch.int8, torch.float32, 1e-4, 1e-4),
+            (torch.int8, torch.float16, 2e-2, 1e-2),
+            (torch.float8_e4m3fnuz, torch.float32, 1e-4, 1e-4),
+        ]
+    )
+    def testScaled(self, table_dtype, dtype, atol, rtol):
+        bs = 2
+        stride = 16
+        head_count = 8
+        head_count_kv = 2
+        head_dim = 32
+        block_count = 3
+        subblock_count = 16
+        scales = torch.rand([subblock_count, head_count_kv]) / 64
+        values = torch.rand([subblock_count, stride, head_count_kv, head_dim]) * 2 - 1
+        if table_dtype.is_floating_point:
+            table = values.to(table_dtype)
+        else:
+            table = (values * 127).round().to(table_dtype)
+        q = torch.rand([bs, head_count, head_dim]).to(dtype)
+        ids = torch.randperm(subblock_count)[: 2 * bs * block_count]
+        k_ids = ids[: bs * block_count].reshape(bs, block_count)
+        v_ids = ids[bs * block_count :].reshape(bs, block_count)
+        seq_lens = torch.tensor([20, 48], dtype=torch.int64)
+        result = kernels.paged_attention_decode_scaled(
+            q, table, scales, k_ids, v_ids, seq_lens
+        )
+        dequant_table = table.to(torch.float32) * scales[:, None, :, None]
+        ref = _reference(q, dequant_table.to(dtype), k_ids, v_ids, seq_lens)
+        torch.testing.assert_close(result, ref, atol=atol, rtol=rtol)
+
+    def testScaledIgnoresUnwrittenPages(self):
+        scales = torch.rand([8, 2]) / 64
+        table = ((torch.rand([8, 16, 2, 16]) * 2 - 1) * 127).round().to(torch.int8)
+        # Pages past the valid length may have never been written a scale.
+        scales[3] = float("nan")
+        scales[6] = float("nan")
+        q = torch.rand([1, 4, 16])
+        k_ids = torch.tensor([[0, 6]])
+        v_ids = torch.tensor([[1, 3]])
+        seq_lens = torch.tensor([16], dtype=torch.int64)
+        result = kernels.paged_attention_decode_scaled(
+            q, table, scales, k_ids, v_ids, seq_lens
+        )
+        dequant_table = table.to(torch.float32) * scales[:, None, :, None]
+        ref = _reference(q, dequant_table, k_ids[:, :1], v_ids[:, :1], seq_lens)
+        self.assertFalse(torch.isnan(result).any())
+        torch.testing.assert_close(result, ref, atol=1e-4, rtol=1e-4)
+
+    def testExportDynamicDims(self):
+        class MyModule(torch.nn.Module):
+            def forward(self, q, table, k_ids, v_ids, seq_lens):
+                return kernels.paged_attention_decode(
+                    q, table, k_ids, v_ids, seq_lens
+                )
+
+        mod = MyModule()
+        bs = torch.export.Dim("bs")
+        blocks = torch.export.Dim("blocks")
+        subblocks = torch.export.Dim("subblocks")
+        ep = torch.export.export(
+            mod,
+            args=(
+                torch.rand([2, 8, 32], dtype=torch.float16),
+                torch.rand([16, 16, 2, 32], dtype=torch.float16),
+                torch.zeros([2, 3], dtype=torch.int64),
+                torch.ones([2, 3], dtype=torch.int64),
+                torch.ones([2], dtype=torch.int64),
+            ),
+            dynamic_shapes={
+                "q": {0: bs},
+                "table": {0: subblocks},
+                "k_ids": {0: bs, 1: blocks},
+                "v_ids": {0: bs, 1: blocks},
+                "seq_lens": {0: bs},
+            },
+        )
+        output = aot.export(ep)
+        output.verify()
+        asm = str(output.mlir_module)
+        self.assertIn("@sharktank_paged_attention_decode_8_2_32_16_f16", asm)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,171 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import logging
+
+logging.basicConfig(level=logging.DEBUG)
+
+import unittest
+from parameterized import parameterized
+
+import torch
+import torch.nn.functional as F
+
+from shark_turbine import aot
+from sharktank import kernels
+
+
+def _reference(input_q, input_zp, weights, weight_zp, bias, rescale, padding, stride):
+    # Padding with the zero point is padding the centered input with zeros.
+    centered_input = input_q.to(torch.float64) - input_zp.to(torch.float64)
+    centered_weights = weights.to(torch.float64) - weight_zp.reshape(-1, 1, 1, 1)
+    accum = F.conv2d(
+        centered_input, centered_weights, bias.to(torch.float64), stride, padding
+    )
+    return (accum * rescale.reshape(1, -1, 1, 1).to(torch.float64)).to(rescale.dtype)
+
+
+def _random_args(n, c, h, w, f, k, dtype):
+    input_q = torch.randint(-128, 128, [n, c, h, w], dtype=torch.int8)
+    input_zp = torch.tensor([3], dtype=torch.int32)
+    weights = torch.randint(-128, 128, [f, c, k, k], dtype=torch.int8)
+    weight_zp = torch.randint(-8, 8, [f], dtype=torch.int32)
+    bias = torch.randint(-1000, 1000, [f], dtype=torch.int32)
+    rescale = (torch.rand([f]) / 1e4).to(dtype)
+    return input_q, input_zp, weights, weight_zp, bias, rescale
+
+
+class qconv_2d_test(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(42)
+
+    @parameterized.expand(
+        [
+            ([1, 1], [1, 1], torch.float32, 1e-4, 1e-4),
+            ([0, 0], [1, 1], torch.float32, 1e-4, 1e-4),
+            ([1, 1], [2, 2], torch.float16, 1e-2, 1e-2),
+        ]
+    )
+    def testNCHW(self, padding, stride, dtype, atol, rtol):
+        args = _random_args(2, 16, 12, 12, 24, 3, dtype)
+        result = kernels.qconv_2d_nchw_fchw(*args, padding, stride, [1, 1])
+        ref = _reference(*args, padding, stride)
+        torch.testing.assert_close(result, ref, atol=atol, rtol=rtol)
+
+    def testNHWC(self):
+        input_q, input_zp, weights, weight_zp, bias, rescale = _random_args(
+            2, 16, 12, 12, 24, 3, torch.float32
+        )
+        result = kernels.qconv_2d_nhwc_hwcf(
+            input_q.permute(0, 2, 3, 1).contiguous(),
+            input_zp,
+            weights.permute(2, 3, 1, 0).contiguous(),
+            weight_zp,
+            bias,
+            rescale,
+            [1, 1],
+            [1, 1],
+            [1, 1],
+        )
+        ref = _reference(
+            input_q, input_zp, weights, weight_zp, bias, rescale, [1, 1], [1, 1]
+        )
+        torch.testing.assert_close(
+            result.permute(0, 3, 1, 2), ref, atol=1e-4, rtol=1e-4
+        )
+
+    @parameterized.expand([("nchw",), ("nhwc",)])
+    def testNormSilu(self, layout):
+        n, c, h, w, f = 2, 16, 8, 8, 8
+        _, input_zp, weights, weight_zp, bias, rescale = _random_args(
+            n, c, h, w, f, 3, torch.float32
+        )
+        input = torch.randn([n, c, h, w])
+        norm_scale = torch.rand([n, c]) + 0.5
+        norm_shift = torch.rand([n, c]) - 0.5
+        input_scale = torch.tensor([40.0])
+        activations = F.silu(
+            input * norm_scale[:, :, None, None] + norm_shift[:, :, None, None]
+        )
+        input_q = (
+            torch.round(activations * input_scale + input_zp)
+            .clamp(-128, 127)
+            .to(torch.int8)
+        )
+        ref = _reference(
+            input_q, input_zp, weights, weight_zp, bias, rescale, [1, 1], [1, 1]
+        )
+        if layout == "nchw":
+            result = kernels.qconv_2d_norm_silu_nchw_fchw(
+                input,
+                norm_scale,
+                norm_shift,
+                input_scale,
+                input_zp,
+                weights,
+                weight_zp,
+                bias,
+                rescale,
+                [1, 1],
+                [1, 1],
+                [1, 1],
+            )
+        else:
+            result = kernels.qconv_2d_norm_silu_nhwc_hwcf(
+                input.permute(0, 2, 3, 1).contiguous(),
+                norm_scale,
+                norm_shift,
+                input_scale,
+                input_zp,
+                weights.permute(2, 3, 1, 0).contiguous(),
+                weight_zp,
+                bias,
+                rescale,
+                [1, 1],
+                [1, 1],
+                [1, 1],
+            ).permute(0, 3, 1, 2)
+        # Rounding ties may quantize an activation differently, moving a result
+        # by up to rescale * |weight|.
+        torch.testing.assert_close(result, ref, atol=2e-2, rtol=1e-3)
+
+    def testExportDynamicDims(self):
+        class MyModule(torch.nn.Module):
+            def forward(self, input, input_zp, weights, weight_zp, bias, rescale):
+                return kernels.qconv_2d_nchw_fchw(
+                    input,
+                    input_zp,
+                    weights,
+                    weight_zp,
+                    bias,
+                    rescale,
+                    [1, 1],
+                    [1, 1],
+                    [1, 1],
+                )
+
+        mod = MyModule()
+        n = torch.export.Dim("n")
+        ep = torch.export.export(
+            mod,
+            args=_random_args(2, 320, 64, 64, 640, 3, torch.float16),
+            dynamic_shapes={
+                "input": {0: n},
+                "input_zp": {},
+                "weights": {},
+                "weight_zp": {},
+                "bias": {},
+                "rescale": {},
+            },
+        )
+        output = aot.export(ep)
+        output.verify()
+        asm = str(output.mlir_module)
+        self.assertIn("@sharktank_qconv_2d_nchw_fchw_1_1_1_1_1_1_i8_f16", asm)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,105 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import unittest
+
+import torch
+
+from sharktank.layers import *
+from sharktank.types import *
+
+
+class SampleTokensTest(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(12345)
+        self.model = BaseCausalLMModel(Theta({}), context_length=16)
+        self.bs = 4
+        self.vocab = 32
+        self.logits = torch.rand([self.bs, self.vocab]) * 8
+
+    def _sample(self, temperature, top_k, top_p, uniform):
+        bs = self.bs
+        return self.model.sample_tokens(
+            self.logits,
+            temperature=torch.full([bs], temperature),
+            top_k=torch.full([bs], top_k, dtype=torch.int64),
+            top_p=torch.full([bs], top_p),
+            uniform=uniform,
+        )
+
+    def testGreedy(self):
+        tokens = self._sample(0.0, 0, 1.0, torch.rand([self.bs]))
+        self.assertEqual(tokens.dtype, torch.int64)
+        torch.testing.assert_close(
+            tokens, torch.argmax(self.logits, dim=-1, keepdim=True)
+        )
+
+    def testTopKOneIsGreedy(self):
+        tokens = self._sample(2.0, 1, 1.0, torch.rand([self.bs]))
+        torch.testing.assert_close(
+            tokens, torch.argmax(self.logits, dim=-1, keepdim=True)
+        )
+
+    def testTopKRestrictsSamples(self):
+        allowed = torch.topk(self.logits, 3, dim=-1).indices
+        for _ in range(20):
+            tokens = self._sample(1.0, 3, 1.0, torch.rand([self.bs]))
+            self.assertTrue((tokens == allowed).any(dim=-1).all())
+
+    def testTopPMatchesDistribution(self):
+        bs = self.bs
+        probs, order = torch.sort(torch.softmax(self.logits, dim=-1), descending=True)
+        mass = torch.cumsum(probs, dim=-1)
+
+        def sample(uniform):
+            # Keeps the three most likely tokens of each row.
+            return self.model.sample_tokens(
+                self.logits,
+                temperature=torch.full([bs], 1.0),
+                top_k=torch.zeros([bs], dtype=torch.int64),
+                top_p=(mass[:, 1] + mass[:, 2]) / 2,
+                uniform=uniform,
+            )
+
+        # Sampling inverts the renormalized distribution of the kept tokens:
+        # just below the kept mass of the first two, the second is selected.
+        tokens = sample(mass[:, 1] / mass[:, 2] - 1e-4)
+        torch.testing.assert_close(tokens, order[:, 1:2])
+        tokens = sample(mass[:, 1] / mass[:, 2] + 1e-4)
+        torch.testing.assert_close(tokens, order[:, 2:3])
+
+        # Tokens past the top-p mass are never drawn, even at the largest
+        # uniform samples.
+        allowed = order[:, :3]
+        for uniform in [torch.rand([bs]) for _ in range(20)] + [
+            torch.full([bs], 1.0 - 1e-7)
+        ]:
+            tokens = sample(uniform)
+            self.assertTrue((tokens == allowed).any(dim=-1).all())
+
+    def testPerRowParameters(self):
+        bs = self.bs
+        tokens = self.model.sample_tokens(
+            self.logits,
+            temperature=torch.tensor([0.0, 1.0, 1.0, 1.0]),
+            top_k=torch.tensor([0, 1, 0, 0]),
+            top_p=torch.tensor([1.0, 1.0, 1e-6, 1.0]),
+            uniform=torch.full([bs], 0.99),
+        )
+        greedy = torch.argmax(self.logits, dim=-1)
+        self.assertEqual(tokens[0:3, 0].tolist(), greedy[0:3].tolist())
+
+    def testLastPositionLogits(self):
+        logits = torch.rand([3, 5, self.vocab])
+        seq_lens = torch.tensor([1, 5, 3])
+        last = self.model.last_position_logits(logits, seq_lens)
+        self.assertEqual(list(last.shape), [3, 1, self.vocab])
+        for row in range(3):
+            torch.testing.assert_close(last[row, 0], logits[row, seq_lens[row] - 1])
+
+
+if __name__ == "__main__":
+    unittest.main()
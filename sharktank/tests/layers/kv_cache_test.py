@@ -0,0 +1,196 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import unittest
+
+import torch
+from parameterized import parameterized
+
+from sharktank.layers import *
+
+
+class PagedKVCacheTest(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(12345)
+        self.cache = PagedKVCache(
+            transformer_block_count=3,
+            attn_head_count=2,
+            attn_head_dim=8,
+            block_seq_stride=4,
+        )
+        self.bs = 3
+        self.page_ids = torch.tensor([[5, 1, 7], [2, 0, 3], [4, 6, 8]])
+
+    def _allocate(self):
+        state = self.cache.allocate(page_count=9)
+        state[0].zero_()
+        return state
+
+    def _read(self, state, transformer_block_index):
+        sl = self.page_ids.shape[1] * self.cache.block_seq_stride
+        partitions = [
+            torch.empty(
+                [self.bs, sl, self.cache.attn_head_count, self.cache.attn_head_dim]
+            )
+            for _ in range(self.cache.cache_partition_count)
+        ]
+        self.cache.read(
+            state,
+            read_into_partitions=partitions,
+            transformer_block_index=transformer_block_index,
+            page_ids=self.page_ids,
+        )
+        return partitions
+
+    def _rand_partitions(self, sl):
+        shape = [self.bs, sl, self.cache.attn_head_count, self.cache.attn_head_dim]
+        return [torch.rand(shape) for _ in range(self.cache.cache_partition_count)]
+
+    def testWriteTimestep(self):
+        state = self._allocate()
+        positions = torch.tensor([0, 7, 11])
+        partitions = self._rand_partitions(1)
+        self.cache.write_timestep(
+            state,
+            partitions,
+            transformer_block_index=1,
+            seq_positions=positions,
+            page_ids=self.page_ids,
+        )
+        for read, written in zip(self._read(state, 1), partitions):
+            for row in range(self.bs):
+                torch.testing.assert_close(
+                    read[row, positions[row]], written[row, 0], atol=0, rtol=0
+                )
+            # Nothing else was touched.
+            read[torch.arange(self.bs), positions] = 0
+            self.assertEqual(torch.count_nonzero(read).item(), 0)
+        for read in self._read(state, 0) + self._read(state, 2):
+            self.assertEqual(torch.count_nonzero(read).item(), 0)
+
+    def testWriteTimestepRotatesK(self):
+        rope = RotaryEmbeddingLayer(
+            rope_dimension_count=self.cache.attn_head_dim, max_seqlen=12
+        )
+        positions = torch.tensor([2, 5, 10])
+        mask = rope.compute_batch_mask(positions, batch_seq_len=1)
+        partitions = self._rand_partitions(1)
+        fused_state = self._allocate()
+        self.cache.write_timestep(
+            fused_state,
+            partitions,
+            transformer_block_index=1,
+            seq_positions=positions,
+            page_ids=self.page_ids,
+            k_rotary_mask=mask,
+        )
+        state = self._allocate()
+        self.cache.write_timestep(
+            state,
+            [apply_rotary_embedding(partitions[0], mask), partitions[1]],
+            transformer_block_index=1,
+            seq_positions=positions,
+            page_ids=self.page_ids,
+        )
+        torch.testing.assert_close(fused_state[0], state[0], atol=0, rtol=0)
+
+    def testWriteRangeIgnoresPadding(self):
+        state = self._allocate()
+        start_positions = torch.tensor([0, 3, 6])
+        seq_lens = torch.tensor([5, 4, 12])
+        partitions = self._rand_partitions(6)
+        self.cache.write_range(
+            state,
+            partitions,
+            transformer_block_index=2,
+            start_positions=start_positions,
+            seq_lens=seq_lens,
+            page_ids=self.page_ids,
+        )
+        for read, written in zip(self._read(state, 2), partitions):
+            for row in range(self.bs):
+                start = start_positions[row].item()
+                end = seq_lens[row].item()
+                torch.testing.assert_close(
+                    read[row, start:end], written[row, 0 : end - start]
+                )
+                self.assertEqual(torch.count_nonzero(read[row, :start]).item(), 0)
+                self.assertEqual(torch.count_nonzero(read[row, end:]).item(), 0)
+
+
+class QuantizedPagedKVCacheTest(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(12345)
+        self.page_ids = torch.tensor([[3, 1], [0, 2]])
+
+    def _create_cache(self, cache_dtype):
+        return PagedKVCache(
+            transformer_block_count=2,
+            attn_head_count=2,
+            attn_head_dim=8,
+            block_seq_stride=4,
+            cache_dtype=cache_dtype,
+        )
+
+    def _read(self, cache, state):
+        partitions = [torch.empty([2, 8, 2, 8]) for _ in range(2)]
+        cache.read(
+            state,
+            read_into_partitions=partitions,
+            transformer_block_index=1,
+            page_ids=self.page_ids,
+        )
+        return partitions
+
+    def testAllocate(self):
+        cache = self._create_cache(torch.int8)
+        self.assertTrue(cache.is_quantized)
+        page_slab, scale_slab = cache.allocate(page_count=5)
+        self.assertEqual(page_slab.dtype, torch.int8)
+        self.assertEqual(list(scale_slab.shape), [5, 2 * 2 * 2])
+        self.assertEqual(scale_slab.dtype, torch.float32)
+
+    @parameterized.expand([(torch.int8, 2e-2), (torch.float8_e4m3fnuz, 1e-1)])
+    def testIncrementalWrites(self, cache_dtype, rtol):
+        cache = self._create_cache(cache_dtype)
+        state = cache.allocate(page_count=4)
+        # Stale contents (NaN for fp8) must never leak into the result.
+        state[0].view(torch.uint8).fill_(0x80)
+        state[1].fill_(float("nan"))
+
+        # Prefill 3 positions of each row, then decode one at a time with
+        # growing magnitudes, which grows the page scales.
+        expected = [torch.zeros([2, 8, 2, 8]) for _ in range(2)]
+        prefill = [torch.rand([2, 3, 2, 8]) for _ in range(2)]
+        cache.write_range(
+            state,
+            prefill,
+            transformer_block_index=1,
+            start_positions=torch.tensor([0, 0]),
+            seq_lens=torch.tensor([3, 3]),
+            page_ids=self.page_ids,
+        )
+        for e, p in zip(expected, prefill):
+            e[:, 0:3] = p
+        for position in range(3, 7):
+            step = [torch.rand([2, 1, 2, 8]) * position for _ in range(2)]
+            cache.write_timestep(
+                state,
+                step,
+                transformer_block_index=1,
+                seq_positions=torch.tensor([position, position]),
+                page_ids=self.page_ids,
+            )
+            for e, p in zip(expected, step):
+                e[:, position] = p[:, 0]
+
+        for read, e in zip(self._read(cache, state), expected):
+            self.assertFalse(torch.isnan(read).any())
+            torch.testing.assert_close(read, e, atol=rtol * 6, rtol=rtol)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,50 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import unittest
+
+import torch
+
+from sharktank.layers import *
+
+
+def _reference(x: torch.Tensor, positions: torch.Tensor, dim: int) -> torch.Tensor:
+    # Complex valued RoPE of x [bs, sl, heads, dim] at positions [bs, sl].
+    freqs = 1.0 / (10000.0 ** (torch.arange(0, dim, 2).float() / dim))
+    angles = positions[..., None].float() * freqs
+    freqs_cis = torch.polar(torch.ones_like(angles), angles)[:, :, None, :]
+    x_ = torch.view_as_complex(x.float().reshape(*x.shape[:-1], -1, 2))
+    return torch.view_as_real(x_ * freqs_cis).flatten(3).type_as(x)
+
+
+class RotaryEmbeddingTest(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(12345)
+        self.dim = 16
+        self.rope = RotaryEmbeddingLayer(rope_dimension_count=self.dim, max_seqlen=64)
+
+    def testForward(self):
+        xq = torch.rand([2, 5, 4, self.dim])
+        xk = torch.rand([2, 5, 2, self.dim])
+        xq_out, xk_out = self.rope(xq=xq, xk=xk, start_index=3)
+        positions = torch.arange(3, 8).expand(2, 5)
+        torch.testing.assert_close(xq_out, _reference(xq, positions, self.dim))
+        torch.testing.assert_close(xk_out, _reference(xk, positions, self.dim))
+
+    def testBatchedMask(self):
+        start_positions = torch.tensor([0, 9, 40])
+        xq = torch.rand([3, 2, 4, self.dim], dtype=torch.float16)
+        xk = torch.rand([3, 2, 2, self.dim], dtype=torch.float16)
+        mask = self.rope.compute_batch_mask(start_positions, batch_seq_len=2)
+        xq_out, xk_out = self.rope.apply_batched_mask(xq=xq, xk=xk, mask=mask)
+        self.assertEqual(xq_out.dtype, torch.float16)
+        positions = start_positions[:, None] + torch.arange(2)
+        torch.testing.assert_close(xq_out, _reference(xq, positions, self.dim))
+        torch.testing.assert_close(xk_out, _reference(xk, positions, self.dim))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,84 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import unittest
+
+import torch
+
+from sharktank.layers import configs
+from sharktank.models.llama.llama import LlamaModelConfig, PagedLlamaModelV1
+from sharktank.utils.testing import make_rand_llama_theta
+
+
+class PagedLlamaModelV1Test(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(12345)
+        self.hp = configs.LlamaHParams(
+            context_length=32,
+            embedding_length=16,
+            block_count=2,
+            feed_forward_length=12,
+            rope_dimension_count=4,
+            attention_head_count=4,
+            attn_head_dim=4,
+            attention_layer_norm_rms_epsilon=1e-5,
+            attention_head_count_kv=2,
+        )
+        self.vocab_size = 11
+        self.theta = make_rand_llama_theta(self.hp, self.vocab_size)
+
+    def _create_model(self):
+        config = LlamaModelConfig(
+            self.hp,
+            block_seq_stride=4,
+            activation_dtype=torch.float32,
+            attention_dtype=torch.float32,
+        )
+        return PagedLlamaModelV1(self.theta, config)
+
+    def testDecodeMatchesSingleTokenChunk(self):
+        # Decode and a one position prefill chunk at a sequence's length must
+        # both cache the token at that position and produce the same logits.
+        model = self._create_model()
+        tokens = torch.tensor([[1, 4, 2, 7, 3, 9, 5, 6], [8, 2, 2, 10, 0, 0, 0, 0]])
+        seq_lens = torch.tensor([8, 4])
+        seq_block_ids = torch.tensor([[0, 1, 2], [3, 4, 5]])
+        cache_state = model.cache.allocate(page_count=6)
+        for t in cache_state:
+            t.zero_()
+        model.prefill(
+            tokens,
+            attention_mask=model.attention_mask(model.input_mask(seq_lens, 8)),
+            seq_block_ids=seq_block_ids[:, :2],
+            cache_state=cache_state,
+        )
+        chunk_cache_state = [t.clone() for t in cache_state]
+
+        next_tokens = torch.tensor([[3], [5]])
+        decode_logits = model.decode(
+            next_tokens,
+            attention_mask=model.decode_attention_mask(
+                model.input_mask(seq_lens + 1, 12)
+            ),
+            start_positions=seq_lens,
+            seq_block_ids=seq_block_ids,
+            cache_state=cache_state,
+        )
+        chunk_logits = model.prefill_chunk(
+            next_tokens,
+            attention_mask=model.chunked_attention_mask(seq_lens, seq_lens + 1, 1, 12),
+            start_positions=seq_lens,
+            seq_lens=seq_lens + 1,
+            seq_block_ids=seq_block_ids,
+            cache_state=chunk_cache_state,
+        )
+        torch.testing.assert_close(chunk_logits, decode_logits)
+        for actual, expected in zip(chunk_cache_state, cache_state):
+            torch.testing.assert_close(actual, expected)
+
+
+if __name__ == "__main__":
+    unittest.main()
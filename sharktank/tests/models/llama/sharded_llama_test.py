@@ -0,0 +1,97 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import unittest
+
+import torch
+
+from sharktank.layers import configs
+from sharktank.models.llama.llama import LlamaModelConfig, PagedLlamaModelV1
+from sharktank.models.llama.sharding import shard_theta
+from sharktank.types import *
+from sharktank.utils.testing import make_rand_llama_theta
+
+
+class ShardedLlamaTest(unittest.TestCase):
+    def setUp(self):
+        torch.manual_seed(12345)
+        self.hp = configs.LlamaHParams(
+            context_length=32,
+            embedding_length=16,
+            block_count=2,
+            feed_forward_length=12,
+            rope_dimension_count=4,
+            attention_head_count=4,
+            attn_head_dim=4,
+            attention_layer_norm_rms_epsilon=1e-5,
+            attention_head_count_kv=2,
+        )
+        self.vocab_size = 11
+        self.theta = make_rand_llama_theta(self.hp, self.vocab_size)
+
+    def _create_model(self, theta: Theta, tensor_parallelism_size: int):
+        config = LlamaModelConfig(
+            self.hp,
+            block_seq_stride=4,
+            activation_dtype=torch.float32,
+            attention_dtype=torch.float32,
+            tensor_parallelism_size=tensor_parallelism_size,
+        )
+        return PagedLlamaModelV1(theta, config)
+
+    def _run(self, model: PagedLlamaModelV1):
+        tokens = torch.tensor([[1, 4, 2, 7, 3, 9, 5, 6], [8, 2, 2, 10, 0, 0, 0, 0]])
+        seq_lens = torch.tensor([8, 4])
+        seq_block_ids = torch.tensor([[0, 1, 2], [3, 4, 5]])
+        cache_state = model.cache.flatten_sharded_state(
+            model.cache.allocate(page_count=6)
+        )
+        for t in cache_state:
+            t.zero_()
+        cache_state = model.cache.unflatten_sharded_state(cache_state)
+
+        prefill_logits = model.prefill(
+            tokens,
+            attention_mask=model.attention_mask(model.input_mask(seq_lens, 8)),
+            seq_block_ids=seq_block_ids[:, :2],
+            cache_state=cache_state,
+        )
+        decode_logits = model.decode(
+            torch.tensor([[3], [5]]),
+            attention_mask=model.decode_attention_mask(
+                model.input_mask(seq_lens + 1, 12)
+            ),
+            start_positions=seq_lens,
+            seq_block_ids=seq_block_ids,
+            cache_state=cache_state,
+        )
+        return prefill_logits, decode_logits
+
+    def testShardedMatchesUnsharded(self):
+        expected_prefill, expected_decode = self._run(
+            self._create_model(self.theta, 1)
+        )
+        sharded_theta = shard_theta(self.theta, 2, self.hp.block_count)
+        self.assertIsInstance(
+            sharded_theta.tensor("blk", 0, "attn_q", "weight"), SplitPrimitiveTensor
+        )
+        sharded_model = self._create_model(sharded_theta, 2)
+        self.assertEqual(sharded_model.cache.attn_head_count, 1)
+        actual_prefill, actual_decode = self._run(sharded_model)
+        torch.testing.assert_close(actual_prefill, expected_prefill)
+        torch.testing.assert_close(actual_decode, expected_decode)
+
+    def testShardingQuantizedThetaRaises(self):
+        tensors = self.theta.flatten()
+        name = "blk.0.attn_q.weight"
+        quantizer = StaticScaledQuantizer(scale=torch.tensor(16.0), dtype=torch.int8)
+        tensors[name] = quantizer.quantize(tensors[name], name=name)
+        with self.assertRaisesRegex(ValueError, name):
+            shard_theta(Theta(tensors), 2, self.hp.block_count)
+
+
+if __name__ == "__main__":
+    unittest.main()
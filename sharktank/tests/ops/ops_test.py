@@ -10,6 +10,7 @@ import torch
 import torch.nn.functional as F
 
 from sharktank import ops
+from sharktank.ops._registry import SignatureDispatcher, overridable, unbox_tensor
 from sharktank.types import *
 
 
@@ -258,5 +259,93 @@ class TestOpExport(unittest.TestCase):
         self.assertIn("mmt_block_scaled_offset_q4_unsigned.default", s)
 
 
+class DispatchTest(unittest.TestCase):
+    def setUp(self):
+        self.calls = []
+
+        @overridable
+        def scale(x, *, fast: bool):
+            ...
+
+        @scale.trampoline
+        def _scale_trampoline(d: SignatureDispatcher, x, *, fast: bool):
+            tensors = (x,)
+            for override in d.find_overrides(tensors):
+                result = override(x, fast=fast)
+                if result is not NotImplemented:
+                    return override, result
+            else:
+                d.fail(tensors)
+
+        @scale.override(torch.Tensor, auto_dequant=True)
+        def scale_default(x, *, fast):
+            self.calls.append("default")
+            return unbox_tensor(x) * 2
+
+        @scale.override(torch.Tensor)
+        def scale_fast(x, *, fast):
+            self.calls.append("fast")
+            if not fast:
+                return NotImplemented
+            return x * 2
+
+        self.scale = scale
+
+    def testFreezeSkipsDecliningOverrides(self):
+        x = torch.ones(2)
+        with ops.freeze_dispatch():
+            for _ in range(3):
+                self.scale(x, fast=False)
+        self.assertEqual(self.calls, ["fast", "default", "default", "default"])
+
+    def testFreezeFallsBackWhenDeclined(self):
+        x = torch.ones(2)
+        with ops.freeze_dispatch():
+            for fast in [True, False]:
+                torch.testing.assert_close(self.scale(x, fast=fast), x * 2)
+        self.assertEqual(self.calls, ["fast", "fast", "default"])
+
+    def testFreezeResolvesPerArgumentType(self):
+        @self.scale.override(QuantizedTensor)
+        def scale_quantized(x, *, fast):
+            self.calls.append("quantized")
+            return x.unpack().dequant() * 2
+
+        x = torch.ones(2, 8)
+        quantizer = StaticScaledQuantizer(scale=torch.tensor(4.0), dtype=torch.int8)
+        qx = quantizer.quantize(x)
+        with ops.freeze_dispatch():
+            # A single call site sees both types, which select different
+            # overrides.
+            for t in [x, qx, x, qx]:
+                torch.testing.assert_close(self.scale(t, fast=False), x * 2)
+        self.assertEqual(
+            self.calls, ["fast", "default", "quantized", "default", "quantized"]
+        )
+
+    def testThawedAfterFreeze(self):
+        x = torch.ones(2)
+        with ops.freeze_dispatch():
+            self.scale(x, fast=False)
+        self.calls.clear()
+        self.scale(x, fast=False)
+        self.assertEqual(self.calls, ["fast", "default"])
+
+    def testProfileCountsDequants(self):
+        x = torch.ones(2, 8)
+        quantizer = StaticScaledQuantizer(scale=torch.tensor(4.0), dtype=torch.int8)
+        qx = quantizer.quantize(x)
+        with ops.profile_dispatch() as profile:
+            self.scale(x, fast=True)
+            self.scale(x, fast=False)
+            self.scale(qx, fast=False)
+        entries = {(e.op, e.override): e for e in profile.entries}
+        fast = entries[("scale", "scale_fast")]
+        default = entries[("scale", "scale_default")]
+        self.assertEqual((fast.calls, fast.dequants), (1, 0))
+        self.assertEqual((default.calls, default.dequants), (2, 1))
+        self.assertIn("scale_default", profile.report())
+
+
 if __name__ == "__main__":
     unittest.main()
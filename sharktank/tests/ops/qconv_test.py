@@ -235,6 +235,47 @@ class QConvTest(unittest.TestCase):
         )
         torch.testing.assert_close(y_actual, y_ref)
 
+    def testGroupNormSiluConv2dFused(self):
+        ops._registry._test_enable_last_op_dispatch(True)
+        input = torch.randn(2, 8, 16, 16, dtype=torch.float32)
+        norm_weight = torch.rand(8, dtype=torch.float32) + 0.5
+        norm_bias = torch.rand(8, dtype=torch.float32) - 0.5
+        weight = torch.randn(8, 8, 3, 3, dtype=torch.float32)
+        bias = torch.rand(8, dtype=torch.float32)
+
+        input_quantizer = StaticScaledQuantizer(
+            scale=torch.tensor(40.0), dtype=torch.int8
+        )
+        weight_scale = 127.0 / weight.abs().flatten(1).amax(1)
+        weight_q = StaticScaledQuantizer(
+            scale=weight_scale, dtype=torch.int8, axis=0
+        ).quantize(weight)
+
+        y_actual = ops.group_norm_silu_conv2d(
+            input,
+            norm_weight,
+            norm_bias,
+            weight_q,
+            bias,
+            num_groups=4,
+            eps=1e-5,
+            input_quantizer=input_quantizer,
+            padding=(1, 1),
+        )
+        self.assertIs(
+            ops._registry._test_get_last_op_dispatch(),
+            ops.qconv_impls.group_norm_silu_qconv2d_tensor_scaled_integer,
+        )
+        x = F.silu(F.group_norm(input, 4, norm_weight, norm_bias, eps=1e-5))
+        y_ref = F.conv2d(
+            input_quantizer.quantize(x).unpack().dequant(),
+            weight_q.unpack().dequant(),
+            bias,
+            padding=(1, 1),
+        )
+        # Rounding ties may quantize an activation differently.
+        torch.testing.assert_close(y_actual, y_ref, atol=5e-2, rtol=1e-3)
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,62 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import unittest
+
+import torch
+
+from sharktank.tools.benchmark_kernels import *
+
+
+class BenchmarkKernelsTest(unittest.TestCase):
+    def testCasesCoverKernels(self):
+        cases = all_cases()
+        names = [c.name for c in cases]
+        self.assertEqual(len(names), len(set(names)))
+        kernel_names = {c.kernel for c in cases}
+        for kernel in [
+            "mmtfp",
+            "batch_matmul_transpose_b",
+            "mmt_block_scaled_q8",
+            "mmt_block_scaled_q8_gemv",
+            "mmt_block_scaled_offset_q4_unsigned",
+            "mmt_block_scaled_offset_q4_unsigned_gemv",
+            "mmt_super_block_scaled_offset_q4_unsigned",
+            "conv_2d_nchw_fchw",
+            "pooling_nchw_sum",
+        ]:
+            self.assertIn(kernel, kernel_names)
+
+    def testCaseRunsEagerly(self):
+        # The smallest pool, which checks that the args match the kernel.
+        case = [c for c in all_cases() if c.kernel == "pooling_nchw_sum"][-1]
+        result = case.create_module()(*case.create_args())
+        self.assertEqual(list(result.shape), [2, 1280, 16, 16])
+
+    def testRoofline(self):
+        peak = DevicePeak(tflops={"float16": 100.0}, gbps=1000.0)
+        # 1 GB in 1 ms at 1 TFLOP: memory bound at 1000 GB/s.
+        report = roofline(10**9, 10**9, 1e-3, "float16", peak)
+        self.assertAlmostEqual(report["tflops"], 1.0)
+        self.assertAlmostEqual(report["gbps"], 1000.0)
+        self.assertEqual(report["bound"], "memory")
+        self.assertAlmostEqual(report["roofline_fraction"], 1.0)
+        self.assertAlmostEqual(report["peak_tflops_fraction"], 0.01)
+
+        report = roofline(10**12, 10**6, 0.1, "float16", peak)
+        self.assertEqual(report["bound"], "compute")
+        self.assertAlmostEqual(report["roofline_fraction"], 0.1)
+
+    def testRooflineUnknownDtype(self):
+        peak = DevicePeak(tflops={"float16": 100.0}, gbps=1000.0)
+        report = roofline(10**9, 10**9, 1e-3, "int8", peak)
+        self.assertIsNone(report["peak_tflops_fraction"])
+        self.assertEqual(report["bound"], "memory")
+        self.assertNotIn("bound", roofline(10**9, 10**9, 1e-3, "int8", None))
+
+
+if __name__ == "__main__":
+    unittest.main()
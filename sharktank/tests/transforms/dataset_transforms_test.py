@@ -15,7 +15,10 @@ import unittest
 
 import torch
 
+from sharktank.layers import FusedLinearLayer, LinearLayer
+from sharktank.transforms.dataset import PackQuantizedTransform
 from sharktank.types import *
+from sharktank.types.gguf_interop import Q8_0
 from sharktank.utils.testing import MainRunnerTestBase
 
 
@@ -75,5 +78,175 @@ class MmtRHSShardingTransformTest(MainRunnerTestBase):
         torch.testing.assert_close(new_t, orig_pts[0].as_torch().split(16, dim=1)[0])
 
 
+class FuseProjectionsTransformTest(MainRunnerTestBase):
+    def _block_scaled(self, name: str, rows: int) -> PlanarQuantizedTensor:
+        layout = BlockScaledLayout(
+            [rows, 64],
+            d=torch.rand([rows, 2, 1], dtype=torch.float32),
+            qs=torch.randint(-8, 8, [rows, 2, 32], dtype=torch.int8),
+        )
+        return PlanarQuantizedTensor(name=name, shape=[rows, 64], layout=layout)
+
+    def testFuse(self):
+        orig_pts = [
+            DefaultPrimitiveTensor(
+                name="blk.0.attn_q.weight", data=torch.randn([32, 64])
+            ),
+            DefaultPrimitiveTensor(
+                name="blk.0.attn_k.weight", data=torch.randn([16, 64])
+            ),
+            DefaultPrimitiveTensor(
+                name="blk.0.attn_v.weight", data=torch.randn([16, 64])
+            ),
+            self._block_scaled("blk.0.ffn_gate.weight", 48),
+            self._block_scaled("blk.0.ffn_up.weight", 48),
+            DefaultPrimitiveTensor(name="other", data=torch.randn([2, 2])),
+        ]
+        orig_theta = Theta(orig_pts)
+        input_path = self.save_dataset(Dataset({}, orig_theta), "input")
+        output_path = self.get_irpa_path("output")
+        from sharktank.examples import fuse_llm_dataset
+
+        self.run_main(
+            fuse_llm_dataset.main,
+            "--irpa-file",
+            input_path,
+            "--output-irpa-file",
+            output_path,
+        )
+        ds_tran = Dataset.load(output_path, mmap=False)
+
+        # Verify.
+        flat_ts = ds_tran.root_theta.flatten()
+        self.assertListEqual(
+            sorted(flat_ts.keys()),
+            ["blk.0.attn_qkv.weight", "blk.0.ffn_gate_up.weight", "other"],
+        )
+        qkv = flat_ts["blk.0.attn_qkv.weight"]
+        self.assertListEqual(qkv.shape, [64, 64])
+        torch.testing.assert_close(
+            qkv.as_torch(), torch.cat([t.as_torch() for t in orig_pts[0:3]])
+        )
+        gate_up = flat_ts["blk.0.ffn_gate_up.weight"]
+        self.assertIsInstance(gate_up, PlanarQuantizedTensor)
+        self.assertIsInstance(gate_up.unpack(), BlockScaledLayout)
+        self.assertListEqual(gate_up.shape, [96, 64])
+
+        # The fused layers compute the same projections.
+        x = torch.randn([2, 3, 64])
+        block_theta = ds_tran.root_theta("blk", 0)
+        qkv_layer = FusedLinearLayer(block_theta("attn_qkv"), split_sizes=[32, 16, 16])
+        xq, xk, xv = qkv_layer(x)
+        for actual, name in zip([xq, xk, xv], ["attn_q", "attn_k", "attn_v"]):
+            expected = LinearLayer(orig_theta("blk", 0, name))(x)
+            torch.testing.assert_close(actual, expected)
+        gate_up_layer = FusedLinearLayer(
+            block_theta("ffn_gate_up"), split_sizes=[48, 48]
+        )
+        gate, up = gate_up_layer(x)
+        for actual, name in zip([gate, up], ["ffn_gate", "ffn_up"]):
+            expected = LinearLayer(orig_theta("blk", 0, name))(x)
+            torch.testing.assert_close(actual, expected)
+
+
+class PackQuantizedTransformTest(MainRunnerTestBase):
+    def _q8_0(self, name: str, rows: int, cols: int) -> Q8_0:
+        # Blocks of an f16 scale followed by 32 int8 samples.
+        d = torch.rand([rows * cols // 32, 1], dtype=torch.float16)
+        qs = torch.randint(-128, 128, [rows * cols // 32, 32], dtype=torch.int8)
+        raw = torch.cat([d.view(torch.uint8), qs.view(torch.uint8)], dim=-1)
+        return Q8_0(raw=raw.flatten(), shape=[rows, cols], name=name)
+
+    def testPack(self):
+        q8 = self._q8_0("blk.0.attn_q.weight", 16, 64)
+        other = DefaultPrimitiveTensor(name="other", data=torch.randn([2, 2]))
+        ds = Dataset({}, Theta([q8, other]))
+        ds.transform(PackQuantizedTransform())
+
+        packed = ds.root_theta.tensor("blk", 0, "attn_q", "weight")
+        self.assertIsInstance(packed, PlanarQuantizedTensor)
+        layout = packed.unpack()
+        self.assertIsInstance(layout, BlockScaledLayout)
+        self.assertTrue(all(p.is_contiguous() for p in layout.planes.values()))
+        torch.testing.assert_close(layout.dequant(), q8.unpack().dequant())
+        self.assertIs(ds.root_theta.tensor("other"), other)
+
+        # Loading restores the packed layout from its planes.
+        output_path = self.save_dataset(ds, "output")
+        ds_loaded = Dataset.load(output_path, mmap=False)
+        loaded = ds_loaded.root_theta.tensor("blk", 0, "attn_q", "weight")
+        self.assertIsInstance(loaded, PlanarQuantizedTensor)
+        self.assertIsInstance(loaded.unpack(), BlockScaledLayout)
+        torch.testing.assert_close(loaded.unpack().dequant(), q8.unpack().dequant())
+
+    def testPackMain(self):
+        q8 = self._q8_0("blk.0.attn_q.weight", 16, 64)
+        input_path = self.save_dataset(Dataset({}, Theta([q8])), "input")
+        output_path = self.get_irpa_path("output")
+        from sharktank.examples import pack_llm_dataset
+
+        self.run_main(
+            pack_llm_dataset.main,
+            "--irpa-file",
+            input_path,
+            "--output-irpa-file",
+            output_path,
+        )
+        ds_tran = Dataset.load(output_path, mmap=False)
+        packed = ds_tran.root_theta.tensor("blk", 0, "attn_q", "weight")
+        self.assertIsInstance(packed, PlanarQuantizedTensor)
+        torch.testing.assert_close(packed.unpack().dequant(), q8.unpack().dequant())
+
+
+class QuantizeTransformTest(MainRunnerTestBase):
+    def testQuantize(self):
+        orig_pts = [
+            DefaultPrimitiveTensor(
+                name="blk.0.attn_q.weight", data=torch.randn([16, 64])
+            ),
+            DefaultPrimitiveTensor(
+                name="blk.0.ffn_up.weight", data=torch.randn([32, 64])
+            ),
+            DefaultPrimitiveTensor(
+                name="blk.0.attn_norm.weight", data=torch.randn([64])
+            ),
+        ]
+        input_path = self.save_dataset(Dataset({}, Theta(orig_pts)), "input")
+        output_path = self.get_irpa_path("output")
+        from sharktank.examples import quantize_llm_dataset
+
+        self.run_main(
+            quantize_llm_dataset.main,
+            "--irpa-file",
+            input_path,
+            "--output-irpa-file",
+            output_path,
+            "--rule",
+            r"^.*\.attn_q\.weight$=channel",
+            "--rule",
+            r"^.*\.ffn_.*\.weight$=block32",
+            "--max-workers",
+            2,
+        )
+        ds_tran = Dataset.load(output_path, mmap=False)
+
+        # Verify.
+        flat_ts = ds_tran.root_theta.flatten()
+        attn_q = flat_ts["blk.0.attn_q.weight"]
+        self.assertIsInstance(attn_q.unpack(), TensorScaledLayout)
+        self.assertListEqual(list(attn_q.unpack().d.shape), [16, 1])
+        ffn_up = flat_ts["blk.0.ffn_up.weight"]
+        self.assertIsInstance(ffn_up.unpack(), BlockScaledLayout)
+        self.assertListEqual(list(ffn_up.unpack().d.shape), [32, 2, 1])
+        self.assertIsInstance(flat_ts["blk.0.attn_norm.weight"], PrimitiveTensor)
+        for orig in orig_pts[0:2]:
+            torch.testing.assert_close(
+                flat_ts[orig.name].unpack().dequant(),
+                orig.as_torch(),
+                atol=5e-2,
+                rtol=5e-2,
+            )
+
+
 if __name__ == "__main__":
     unittest.main()
@@ -127,6 +127,31 @@ class DatasetTest(unittest.TestCase):
             "a.c.d", ExternalTensorTrait.get(t_acd.as_torch()).external_name
         )
 
+    def testDatasetLazyLoad(self):
+        theta = Theta(
+            _flat_t_dict(
+                _t("a.b.c", 1, 2),
+                _t("a.c.d", 10, 11),
+            )
+        )
+        Dataset({}, theta).save(self.temp_dir / "myds.irpa")
+
+        ds_load = Dataset.load(self.temp_dir / "myds.irpa", mmap=False)
+        root_theta = ds_load.root_theta
+        self.assertEqual(["a.b.c", "a.c.d"], root_theta.tensor_names())
+        self.assertIsInstance(root_theta.tree["a"]["b"]["c"], LazyInferenceTensor)
+        self.assertIsInstance(root_theta.tree["a"]["c"]["d"], LazyInferenceTensor)
+
+        # Sub-thetas share placeholders and resolve them in place.
+        t_abc = root_theta("a")("b", "c")
+        self.assertEqual([1, 2], list(t_abc.shape))
+        self.assertIs(t_abc, root_theta.tree["a"]["b"]["c"])
+        self.assertIs(t_abc, root_theta.tensor("a", "b", "c"))
+        self.assertIsInstance(root_theta.tree["a"]["c"]["d"], LazyInferenceTensor)
+
+        ds_eager = Dataset.load(self.temp_dir / "myds.irpa", mmap=False, lazy=False)
+        self.assertIsInstance(ds_eager.root_theta.tree["a"]["c"]["d"], InferenceTensor)
+
     def _createTestLayout(self):
         n = 128
         k = 1024
@@ -158,5 +183,41 @@ class DatasetTest(unittest.TestCase):
         self.assertEqual(t_load.layout.metadata, t_orig.layout.metadata)
 
 
+    def testDatasetStreamingSave(self):
+        data = torch.randn([8, 6])
+        theta = Theta(
+            [
+                DefaultPrimitiveTensor(name="a.b", data=data),
+                DefaultPrimitiveTensor(name="a.c", data=torch.randn([3])),
+            ]
+        )
+
+        def split(it):
+            if it.name != "a.b":
+                return it
+            return SplitPrimitiveTensor(
+                name=it.name, shard_dim=1, ts=it.as_torch(), shard_count=2
+            )
+
+        Dataset({}, theta).save(
+            self.temp_dir / "myds.irpa", transform=split, max_workers=2, streaming=True
+        )
+        # Spill files are removed once the archives are written.
+        self.assertListEqual(
+            sorted(p.name for p in self.temp_dir.iterdir()),
+            ["myds.irpa", "myds.rank0.irpa", "myds.rank1.irpa"],
+        )
+
+        ds_load = Dataset.load(self.temp_dir / "myds.irpa", mmap=False)
+        t_ab = ds_load.root_theta.tensor("a", "b")
+        self.assertIsInstance(t_ab, SplitPrimitiveTensor)
+        torch.testing.assert_close(
+            torch.cat([s.as_torch() for s in t_ab.shards], dim=1), data
+        )
+        torch.testing.assert_close(
+            ds_load.root_theta.tensor("a", "c").as_torch(),
+            theta.tensor("a", "c").as_torch(),
+        )
+
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,136 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+from pathlib import Path
+import shutil
+import tempfile
+import unittest
+
+import gguf
+import numpy as np
+import torch
+
+from shark_turbine.aot import ExternalTensorTrait
+from sharktank.types import *
+from sharktank.types.gguf_interop import load_file
+from sharktank.types.gguf_interop.layouts import Q5_K, Q6_K
+
+
+class GgufLoadTest(unittest.TestCase):
+    def setUp(self):
+        self.temp_dir = Path(tempfile.mkdtemp("gguf_interop_test"))
+        self.path = self.temp_dir / "test.gguf"
+        self.weight = np.arange(24, dtype=np.float32).reshape(4, 6)
+        writer = gguf.GGUFWriter(self.path, "llama")
+        writer.add_uint32("test.value", 42)
+        writer.add_tensor("blk.0.weight", self.weight)
+        writer.write_header_to_file()
+        writer.write_kv_data_to_file()
+        writer.write_tensors_to_file()
+        writer.close()
+
+    def tearDown(self):
+        shutil.rmtree(self.temp_dir)
+
+    def testLoadIsMapped(self):
+        ds = load_file(self.path)
+        self.assertEqual(ds.properties["test.value"], 42)
+        t = ds.root_theta.tensor("blk", "0", "weight")
+        data = t.as_torch()
+        self.assertEqual(list(data.shape), [4, 6])
+        torch.testing.assert_close(data, torch.from_numpy(self.weight))
+        self.assertEqual(ExternalTensorTrait.get(data).external_name, "blk.0.weight")
+
+        # Writes are private to the process and never reach the file.
+        data[0, 0] = 100.0
+        reloaded = load_file(self.path).root_theta.tensor("blk", "0", "weight")
+        self.assertEqual(reloaded.as_torch()[0, 0].item(), 0.0)
+
+
+def _get_scale_min_k4(j: int, q: list[int]) -> tuple[int, int]:
+    if j < 4:
+        return q[j] & 63, q[j + 4] & 63
+    scale = (q[j + 4] & 0xF) | ((q[j - 4] >> 6) << 4)
+    m = (q[j + 4] >> 4) | ((q[j] >> 6) << 4)
+    return scale, m
+
+
+def _dequantize_row_q5_k(block: bytes) -> list[float]:
+    # Transcribed from dequantize_row_q5_K in ggml.
+    d, dmin = np.frombuffer(block[0:4], dtype=np.float16).astype(np.float32)
+    scales = list(block[4:16])
+    qh = list(block[16:48])
+    ql = list(block[48:176])
+    y = []
+    for j in range(4):
+        sc1, m1 = _get_scale_min_k4(2 * j, scales)
+        sc2, m2 = _get_scale_min_k4(2 * j + 1, scales)
+        u1, u2 = 1 << (2 * j), 2 << (2 * j)
+        for l in range(32):
+            q = (ql[32 * j + l] & 0xF) + (16 if qh[l] & u1 else 0)
+            y.append(d * sc1 * q - dmin * m1)
+        for l in range(32):
+            q = (ql[32 * j + l] >> 4) + (16 if qh[l] & u2 else 0)
+            y.append(d * sc2 * q - dmin * m2)
+    return y
+
+
+def _dequantize_row_q6_k(block: bytes) -> list[float]:
+    # Transcribed from dequantize_row_q6_K in ggml.
+    ql = list(block[0:128])
+    qh = list(block[128:192])
+    sc = list(np.frombuffer(block[192:208], dtype=np.int8))
+    d = np.frombuffer(block[208:210], dtype=np.float16).astype(np.float32)[0]
+    y = [0.0] * 256
+    for n in range(2):
+        ql_n, qh_n, sc_n = ql[64 * n :], qh[32 * n :], sc[8 * n :]
+        for l in range(32):
+            i = l // 16
+            q1 = ((ql_n[l] & 0xF) | (((qh_n[l] >> 0) & 3) << 4)) - 32
+            q2 = ((ql_n[l + 32] & 0xF) | (((qh_n[l] >> 2) & 3) << 4)) - 32
+            q3 = ((ql_n[l] >> 4) | (((qh_n[l] >> 4) & 3) << 4)) - 32
+            q4 = ((ql_n[l + 32] >> 4) | (((qh_n[l] >> 6) & 3) << 4)) - 32
+            y[128 * n + l] = d * sc_n[i] * q1
+            y[128 * n + l + 32] = d * sc_n[i + 2] * q2
+            y[128 * n + l + 64] = d * sc_n[i + 4] * q3
+            y[128 * n + l + 96] = d * sc_n[i + 6] * q4
+    return y
+
+
+class GgufKQuantUnpackTest(unittest.TestCase):
+    def setUp(self):
+        self.rng = np.random.default_rng(12345)
+
+    def _random_blocks(self, rows: int, block_bytes: int, scale_offsets: list[int]):
+        raw = self.rng.integers(0, 256, size=(rows, block_bytes), dtype=np.uint8)
+        # Keep the f16 scales finite and small.
+        for offset in scale_offsets:
+            raw[:, offset : offset + 2] = (
+                self.rng.random((rows, 1), dtype=np.float32)
+                .astype(np.float16)
+                .view(np.uint8)
+            )
+        return raw
+
+    def _check(self, cls, rows, block_bytes, scale_offsets, dequantize_row):
+        raw = self._random_blocks(rows, block_bytes, scale_offsets)
+        t = cls(raw=torch.from_numpy(raw.flatten()), shape=[rows, 256])
+        ref = torch.tensor(
+            [dequantize_row(raw[r].tobytes()) for r in range(rows)],
+            dtype=torch.float32,
+        )
+        actual = t.unpack().dequant(torch.float32)
+        torch.testing.assert_close(actual, ref, atol=1e-2, rtol=1e-2)
+
+    def testQ5_K(self):
+        self._check(Q5_K, 3, 176, [0, 2], _dequantize_row_q5_k)
+
+    def testQ6_K(self):
+        self._check(Q6_K, 3, 210, [208], _dequantize_row_q6_k)
+
+
+if __name__ == "__main__":
+    unittest.main()
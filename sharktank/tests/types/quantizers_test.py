@@ -165,5 +165,35 @@ class DynamicScaledQuantizerTest(TempDirTestBase):
         torch.testing.assert_close(orig_value, dequant_value, atol=1e-1, rtol=1e-1)
 
 
+    def testPerAxisQuantDequantInt(self):
+        qr = DynamicScaledQuantizer(dtype=torch.int8, axis=0)
+        qr = self._roundtrip(qr, "_qr")
+        self.assertEqual(qr.axis, 0)
+        orig_value = torch.tensor(
+            [[-5.0, -2.0, 3.0, 4.5], [0.05, -0.02, 0.03, 0.01]], dtype=torch.float32
+        )
+        qt_value = qr.quantize(orig_value)
+        layout = qt_value.unpack()
+        self.assertListEqual(list(layout.d.shape), [2, 1])
+        dequant_value = layout.dequant()
+        # Each row is scaled by its own range.
+        torch.testing.assert_close(orig_value, dequant_value, atol=1e-3, rtol=3e-2)
+
+    def testBlockQuantDequantInt(self):
+        qr = DynamicScaledQuantizer(dtype=torch.int8, block_size=4)
+        qr = self._roundtrip(qr, "_qr")
+        self.assertEqual(qr.block_size, 4)
+        orig_value = torch.tensor(
+            [[-5.0, -2.0, 3.0, 4.5, 0.05, -0.02, 0.03, 0.01]], dtype=torch.float32
+        )
+        qt_value = qr.quantize(orig_value)
+        layout = qt_value.unpack()
+        self.assertIsInstance(layout, BlockScaledLayout)
+        self.assertListEqual(list(layout.d.shape), [1, 2, 1])
+        self.assertListEqual(list(layout.qs.shape), [1, 2, 4])
+        dequant_value = layout.dequant()
+        torch.testing.assert_close(orig_value, dequant_value, atol=1e-3, rtol=3e-2)
+
+
 if __name__ == "__main__":
     unittest.main()
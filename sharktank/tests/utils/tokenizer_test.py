@@ -0,0 +1,79 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import unittest
+
+import numpy as np
+
+from sharktank.utils.tokenizer import *
+
+
+class Utf8Tokenizer(InferenceTokenizer):
+    """Tokenizes into the bytes of utf-8 encoded texts."""
+
+    def _encode(self, texts: list[str]) -> list[list[int]]:
+        return [list(t.encode()) for t in texts]
+
+    def _decode(self, tokens: list[list[int]]) -> list[str]:
+        return [bytes(row).decode(errors="replace") for row in tokens]
+
+
+class EncodeTest(unittest.TestCase):
+    def testPadded(self):
+        t = Utf8Tokenizer()
+        tokens, lengths = t.encode(["ab", "abcde"], pad_to_multiple_of=4)
+        self.assertEqual(lengths, [2, 5])
+        self.assertEqual(tokens.dtype, np.int64)
+        self.assertEqual(
+            tokens.tolist(),
+            [[97, 98, 0, 0, 0, 0, 0, 0], [97, 98, 99, 100, 101, 0, 0, 0]],
+        )
+        self.assertEqual(t.decode(tokens, lengths), ["ab", "abcde"])
+
+    def testPaddedIntoOutput(self):
+        t = Utf8Tokenizer()
+        out = np.full((3, 6), -1, dtype=np.int64)
+        tokens, lengths = t.encode(["abc", "a"], pad_token=7, out=out)
+        self.assertEqual(lengths, [3, 1])
+        self.assertTrue(np.shares_memory(tokens, out))
+        self.assertEqual(
+            out.tolist(),
+            [[97, 98, 99, -1, -1, -1], [97, 7, 7, -1, -1, -1], 6 * [-1]],
+        )
+
+
+class IncrementalDetokenizerTest(unittest.TestCase):
+    def testSteps(self):
+        t = Utf8Tokenizer()
+        prompt = list("Hi ".encode())
+        detokenizer = IncrementalDetokenizer(prompt, context=2)
+        e_acute = list("é".encode())
+        self.assertEqual(detokenizer.step(t, [104]), "h")
+        # Held back until the character is complete.
+        self.assertEqual(detokenizer.step(t, e_acute[:1]), "")
+        self.assertEqual(detokenizer.step(t, e_acute[1:] + [121]), "éy")
+        self.assertEqual(detokenizer.token_ids, prompt + [104] + e_acute + [121])
+
+    def testFinal(self):
+        t = Utf8Tokenizer()
+        detokenizer = IncrementalDetokenizer()
+        self.assertEqual(detokenizer.step(t, list("ok".encode())), "ok")
+        self.assertEqual(detokenizer.step(t, [0xC3], final=True), "�")
+
+    def testBatchedWindows(self):
+        t = Utf8Tokenizer()
+        detokenizers = [IncrementalDetokenizer(), IncrementalDetokenizer([97])]
+        windows = [d.add_tokens([98, 99]) for d in detokenizers]
+        texts = t.decode([w for pair in windows for w in pair])
+        deltas = [
+            d.commit(texts[2 * i], texts[2 * i + 1])
+            for i, d in enumerate(detokenizers)
+        ]
+        self.assertEqual(deltas, ["bc", "bc"])
+
+
+if __name__ == "__main__":
+    unittest.main()
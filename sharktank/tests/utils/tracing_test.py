@@ -0,0 +1,83 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import json
+import unittest
+
+import torch
+
+from sharktank import ops
+from sharktank.utils import tracing
+
+
+class TracerTest(unittest.TestCase):
+    def setUp(self):
+        self.tracer = tracing.Tracer()
+        self.previous = tracing.install(self.tracer)
+
+    def tearDown(self):
+        tracing.install(self.previous)
+
+    def testNestedSpans(self):
+        with tracing.span("outer", "test", step=1):
+            with tracing.span("inner", "test") as args:
+                args["result"] = 2
+        inner, outer = self.tracer.events
+        self.assertEqual(outer["name"], "outer")
+        self.assertEqual(outer["ph"], "X")
+        self.assertEqual(outer["args"], {"step": 1})
+        self.assertEqual(inner["args"], {"result": 2})
+        self.assertGreaterEqual(inner["ts"], outer["ts"])
+        self.assertLessEqual(inner["ts"] + inner["dur"], outer["ts"] + outer["dur"])
+        trace = json.loads(self.tracer.render())
+        self.assertEqual(len(trace["traceEvents"]), 2)
+
+    def testSampledPerRootSpan(self):
+        self.tracer.sample_rate = 0.0
+        with tracing.span("outer"):
+            with tracing.span("inner"):
+                self.tracer.instant("event")
+        tracing.record_span("phase", 0.0, 1.0)
+        self.assertEqual(self.tracer.events, [])
+
+    def testMaxEvents(self):
+        self.tracer.max_events = 2
+        for i in range(3):
+            tracing.record_span(f"phase{i}", 0.0, 1.0)
+        self.assertEqual(len(self.tracer.events), 2)
+        self.assertEqual(self.tracer.dropped_events, 1)
+
+    def testTensorSummary(self):
+        t = torch.tensor([1.0, float("nan"), -3.0, 2.0])
+        self.tracer.trace_tensor("t", t)
+        (event,) = self.tracer.events
+        self.assertEqual(event["ph"], "i")
+        self.assertEqual(
+            event["args"],
+            {
+                "shape": [4],
+                "dtype": "torch.float32",
+                "nan_count": 1,
+                "min": -3.0,
+                "max": 2.0,
+            },
+        )
+
+    def testOpDispatchSpans(self):
+        ops.elementwise(torch.add, torch.ones(2), torch.ones(2))
+        names = [e["name"] for e in self.tracer.events if e["cat"] == "op"]
+        self.assertIn("elementwise", names)
+
+    def testDisabled(self):
+        tracing.install(None)
+        with tracing.span("outer"):
+            pass
+        tracing.record_span("phase", 0.0, 1.0)
+        self.assertEqual(self.tracer.events, [])
+
+
+if __name__ == "__main__":
+    unittest.main()
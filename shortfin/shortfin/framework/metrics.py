@@ -0,0 +1,371 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Prometheus style metrics for serving.
+
+Metrics are counters, gauges and histograms, created on a `MetricsRegistry`
+(typically the process wide `REGISTRY`) and optionally split by labels.
+`MetricsRegistry.render()` produces the Prometheus text exposition format,
+which servers expose for scraping.
+
+Metrics are updated from the host context threads and read from the server
+thread, so all updates are guarded by a lock.
+
+Gauges of state held by several objects of a process (e.g. a cache per
+device) sum over the live objects of a `WeakInstanceSet` when rendered,
+rather than each object overwriting the gauge with its own value.
+"""
+
+from typing import Callable, Generic, Iterator, Optional, Sequence, TypeVar
+
+from contextlib import contextmanager
+import math
+from threading import Lock
+import time
+import weakref
+
+__all__ = [
+    "Counter",
+    "Gauge",
+    "Histogram",
+    "MetricsRegistry",
+    "REGISTRY",
+    "WeakInstanceSet",
+]
+
+T = TypeVar("T")
+
+# Default buckets of latency histograms, in seconds.
+DEFAULT_LATENCY_BUCKETS = (
+    0.0001,
+    0.00025,
+    0.0005,
+    0.001,
+    0.0025,
+    0.005,
+    0.01,
+    0.025,
+    0.05,
+    0.1,
+    0.25,
+    0.5,
+    1.0,
+    2.5,
+    5.0,
+    10.0,
+)
+
+LabelValues = tuple[str, ...]
+
+
+def _format_value(value: float) -> str:
+    if math.isinf(value):
+        return "+Inf" if value > 0 else "-Inf"
+    if value == int(value) and abs(value) < 1e15:
+        return str(int(value))
+    return repr(float(value))
+
+
+def _escape_label(value: str) -> str:
+    return value.replace("\\", "\\\\").replace('"', '\\"').replace("\n", "\\n")
+
+
+def _format_labels(names: Sequence[str], values: Sequence[str]) -> str:
+    if not names:
+        return ""
+    pairs = ",".join(f'{n}="{_escape_label(v)}"' for n, v in zip(names, values))
+    return "{" + pairs + "}"
+
+
+class _Metric:
+    """Base of metrics with a child per combination of label values."""
+
+    kind = ""
+
+    def __init__(self, name: str, help: str, labelnames: Sequence[str], lock: Lock):
+        self.name = name
+        self.help = help
+        self.labelnames = tuple(labelnames)
+        self._lock = lock
+        self._children: dict[LabelValues, object] = {}
+        if not self.labelnames:
+            self._children[()] = self._new_child()
+
+    def _new_child(self):
+        raise NotImplementedError
+
+    def labels(self, **labels: str):
+        """Gets the child metric of the given label values."""
+        assert set(labels.keys()) == set(
+            self.labelnames
+        ), f"Metric {self.name} expects labels {self.labelnames} (got {labels})"
+        key = tuple(str(labels[n]) for n in self.labelnames)
+        with self._lock:
+            child = self._children.get(key)
+            if child is None:
+                child = self._children[key] = self._new_child()
+            return child
+
+    def _unlabeled(self):
+        assert not self.labelnames, f"Metric {self.name} requires labels"
+        return self._children[()]
+
+    def _render_samples(self, lines: list[str]):
+        raise NotImplementedError
+
+    def render(self, lines: list[str]):
+        lines.append(f"# HELP {self.name} {self.help}")
+        lines.append(f"# TYPE {self.name} {self.kind}")
+        self._render_samples(lines)
+
+
+class _CounterChild:
+    __slots__ = ["_lock", "value"]
+
+    def __init__(self, lock: Lock):
+        self._lock = lock
+        self.value = 0.0
+
+    def inc(self, amount: float = 1.0):
+        assert amount >= 0, "Counters can only increase"
+        with self._lock:
+            self.value += amount
+
+
+class Counter(_Metric):
+    """A monotonically increasing count."""
+
+    kind = "counter"
+
+    def _new_child(self):
+        return _CounterChild(self._lock)
+
+    def inc(self, amount: float = 1.0):
+        self._unlabeled().inc(amount)
+
+    def _render_samples(self, lines: list[str]):
+        with self._lock:
+            children = list(self._children.items())
+        for key, child in children:
+            labels = _format_labels(self.labelnames, key)
+            lines.append(f"{self.name}{labels} {_format_value(child.value)}")
+
+
+class _GaugeChild:
+    __slots__ = ["_function", "_lock", "_value"]
+
+    def __init__(self, lock: Lock):
+        self._lock = lock
+        self._value = 0.0
+        self._function: Optional[Callable[[], float]] = None
+
+    def set(self, value: float):
+        with self._lock:
+            self._value = value
+
+    def inc(self, amount: float = 1.0):
+        with self._lock:
+            self._value += amount
+
+    def dec(self, amount: float = 1.0):
+        self.inc(-amount)
+
+    def set_function(self, function: Callable[[], float]):
+        """Reads the value from `function` when rendered rather than storing it."""
+        self._function = function
+
+    @property
+    def value(self) -> float:
+        function = self._function
+        if function is not None:
+            return float(function())
+        return self._value
+
+
+class Gauge(_Metric):
+    """A value which can go up and down."""
+
+    kind = "gauge"
+
+    def _new_child(self):
+        return _GaugeChild(self._lock)
+
+    def set(self, value: float):
+        self._unlabeled().set(value)
+
+    def inc(self, amount: float = 1.0):
+        self._unlabeled().inc(amount)
+
+    def dec(self, amount: float = 1.0):
+        self._unlabeled().dec(amount)
+
+    def set_function(self, function: Callable[[], float]):
+        self._unlabeled().set_function(function)
+
+    def _render_samples(self, lines: list[str]):
+        with self._lock:
+            children = list(self._children.items())
+        for key, child in children:
+            labels = _format_labels(self.labelnames, key)
+            lines.append(f"{self.name}{labels} {_format_value(child.value)}")
+
+
+class _HistogramChild:
+    __slots__ = ["_lock", "buckets", "counts", "count", "sum"]
+
+    def __init__(self, lock: Lock, buckets: tuple[float, ...]):
+        self._lock = lock
+        self.buckets = buckets
+        # Non-cumulative count per bucket, with a final +Inf bucket.
+        self.counts = [0] * (len(buckets) + 1)
+        self.count = 0
+        self.sum = 0.0
+
+    def observe(self, value: float):
+        index = len(self.buckets)
+        for i, bound in enumerate(self.buckets):
+            if value <= bound:
+                index = i
+                break
+        with self._lock:
+            self.counts[index] += 1
+            self.count += 1
+            self.sum += value
+
+    @contextmanager
+    def time(self) -> Iterator[None]:
+        """Observes the seconds spent in the context."""
+        start = time.perf_counter()
+        try:
+            yield
+        finally:
+            self.observe(time.perf_counter() - start)
+
+
+class Histogram(_Metric):
+    """Counts observed values into cumulative buckets."""
+
+    kind = "histogram"
+
+    def __init__(
+        self,
+        name: str,
+        help: str,
+        labelnames: Sequence[str],
+        lock: Lock,
+        buckets: Sequence[float] = DEFAULT_LATENCY_BUCKETS,
+    ):
+        self.buckets = tuple(sorted(buckets))
+        super().__init__(name, help, labelnames, lock)
+
+    def _new_child(self):
+        return _HistogramChild(self._lock, self.buckets)
+
+    def observe(self, value: float):
+        self._unlabeled().observe(value)
+
+    def time(self):
+        return self._unlabeled().time()
+
+    def _render_samples(self, lines: list[str]):
+        with self._lock:
+            children = [
+                (key, list(child.counts), child.count, child.sum)
+                for key, child in self._children.items()
+            ]
+        names = self.labelnames + ("le",)
+        for key, counts, count, total in children:
+            cumulative = 0
+            for bound, bucket_count in zip(self.buckets + (math.inf,), counts):
+                cumulative += bucket_count
+                labels = _format_labels(names, key + (_format_value(bound),))
+                lines.append(f"{self.name}_bucket{labels} {cumulative}")
+            labels = _format_labels(self.labelnames, key)
+            lines.append(f"{self.name}_sum{labels} {_format_value(total)}")
+            lines.append(f"{self.name}_count{labels} {count}")
+
+
+class WeakInstanceSet(Generic[T]):
+    """Weakly held objects whose state gauges aggregate when rendered.
+
+    Objects that are no longer referenced elsewhere drop out of the set, so
+    registering an object with a gauge does not keep it alive.
+    """
+
+    def __init__(self):
+        self._lock = Lock()
+        self._instances: weakref.WeakSet[T] = weakref.WeakSet()
+
+    def add(self, instance: T):
+        with self._lock:
+            self._instances.add(instance)
+
+    def discard(self, instance: T):
+        with self._lock:
+            self._instances.discard(instance)
+
+    def sum(self, function: Callable[[T], float]) -> Callable[[], float]:
+        """Returns a gauge function summing `function` over the live objects."""
+
+        def total() -> float:
+            with self._lock:
+                instances = list(self._instances)
+            return sum(function(instance) for instance in instances)
+
+        return total
+
+
+class MetricsRegistry:
+    """Named collection of metrics.
+
+    Metrics are created on first use: requesting an existing name returns the
+    existing metric, so modules can declare the metrics they update without
+    coordinating.
+    """
+
+    def __init__(self):
+        self._lock = Lock()
+        self._metrics: dict[str, _Metric] = {}
+
+    def _get_or_create(self, cls, name: str, help: str, labelnames, **kwargs):
+        with self._lock:
+            metric = self._metrics.get(name)
+            if metric is None:
+                metric = cls(name, help, labelnames, Lock(), **kwargs)
+                self._metrics[name] = metric
+        assert (
+            type(metric) is cls and metric.labelnames == tuple(labelnames)
+        ), f"Metric {name} already registered as a different metric"
+        return metric
+
+    def counter(self, name: str, help: str, labelnames: Sequence[str] = ()) -> Counter:
+        return self._get_or_create(Counter, name, help, labelnames)
+
+    def gauge(self, name: str, help: str, labelnames: Sequence[str] = ()) -> Gauge:
+        return self._get_or_create(Gauge, name, help, labelnames)
+
+    def histogram(
+        self,
+        name: str,
+        help: str,
+        labelnames: Sequence[str] = (),
+        *,
+        buckets: Sequence[float] = DEFAULT_LATENCY_BUCKETS,
+    ) -> Histogram:
+        return self._get_or_create(Histogram, name, help, labelnames, buckets=buckets)
+
+    def render(self) -> str:
+        """Renders all metrics in the Prometheus text exposition format."""
+        with self._lock:
+            metrics = sorted(self._metrics.values(), key=lambda m: m.name)
+        lines: list[str] = []
+        for metric in metrics:
+            metric.render(lines)
+        return "\n".join(lines) + "\n"
+
+
+# Process wide registry, which is exposed by the servers.
+REGISTRY = MetricsRegistry()
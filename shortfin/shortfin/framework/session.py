@@ -10,6 +10,9 @@ Key concepts:
 
   * DeviceSession: A single HAL device and other process-level globals. Shared global
     memory and corresponding synchronization handles are accessible from here.
+  * DeviceSessionGroup: DeviceSessions of several devices served from one process.
+    Their module sets share host-side mappings of VMFBs and parameters (see
+    HostMappings), so weights are mapped into host memory once per process.
   * WorkQueue: Logical stream of execution, nested under the DeviceSession. Each
     queue holds a timeline semaphore which sequences invocations. For these models,
     we route workloads of vastly different characteristics to distinct queues (i.e.
@@ -22,7 +25,16 @@ Key concepts:
     host side work across multiple OS threads, ensuring faster feeding of the device.
 """
 
-from typing import Any, Callable, Coroutine, Generic, TypeVar, Optional, Union
+from typing import (
+    Any,
+    Callable,
+    Coroutine,
+    Generic,
+    TypeVar,
+    Optional,
+    Sequence,
+    Union,
+)
 
 import asyncio
 import concurrent.futures
@@ -55,6 +67,7 @@ from iree.runtime import (  # type: ignore[import-untyped]
 )
 
 from .logging import get_logger, NDEBUG
+from .metrics import REGISTRY
 
 T = TypeVar("T")
 
@@ -72,12 +85,57 @@ def get_vm_instance() -> VmInstance:
     return _GLOBAL_VM_INSTANCE
 
 
+class HostMappings:
+    """Host-side mappings of VMFBs and parameter files, by path.
+
+    Modules and parameter indices are not bound to a device, so module sets of
+    different devices can share them rather than each mapping its own copy.
+    """
+
+    __slots__ = [
+        "_lock",
+        "_parameter_indices",
+        "_vmfbs",
+        "vm_instance",
+    ]
+
+    def __init__(self, vm_instance: VmInstance):
+        self.vm_instance = vm_instance
+        self._lock = Lock()
+        self._vmfbs: dict[str, VmModule] = {}
+        self._parameter_indices: dict[str, ParameterIndex] = {}
+
+    def vmfb(self, vmfb_path: str) -> VmModule:
+        """Gets the module of a VMFB, mapping it on first use."""
+        key = str(vmfb_path)
+        with self._lock:
+            module = self._vmfbs.get(key)
+            if module is None:
+                logger.info("Mapping VMFB %s", vmfb_path)
+                module = VmModule.mmap(self.vm_instance, key)
+                self._vmfbs[key] = module
+            return module
+
+    def parameter_index(self, sources_path: str) -> ParameterIndex:
+        """Gets the index of a parameter file, loading it on first use."""
+        key = str(sources_path)
+        with self._lock:
+            index = self._parameter_indices.get(key)
+            if index is None:
+                logger.info("Loading parameter index %s", sources_path)
+                index = ParameterIndex()
+                index.load(key)
+                self._parameter_indices[key] = index
+            return index
+
+
 class DeviceSession:
     """Top-level object associated with a single attached device."""
 
     __slots__ = [
         "device",
         "driver",
+        "host_mappings",
         "_module_sets",
         "queues",
         "_queue_request_count",
@@ -92,9 +150,14 @@ class DeviceSession:
         device: Optional[HalDevice] = None,
         vm_instance: Optional[VmInstance] = None,
         queue_count: int = 1,
+        host_mappings: Optional[HostMappings] = None,
     ):
         self._queue_request_count = 0
         self.vm_instance = vm_instance or get_vm_instance()
+        self.host_mappings = host_mappings or HostMappings(self.vm_instance)
+        assert (
+            self.host_mappings.vm_instance is self.vm_instance
+        ), "Host mappings must be of the session's VmInstance"
         if uri is not None:
             assert (
                 driver is None and device is None
@@ -140,6 +203,89 @@ class DeviceSession:
             return self.queues[qc % len(self.queues)]
 
 
+class DeviceSessionGroup:
+    """DeviceSessions of several devices, sharing a VmInstance and HostMappings.
+
+    Devices are given by URI or enumerated from a driver. Each session has its
+    own queues, module sets and host contexts, so work on the devices is
+    scheduled independently.
+    """
+
+    __slots__ = [
+        "host_mappings",
+        "sessions",
+        "vm_instance",
+    ]
+
+    def __init__(
+        self,
+        *,
+        uris: Sequence[str] = (),
+        driver: Optional[Union[str, HalDriver]] = None,
+        device_count: Optional[int] = None,
+        vm_instance: Optional[VmInstance] = None,
+        queue_count: int = 1,
+    ):
+        self.vm_instance = vm_instance or get_vm_instance()
+        self.host_mappings = HostMappings(self.vm_instance)
+        self.sessions: list[DeviceSession] = []
+        if uris:
+            assert driver is None, "If 'uris' are given, 'driver' cannot be set"
+            assert device_count is None or device_count == len(uris)
+            for uri in uris:
+                self.sessions.append(
+                    DeviceSession(
+                        uri=uri,
+                        vm_instance=self.vm_instance,
+                        queue_count=queue_count,
+                        host_mappings=self.host_mappings,
+                    )
+                )
+        else:
+            assert driver is not None, "One of 'uris' or 'driver' must be given"
+            if isinstance(driver, str):
+                driver = get_driver(driver)
+            device_infos = driver.query_available_devices()
+            if device_count is not None:
+                if device_count > len(device_infos):
+                    raise ValueError(
+                        f"Requested {device_count} devices but only "
+                        f"{len(device_infos)} are available"
+                    )
+                device_infos = device_infos[:device_count]
+            for info in device_infos:
+                logger.info("Opening device %s", info)
+                self.sessions.append(
+                    DeviceSession(
+                        driver=driver,
+                        device=driver.create_device(info),
+                        vm_instance=self.vm_instance,
+                        queue_count=queue_count,
+                        host_mappings=self.host_mappings,
+                    )
+                )
+        assert self.sessions, "No devices opened"
+
+    def __len__(self):
+        return len(self.sessions)
+
+    def __getitem__(self, index: int) -> DeviceSession:
+        return self.sessions[index]
+
+    def create_module_sets(
+        self, name: str, *, context_count: int = 1
+    ) -> list["ModuleSet"]:
+        """Creates a module set of the given name on each device."""
+        return [
+            session.create_module_set(name, context_count=context_count)
+            for session in self.sessions
+        ]
+
+    def shutdown(self):
+        for session in self.sessions:
+            session.shutdown()
+
+
 class ModuleSet:
     __slots__ = [
         "contexts",
@@ -169,14 +315,19 @@ class ModuleSet:
 
     def load_vmfb(self, vmfb_path: str):
         logger.info("Loading VMFB %s", vmfb_path)
-        self.add(VmModule.mmap(self.session.vm_instance, vmfb_path))
+        self.add(self.session.host_mappings.vmfb(vmfb_path))
 
-    def load_io_module(self, sources_path: str):
-        logger.info("Loading IO Module %s", sources_path)
-        index = ParameterIndex()
-        index.load(sources_path)
-        par_provider = index.create_provider(scope="model")
-        self.add(create_io_parameters_module(self.session.vm_instance, par_provider))
+    def load_io_module(
+        self, sources_path: str, scope: str = "model", *more_sources: tuple[str, str]
+    ):
+        """Loads the parameter module, serving the archive at `sources_path`
+        under `scope` and each further (path, scope) of `more_sources`."""
+        providers = []
+        for path, path_scope in [(sources_path, scope), *more_sources]:
+            logger.info("Loading IO Module %s (scope %s)", path, path_scope)
+            index = self.session.host_mappings.parameter_index(path)
+            providers.append(index.create_provider(scope=path_scope))
+        self.add(create_io_parameters_module(self.session.vm_instance, *providers))
 
     def initialize(self):
         assert not self.initialized, "Already initialized"
@@ -346,6 +497,13 @@ class WorkQueue:
         sem = self._semaphore
         return HalFence.create_at(sem, current_step), HalFence.create_at(sem, next_step)
 
+    @property
+    def outstanding_steps(self) -> int:
+        """Number of steps queued but not yet completed."""
+        with self._lock:
+            current_step = self._step
+        return max(0, current_step - self._semaphore.query())
+
     def sync(self, host_context: HostContext) -> asyncio.Future:
         """Awaitable that completes when all work currently queued completed."""
         with self._lock:
@@ -446,6 +604,18 @@ class TransferBuffer:
                 )
 
 
+TRANSFER_POOL_BUFFERS = REGISTRY.gauge(
+    "shortfin_transfer_pool_buffers",
+    "Transfer buffers allocated by each pool",
+    ["pool"],
+)
+TRANSFER_POOL_GROW_TOTAL = REGISTRY.counter(
+    "shortfin_transfer_pool_grow_total",
+    "Transfer buffers allocated by growing exhausted pools",
+    ["pool"],
+)
+
+
 class TransferBufferPool:
     """Pool of transfer buffers of a fixed size."""
 
@@ -466,6 +636,7 @@ class TransferBufferPool:
         self.name = name
         if initial_capacity > 0:
             self._free_list = [allocator() for _ in range(initial_capacity)]
+            TRANSFER_POOL_BUFFERS.labels(pool=name).inc(initial_capacity)
         self._allocator = None
         if growable:
             self._allocator = allocator
@@ -538,6 +709,8 @@ class TransferBufferPool:
                 f"Transfer buffer pool '%s' exhausted and not growable", self.name
             )
         logger.info("Grow transfer buffer pool '%s'", self.name)
+        TRANSFER_POOL_BUFFERS.labels(pool=self.name).inc()
+        TRANSFER_POOL_GROW_TOTAL.labels(pool=self.name).inc()
         tb = allocator()
         assert tb._pool is None
         tb._pool = self
@@ -581,6 +754,63 @@ class AsyncResources:
                 self.recycle()
 
 
+class PipelinedResources:
+    """Ring of AsyncResources for staging the inputs of successive steps.
+
+    Each step stages into the next set of the ring, which is only recycled once
+    the last step it was used for has completed on its queue. With a depth of 2,
+    host-side staging of step N+1 proceeds while step N executes (double
+    buffering). A depth of 1 recycles each step's resources once the prior step
+    completed.
+    """
+
+    __slots__ = [
+        "_guards",
+        "_index",
+        "_ring",
+    ]
+
+    def __init__(self, depth: int = 1):
+        assert depth > 0, "Pipeline depth must be positive"
+        self._ring = [AsyncResources() for _ in range(depth)]
+        self._guards: list[Optional[TimelineGuarded[None]]] = [None] * depth
+        self._index = 0
+
+    @property
+    def depth(self) -> int:
+        return len(self._ring)
+
+    async def acquire(self, host_context: HostContext) -> AsyncResources:
+        """Waits for the next set of resources to be free and returns it recycled.
+
+        The step staged into it must be released with `retire()`.
+        """
+        index = self._index
+        guard = self._guards[index]
+        if guard is not None:
+            await guard.resolve(host_context)
+            self._guards[index] = None
+        resources = self._ring[index]
+        resources.recycle()
+        return resources
+
+    def retire(self, work_queue: WorkQueue):
+        """Marks the most recently acquired resources as in use until the current
+        position of the queue, advancing to the next set in the ring."""
+        index = self._index
+        self._guards[index] = work_queue.guard(None)
+        self._index = (index + 1) % len(self._ring)
+
+    def recycle(self):
+        """Recycles all resources. The queues they were used on must be synced."""
+        for resources in self._ring:
+            resources.recycle()
+        self._guards = [None] * len(self._ring)
+
+    def __repr__(self):
+        return f"PipelinedResources(depth={len(self._ring)}, index={self._index})"
+
+
 class TimelineGuarded(Generic[T]):
     """Some form of results that are structurally available now but will not be
     populated until some point in the future.
@@ -606,5 +836,9 @@ class TimelineGuarded(Generic[T]):
         """Produces an awaitable that resolves to the value once available."""
         return host_context.on_semaphore(self.sem, self.timeline, self.value)
 
+    def is_ready(self) -> bool:
+        """Whether the timepoint has already been reached (without waiting)."""
+        return self.sem.query() >= self.timeline
+
     def __repr__(self):
         return f"TimelineGuarded[{self.sem} @ {self.timeline}] = {self.value}"
@@ -17,20 +17,32 @@ import sys
 import uuid
 import uvicorn
 
+from sharktank.utils import tracing
+
 from ...framework.logging import get_logger
+from ...framework.metrics import REGISTRY
 from ...framework.session import DeviceSession
 
 
 from ..service import (
     create_mock_generate_service,
+    EchoGenerateService,
     GenerateService,
     GenerateRequest,
 )
+from ..tokenizer_service import TokenizerPool, TokenizerService
 
 logger = get_logger("shortfin.llm.api_server")
 app = FastAPI()
 service: Optional[GenerateService] = None
 
+REQUESTS_TOTAL = REGISTRY.counter(
+    "shortfin_llm_requests_total", "Generate requests received", ["stream"]
+)
+REQUESTS_IN_FLIGHT = REGISTRY.gauge(
+    "shortfin_llm_requests_in_flight", "Generate requests being served"
+)
+
 
 def get_service() -> GenerateService:
     assert service is not None, "Service was not initialized"
@@ -43,33 +55,63 @@ async def health() -> Response:
     return Response(status_code=200)
 
 
+@app.get("/metrics")
+async def metrics() -> Response:
+    return Response(
+        content=REGISTRY.render(), media_type="text/plain; version=0.0.4"
+    )
+
+
+@app.get("/trace")
+async def trace() -> Response:
+    """Returns the Chrome trace recorded so far, if tracing is enabled."""
+    tracer = tracing.get_tracer()
+    if tracer is None:
+        return Response(status_code=404)
+    return Response(content=tracer.render(), media_type="application/json")
+
+
 @app.post("/generate")
 async def generate(request: Request) -> Response:
     service = get_service()
     r = await request.json()
     prompt = r.pop("prompt")
     stream = bool(r.pop("stream", False))
+    max_tokens = r.pop("max_tokens", None)
     request_id = uuid.uuid4().hex
+    REQUESTS_TOTAL.labels(stream=str(stream).lower()).inc()
 
-    generate_request = GenerateRequest(request_id=request_id, prompt=prompt)
+    generate_request = GenerateRequest(
+        request_id=request_id,
+        prompt=prompt,
+        max_tokens=None if max_tokens is None else int(max_tokens),
+    )
     result_parts = service.handle_request(generate_request)
 
     if stream:
         # TODO: This isn't entirely matching how others do it: we should be returning
         # the full result on each update.
         async def stream_contents() -> AsyncGenerator[bytes, None]:
-            async for part in result_parts:
-                response_record = json.dumps({"text": part.text})
-                yield (response_record + "\0").encode()
+            REQUESTS_IN_FLIGHT.inc()
+            try:
+                async for part in result_parts:
+                    response_record = json.dumps({"text": part.text})
+                    yield (response_record + "\0").encode()
+            finally:
+                REQUESTS_IN_FLIGHT.dec()
 
         return StreamingResponse(stream_contents())
 
     # Non-streaming just reads to the final.
-    async for result_part in result_parts:
-        if await request.is_disconnected():
-            # Abort.
-            await service.abort(generate_request.request_id)
-            return Response(status_code=499)
+    REQUESTS_IN_FLIGHT.inc()
+    try:
+        async for result_part in result_parts:
+            if await request.is_disconnected():
+                # Abort.
+                await service.abort(generate_request.request_id)
+                return Response(status_code=499)
+    finally:
+        REQUESTS_IN_FLIGHT.dec()
 
     assert result_part is not None, "No results generated!"
     return JSONResponse({"text": result_part.text})
@@ -97,17 +139,55 @@ def main(clargs: Sequence[str]):
     parser.add_argument(
         "--device-uri", type=str, default="local-task", help="Device URI to serve on"
     )
+    parser.add_argument(
+        "--tokenizer",
+        type=str,
+        default=None,
+        help="Path of a transformers tokenizer (the mock service maps code points "
+        "otherwise)",
+    )
+    parser.add_argument(
+        "--tokenizer-workers",
+        type=int,
+        default=2,
+        help="Threads running the tokenizer off of the event loop",
+    )
+    parser.add_argument(
+        "--trace-path",
+        type=str,
+        default=None,
+        help="Records a Chrome trace of generation steps, saved here at exit "
+        "(and served at /trace)",
+    )
+    parser.add_argument(
+        "--trace-sample-rate",
+        type=float,
+        default=1.0,
+        help="Fraction of spans to record when tracing",
+    )
 
     args = parser.parse_args(clargs)
+    if args.trace_path:
+        tracing.configure(args.trace_path, sample_rate=args.trace_sample_rate)
 
     # Spin up the device machinery.
     # Note that in the future, for multi-device, we will need more scaffolding for
-    # configuration and bringup, obviously.
+    # configuration and bringup, obviously. Multi-device serving is available
+    # in-process (see `BatchDispatcher` and the load generator), but the REST
+    # server only has the mock service to serve so far.
     device_session = DeviceSession(uri=args.device_uri)
 
     if args.testing_mock_service:
         logger.info("Enabling mock LLM generate service")
-        service = create_mock_generate_service()
+        if args.tokenizer:
+            from sharktank.utils.tokenizer import load_tokenizer
+
+            pool = TokenizerPool(
+                load_tokenizer(args.tokenizer), max_workers=args.tokenizer_workers
+            )
+            service = TokenizerService(EchoGenerateService(), pool)
+        else:
+            service = create_mock_generate_service()
 
     app.root_path = args.root_path
     uvicorn.run(
@@ -6,8 +6,17 @@
 
 """Manages the block cache."""
 
+from typing import Optional
+
+import asyncio
+from collections import deque
+import heapq
+from threading import Lock
+
 from iree.runtime import (  # type: ignore
+    HalBuffer,
     HalBufferView,
+    HalCommandBuffer,
     HalElementType,
     BufferUsage,
     MemoryType,
@@ -16,65 +25,364 @@ from iree.runtime import (  # type: ignore
 )
 
 from ..framework.logging import get_logger
-from ..framework.session import DeviceSession
+from ..framework.metrics import REGISTRY, WeakInstanceSet
+from ..framework.session import DeviceSession, HostContext, WorkQueue
 
 from .config import human_size, CacheParams
 
 
 logger = get_logger("shortfin.llm.cache")
 
+KV_BLOCKS = REGISTRY.gauge(
+    "shortfin_llm_kv_blocks",
+    "Attention blocks of the cache: free, cached (evictable), used and total",
+    ["state"],
+)
+KV_BLOCK_WAITERS = REGISTRY.gauge(
+    "shortfin_llm_kv_block_waiters",
+    "Acquisitions waiting on attention blocks to be released",
+)
+KV_BLOCKS_WAITING = REGISTRY.gauge(
+    "shortfin_llm_kv_blocks_waiting",
+    "Attention blocks requested by waiting acquisitions",
+)
+KV_HOST_BLOCKS = REGISTRY.gauge(
+    "shortfin_llm_kv_host_blocks",
+    "Attention blocks of the host offload tier: free and total",
+    ["state"],
+)
+KV_TRANSFERRED_BLOCKS_TOTAL = REGISTRY.counter(
+    "shortfin_llm_kv_transferred_blocks_total",
+    "Attention blocks copied to (offload) and from (restore) the host tier",
+    ["direction"],
+)
+
+# The cache gauges sum over the live caches of the process (e.g. one per
+# device), read from the caches when rendered.
+_METRIC_CACHES: WeakInstanceSet["AttnBlockCache"] = WeakInstanceSet()
+KV_BLOCKS.labels(state="total").set_function(
+    _METRIC_CACHES.sum(lambda cache: len(cache.attn_block_entries))
+)
+KV_BLOCKS.labels(state="free").set_function(
+    _METRIC_CACHES.sum(lambda cache: len(cache.attn_block_free))
+)
+KV_BLOCKS.labels(state="cached").set_function(
+    _METRIC_CACHES.sum(lambda cache: cache.cached_block_count)
+)
+KV_BLOCKS.labels(state="used").set_function(
+    _METRIC_CACHES.sum(
+        lambda cache: len(cache.attn_block_entries) - cache.available_block_count
+    )
+)
+KV_BLOCK_WAITERS.set_function(_METRIC_CACHES.sum(lambda cache: len(cache._waiters)))
+KV_BLOCKS_WAITING.set_function(
+    _METRIC_CACHES.sum(lambda cache: cache.waiting_block_count)
+)
+KV_HOST_BLOCKS.labels(state="total").set_function(
+    _METRIC_CACHES.sum(lambda cache: cache.cache_params.host_block_count)
+)
+KV_HOST_BLOCKS.labels(state="free").set_function(
+    _METRIC_CACHES.sum(lambda cache: len(cache.host_block_free))
+)
+
+
+class AttnBlocksUnavailableError(RuntimeError):
+    """Raised instead of waiting on attention blocks that only the waiter
+    itself could release."""
+
 
 class AttnBlockCacheEntry:
     __slots__ = [
         "index",
-        "in_use",
+        "ref_count",
+        "prefix_node",
     ]
 
     def __init__(self, index: int):
         self.index = index
-        self.in_use = False
+        # Number of sequences currently referencing the block.
+        self.ref_count = 0
+        # If the block holds a published prompt prefix chunk, its trie node.
+        self.prefix_node: Optional["_PrefixNode"] = None
+
+    @property
+    def in_use(self) -> bool:
+        return self.ref_count > 0
 
     def __repr__(self):
-        return f"Block({self.index}, {'FREE' if not self.in_use else 'BUSY'})"
+        state = "BUSY" if self.in_use else "FREE"
+        if self.prefix_node is not None:
+            state += "+CACHED"
+        return f"Block({self.index}, {state}, refs={self.ref_count})"
+
+
+class _PrefixNode:
+    """Node of the prefix trie.
+
+    Each non-root node corresponds to one block of `block_pos_stride` prompt
+    tokens (its `key`) following the tokens of its parent path.
+    """
+
+    __slots__ = [
+        "block",
+        "children",
+        "key",
+        "last_access",
+        "parent",
+    ]
+
+    def __init__(
+        self,
+        key: tuple[int, ...],
+        block: Optional[AttnBlockCacheEntry],
+        parent: Optional["_PrefixNode"],
+    ):
+        self.key = key
+        self.block = block
+        self.parent = parent
+        self.children: dict[tuple[int, ...], "_PrefixNode"] = {}
+        self.last_access = 0
+
+    @property
+    def evictable(self) -> bool:
+        return (
+            self.parent is not None
+            and not self.children
+            and self.block is not None
+            and self.block.ref_count == 0
+        )
+
+
+class HostBlocks:
+    """Attention blocks offloaded to the host tier, in sequence order.
+
+    Holds host blocks until restored with `AttnBlockCache.restore_attn_blocks()`
+    or discarded with `AttnBlockCache.discard_host_blocks()`.
+    """
+
+    __slots__ = [
+        "indices",
+    ]
+
+    def __init__(self, indices: list[int]):
+        self.indices = indices
+
+    def __len__(self):
+        return len(self.indices)
+
+    def __repr__(self):
+        return f"HostBlocks({self.indices})"
+
+
+class _CacheSlab:
+    """A buffer of cache state with a row of `block_size_bytes` per block."""
+
+    __slots__ = [
+        "buffer",
+        "block_size_bytes",
+        "view",
+    ]
+
+    def __init__(self, buffer: HalBuffer, view: HalBufferView, block_size_bytes: int):
+        self.buffer = buffer
+        self.view = view
+        self.block_size_bytes = block_size_bytes
+
+
+class _BlockWaiter:
+    """An acquisition waiting for blocks to be released."""
+
+    __slots__ = [
+        "blocks",
+        "count",
+        "future",
+        "loop",
+    ]
+
+    def __init__(self, count: int, loop: asyncio.AbstractEventLoop):
+        self.count = count
+        self.loop = loop
+        self.future: asyncio.Future = loop.create_future()
+        # Populated under the cache lock when granted.
+        self.blocks: list[AttnBlockCacheEntry] = []
+
+    def grant(self):
+        if not self.future.done():
+            self.future.set_result(None)
 
 
 class AttnBlockCache:
+    """Reference counted attention block cache with prompt prefix sharing.
+
+    Blocks which are completely filled by prompt tokens can be published into a
+    trie keyed by `block_pos_stride` sized token chunks. Later sequences sharing
+    the same prompt prefix retain those blocks instead of acquiring and
+    populating new ones. Published blocks stay cached after their last
+    reference is released and are evicted in LRU order (leaves first) only
+    when the free list cannot satisfy an acquisition.
+
+    Acquisitions which cannot be satisfied wait (in FIFO order, so that a large
+    request is not starved by a stream of small ones) until enough blocks are
+    released. Since the cache is shared by states running on different host
+    contexts, accounting is guarded by a lock and waiters are woken on their
+    own event loops.
+
+    If `CacheParams.host_block_count` is set, the cache has a second tier of
+    blocks in host memory (also accessible to the device). Blocks of idle or
+    preempted sequences can be offloaded to it and restored later, instead of
+    being recomputed. Copies between the tiers run on a dedicated work queue.
+    """
+
     def __init__(self, session: DeviceSession, cache_params: CacheParams):
         self.session = session
         self.cache_params = cache_params
         self._initialize_block_cache()
 
-    def _initialize_block_cache(self):
-        model_params = self.cache_params.model
-        # Allocate the on-device cache slab.
-        attn_block_count = self.cache_params.device_block_count
-        attn_block_size_elements = self.cache_params.attn_block_size_elements
+    @property
+    def cache_state_buffer_views(self) -> list[HalBufferView]:
+        """Buffer views making up the cache state argument of model functions."""
+        views = [self.attn_block_buffer_view]
+        if self.attn_scale_buffer_view is not None:
+            views.append(self.attn_scale_buffer_view)
+        return views
+
+    @property
+    def draft_cache_state_buffer_views(self) -> list[HalBufferView]:
+        """Cache state argument of the draft model's functions, indexed by the
+        same blocks (empty without a draft model)."""
+        return self._draft_cache_state_buffer_views
+
+    def _allocate_cache_state(
+        self,
+        cache_params: CacheParams,
+        name: str,
+        *,
+        memory_type=MemoryType.DEVICE_LOCAL,
+        attn_block_count: Optional[int] = None,
+    ) -> list[_CacheSlab]:
+        """Allocates the slab(s) of a model's cache state (on device unless
+        another `memory_type` is given)."""
+        model_params = cache_params.model
+        if attn_block_count is None:
+            attn_block_count = cache_params.device_block_count
+        attn_block_size_elements = cache_params.attn_block_size_elements
         attn_block_size_bytes = attn_block_size_elements * model_params.attn_dtype_size
         attn_cache_size_bytes = attn_block_count * attn_block_size_bytes
 
-        logger.info("Setting up cache for\n  %r", self.cache_params)
+        logger.info("Setting up %s cache for\n  %r", name, cache_params)
         logger.info(
-            "Allocating attention static cache on device of %s "
-            "(blocks=%s, block_size=%s bytes)",
+            "Allocating %s static cache of %s (blocks=%s, block_size=%s bytes)",
+            name,
             human_size(attn_cache_size_bytes),
             attn_block_count,
             attn_block_size_bytes,
         )
-        self.attn_block_buffer = self.session.device.allocator.allocate_buffer(
-            memory_type=MemoryType.DEVICE_LOCAL,
+        attn_block_buffer = self.session.device.allocator.allocate_buffer(
+            memory_type=memory_type,
             allowed_usage=BufferUsage.DEFAULT,
             allocation_size=attn_cache_size_bytes,
         )
 
         # Attn block logical view.
-        self.attn_block_buffer_view = HalBufferView(
-            self.attn_block_buffer,
-            [
-                attn_block_count,
-                attn_block_size_elements,
-            ],
-            model_params.attn_dtype,
-        )
+        slabs = [
+            _CacheSlab(
+                attn_block_buffer,
+                HalBufferView(
+                    attn_block_buffer,
+                    [
+                        attn_block_count,
+                        attn_block_size_elements,
+                    ],
+                    model_params.attn_dtype,
+                ),
+                attn_block_size_bytes,
+            )
+        ]
+
+        # Quantized caches keep per-block scales in a second slab.
+        if model_params.attn_scale_dtype is not None:
+            attn_block_scale_elements = cache_params.attn_block_scale_elements
+            attn_block_scale_bytes = (
+                attn_block_scale_elements * model_params.attn_scale_dtype_size
+            )
+            attn_scale_size_bytes = attn_block_count * attn_block_scale_bytes
+            logger.info(
+                "Allocating %s scale cache of %s",
+                name,
+                human_size(attn_scale_size_bytes),
+            )
+            attn_scale_buffer = self.session.device.allocator.allocate_buffer(
+                memory_type=memory_type,
+                allowed_usage=BufferUsage.DEFAULT,
+                allocation_size=attn_scale_size_bytes,
+            )
+            slabs.append(
+                _CacheSlab(
+                    attn_scale_buffer,
+                    HalBufferView(
+                        attn_scale_buffer,
+                        [
+                            attn_block_count,
+                            attn_block_scale_elements,
+                        ],
+                        model_params.attn_scale_dtype,
+                    ),
+                    attn_block_scale_bytes,
+                )
+            )
+        return slabs
+
+    def _initialize_block_cache(self):
+        cache_params = self.cache_params
+        attn_block_count = cache_params.device_block_count
+        slabs = self._allocate_cache_state(cache_params, "attention")
+        self.attn_block_buffer_view = slabs[0].view
+        self.attn_scale_buffer_view = slabs[1].view if len(slabs) > 1 else None
+
+        # A draft model for speculative decoding keeps its own slab(s), with
+        # each block holding the draft's state for the same positions.
+        self._draft_cache_state_buffer_views: list[HalBufferView] = []
+        draft_cache_params = None
+        if cache_params.draft_model is not None:
+            draft_cache_params = CacheParams(
+                model=cache_params.draft_model,
+                device_block_count=attn_block_count,
+                block_pos_stride=cache_params.block_pos_stride,
+            )
+            draft_slabs = self._allocate_cache_state(
+                draft_cache_params, "draft attention"
+            )
+            self._draft_cache_state_buffer_views = [slab.view for slab in draft_slabs]
+            slabs.extend(draft_slabs)
+
+        # The host tier mirrors each slab, and blocks are copied as a row of
+        # each slab.
+        self._device_slabs = slabs
+        self._host_slabs: list[_CacheSlab] = []
+        host_block_count = cache_params.host_block_count
+        if host_block_count > 0:
+            host_memory_type = MemoryType.HOST_LOCAL | MemoryType.DEVICE_VISIBLE
+            self._host_slabs = self._allocate_cache_state(
+                cache_params,
+                "host attention",
+                memory_type=host_memory_type,
+                attn_block_count=host_block_count,
+            )
+            if draft_cache_params is not None:
+                self._host_slabs.extend(
+                    self._allocate_cache_state(
+                        draft_cache_params,
+                        "host draft attention",
+                        memory_type=host_memory_type,
+                        attn_block_count=host_block_count,
+                    )
+                )
+        self.host_block_free = list(range(host_block_count))
+        # Copies between the tiers run on their own queue, if there is a host
+        # tier.
+        self._transfer_queue: Optional[WorkQueue] = None
+        if host_block_count > 0:
+            self._transfer_queue = WorkQueue(self.session)
 
         # Accounting structs.
         self.attn_block_entries = [
@@ -82,19 +390,238 @@ class AttnBlockCache:
         ]
         self.attn_block_free = list(self.attn_block_entries)
 
+        # Prefix trie and lazily invalidated min-heap of evictable leaves,
+        # ordered by (last_access, insertion order).
+        self._prefix_root = _PrefixNode((), None, None)
+        self._evictable_heap: list[tuple[int, int, _PrefixNode]] = []
+        self._access_clock = 0
+        self._heap_counter = 0
+        # Count of published blocks with no references. Every such block can be
+        # evicted (leaves first) since referenced blocks pin their ancestors.
+        self._cached_unreferenced_count = 0
+        # Sum of the reference counts of all blocks.
+        self._reference_count = 0
+
+        # Acquisitions waiting on released blocks, in arrival order.
+        self._lock = Lock()
+        self._waiters: deque[_BlockWaiter] = deque()
+
+        # Metrics are read from the cache when rendered.
+        _METRIC_CACHES.add(self)
+
+    @property
+    def cached_block_count(self) -> int:
+        """Number of blocks held only by the prefix cache (evictable)."""
+        return self._cached_unreferenced_count
+
+    @property
+    def available_block_count(self) -> int:
+        """Number of blocks that can be acquired (free or evictable)."""
+        return len(self.attn_block_free) + self._cached_unreferenced_count
+
+    @property
+    def waiting_block_count(self) -> int:
+        """Total number of blocks requested by waiting acquisitions."""
+        with self._lock:
+            return sum(w.count for w in self._waiters)
+
+    def is_sole_holder(self, blocks: list[AttnBlockCacheEntry]) -> bool:
+        """Whether `blocks` (listing a block once per reference held) are all
+        the references to blocks in use.
+
+        If so, no other holder can release blocks, so an acquisition that
+        cannot be granted now would wait forever unless the holder of `blocks`
+        releases some of them.
+        """
+        with self._lock:
+            return len(blocks) == self._reference_count
+
+    def can_acquire(self, count: int) -> bool:
+        """Whether an acquisition of `count` blocks would be granted without
+        waiting."""
+        with self._lock:
+            return not self._waiters and count <= self.available_block_count
+
+    def _tick(self) -> int:
+        self._access_clock += 1
+        return self._access_clock
+
+    def _push_evictable(self, node: _PrefixNode):
+        self._heap_counter += 1
+        heapq.heappush(
+            self._evictable_heap, (node.last_access, self._heap_counter, node)
+        )
+
+    def _evict(self, count: int) -> int:
+        """Evicts up to `count` unreferenced leaf blocks into the free list.
+
+        Returns the number of blocks evicted.
+        """
+        heap = self._evictable_heap
+        evicted = 0
+        while evicted < count and heap:
+            last_access, _, node = heapq.heappop(heap)
+            # Entries are invalidated lazily: skip any that have been touched
+            # or have become referenced/non-leaf since being pushed.
+            if node.last_access != last_access or not node.evictable:
+                continue
+            parent = node.parent
+            assert parent is not None
+            del parent.children[node.key]
+            block = node.block
+            assert block is not None
+            block.prefix_node = None
+            node.block = None
+            node.parent = None
+            self.attn_block_free.append(block)
+            self._cached_unreferenced_count -= 1
+            evicted += 1
+            if parent.evictable:
+                self._push_evictable(parent)
+        if evicted:
+            logger.debug("Evicted %s cached prefix blocks", evicted)
+        return evicted
+
+    def _prefix_chunks(self, token_ids: list[int], max_blocks: int):
+        stride = self.cache_params.block_pos_stride
+        for i in range(max_blocks):
+            yield tuple(token_ids[i * stride : (i + 1) * stride])
+
+    def match_prefix(self, token_ids: list[int]) -> list[AttnBlockCacheEntry]:
+        """Finds and retains cached blocks for the longest prompt prefix.
+
+        Only whole blocks are matched and the block containing the final token
+        is never matched, so that at least one position is left to compute.
+        The returned blocks are in sequence order and each has been retained
+        once on behalf of the caller (release with `release_attn_blocks()`).
+        """
+        stride = self.cache_params.block_pos_stride
+        max_blocks = max(0, (len(token_ids) - 1) // stride)
+        matched: list[AttnBlockCacheEntry] = []
+        with self._lock:
+            now = self._tick()
+            node = self._prefix_root
+            for chunk in self._prefix_chunks(token_ids, max_blocks):
+                child = node.children.get(chunk)
+                if child is None:
+                    break
+                child.last_access = now
+                block = child.block
+                assert block is not None
+                if block.ref_count == 0:
+                    self._cached_unreferenced_count -= 1
+                block.ref_count += 1
+                self._reference_count += 1
+                matched.append(block)
+                node = child
+        if matched:
+            logger.debug("Prefix cache hit: %s blocks", len(matched))
+        return matched
+
+    def publish_prefix(self, token_ids: list[int], blocks: list[AttnBlockCacheEntry]):
+        """Publishes the populated, whole blocks of a prompt into the trie.
+
+        `blocks` are the sequence's blocks in sequence order and must already
+        contain the K/V state for `token_ids`. Publishing stops at the first
+        chunk that is already cached with another block (i.e. by a
+        concurrently prefilled sequence): neither the sequence's private copy
+        nor its later blocks are published, since their references would not
+        pin the other sequence's blocks that they would hang from.
+        """
+        stride = self.cache_params.block_pos_stride
+        full_blocks = min(len(token_ids) // stride, len(blocks))
+        with self._lock:
+            now = self._tick()
+            node = self._prefix_root
+            chunks = self._prefix_chunks(token_ids, full_blocks)
+            for chunk, block in zip(chunks, blocks):
+                child = node.children.get(chunk)
+                if child is None:
+                    if block.prefix_node is not None:
+                        # Block is already published under a different path.
+                        break
+                    child = _PrefixNode(chunk, block, node)
+                    block.prefix_node = child
+                    node.children[chunk] = child
+                    if not block.in_use:
+                        self._cached_unreferenced_count += 1
+                elif child.block is not block:
+                    break
+                child.last_access = now
+                if child.evictable:
+                    # Touching invalidated any existing heap entry.
+                    self._push_evictable(child)
+                node = child
+
+    def _allocate(self, count: int, into_list: list[AttnBlockCacheEntry]):
+        """Moves `count` blocks into `into_list`, evicting as needed.
+
+        The lock must be held and `count` must be available.
+        """
+        free_list = self.attn_block_free
+        if len(free_list) < count:
+            self._evict(count - len(free_list))
+        assert len(free_list) >= count
+        for i in range(count):
+            block = free_list.pop()
+            assert block.ref_count == 0 and block.prefix_node is None
+            block.ref_count = 1
+            into_list.append(block)
+        self._reference_count += count
+
+    def _grant_waiters(self):
+        """Grants waiting acquisitions in FIFO order while blocks are available.
+
+        The lock must be held.
+        """
+        waiters = self._waiters
+        while waiters:
+            waiter = waiters[0]
+            if waiter.future.cancelled():
+                waiters.popleft()
+                continue
+            if waiter.count > self.available_block_count:
+                break
+            waiters.popleft()
+            self._allocate(waiter.count, waiter.blocks)
+            waiter.loop.call_soon_threadsafe(waiter.grant)
+
     async def acquire_attn_blocks(
         self, count: int, into_list: list[AttnBlockCacheEntry]
     ):
         """Acquires 'count' attention blocks.
 
-        If there are insufficient free blocks, raises an exception.
+        Unreferenced cached prefix blocks are evicted as needed. If there are
+        still insufficient blocks, waits until enough have been released and all
+        earlier waiting acquisitions have been granted. Raises if `count` exceeds
+        the capacity of the cache, since such a request could never be granted.
         """
-        free_list = self.attn_block_free
+        capacity = len(self.attn_block_entries)
         assert (
-            len(free_list) >= count
-        ), f"Cache does not contain requested {count} free attn blocks"
-        for i in range(count):
-            into_list.append(free_list.pop())
+            count <= capacity
+        ), f"Requested {count} attn blocks exceeds cache capacity {capacity}"
+        with self._lock:
+            if not self._waiters and count <= self.available_block_count:
+                self._allocate(count, into_list)
+                return
+            waiter = _BlockWaiter(count, asyncio.get_running_loop())
+            self._waiters.append(waiter)
+        logger.debug(
+            "Waiting on %s attn blocks (%s waiters)", count, len(self._waiters)
+        )
+        try:
+            await waiter.future
+        except asyncio.CancelledError:
+            with self._lock:
+                if waiter in self._waiters:
+                    self._waiters.remove(waiter)
+                    # The head may now be satisfiable.
+                    self._grant_waiters()
+                    raise
+            # Granted concurrently with cancellation: give the blocks back.
+            await self.release_attn_blocks(waiter.blocks)
+            raise
+        into_list.extend(waiter.blocks)
 
     async def release_attn_blocks(self, blocks: list[AttnBlockCacheEntry]):
         """Releases a list of attention blocks.
@@ -102,10 +629,141 @@ class AttnBlockCache:
         If at all possible, this should be batched to include all blocks that need to
         be released at a given time since this will trigger heavy-weight scheduling
         that will work better with a view of the new free list as a whole.
+
+        Blocks which are published in the prefix cache are retained there
+        (evictable) once their last reference is released.
         """
         free_list = self.attn_block_free
-        for block in blocks:
-            free_list.append(block)
+        with self._lock:
+            now = self._tick()
+            for block in blocks:
+                assert block.ref_count > 0, f"Releasing unreferenced block {block}"
+                block.ref_count -= 1
+                self._reference_count -= 1
+                if block.ref_count > 0:
+                    continue
+                node = block.prefix_node
+                if node is None:
+                    free_list.append(block)
+                else:
+                    self._cached_unreferenced_count += 1
+                    node.last_access = now
+                    if node.evictable:
+                        self._push_evictable(node)
+            self._grant_waiters()
+
+    def _record_block_copies(
+        self,
+        cb: HalCommandBuffer,
+        to_host: bool,
+        device_indices: list[int],
+        host_indices: list[int],
+    ):
+        """Records copies of blocks between the tiers, coalescing runs of
+        consecutive blocks in both."""
+        runs: list[list[int]] = []  # [device_index, host_index, count]
+        for device_index, host_index in zip(device_indices, host_indices):
+            if runs:
+                run = runs[-1]
+                if (
+                    device_index == run[0] + run[2]
+                    and host_index == run[1] + run[2]
+                ):
+                    run[2] += 1
+                    continue
+            runs.append([device_index, host_index, 1])
+        for device_slab, host_slab in zip(self._device_slabs, self._host_slabs):
+            block_size = device_slab.block_size_bytes
+            for device_index, host_index, count in runs:
+                device_offset = device_index * block_size
+                host_offset = host_index * block_size
+                if to_host:
+                    cb.copy(
+                        device_slab.buffer,
+                        host_slab.buffer,
+                        source_offset=device_offset,
+                        target_offset=host_offset,
+                        length=count * block_size,
+                    )
+                else:
+                    cb.copy(
+                        host_slab.buffer,
+                        device_slab.buffer,
+                        source_offset=host_offset,
+                        target_offset=device_offset,
+                        length=count * block_size,
+                    )
+
+    async def _transfer(
+        self,
+        host_context: HostContext,
+        to_host: bool,
+        device_indices: list[int],
+        host_indices: list[int],
+    ):
+        """Copies blocks between the tiers, returning once complete."""
+        queue = self._transfer_queue
+        assert queue is not None, "The cache has no host tier"
+        cb = HalCommandBuffer(self.session.device)
+        self._record_block_copies(cb, to_host, device_indices, host_indices)
+        cb.end()
+        queue.execute_sequential([cb])
+        await queue.sync(host_context)
+        KV_TRANSFERRED_BLOCKS_TOTAL.labels(
+            direction="offload" if to_host else "restore"
+        ).inc(len(device_indices))
+
+    async def offload_attn_blocks(
+        self, host_context: HostContext, blocks: list[AttnBlockCacheEntry]
+    ) -> Optional[HostBlocks]:
+        """Copies blocks to the host tier, then releases them.
+
+        Any work writing the blocks must have completed. Returns None (leaving
+        the blocks as they are) if the host tier cannot hold them.
+        """
+        with self._lock:
+            host_free = self.host_block_free
+            if not blocks or len(blocks) > len(host_free):
+                return None
+            host_indices = [host_free.pop() for _ in blocks]
+        host_blocks = HostBlocks(host_indices)
+        try:
+            await self._transfer(
+                host_context, True, [b.index for b in blocks], host_indices
+            )
+        except BaseException:
+            self.discard_host_blocks(host_blocks)
+            raise
+        logger.debug("Offloaded %s attn blocks to host", len(blocks))
+        await self.release_attn_blocks(blocks)
+        return host_blocks
+
+    async def restore_attn_blocks(
+        self,
+        host_context: HostContext,
+        host_blocks: HostBlocks,
+        into_list: list[AttnBlockCacheEntry],
+    ):
+        """Acquires blocks (waiting as `acquire_attn_blocks()`) and copies the
+        offloaded blocks back into them, releasing the host blocks."""
+        blocks: list[AttnBlockCacheEntry] = []
+        await self.acquire_attn_blocks(len(host_blocks), blocks)
+        try:
+            await self._transfer(
+                host_context, False, [b.index for b in blocks], host_blocks.indices
+            )
+        except BaseException:
+            await self.release_attn_blocks(blocks)
+            raise
+        logger.debug("Restored %s attn blocks from host", len(blocks))
+        self.discard_host_blocks(host_blocks)
+        into_list.extend(blocks)
+
+    def discard_host_blocks(self, host_blocks: HostBlocks):
+        """Releases offloaded blocks without restoring them."""
+        with self._lock:
+            self.host_block_free.extend(host_blocks.indices)
+        host_blocks.indices = []
 
 
 def create_attn_block_cache_module(attn_block_cache: AttnBlockCache) -> VmModule:
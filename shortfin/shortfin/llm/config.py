@@ -56,7 +56,8 @@ predictable if we just reserve what we need. Again, numbers are given to give a
 sense of scale only: real workloads will vary.
 """
 
-from dataclasses import dataclass
+from dataclasses import dataclass, field
+from typing import Optional
 
 from iree.runtime import (  # type: ignore
     HalElementType,
@@ -102,19 +103,63 @@ class ModelParams:
     # ABI of the module.
     module_abi_version: int = 1
 
+    # Scope of the parameters that the module loads.
+    parameter_scope: str = "model"
+
+    # Batch sizes that chunked prefill is compiled for ("prefill_chunk_bs{n}").
+    # Empty if the module does not support chunked prefill. Must be in ascending
+    # order.
+    prefill_chunk_batch_sizes: list[int] = field(default_factory=list)
+
+    # Largest batch size of the entry-points exported with a dynamic batch
+    # dimension ("{name}_bs_dyn" for each exported "{name}_bs{n}"), which run
+    # any batch size without padding rows. The batch sizes above are then
+    # specialized fast paths (and may be empty). 0 if not exported.
+    dynamic_batch_size: int = 0
+
+    # If the attention caches are quantized, the element type of the scales
+    # kept for each (block, transformer block, K/V, head) in a separate slab.
+    attn_scale_dtype: Optional[HalElementType] = None
+
+    # Whether the module was compiled for the async-external execution model, in
+    # which each entry-point has a "{name}$async" variant taking wait and signal
+    # fences after its inputs and returning without blocking on the device.
+    async_invocations: bool = False
+
+    # Whether prefill returns only the logits of each row's last position
+    # ([bs, 1, vocab]) rather than of every position.
+    prefill_last_logits: bool = False
+
+    # Whether the module exports "sample_bs{n}" entry-points for each decode
+    # batch size, which sample [bs, 1] tokens from [bs, 1, vocab] logits on the
+    # device given per-row temperature, top-k, top-p and uniform samples.
+    sampling: bool = False
+
+    # Number of positions per row (the last accepted token plus the speculated
+    # tokens) verified by "verify_bs{n}" entry-points for speculative decoding.
+    # These return the greedy next token after each position as [bs, n] int64.
+    # 0 if the module does not export them.
+    verify_chunk_len: int = 0
+
     # Size in bytes of the KV cache dtype.
     @property
     def attn_dtype_size(self) -> int:
         assert HalElementType.is_byte_aligned(self.attn_dtype)
         return HalElementType.dense_byte_count(self.attn_dtype)
 
+    @property
+    def attn_scale_dtype_size(self) -> int:
+        assert self.attn_scale_dtype is not None
+        assert HalElementType.is_byte_aligned(self.attn_scale_dtype)
+        return HalElementType.dense_byte_count(self.attn_scale_dtype)
+
     @property
     def max_prefill_batch_size(self) -> int:
-        return self.prefill_batch_sizes[-1]
+        return max(self.prefill_batch_sizes + [self.dynamic_batch_size])
 
     @property
     def max_decode_batch_size(self) -> int:
-        return self.decode_batch_sizes[-1]
+        return max(self.decode_batch_sizes + [self.dynamic_batch_size])
 
     @property
     def max_batch_size(self):
@@ -124,7 +169,14 @@ class ModelParams:
     def load_json(path):
         f = open(path)
         j = json.load(f)
-        return ModelParams(attn_dtype=HalElementType.FLOAT_16, **j)
+        # Element types are given by HalElementType name.
+        attn_dtype = getattr(HalElementType, j.pop("attn_dtype", "FLOAT_16"))
+        attn_scale_dtype = j.pop("attn_scale_dtype", None)
+        if attn_scale_dtype is not None:
+            attn_scale_dtype = getattr(HalElementType, attn_scale_dtype)
+        return ModelParams(
+            attn_dtype=attn_dtype, attn_scale_dtype=attn_scale_dtype, **j
+        )
 
 
 @dataclass
@@ -145,6 +197,14 @@ class CacheParams:
     # The stride of each block in sequence positions.
     block_pos_stride: int
 
+    # A draft model for speculative decoding, whose cache state is kept in
+    # separate slabs indexed by the same blocks.
+    draft_model: Optional[ModelParams] = None
+
+    # The size of the host memory tier that blocks of preempted or idle
+    # sequences can be offloaded to (0 for none).
+    host_block_count: int = 0
+
     @property
     def attn_unit_size_elements(self) -> int:
         """Size in bytes of each cache line in the attention cache.
@@ -163,6 +223,12 @@ class CacheParams:
         """Size in bytes of each attention block of {block_position_stride} positions."""
         return self.attn_unit_size_elements * self.block_pos_stride
 
+    @property
+    def attn_block_scale_elements(self) -> int:
+        """Number of scales of each attention block of a quantized cache: one per
+        transformer block, K/V cache line and head."""
+        return self.model.transformer_block_count * 2 * self.model.attn_head_count
+
 
 @dataclass
 class ServiceParams:
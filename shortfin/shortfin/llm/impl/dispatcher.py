@@ -0,0 +1,71 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Placement of requests across the batch states of several devices.
+
+A process serving a node runs a `GenerateServiceV1` per device (see
+`DeviceSessionGroup`) and one or more `GenerateState`s of each, every state
+stepping its own batch on its own work queue. The `BatchDispatcher` places
+each arriving request on the least loaded state, from which the scheduler
+driving that state admits it.
+"""
+
+from typing import Optional
+
+from collections import deque
+
+from ..service import GenerateRequest
+from .service_v1 import GenerateState
+
+__all__ = [
+    "BatchDispatcher",
+]
+
+
+class BatchDispatcher:
+    """Places requests on the least loaded of several batch states.
+
+    A state's load is ordered by the fraction of its batch capacity taken by
+    live, pending and placed sequences, then by the steps outstanding on its
+    queue and finally by the fraction of its device's attention blocks in use.
+    Requests stay with the state they are placed on.
+    """
+
+    def __init__(self, states: list[GenerateState]):
+        assert states, "No states to dispatch to"
+        self.states = states
+        self._placed: list[deque[GenerateRequest]] = [deque() for _ in states]
+
+    def load(self, index: int) -> tuple[float, int, float]:
+        state = self.states[index]
+        service = state.service
+        capacity = service.params.model.max_batch_size
+        sequence_count = capacity - state.free_batch_capacity + len(self._placed[index])
+        cache = service.cache
+        block_count = len(cache.attn_block_entries)
+        blocks_used = 1.0 - cache.available_block_count / block_count
+        return (sequence_count / capacity, state.outstanding_steps, blocks_used)
+
+    def place(self, request: GenerateRequest) -> int:
+        """Places a request on the least loaded state, returning its index."""
+        index = min(range(len(self.states)), key=self.load)
+        self._placed[index].append(request)
+        return index
+
+    def placed_count(self, index: Optional[int] = None) -> int:
+        """Number of placed requests not yet taken (by one or all states)."""
+        if index is not None:
+            return len(self._placed[index])
+        return sum(len(placed) for placed in self._placed)
+
+    def take(self, index: int, limit: Optional[int] = None) -> list[GenerateRequest]:
+        """Takes the requests placed on a state, in order, up to its free batch
+        capacity and at most `limit` (if given)."""
+        placed = self._placed[index]
+        count = min(len(placed), self.states[index].free_batch_capacity)
+        if limit is not None:
+            count = max(0, min(count, limit))
+        return [placed.popleft() for _ in range(count)]
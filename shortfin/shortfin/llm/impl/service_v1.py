@@ -12,9 +12,14 @@ Perhaps the biggest issue is that it wouldn't mate well as-is with samplers.
 
 import asyncio
 from dataclasses import dataclass
+import itertools
+import time
+from typing import Optional
 
 import numpy as np
 
+from sharktank.utils import tracing
+
 from iree.runtime import (  # type: ignore
     HalBufferView,
     HalCommandBuffer,
@@ -25,16 +30,23 @@ from iree.runtime import (  # type: ignore
 )
 
 from ...framework.logging import get_logger, NDEBUG
+from ...framework.metrics import REGISTRY, WeakInstanceSet
 from ...framework.session import (
     AsyncResources,
     DeviceSession,
+    PipelinedResources,
     TimelineGuarded,
     TransferBufferPool,
     WorkQueue,
 )
 
-from ..attn_block_cache import AttnBlockCacheEntry, AttnBlockCache
-from ..config import ServiceParams
+from ..attn_block_cache import (
+    AttnBlockCacheEntry,
+    AttnBlockCache,
+    AttnBlocksUnavailableError,
+    HostBlocks,
+)
+from ..config import ModelParams, ServiceParams
 from ..service import (
     BatchGenerateService,
     BatchGenerateState,
@@ -46,16 +58,149 @@ logger = get_logger("shortfin.llm.impl.service_v1")
 
 EXPECTED_CONCURRENCY = 10
 
+# Step metrics. Steps are the entry-points invoked (prefill, decode, sample,
+# chunked, verify and the draft_* steps) and their phases are:
+#   resource_wait: waiting for the transfer buffers of a previous step
+#   h2d_staging: populating and enqueuing the input transfers
+#   invoke: the entry-point invocation (which blocks unless async)
+#   fence_wait: waiting for the results (in `read_back()`)
+#   readback: mapping the results to the host (in `read_back()`)
+STEP_PHASE_SECONDS = REGISTRY.histogram(
+    "shortfin_llm_step_phase_seconds",
+    "Seconds spent in each phase of a generation step",
+    ["step", "phase"],
+)
+BLOCK_ACQUIRE_SECONDS = REGISTRY.histogram(
+    "shortfin_llm_block_acquire_seconds",
+    "Seconds spent acquiring attention blocks for sequences",
+)
+STEPS_TOTAL = REGISTRY.counter(
+    "shortfin_llm_steps_total",
+    "Generation steps invoked by compiled batch size",
+    ["step", "batch_size"],
+)
+STEP_ROWS_TOTAL = REGISTRY.counter(
+    "shortfin_llm_step_rows_total",
+    "Occupied batch rows of generation steps by compiled batch size",
+    ["step", "batch_size"],
+)
+STEP_BATCH_OCCUPANCY = REGISTRY.histogram(
+    "shortfin_llm_step_batch_occupancy",
+    "Fraction of the compiled batch size occupied by each step",
+    ["step"],
+    buckets=(0.125, 0.25, 0.375, 0.5, 0.625, 0.75, 0.875, 1.0),
+)
+SEQUENCES = REGISTRY.gauge(
+    "shortfin_llm_sequences",
+    "Sequences of the batch: pending (queued for prefill) or live (decoding)",
+    ["state"],
+)
+# The sequence gauges sum over the live batch states of the process.
+_METRIC_STATES: WeakInstanceSet["GenerateState"] = WeakInstanceSet()
+SEQUENCES.labels(state="pending").set_function(
+    _METRIC_STATES.sum(lambda state: len(state._pending_sequences))
+)
+SEQUENCES.labels(state="live").set_function(
+    _METRIC_STATES.sum(lambda state: len(state._sequences))
+)
+
+
+def _observe_phase(step: str, phase: str, start: float, end: float):
+    """Records a step phase in STEP_PHASE_SECONDS and, if tracing, as a
+    "{step}.{phase}" span."""
+    STEP_PHASE_SECONDS.labels(step=step, phase=phase).observe(end - start)
+    tracing.record_span(f"{step}.{phase}", start, end, cat="shortfin")
+
+
+class BatchEntrypoints:
+    """Entry-points of a step by batch size.
+
+    Batch sizes are either specialized ("{name}_bs{n}") or run by the variant
+    with a dynamic batch dimension ("{name}_bs_dyn"), if exported, which takes
+    any batch size up to `dynamic_batch_size`.
+    """
+
+    __slots__ = ["static", "dynamic", "dynamic_batch_size"]
+
+    def __init__(
+        self,
+        static: dict[int, VmFunction],
+        dynamic: Optional[VmFunction] = None,
+        dynamic_batch_size: int = 0,
+    ):
+        self.static = static
+        self.dynamic = dynamic
+        self.dynamic_batch_size = dynamic_batch_size if dynamic is not None else 0
+
+    def __bool__(self) -> bool:
+        return bool(self.static) or self.dynamic is not None
+
+    def __getitem__(self, bs: int) -> VmFunction:
+        function = self.static.get(bs)
+        if function is None:
+            assert (
+                bs <= self.dynamic_batch_size
+            ), f"No entry-point for batch size {bs}"
+            function = self.dynamic
+        return function
+
+    @property
+    def max_batch_size(self) -> int:
+        return max([*self.static.keys(), self.dynamic_batch_size])
+
+    def select_batch_size(self, rows: int) -> int:
+        """Selects the batch size to run `rows` rows with.
+
+        A specialized batch size of exactly `rows` is preferred, then the
+        dynamic variant (which needs no padding rows), then the smallest larger
+        specialized batch size.
+        """
+        assert rows > 0
+        if rows in self.static or rows <= self.dynamic_batch_size:
+            return rows
+        for bs in sorted(self.static.keys()):
+            if bs >= rows:
+                return bs
+        raise AssertionError(f"Unsupported batch size: {rows}")
+
 
 class GenerateServiceV1(BatchGenerateService):
     def __init__(
-        self, *, session: DeviceSession, params: ServiceParams, cache: AttnBlockCache
+        self,
+        *,
+        session: DeviceSession,
+        params: ServiceParams,
+        cache: AttnBlockCache,
+        preemption: bool = True,
+        prefill_chunk_size: int = 0,
+        pipeline_depth: int = 1,
     ):
         self.params = params
+        # When a decode step cannot acquire its attention blocks, whether to
+        # preempt the most recently admitted sequences (to be recomputed by a
+        # later prefill) rather than waiting on other states to release blocks.
+        self.preemption = preemption
+        # Admission order of sequences across all states. Later admissions have
+        # lower priority for preemption.
+        self._admit_counter = itertools.count()
+        # Maximum number of prompt positions prefilled per sequence by a
+        # chunked step (0 disables chunked prefill).
+        self.prefill_chunk_size = prefill_chunk_size
+        # Number of steps of each kind whose inputs can be staged at once. At 2,
+        # a state stages its next step while the previous one executes, which
+        # requires async invocations to overlap with the device.
+        self.pipeline_depth = pipeline_depth
         self.block_pos_stride = params.cache.block_pos_stride
         self.batch_sizes = params.model.prefill_batch_sizes
         # TODO: Remove distinction between prefill and decode batch sizes.
         assert params.model.decode_batch_sizes == self.batch_sizes
+        # Batch sizes not specialized are run by the "{name}_bs_dyn" variants of
+        # the entry-points, which take any batch size up to this (0 if not
+        # exported).
+        self.dynamic_batch_size = params.model.dynamic_batch_size
+        assert (
+            self.batch_sizes or self.dynamic_batch_size > 0
+        ), "Model exports no batch sizes"
         self.session = session
         self.cache = cache
         module_name = params.model.module_name
@@ -63,27 +208,102 @@ class GenerateServiceV1(BatchGenerateService):
         self.module_set = session.module_set(params.model.module_name)
 
         # Initialize prefill entry-points (1 per batch size).
-        self.prefill_functions: dict[int, VmFunction] = {}
-        for bs in self.batch_sizes:
-            assert bs not in self.prefill_functions
-            symbol_name = f"prefill_bs{bs}"
-            logger.info("Looking up symbol '%s'", symbol_name)
-            self.prefill_functions[bs] = self.module_set.function(
-                module_name, symbol_name
-            )
+        self.prefill_functions = self._lookup_batch_entrypoints(
+            "prefill", self.batch_sizes
+        )
 
         # Initialize decode entry-points (1 per batch size).
-        self.decode_functions: dict[int, VmFunction] = {}
-        for bs in self.batch_sizes:
-            assert bs not in self.decode_functions
-            symbol_name = f"decode_bs{bs}"
-            logger.info("Looking up symbol '%s'", symbol_name)
-            self.decode_functions[bs] = self.module_set.function(
-                module_name, symbol_name
+        self.decode_functions = self._lookup_batch_entrypoints(
+            "decode", self.batch_sizes
+        )
+
+        # Initialize chunked prefill entry-points (1 per batch size), if enabled.
+        self.prefill_chunk_batch_sizes: list[int] = []
+        self.prefill_chunk_functions = BatchEntrypoints({})
+        if prefill_chunk_size > 0:
+            self.prefill_chunk_batch_sizes = params.model.prefill_chunk_batch_sizes
+            self.prefill_chunk_functions = self._lookup_batch_entrypoints(
+                "prefill_chunk", self.prefill_chunk_batch_sizes
+            )
+            assert (
+                self.prefill_chunk_functions
+            ), "Chunked prefill requires prefill_chunk_bs{n} entry-points"
+
+        # Initialize on-device sampling entry-points (1 per batch size), if
+        # exported.
+        self.sample_functions = BatchEntrypoints({})
+        if params.model.sampling:
+            self.sample_functions = self._lookup_batch_entrypoints(
+                "sample", self.batch_sizes
+            )
+
+        # Initialize speculative decoding entry-points (1 per batch size) if the
+        # cache holds state for a draft model, which must be in the same module
+        # set: the draft's prefill, decode and sampling plus target verification.
+        self.draft_params: Optional[ModelParams] = cache.cache_params.draft_model
+        self.speculate_k = 0
+        self.draft_prefill_functions = BatchEntrypoints({})
+        self.draft_decode_functions = BatchEntrypoints({})
+        self.draft_sample_functions = BatchEntrypoints({})
+        self.verify_functions = BatchEntrypoints({})
+        draft = self.draft_params
+        if draft is not None:
+            assert (
+                params.model.verify_chunk_len > 1
+            ), "Speculative decoding requires verify_bs{n} entry-points"
+            assert draft.sampling, "Draft model requires sample_bs{n} entry-points"
+            assert draft.module_name != module_name, "Draft module name must differ"
+            assert (
+                prefill_chunk_size == 0
+            ), "Speculative decoding does not support chunked prefill"
+            assert (
+                draft.dynamic_batch_size >= self.dynamic_batch_size
+            ), "Draft model must export the dynamic batch size of the model"
+            self.speculate_k = params.model.verify_chunk_len - 1
+            self.verify_functions = self._lookup_batch_entrypoints(
+                "verify", self.batch_sizes
+            )
+            self.draft_prefill_functions = self._lookup_batch_entrypoints(
+                "prefill", self.batch_sizes, draft
+            )
+            self.draft_decode_functions = self._lookup_batch_entrypoints(
+                "decode", self.batch_sizes, draft
+            )
+            self.draft_sample_functions = self._lookup_batch_entrypoints(
+                "sample", self.batch_sizes, draft
             )
 
         self._initialize_transfer_pools()
 
+    def _lookup_entrypoint(
+        self, symbol_name: str, model: Optional[ModelParams] = None
+    ) -> VmFunction:
+        """Looks up an entry-point of the served (or given) model, selecting its
+        async variant if compiled."""
+        if model is None:
+            model = self.params.model
+        if model.async_invocations:
+            symbol_name = f"{symbol_name}$async"
+        logger.info("Looking up symbol '%s'", symbol_name)
+        return self.module_set.function(model.module_name, symbol_name)
+
+    def _lookup_batch_entrypoints(
+        self,
+        name: str,
+        batch_sizes: list[int],
+        model: Optional[ModelParams] = None,
+    ) -> BatchEntrypoints:
+        """Looks up the "{name}_bs{n}" entry-points of each batch size and the
+        "{name}_bs_dyn" one if the service runs dynamic batch sizes."""
+        static: dict[int, VmFunction] = {}
+        for bs in batch_sizes:
+            assert bs not in static
+            static[bs] = self._lookup_entrypoint(f"{name}_bs{bs}", model)
+        dynamic = None
+        if self.dynamic_batch_size > 0:
+            dynamic = self._lookup_entrypoint(f"{name}_bs_dyn", model)
+        return BatchEntrypoints(static, dynamic, self.dynamic_batch_size)
+
     def _initialize_transfer_pools(self):
         params = self.params
         max_bs = params.model.max_batch_size
@@ -162,6 +382,17 @@ class GenerateServiceV1(BatchGenerateService):
             name="decode_start_pos",
         )
 
+        # Sampling params: array([max_batch_size]) of 32 or 64 bit elements.
+        # Per-row temperature, top-k, top-p and uniform samples.
+        self.sample_params_pool = TransferBufferPool.shaped(
+            self.session,
+            [max_bs],
+            HalElementType.SINT_64,
+            initial_capacity=4 * initial_inflight,
+            growable=True,
+            name="sample_params",
+        )
+
     def start(self) -> "GenerateState":
         return GenerateState(self)
 
@@ -171,24 +402,51 @@ class GenerateServiceV1(BatchGenerateService):
 
 class _Sequence:
     __slots__ = [
+        "admit_order",
         "attn_blocks",
         "attn_blocks_needed",
+        "cached_prefix_length",
         "current_token_ids",
         "decode_token_ids",
+        "draft_length",
+        "host_blocks",
+        "host_length",
+        "prefill_position",
         "request",
+        "rng",
         "seq_length",
     ]
 
     current_token_ids: list[int]
     decode_token_ids: list[int]
 
-    def __init__(self, request: GenerateRequest):
+    def __init__(self, request: GenerateRequest, admit_order: int):
         self.request = request
+        self.admit_order = admit_order
         self.seq_length: int = 0
         self.attn_blocks: list[AttnBlockCacheEntry] = []
         self.attn_blocks_needed: int = 0
+        # Number of leading positions whose K/V state was already populated
+        # by blocks shared from the prefix cache.
+        self.cached_prefix_length: int = 0
+        # Number of leading prompt positions populated so far by chunked prefill
+        # (including the cached prefix).
+        self.prefill_position: int = 0
+        # Number of leading positions whose K/V state is populated in the draft
+        # model's cache (for speculative decoding).
+        self.draft_length: int = 0
+        # Blocks offloaded to the host tier on preemption, holding the state
+        # of the leading `host_length` positions until restored.
+        self.host_blocks: Optional[HostBlocks] = None
+        self.host_length: int = 0
         self.decode_token_ids = []
         self.current_token_ids = []
+        # Random stream for on-device sampling of the sequence's tokens.
+        self.rng = np.random.default_rng(request.sampling.seed)
+
+    @property
+    def request_id(self) -> str:
+        return self.request.request_id
 
     def attn_blocks_available(self):
         return len(self.attn_blocks)
@@ -199,36 +457,355 @@ class _Sequence:
         return new_size - old_size
 
 
+class _StepRow:
+    """A row of a chunked step: `length` positions from `start_position`."""
+
+    __slots__ = [
+        "emits_token",
+        "length",
+        "seq",
+        "start_position",
+    ]
+
+    def __init__(
+        self, seq: _Sequence, start_position: int, length: int, emits_token: bool
+    ):
+        self.seq = seq
+        self.start_position = start_position
+        self.length = length
+        # Whether the row's output is the sequence's next token (i.e. it is a
+        # decode row or the final chunk of a prompt).
+        self.emits_token = emits_token
+
+
+def _map_host_array(bv: HalBufferView) -> np.ndarray:
+    """Maps a (small) result buffer view to a host array."""
+    return bv.map().asarray(bv.shape, HalElementType.map_to_dtype(bv.element_type))
+
+
 class GenerateState(BatchGenerateState):
+    """Batch state which supports iteration-level (continuous) batching.
+
+    Sequences are admitted with `set_sequences()`/`add_sequences()` and wait in
+    a pending set until the next `prefill()`, after which they join the live
+    decode batch. Finished sequences can be removed with `retire_sequences()`
+    between any two steps, releasing their attention blocks. Each decode step
+    is repacked into the batch size fitting the live sequences (exactly, with a
+    dynamic batch entry-point, or else the smallest compiled `decode_bs{N}`
+    that can hold them), so a long generation does not pin a large batch.
+
+    Block acquisition waits while the cache is exhausted. If the service has
+    preemption enabled, a decode step which cannot be granted its blocks instead
+    preempts its most recently admitted sequences: their blocks are released and
+    they return to the pending set to be recomputed (prompt plus generated
+    tokens) by the next `prefill()`. An acquisition which only this state's own
+    sequences could make room for raises AttnBlocksUnavailableError instead of
+    waiting, so that the caller can retire sequences and retry.
+
+    Services with a draft model can instead run speculative steps
+    (`set_speculative_step()` and `speculative_decode()`): the draft proposes
+    several tokens per sequence which the served model verifies at once. They
+    do not support chunked prefill.
+
+    With a module that exports sampling entry-points, `sample()` chains after a
+    decode (or last-position prefill) step to sample its tokens on the device,
+    so only token ids are read back rather than full logits.
+
+    The inputs of each step are staged through a ring of transfer buffers of the
+    service's `pipeline_depth`. With a depth of 2 and a module compiled for async
+    invocations, a step returns once its work is scheduled behind the previous
+    one, so the host stages step N+1 while step N executes on the device.
+
+    As an alternative to separate prefill and decode invocations, services with
+    chunked prefill enabled can run mixed steps (`set_chunked_step()` and
+    `chunked_step()`): every live sequence decodes one token while pending
+    sequences each prefill their next chunk of the prompt in the same
+    invocation, so a long prompt never stalls decoding for its full duration.
+    """
+
     __slots__ = [
         "_bs",
         "_decode_function",
+        "_decode_resources",
+        "_prefill_bs",
         "_prefill_function",
+        "_prefill_resources",
         "_max_attn_blocks_length",
+        "_max_prefill_attn_blocks_length",
         "_max_seq_length",
-        "_resources",
+        "_pending_sequences",
+        "_unpublished_sequences",
         "_service",
         "_sequences",
         "_batch_queue",
+        "_chunk_bs",
+        "_chunk_function",
+        "_chunk_len",
+        "_chunk_resources",
+        "_sample_resources",
+        "_staging_start",
+        "_sample_rows",
+        "_step_rows",
+        "_unpublished_guard",
     ]
 
     def __init__(self, service: GenerateServiceV1):
         super().__init__(service.module_set.host_context)
-        self._resources = AsyncResources()
+        depth = service.pipeline_depth
+        self._prefill_resources = PipelinedResources(depth)
+        self._decode_resources = PipelinedResources(depth)
+        self._chunk_resources = PipelinedResources(depth)
+        self._sample_resources = PipelinedResources(depth)
+        # Start of the input staging of the current step, for its metrics.
+        self._staging_start: Optional[float] = None
+        self._step_rows: list[_StepRow] = []
+        # Rows of the last prefill or decode step, for `sample()`.
+        self._sample_rows: list[_Sequence] = []
         self._service = service
+        # Live sequences, in decode batch row order.
         self._sequences: list[_Sequence] = []
+        # Admitted sequences which have not yet been prefilled, in prefill
+        # batch row order.
+        self._pending_sequences: list[_Sequence] = []
+        # Prefilled sequences whose prompt blocks have not yet been published
+        # to the prefix cache (publishing waits for the prefill to complete).
+        self._unpublished_sequences: list[_Sequence] = []
+        self._unpublished_guard: Optional[TimelineGuarded[HalBufferView]] = None
         self._batch_queue = WorkQueue(service.session)
+        _METRIC_STATES.add(self)
+
+    @property
+    def service(self) -> GenerateServiceV1:
+        return self._service
+
+    @property
+    def requests(self) -> list[GenerateRequest]:
+        """Requests of the live decode batch in batch row order."""
+        return [seq.request for seq in self._sequences]
+
+    @property
+    def pending_requests(self) -> list[GenerateRequest]:
+        """Requests awaiting prefill in prefill batch row order."""
+        return [seq.request for seq in self._pending_sequences]
+
+    @property
+    def step_requests(self) -> list[GenerateRequest]:
+        """Requests of the planned chunked step in batch row order."""
+        return [row.seq.request for row in self._step_rows]
+
+    @property
+    def step_token_rows(self) -> list[int]:
+        """Rows of the planned chunked step whose output is a next token.
+
+        Decode rows come first, followed by prefill chunk rows, so once the
+        step is issued, these rows correspond in order to `requests`.
+        """
+        return [i for i, row in enumerate(self._step_rows) if row.emits_token]
+
+    @property
+    def step_row_lengths(self) -> list[int]:
+        """Number of positions of each row of the planned chunked step.
+
+        A row's last logits are at offset `length - 1` of its row of the
+        step's full logits (decode rows have length 1).
+        """
+        return [row.length for row in self._step_rows]
+
+    @property
+    def free_batch_capacity(self) -> int:
+        """Number of additional sequences that can be admitted."""
+        return self._service.params.model.max_batch_size - (
+            len(self._sequences) + len(self._pending_sequences)
+        )
+
+    @property
+    def outstanding_steps(self) -> int:
+        """Number of steps issued to the work queue and not yet completed."""
+        return self._batch_queue.outstanding_steps
+
+    def _publish_prefixes(self):
+        """Publishes prompt blocks of completed prefills to the prefix cache.
+
+        Does nothing until the work queue has passed the most recent prefill
+        that populated them.
+        """
+        guard = self._unpublished_guard
+        if guard is not None and not guard.is_ready():
+            return
+        self._unpublished_guard = None
+        cache = self._service.cache
+        for seq in self._unpublished_sequences:
+            cache.publish_prefix(
+                seq.request.required_prompt_token_ids, seq.attn_blocks
+            )
+        self._unpublished_sequences = []
+
+    def _update_prefill_selection(self):
+        """Selects the batched prefill entrypoint for everything pending."""
+        pending = self._pending_sequences
+        if not pending:
+            return
+        self._prefill_bs = self._select_batch_size(
+            len(pending), self._service.prefill_functions
+        )
+        self._prefill_function = self._service.prefill_functions[self._prefill_bs]
+        self._max_prefill_attn_blocks_length = max(
+            seq.attn_blocks_needed for seq in pending
+        )
+
+    async def _acquire_step_resources(
+        self, resources: PipelinedResources, step: str
+    ) -> AsyncResources:
+        """Acquires the staging resources of a step, starting its metrics."""
+        start = time.perf_counter()
+        acquired = await resources.acquire(self.host_context)
+        self._staging_start = time.perf_counter()
+        _observe_phase(step, "resource_wait", start, self._staging_start)
+        return acquired
+
+    async def read_back(
+        self, guarded: TimelineGuarded[HalBufferView], step: str
+    ) -> np.ndarray:
+        """Waits for the (small) result of a step and maps it to the host.
+
+        The wait and the mapping are recorded as phases of `step`.
+        """
+        start = time.perf_counter()
+        value = await guarded.resolve(self.host_context)
+        resolved = time.perf_counter()
+        _observe_phase(step, "fence_wait", start, resolved)
+        host_array = _map_host_array(value)
+        _observe_phase(step, "readback", resolved, time.perf_counter())
+        return host_array
+
+    async def _restore_offloaded(self, sequences: list[_Sequence]):
+        """Restores the blocks of sequences offloaded to the host tier.
+
+        Restored positions count as a cached prefix, except for the last
+        position, which is always computed to produce the next token.
+        """
+        cache = self._service.cache
+        for seq in sequences:
+            host_blocks = seq.host_blocks
+            if host_blocks is None:
+                continue
+            with BLOCK_ACQUIRE_SECONDS.time():
+                await cache.restore_attn_blocks(
+                    self.host_context, host_blocks, seq.attn_blocks
+                )
+            seq.host_blocks = None
+            seq.cached_prefix_length = min(
+                seq.host_length, len(seq.current_token_ids) - 1
+            )
+            seq.prefill_position = seq.cached_prefix_length
+
+    def _discard_offloaded(self, sequences: list[_Sequence]):
+        cache = self._service.cache
+        for seq in sequences:
+            if seq.host_blocks is not None:
+                cache.discard_host_blocks(seq.host_blocks)
+                seq.host_blocks = None
+
+    def _drop_offloaded(self, sequences: list[_Sequence]):
+        """Discards the host blocks of sequences to be recomputed."""
+        for seq in sequences:
+            if seq.host_blocks is None:
+                continue
+            self._discard_offloaded([seq])
+            seq.cached_prefix_length = 0
+            seq.prefill_position = 0
+
+    def _match_cached_prefix(self, seq: _Sequence):
+        """Shares the cached blocks of a sequence's longest cached prompt
+        prefix if the service runs chunked steps, which only compute the
+        positions after it. A plain `prefill()` computes and writes every
+        position, which would race with readers of the shared blocks."""
+        service = self._service
+        if service.prefill_chunk_size > 0:
+            seq.attn_blocks.extend(service.cache.match_prefix(seq.current_token_ids))
+        seq.cached_prefix_length = len(seq.attn_blocks) * service.block_pos_stride
+        seq.prefill_position = seq.cached_prefix_length
+
+    async def _unshare_cached_prefixes(self, sequences: list[_Sequence]):
+        """Releases the shared prefix blocks of sequences to be prefilled, which
+        then compute their prefix into blocks of their own."""
+        block_pos_stride = self._service.block_pos_stride
+        shared_blocks: list[AttnBlockCacheEntry] = []
+        for seq in sequences:
+            prefix_block_count = seq.cached_prefix_length // block_pos_stride
+            shared_blocks.extend(seq.attn_blocks[:prefix_block_count])
+            del seq.attn_blocks[:prefix_block_count]
+            seq.cached_prefix_length = 0
+            seq.prefill_position = 0
+        if shared_blocks:
+            await self._service.cache.release_attn_blocks(shared_blocks)
+
+    async def _acquire_needed_blocks(self, sequences: list[_Sequence]):
+        """Acquires the blocks each sequence needs beyond those it holds.
+
+        The blocks are acquired in one batch so as to give the scheduler the
+        most visibility into the need. Raises AttnBlocksUnavailableError rather
+        than waiting if the blocks could only be released by this state.
+        """
+        attn_blocks_required = sum(
+            seq.attn_blocks_needed - seq.attn_blocks_available() for seq in sequences
+        )
+        if attn_blocks_required == 0:
+            return
+        logger.debug("Acquire attn blocks: %s", attn_blocks_required)
+        cache = self._service.cache
+        if not cache.can_acquire(attn_blocks_required):
+            # Sequences being admitted are not yet pending but may hold shared
+            # prefix blocks.
+            owners = {
+                id(seq): seq
+                for seq in self._sequences + self._pending_sequences + sequences
+            }
+            held = [b for seq in owners.values() for b in seq.attn_blocks]
+            if cache.is_sole_holder(held):
+                raise AttnBlocksUnavailableError(
+                    f"Cannot acquire {attn_blocks_required} attn blocks: "
+                    f"{cache.available_block_count} are available and all others "
+                    "are held by this batch"
+                )
+        all_attn_blocks: list[AttnBlockCacheEntry] = []
+        with BLOCK_ACQUIRE_SECONDS.time():
+            await cache.acquire_attn_blocks(attn_blocks_required, all_attn_blocks)
+        block_index = 0
+        for seq in sequences:
+            next_block_count = seq.attn_blocks_needed - seq.attn_blocks_available()
+            seq.attn_blocks.extend(
+                all_attn_blocks[block_index : block_index + next_block_count]
+            )
+            block_index += next_block_count
+
+    def _select_batch_size(
+        self, bs: int, functions: Optional[BatchEntrypoints] = None
+    ) -> int:
+        """Selects the batch size of the step `functions` (by default those of
+        decode) to run `bs` rows with."""
+        if functions is None:
+            functions = self._service.decode_functions
+        return functions.select_batch_size(bs)
 
     async def recycle(self):
         """Recycles or releases all resources consumed by this instance."""
         cache = self._service.cache
-        self._batch_queue.sync(self.host_context)
-        self._resources.recycle()
+        await self._batch_queue.sync(self.host_context)
+        self._publish_prefixes()
+        self._prefill_resources.recycle()
+        self._decode_resources.recycle()
+        self._chunk_resources.recycle()
+        self._sample_resources.recycle()
+        self._step_rows = []
+        self._sample_rows = []
         all_blocks = []
-        for seq in self._sequences:
+        for seq in self._sequences + self._pending_sequences:
             all_blocks.extend(seq.attn_blocks)
             seq.attn_blocks.clear()
+        self._discard_offloaded(self._pending_sequences)
         self._sequences = []
+        self._pending_sequences = []
         await cache.release_attn_blocks(all_blocks)
 
     async def set_sequences(self, requests: list[GenerateRequest]):
@@ -236,70 +813,110 @@ class GenerateState(BatchGenerateState):
 
         This is async because it acquires resources which may not be available.
         """
-        service = self._service
-        block_pos_stride = service.block_pos_stride
+        assert (
+            not self._sequences and not self._pending_sequences
+        ), "set_sequences already called"
+        await self.add_sequences(requests)
 
-        # Loop through each request and reserve initial attention blocks.
-        bs = 0
-        sequences = self._sequences
-        assert not sequences, "set_sequences already called"
-        max_attn_blocks_length = 0
-        max_seq_length = 0
-        attn_blocks_required = 0
+    async def add_sequences(self, requests: list[GenerateRequest]):
+        """Admits additional sequences into an in-flight batch.
 
-        for req in requests:
-            bs += 1
-            seq = _Sequence(req)
-            sequences.append(seq)
-            seq.current_token_ids = req.required_prompt_token_ids
-            seq_length = len(seq.current_token_ids)
-            seq.seq_length = seq_length
-            max_seq_length = max(max_seq_length, seq_length)
-            initial_block_count = seq_length // block_pos_stride + 1
-            attn_blocks_required += initial_block_count
-            seq.attn_blocks_needed = initial_block_count
-            max_attn_blocks_length = max(max_attn_blocks_length, initial_block_count)
-
-        # Determine the appropriate batched entrypoints.
-        assert bs > 0
-        for allowed_bs in service.batch_sizes:
-            if allowed_bs >= bs:
-                self._prefill_function = service.prefill_functions[allowed_bs]
-                self._decode_function = service.decode_functions[allowed_bs]
-                break
-        else:
-            raise AssertionError(f"Unsupported batch size: {bs}")
+        The sequences are prefilled by the next call to `prefill()` and join the
+        live decode batch afterwards. May be called between any two steps.
 
-        # Acquire the needed attention blocks in one batch so as to give the scheduler
-        # the most visibility into the need.
-        logger.debug("Acquire prefill attn blocks: %s", attn_blocks_required)
-        all_attn_blocks: list[AttnBlockCacheEntry] = []
-        await service.cache.acquire_attn_blocks(attn_blocks_required, all_attn_blocks)
-        block_index = 0
-        for seq in sequences:
-            next_block_count = seq.attn_blocks_needed
-            seq.attn_blocks.extend(
-                all_attn_blocks[block_index : block_index + seq.attn_blocks_needed]
+        This is async because it acquires resources which may not be available.
+        """
+        service = self._service
+        block_pos_stride = service.block_pos_stride
+        assert requests, "No requests to add"
+        assert (
+            len(requests) <= self.free_batch_capacity
+        ), f"Cannot admit {len(requests)} sequences (capacity {self.free_batch_capacity})"
+
+        # Loop through each request, sharing any cached prompt prefix blocks
+        # and reserving the remaining initial attention blocks.
+        new_sequences: list[_Sequence] = []
+        for req in requests:
+            seq = _Sequence(req, next(service._admit_counter))
+            new_sequences.append(seq)
+            seq.current_token_ids = list(req.required_prompt_token_ids)
+            seq.seq_length = len(seq.current_token_ids)
+            seq.attn_blocks_needed = seq.seq_length // block_pos_stride + 1
+            self._match_cached_prefix(seq)
+
+        try:
+            await self._acquire_needed_blocks(new_sequences)
+        except BaseException:
+            # Give back any shared prefix blocks if the wait was abandoned.
+            await service.cache.release_attn_blocks(
+                [b for seq in new_sequences for b in seq.attn_blocks]
             )
-            block_index += next_block_count
+            raise
+        self._pending_sequences.extend(new_sequences)
+        self._update_prefill_selection()
 
-        # Save state.
-        self._bs = allowed_bs
-        self._max_attn_blocks_length = max_attn_blocks_length
-        self._max_seq_length = max_seq_length
+    async def retire_sequences(self, request_ids: list[str]):
+        """Removes finished sequences from the batch, releasing their blocks.
+
+        Remaining live sequences keep their relative order and are repacked
+        into the smallest fitting decode batch on the next `set_decode_step()`.
+        """
+        retire_ids = set(request_ids)
+        retired_blocks: list[AttnBlockCacheEntry] = []
+
+        # Outstanding steps may still reference the blocks, and completed
+        # prefills should be published before their blocks are released.
+        await self._batch_queue.sync(self.host_context)
+        self._publish_prefixes()
+
+        def partition(sequences: list[_Sequence]) -> list[_Sequence]:
+            kept = []
+            for seq in sequences:
+                if seq.request_id in retire_ids:
+                    retired_blocks.extend(seq.attn_blocks)
+                    seq.attn_blocks.clear()
+                    self._discard_offloaded([seq])
+                else:
+                    kept.append(seq)
+            return kept
+
+        self._sequences = partition(self._sequences)
+        self._pending_sequences = partition(self._pending_sequences)
+        self._update_prefill_selection()
+        if retired_blocks:
+            await self._service.cache.release_attn_blocks(retired_blocks)
 
     async def prefill(self) -> TimelineGuarded[HalBufferView]:
+        """Prefills all pending sequences, moving them into the live batch.
+
+        Rows of the result correspond to `pending_requests` as they were prior
+        to the call.
+        """
         hc = self.host_context
         service = self._service
-        resources = self._resources
-        bs = self._bs
-        service = self._service
+        sequences = self._pending_sequences
+        assert sequences, "No pending sequences to prefill"
+        # Preempted sequences give up their blocks and re-acquire them here.
+        # Prefill recomputes all positions of its rows, so blocks offloaded for
+        # a chunked step are dropped rather than copied back, and prefix blocks
+        # shared for a chunked step are swapped for private ones rather than
+        # rewritten under other sequences reading them.
+        self._drop_offloaded(sequences)
+        await self._unshare_cached_prefixes(sequences)
+        await self._acquire_needed_blocks(sequences)
+        bs = self._prefill_bs
         block_pos_stride = service.block_pos_stride
-        max_attn_blocks_length = self._max_attn_blocks_length
+        max_attn_blocks_length = self._max_prefill_attn_blocks_length
         max_seq_length = max_attn_blocks_length * block_pos_stride
-        sequences = self._sequences
         work_queue = self._batch_queue
 
+        # Transfer buffers are reused once the prefill that last staged into
+        # them has completed (the prior one unless pipelined).
+        resources = await self._acquire_step_resources(
+            self._prefill_resources, "prefill"
+        )
+        self._publish_prefixes()
+
         # Record a command buffer for performing h2d transfers.
         cb = HalCommandBuffer(hc.session.device)
 
@@ -347,76 +964,192 @@ class GenerateState(BatchGenerateState):
         #   seq_lens
         #   attn_block_indices
         #   attn_block_buffer_view (the entire slab passed as input)
-        #   wait, signal semaphores
+        #   attn_scale_buffer_view (if the cache is quantized)
+        #   wait, signal fences (if async invocations)
         #   tied attn_block_buffer (for input[2])
         #   tied attn_block_buffer (for result[0])
         inputs = VmVariantList(3)
         inputs.push_ref(prefill_tokens_device)
         inputs.push_ref(prefill_seq_lens_device)
         inputs.push_ref(prefill_attn_block_indices_device)
-        inputs.push_ref(service.cache.attn_block_buffer_view)
+        for cache_state_view in service.cache.cache_state_buffer_views:
+            inputs.push_ref(cache_state_view)
 
         # Outputs:
         #   attn_block_buffer_view (tied output)
         #   decode_tokens
         outputs = VmVariantList(1)
-        # TODO: Async invoke.
-        hc.vm_context.invoke(self._prefill_function, inputs, outputs)
-        return work_queue.guard(outputs.get_as_ref(0).deref(HalBufferView))
-
-    async def set_decode_step(self, tokens):
-        """Initiates processing of a list of tokens to decode across each batch
+        if service.draft_params is not None:
+            # The draft model prefills the same inputs into its own cache slabs.
+            draft_inputs = VmVariantList(3)
+            draft_inputs.push_ref(prefill_tokens_device)
+            draft_inputs.push_ref(prefill_seq_lens_device)
+            draft_inputs.push_ref(prefill_attn_block_indices_device)
+            for cache_state_view in service.cache.draft_cache_state_buffer_views:
+                draft_inputs.push_ref(cache_state_view)
+            self._invoke(
+                service.draft_prefill_functions[bs],
+                draft_inputs,
+                VmVariantList(1),
+                step="draft_prefill",
+                rows=len(sequences),
+                batch_size=bs,
+                model_params=service.draft_params,
+            )
+            for seq in sequences:
+                seq.draft_length = len(seq.current_token_ids)
+        guarded_outputs = self._invoke(
+            self._prefill_function,
+            inputs,
+            outputs,
+            self._prefill_resources,
+            step="prefill",
+            rows=len(sequences),
+            batch_size=bs,
+        )
 
-        This is async because it acquires resources which may not be available.
+        # Prefilled sequences join the live decode batch.
+        self._sample_rows = list(sequences)
+        self._sequences.extend(sequences)
+        self._unpublished_sequences.extend(sequences)
+        self._unpublished_guard = guarded_outputs
+        self._pending_sequences = []
+        return guarded_outputs
+
+    async def _preempt(self, seq: _Sequence):
+        """Releases the blocks of a live sequence and returns it to pending.
+
+        The sequence is recomputed by the next prefill over its prompt plus
+        all tokens generated so far, which shares any cached prompt prefix if
+        it is a chunked step. If the service runs chunked steps and the cache
+        has a host tier with room, the blocks are offloaded to it instead and
+        restored by the next chunked step, which then only computes positions
+        from the last token on. (A plain `prefill()` recomputes every position,
+        so it gains nothing from them.) The work queue must be synced past any
+        step referencing its blocks.
         """
+        cache = self._service.cache
+        block_pos_stride = self._service.block_pos_stride
+        logger.debug("Preempting sequence %s", seq.request_id)
+        self._sequences.remove(seq)
+        seq.current_token_ids.extend(seq.decode_token_ids)
+        seq.decode_token_ids = []
+        seq.seq_length = len(seq.current_token_ids)
+        seq.attn_blocks_needed = seq.seq_length // block_pos_stride + 1
+        released_blocks = seq.attn_blocks
+        seq.attn_blocks = []
+
+        # All but the last token (appended before the step which would have
+        # decoded it) have their state populated.
+        host_length = seq.seq_length - 1
+        host_block_count = -(-host_length // block_pos_stride)
+        if (
+            self._service.prefill_chunk_size > 0
+            and host_block_count > 0
+            and len(cache.host_block_free) >= host_block_count
+        ):
+            seq.host_blocks = await cache.offload_attn_blocks(
+                self.host_context, released_blocks[:host_block_count]
+            )
+            if seq.host_blocks is not None:
+                seq.host_length = host_length
+                released_blocks = released_blocks[host_block_count:]
+                logger.debug(
+                    "Offloaded %s blocks of sequence %s",
+                    host_block_count,
+                    seq.request_id,
+                )
+        await cache.release_attn_blocks(released_blocks)
+        if seq.host_blocks is None:
+            self._match_cached_prefix(seq)
+        else:
+            # Offloaded positions count once restored.
+            seq.cached_prefix_length = 0
+            seq.prefill_position = 0
+        self._pending_sequences.append(seq)
+        self._update_prefill_selection()
+
+    async def _advance_sequences(self, tokens, lookahead: int = 0):
+        """Appends a token to each live sequence and acquires the blocks to
+        decode it (and `lookahead` further positions), preempting sequences if
+        enabled and needed."""
         service = self._service
+        cache = service.cache
         block_pos_stride = service.block_pos_stride
 
         sequences = self._sequences
-        assert sequences, "set_sequences was not called yet"
+        assert sequences, "no live sequences (set_sequences or prefill not called)"
         assert len(sequences) == len(tokens), "expected token for each sequence"
 
-        max_attn_blocks_length = 0
-        max_seq_length = 0
-        attn_blocks_required = 0
-
-        for tok, seq in zip(tokens, self._sequences):
+        for tok, seq in zip(tokens, sequences):
             seq.decode_token_ids.append(tok)
             seq.seq_length = seq.seq_length + 1
+            seq.attn_blocks_needed = (
+                seq.seq_length + lookahead
+            ) // block_pos_stride + 1
+
+        def blocks_required() -> int:
+            return sum(
+                seq.attn_blocks_needed - seq.attn_blocks_available()
+                for seq in self._sequences
+            )
 
-            max_seq_length = max(max_seq_length, seq.seq_length)
-            block_count = seq.seq_length // block_pos_stride + 1
+        # Rather than waiting on blocks that may only be released by this
+        # batch, preempt the most recently admitted sequences (always keeping
+        # one so that progress is made).
+        if service.preemption and not cache.can_acquire(blocks_required()):
+            await self._batch_queue.sync(self.host_context)
+            self._publish_prefixes()
+            while len(self._sequences) > 1 and not cache.can_acquire(
+                blocks_required()
+            ):
+                victim = max(self._sequences, key=lambda seq: seq.admit_order)
+                await self._preempt(victim)
 
-            seq.attn_blocks_needed = block_count
-            attn_blocks_required += block_count - seq.attn_blocks_available()
-            max_attn_blocks_length = max(max_attn_blocks_length, block_count)
+        await self._acquire_needed_blocks(self._sequences)
 
-        # Acquire the needed attention blocks in one batch so as to give the scheduler
-        # the most visibility into the need.
-        logger.debug("Acquire decode attn blocks: %s", attn_blocks_required)
-        all_attn_blocks: list[AttnBlockCacheEntry] = []
-        await service.cache.acquire_attn_blocks(attn_blocks_required, all_attn_blocks)
-        block_index = 0
-        for seq in sequences:
-            next_block_count = seq.attn_blocks_needed - seq.attn_blocks_available()
-            seq.attn_blocks.extend(
-                all_attn_blocks[block_index : block_index + next_block_count]
-            )
-            block_index += next_block_count
+    async def set_decode_step(self, tokens):
+        """Initiates processing of a list of tokens to decode across each batch
+
+        This is async because it acquires resources which may not be available.
+        With preemption enabled, sequences may be moved from `requests` back to
+        `pending_requests` (see `GenerateState`), in which case they must be
+        prefilled again before they continue decoding.
+        """
+        service = self._service
+        await self._advance_sequences(tokens)
+        sequences = self._sequences
+
+        # Repack the live sequences into the decode entrypoint fitting them.
+        self._bs = self._select_batch_size(len(sequences))
+        self._decode_function = service.decode_functions[self._bs]
 
         # Save state.
-        self._max_attn_blocks_length = max_attn_blocks_length
-        self._max_seq_length = max_seq_length
+        self._max_attn_blocks_length = max(
+            seq.attn_blocks_needed for seq in sequences
+        )
+        self._max_seq_length = max(seq.seq_length for seq in sequences)
 
     async def decode(self) -> TimelineGuarded[HalBufferView]:
+        """Runs one decode step over the live sequences.
+
+        Rows of the result correspond to `requests`.
+        """
         hc = self.host_context
         service = self._service
-        resources = self._resources
         bs = self._bs
         max_attn_blocks_length = self._max_attn_blocks_length
         sequences = self._sequences
         work_queue = self._batch_queue
 
+        # Transfer buffers are reused once the decode step that last staged into
+        # them has completed. This is typically already the case since its
+        # outputs were needed to produce this step's tokens.
+        resources = await self._acquire_step_resources(
+            self._decode_resources, "decode"
+        )
+        self._publish_prefixes()
+
         # Record a command buffer for performing h2d transfers.
         cb = HalCommandBuffer(hc.session.device)
 
@@ -456,13 +1189,14 @@ class GenerateState(BatchGenerateState):
 
             tok = seq.decode_token_ids[0]
             seq_len = len(seq.current_token_ids)
-            print(f"seq.current_token_ids: {seq.current_token_ids}")
             seq.current_token_ids.append(tok)
             seq.decode_token_ids = seq.decode_token_ids[1:]
 
             decode_tokens_host[i, 0] = tok
+            # The token is cached at position `seq_len` and attends to all
+            # positions through its own.
             decode_start_pos_host[i] = seq_len
-            decode_seq_lens_host[i] = seq_len
+            decode_seq_lens_host[i] = seq_len + 1
             for j in range(len(seq.attn_blocks)):
                 decode_attn_block_indices_host[i, j] = attn_blocks[j].index
 
@@ -476,7 +1210,8 @@ class GenerateState(BatchGenerateState):
         #   start_pos
         #   attn_block_indices
         #   attn_block_buffer_view (the entire slab passed as input)
-        #   wait, signal semaphores
+        #   attn_scale_buffer_view (if the cache is quantized)
+        #   wait, signal fences (if async invocations)
         #   tied attn_block_buffer (for input[4])
         #   tied attn_block_buffer (for result[0])
         inputs = VmVariantList(5)
@@ -484,12 +1219,612 @@ class GenerateState(BatchGenerateState):
         inputs.push_ref(decode_seq_lens_device)
         inputs.push_ref(decode_start_pos_device)
         inputs.push_ref(decode_attn_block_indices_device)
-        inputs.push_ref(service.cache.attn_block_buffer_view)
+        for cache_state_view in service.cache.cache_state_buffer_views:
+            inputs.push_ref(cache_state_view)
 
         # Outputs:
         #   attn_block_buffer_view (tied output)
         #   decode_tokens
         outputs = VmVariantList(1)
-        # TODO: Async invoke.
-        hc.vm_context.invoke(self._decode_function, inputs, outputs)
+        self._sample_rows = list(sequences)
+        return self._invoke(
+            self._decode_function,
+            inputs,
+            outputs,
+            self._decode_resources,
+            step="decode",
+            rows=len(sequences),
+            batch_size=bs,
+        )
+
+    async def sample(
+        self, logits: TimelineGuarded[HalBufferView]
+    ) -> TimelineGuarded[HalBufferView]:
+        """Samples the next token of each row of the last prefill or decode step
+        on the device, so that only token ids need to be read back.
+
+        `logits` is the result of that step, which must be [bs, 1, vocab] (for
+        prefill, the module must return last-position logits). The sampling is
+        scheduled behind the step without waiting for it. Each row is sampled
+        per its request's `SamplingParams`, and the result is [bs, 1] int64
+        tokens.
+        """
+        hc = self.host_context
+        service = self._service
+        assert service.sample_functions, "module does not export sample_bs{n}"
+        rows = self._sample_rows
+        assert rows, "no prefill or decode step to sample"
+        logits_view = logits.value
+        bs = logits_view.shape[0]
+        assert (
+            logits_view.shape[1] == 1
+        ), f"Expected last-position logits but got shape {logits_view.shape}"
+        assert len(rows) <= bs
+        work_queue = self._batch_queue
+        resources = await self._acquire_step_resources(
+            self._sample_resources, "sample"
+        )
+
+        # Record a command buffer for performing h2d transfers.
+        cb = HalCommandBuffer(hc.session.device)
+        pool = service.sample_params_pool
+        temperature_host, temperature_device = resources.acquire_transfer_buffer(
+            pool
+        ).h2d_array(cb, [bs], HalElementType.FLOAT_32, fill_value=0.0)
+        top_k_host, top_k_device = resources.acquire_transfer_buffer(pool).h2d_array(
+            cb, [bs], HalElementType.SINT_64, fill_value=0
+        )
+        top_p_host, top_p_device = resources.acquire_transfer_buffer(pool).h2d_array(
+            cb, [bs], HalElementType.FLOAT_32, fill_value=1.0
+        )
+        uniform_host, uniform_device = resources.acquire_transfer_buffer(
+            pool
+        ).h2d_array(cb, [bs], HalElementType.FLOAT_32, fill_value=0.0)
+
+        # Batch padding rows are sampled greedily.
+        for i, seq in enumerate(rows):
+            sampling = seq.request.sampling
+            temperature_host[i] = sampling.temperature
+            top_k_host[i] = sampling.top_k
+            top_p_host[i] = sampling.top_p
+            uniform_host[i] = seq.rng.random()
+
+        # Perform h2d transfers.
+        cb.end()
+        work_queue.execute_sequential([cb])
+
+        # Inputs:
+        #   logits
+        #   temperature
+        #   top_k
+        #   top_p
+        #   uniform
+        #   wait, signal fences (if async invocations)
+        inputs = VmVariantList(5)
+        inputs.push_ref(logits_view)
+        inputs.push_ref(temperature_device)
+        inputs.push_ref(top_k_device)
+        inputs.push_ref(top_p_device)
+        inputs.push_ref(uniform_device)
+
+        # Outputs:
+        #   tokens
+        outputs = VmVariantList(1)
+        return self._invoke(
+            service.sample_functions[bs],
+            inputs,
+            outputs,
+            self._sample_resources,
+            step="sample",
+            rows=len(rows),
+            batch_size=bs,
+        )
+
+    async def set_speculative_step(self, tokens):
+        """Initiates a speculative decode step (see `speculative_decode()`).
+
+        `tokens` are the next tokens of the live sequences, as for
+        `set_decode_step()`. Blocks are acquired for all positions that the
+        step may populate, and those left unused are released by the step.
+        """
+        service = self._service
+        assert service.speculate_k > 0, "speculative decoding is not enabled"
+        await self._advance_sequences(tokens, lookahead=service.speculate_k)
+        sequences = self._sequences
+        self._bs = self._select_batch_size(len(sequences))
+        self._max_attn_blocks_length = max(
+            seq.attn_blocks_needed for seq in sequences
+        )
+
+    async def speculative_decode(self) -> list[list[int]]:
+        """Runs a draft-then-verify decode step over the live sequences.
+
+        The draft model proposes `speculate_k` tokens per sequence by greedy
+        decoding, which the served model then checks in a single verification
+        invocation over the paged cache. Each sequence accepts the longest
+        prefix of its proposal matching the served model's greedy predictions
+        followed by the served model's own prediction after it, so the result is
+        that of greedy decoding with the served model alone. Blocks acquired
+        for rejected positions are released.
+
+        Returns the accepted tokens of each row of `requests`. The last one of
+        each row is its next token, to be passed to the next step (as for the
+        result of `decode()`); the others are already part of the sequence.
+        """
+        service = self._service
+        k = service.speculate_k
+        sequences = self._sequences
+        assert sequences, "set_speculative_step not called"
+
+        # Before proposing, each row feeds the draft any accepted positions
+        # missing from its cache (at most one, when all of its last proposal
+        # was accepted) followed by the next token.
+        draft_inputs: list[list[int]] = []
+        for seq in sequences:
+            assert len(seq.decode_token_ids) == 1, "set_speculative_step not called"
+            row_inputs = seq.current_token_ids[seq.draft_length :]
+            draft_inputs.append(row_inputs + seq.decode_token_ids)
+        draft_step_count = max(len(row_inputs) for row_inputs in draft_inputs) + k - 1
+
+        # The outputs of a row's draft steps after its last input are proposed,
+        # up to k of them.
+        proposals: list[list[int]] = [[] for _ in sequences]
+        step_tokens = [row_inputs[0] for row_inputs in draft_inputs]
+        for step in range(draft_step_count):
+            guarded_tokens = await self._draft_step(step_tokens, step)
+            draft_tokens = await self.read_back(guarded_tokens, "draft_sample")
+            for i, row_inputs in enumerate(draft_inputs):
+                if step + 1 < len(row_inputs):
+                    step_tokens[i] = row_inputs[step + 1]
+                else:
+                    step_tokens[i] = int(draft_tokens[i, 0])
+                    if len(proposals[i]) < k:
+                        proposals[i].append(step_tokens[i])
+
+        guarded_predictions = await self._verify_step(proposals)
+        predictions = await self.read_back(guarded_predictions, "verify")
+
+        accepted_tokens: list[list[int]] = []
+        released_blocks: list[AttnBlockCacheEntry] = []
+        block_pos_stride = service.block_pos_stride
+        for i, seq in enumerate(sequences):
+            proposal = proposals[i]
+            accept_count = 0
+            while (
+                accept_count < len(proposal)
+                and proposal[accept_count] == predictions[i, accept_count]
+            ):
+                accept_count += 1
+            seq.current_token_ids.extend(seq.decode_token_ids)
+            seq.current_token_ids.extend(proposal[:accept_count])
+            seq.decode_token_ids = []
+            seq.seq_length = len(seq.current_token_ids)
+            seq.draft_length = min(
+                seq.draft_length + draft_step_count, seq.seq_length
+            )
+            accepted_tokens.append(
+                proposal[:accept_count] + [int(predictions[i, accept_count])]
+            )
+
+            # Roll back the blocks of rejected positions.
+            seq.attn_blocks_needed = seq.seq_length // block_pos_stride + 1
+            released_blocks.extend(seq.attn_blocks[seq.attn_blocks_needed :])
+            del seq.attn_blocks[seq.attn_blocks_needed :]
+        if released_blocks:
+            await service.cache.release_attn_blocks(released_blocks)
+        self._sample_rows = []
+        return accepted_tokens
+
+    async def _draft_step(
+        self, tokens: list[int], step: int
+    ) -> TimelineGuarded[HalBufferView]:
+        """Runs the `step`th draft decode of a speculative step on a token per
+        row, chaining greedy sampling of its next tokens on the device."""
+        hc = self.host_context
+        service = self._service
+        bs = self._bs
+        max_attn_blocks_length = self._max_attn_blocks_length
+        sequences = self._sequences
+        work_queue = self._batch_queue
+        resources = await self._acquire_step_resources(
+            self._decode_resources, "draft_decode"
+        )
+
+        # Record a command buffer for performing h2d transfers.
+        cb = HalCommandBuffer(hc.session.device)
+        tokens_host, tokens_device = resources.acquire_transfer_buffer(
+            service.decode_tokens_pool
+        ).h2d_array(cb, [bs, 1], HalElementType.SINT_64, fill_value=0)
+        seq_lens_host, seq_lens_device = resources.acquire_transfer_buffer(
+            service.decode_seq_lens_pool
+        ).h2d_array(cb, [bs], HalElementType.SINT_64, fill_value=0)
+        start_pos_host, start_pos_device = resources.acquire_transfer_buffer(
+            service.decode_start_pos_pool
+        ).h2d_array(cb, [bs], HalElementType.SINT_64, fill_value=0)
+        (
+            attn_block_indices_host,
+            attn_block_indices_device,
+        ) = resources.acquire_transfer_buffer(service.block_indices_pool).h2d_array(
+            cb, [bs, max_attn_blocks_length], HalElementType.SINT_64, fill_value=0
+        )
+
+        # Greedy sampling (the defaults of each sampling parameter).
+        sample_views = [
+            resources.acquire_transfer_buffer(service.sample_params_pool).h2d_array(
+                cb, [bs], element_type, fill_value=fill_value
+            )[1]
+            for element_type, fill_value in [
+                (HalElementType.FLOAT_32, 0.0),
+                (HalElementType.SINT_64, 0),
+                (HalElementType.FLOAT_32, 1.0),
+                (HalElementType.FLOAT_32, 0.0),
+            ]
+        ]
+
+        # Each row's token is at the next position of its draft cache and
+        # attends to all positions through its own.
+        for i, seq in enumerate(sequences):
+            position = seq.draft_length + step
+            tokens_host[i, 0] = tokens[i]
+            start_pos_host[i] = position
+            seq_lens_host[i] = position + 1
+            for j in range(len(seq.attn_blocks)):
+                attn_block_indices_host[i, j] = seq.attn_blocks[j].index
+
+        # Batch padding rows duplicate the last row (see `chunked_step()`).
+        row_count = len(sequences)
+        tokens_host[row_count:bs] = tokens_host[row_count - 1]
+        start_pos_host[row_count:bs] = start_pos_host[row_count - 1]
+        seq_lens_host[row_count:bs] = seq_lens_host[row_count - 1]
+        attn_block_indices_host[row_count:bs] = attn_block_indices_host[
+            row_count - 1
+        ]
+
+        # Perform h2d transfers.
+        cb.end()
+        work_queue.execute_sequential([cb])
+
+        # Draft decode inputs are as for `decode()`.
+        inputs = VmVariantList(5)
+        inputs.push_ref(tokens_device)
+        inputs.push_ref(seq_lens_device)
+        inputs.push_ref(start_pos_device)
+        inputs.push_ref(attn_block_indices_device)
+        for cache_state_view in service.cache.draft_cache_state_buffer_views:
+            inputs.push_ref(cache_state_view)
+        guarded_logits = self._invoke(
+            service.draft_decode_functions[bs],
+            inputs,
+            VmVariantList(1),
+            step="draft_decode",
+            rows=len(sequences),
+            batch_size=bs,
+            model_params=service.draft_params,
+        )
+
+        # Draft sampling inputs are as for `sample()`.
+        sample_inputs = VmVariantList(5)
+        sample_inputs.push_ref(guarded_logits.value)
+        for sample_view in sample_views:
+            sample_inputs.push_ref(sample_view)
+        return self._invoke(
+            service.draft_sample_functions[bs],
+            sample_inputs,
+            VmVariantList(1),
+            self._decode_resources,
+            step="draft_sample",
+            rows=len(sequences),
+            batch_size=bs,
+            model_params=service.draft_params,
+        )
+
+    async def _verify_step(
+        self, proposals: list[list[int]]
+    ) -> TimelineGuarded[HalBufferView]:
+        """Verifies the next token and proposed tokens of each row with the
+        served model, returning its greedy predictions after each position."""
+        hc = self.host_context
+        service = self._service
+        bs = self._bs
+        verify_len = service.speculate_k + 1
+        max_attn_blocks_length = self._max_attn_blocks_length
+        sequences = self._sequences
+        work_queue = self._batch_queue
+        resources = await self._acquire_step_resources(
+            self._decode_resources, "verify"
+        )
+
+        # Record a command buffer for performing h2d transfers.
+        cb = HalCommandBuffer(hc.session.device)
+        tokens_host, tokens_device = resources.acquire_transfer_buffer(
+            service.prefill_tokens_pool
+        ).h2d_array(cb, [bs, verify_len], HalElementType.SINT_64, fill_value=0)
+        start_pos_host, start_pos_device = resources.acquire_transfer_buffer(
+            service.decode_start_pos_pool
+        ).h2d_array(cb, [bs], HalElementType.SINT_64, fill_value=0)
+        seq_lens_host, seq_lens_device = resources.acquire_transfer_buffer(
+            service.decode_seq_lens_pool
+        ).h2d_array(cb, [bs], HalElementType.SINT_64, fill_value=0)
+        (
+            attn_block_indices_host,
+            attn_block_indices_device,
+        ) = resources.acquire_transfer_buffer(service.block_indices_pool).h2d_array(
+            cb, [bs, max_attn_blocks_length], HalElementType.SINT_64, fill_value=0
+        )
+
+        # Rows are verified as a chunk from their next position, padded past
+        # their sequence length.
+        for i, seq in enumerate(sequences):
+            row_tokens = seq.decode_token_ids + proposals[i]
+            start = len(seq.current_token_ids)
+            tokens_host[i, 0 : len(row_tokens)] = row_tokens
+            start_pos_host[i] = start
+            seq_lens_host[i] = start + len(row_tokens)
+            for j in range(len(seq.attn_blocks)):
+                attn_block_indices_host[i, j] = seq.attn_blocks[j].index
+
+        # Batch padding rows duplicate the last row (see `chunked_step()`).
+        row_count = len(sequences)
+        tokens_host[row_count:bs] = tokens_host[row_count - 1]
+        start_pos_host[row_count:bs] = start_pos_host[row_count - 1]
+        seq_lens_host[row_count:bs] = seq_lens_host[row_count - 1]
+        attn_block_indices_host[row_count:bs] = attn_block_indices_host[
+            row_count - 1
+        ]
+
+        # Perform h2d transfers.
+        cb.end()
+        work_queue.execute_sequential([cb])
+
+        # Inputs are as for `chunked_step()`.
+        inputs = VmVariantList(5)
+        inputs.push_ref(tokens_device)
+        inputs.push_ref(start_pos_device)
+        inputs.push_ref(seq_lens_device)
+        inputs.push_ref(attn_block_indices_device)
+        for cache_state_view in service.cache.cache_state_buffer_views:
+            inputs.push_ref(cache_state_view)
+
+        # Outputs:
+        #   greedy next token after each position: [bs, verify_len]
+        outputs = VmVariantList(1)
+        return self._invoke(
+            service.verify_functions[bs],
+            inputs,
+            outputs,
+            self._decode_resources,
+            step="verify",
+            rows=len(sequences),
+            batch_size=bs,
+        )
+
+    async def set_chunked_step(self, tokens):
+        """Plans a step which mixes decode rows with prefill chunks.
+
+        `tokens` are the next tokens of the live sequences, as for
+        `set_decode_step()` (empty if there are none). Every live sequence gets
+        a decode row, and pending sequences, in order, each get a row with the
+        next chunk of up to `prefill_chunk_size` prompt positions while the
+        largest compiled batch has room. See `step_requests` and
+        `step_token_rows` for the layout of the result of `chunked_step()`.
+
+        This is async because it acquires resources which may not be available.
+        """
+        service = self._service
+        chunk_size = service.prefill_chunk_size
+        assert chunk_size > 0, "chunked prefill is not enabled for this service"
+        if tokens or self._sequences:
+            await self._advance_sequences(tokens)
+
+        max_rows = service.prefill_chunk_functions.max_batch_size
+        decode_sequences = list(self._sequences)
+        assert (
+            len(decode_sequences) <= max_rows
+        ), f"Live batch exceeds the largest chunked batch size {max_rows}"
+        chunk_sequences = self._pending_sequences[: max_rows - len(decode_sequences)]
+        assert decode_sequences or chunk_sequences, "no sequences to step"
+        # Preempted sequences re-acquire (or restore) their blocks here.
+        await self._restore_offloaded(chunk_sequences)
+        await self._acquire_needed_blocks(chunk_sequences)
+
+        # Rows are padded to a common chunk length, which must keep every row's
+        # positions within the maximum sequence length.
+        max_start = max(
+            [len(seq.current_token_ids) for seq in decode_sequences]
+            + [seq.prefill_position for seq in chunk_sequences]
+        )
+        max_chunk_len = min(chunk_size, service.params.model.max_seq_len - max_start)
+        rows: list[_StepRow] = []
+        for seq in decode_sequences:
+            rows.append(_StepRow(seq, len(seq.current_token_ids), 1, True))
+        for seq in chunk_sequences:
+            remaining = len(seq.current_token_ids) - seq.prefill_position
+            length = min(max_chunk_len, remaining)
+            rows.append(
+                _StepRow(seq, seq.prefill_position, length, length == remaining)
+            )
+
+        self._step_rows = rows
+        self._sample_rows = []
+        self._chunk_len = max(row.length for row in rows)
+        self._chunk_bs = self._select_batch_size(
+            len(rows), service.prefill_chunk_functions
+        )
+        self._chunk_function = service.prefill_chunk_functions[self._chunk_bs]
+        self._max_attn_blocks_length = max(
+            row.seq.attn_blocks_needed for row in rows
+        )
+
+    async def chunked_step(self) -> TimelineGuarded[HalBufferView]:
+        """Runs the step planned by `set_chunked_step()`.
+
+        Rows of the result correspond to `step_requests`. Sequences whose final
+        prompt chunk was included join the live decode batch.
+        """
+        hc = self.host_context
+        service = self._service
+        rows = self._step_rows
+        assert rows, "set_chunked_step not called"
+        bs = self._chunk_bs
+        chunk_len = self._chunk_len
+        max_attn_blocks_length = self._max_attn_blocks_length
+        work_queue = self._batch_queue
+
+        resources = await self._acquire_step_resources(
+            self._chunk_resources, "chunked"
+        )
+        self._publish_prefixes()
+
+        # Record a command buffer for performing h2d transfers.
+        cb = HalCommandBuffer(hc.session.device)
+
+        # chunk_tokens: array([bs, chunk_len], np.int64)
+        chunk_tokens_host, chunk_tokens_device = resources.acquire_transfer_buffer(
+            service.prefill_tokens_pool
+        ).h2d_array(cb, [bs, chunk_len], HalElementType.SINT_64, fill_value=0)
+
+        # chunk_start_pos: array([bs], np.int64)
+        (
+            chunk_start_pos_host,
+            chunk_start_pos_device,
+        ) = resources.acquire_transfer_buffer(service.decode_start_pos_pool).h2d_array(
+            cb, [bs], HalElementType.SINT_64, fill_value=0
+        )
+
+        # chunk_seq_lens: array([bs], np.int64)
+        (
+            chunk_seq_lens_host,
+            chunk_seq_lens_device,
+        ) = resources.acquire_transfer_buffer(service.decode_seq_lens_pool).h2d_array(
+            cb, [bs], HalElementType.SINT_64, fill_value=0
+        )
+
+        # attn_block_indices: array([bs, max_attn_blocks], np.int64)
+        (
+            chunk_attn_block_indices_host,
+            chunk_attn_block_indices_device,
+        ) = resources.acquire_transfer_buffer(service.block_indices_pool).h2d_array(
+            cb, [bs, max_attn_blocks_length], HalElementType.SINT_64, fill_value=0
+        )
+
+        # Populate host buffers for each row.
+        completed: list[_Sequence] = []
+        for i, row in enumerate(rows):
+            seq = row.seq
+            start = row.start_position
+            if seq.decode_token_ids:
+                # Decode row.
+                tok = seq.decode_token_ids[0]
+                seq.current_token_ids.append(tok)
+                seq.decode_token_ids = seq.decode_token_ids[1:]
+            else:
+                # Prefill chunk row.
+                seq.prefill_position = start + row.length
+                if row.emits_token:
+                    completed.append(seq)
+            chunk_tokens_host[i, 0 : row.length] = seq.current_token_ids[
+                start : start + row.length
+            ]
+            chunk_start_pos_host[i] = start
+            chunk_seq_lens_host[i] = start + row.length
+            for j in range(len(seq.attn_blocks)):
+                chunk_attn_block_indices_host[i, j] = seq.attn_blocks[j].index
+
+        # Batch padding rows duplicate the last row so that their cache writes
+        # are identical to its writes rather than landing in arbitrary blocks.
+        row_count = len(rows)
+        chunk_tokens_host[row_count:bs] = chunk_tokens_host[row_count - 1]
+        chunk_start_pos_host[row_count:bs] = chunk_start_pos_host[row_count - 1]
+        chunk_seq_lens_host[row_count:bs] = chunk_seq_lens_host[row_count - 1]
+        chunk_attn_block_indices_host[row_count:bs] = chunk_attn_block_indices_host[
+            row_count - 1
+        ]
+
+        # Perform h2d transfers.
+        cb.end()
+        work_queue.execute_sequential([cb])
+
+        # Inputs:
+        #   token_ids
+        #   start_pos
+        #   seq_lens
+        #   attn_block_indices
+        #   attn_block_buffer_view (the entire slab passed as input)
+        #   attn_scale_buffer_view (if the cache is quantized)
+        #   wait, signal fences (if async invocations)
+        inputs = VmVariantList(5)
+        inputs.push_ref(chunk_tokens_device)
+        inputs.push_ref(chunk_start_pos_device)
+        inputs.push_ref(chunk_seq_lens_device)
+        inputs.push_ref(chunk_attn_block_indices_device)
+        for cache_state_view in service.cache.cache_state_buffer_views:
+            inputs.push_ref(cache_state_view)
+
+        # Outputs:
+        #   logits (or tokens) for every row
+        outputs = VmVariantList(1)
+        guarded_outputs = self._invoke(
+            self._chunk_function,
+            inputs,
+            outputs,
+            self._chunk_resources,
+            step="chunked",
+            rows=len(rows),
+            batch_size=bs,
+        )
+
+        # Fully prefilled sequences join the live decode batch.
+        if completed:
+            completed_ids = set(id(seq) for seq in completed)
+            self._pending_sequences = [
+                seq for seq in self._pending_sequences if id(seq) not in completed_ids
+            ]
+            self._sequences.extend(completed)
+            self._unpublished_sequences.extend(completed)
+            self._unpublished_guard = guarded_outputs
+            self._update_prefill_selection()
+        return guarded_outputs
+
+    def _invoke(
+        self,
+        function: VmFunction,
+        inputs: VmVariantList,
+        outputs: VmVariantList,
+        resources: Optional[PipelinedResources] = None,
+        *,
+        step: str,
+        rows: int,
+        batch_size: int,
+        model_params: Optional[ModelParams] = None,
+    ) -> TimelineGuarded[HalBufferView]:
+        """Invokes a step entry-point after the h2d transfers of its inputs.
+
+        With async invocations (per the `model_params` of the invoked module,
+        which default to the served model's), the function waits on the
+        queue's current step (the transfers) and signals the next, returning
+        once its work is scheduled. Otherwise the invocation blocks until it
+        completes. Either way, the staged resources (if given) stay in use
+        until the outputs are available.
+
+        The `step` name and its occupied `rows` of the compiled `batch_size`
+        are recorded in the step metrics.
+        """
+        work_queue = self._batch_queue
+        if model_params is None:
+            model_params = self._service.params.model
+        if model_params.async_invocations:
+            wait_fence, signal_fence = work_queue.step_fences()
+            inputs.push_ref(wait_fence)
+            inputs.push_ref(signal_fence)
+        start = time.perf_counter()
+        if self._staging_start is not None:
+            _observe_phase(step, "h2d_staging", self._staging_start, start)
+            self._staging_start = None
+        self.host_context.vm_context.invoke(function, inputs, outputs)
+        _observe_phase(step, "invoke", start, time.perf_counter())
+        STEPS_TOTAL.labels(step=step, batch_size=batch_size).inc()
+        STEP_ROWS_TOTAL.labels(step=step, batch_size=batch_size).inc(rows)
+        STEP_BATCH_OCCUPANCY.labels(step=step).observe(rows / batch_size)
+        if resources is not None:
+            resources.retire(work_queue)
         return work_queue.guard(outputs.get_as_ref(0).deref(HalBufferView))
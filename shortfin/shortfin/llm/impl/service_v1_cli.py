@@ -8,14 +8,11 @@ import asyncio
 import argparse
 import numpy
 import sys
+from typing import Optional
 
 from transformers import LlamaTokenizer  # type: ignore
 
-from iree.runtime import (  # type: ignore
-    HalElementType,
-)
-
-from shortfin.framework.session import DeviceSession
+from shortfin.framework.session import DeviceSessionGroup
 
 from shortfin.llm.attn_block_cache import (
     create_attn_block_cache_module,
@@ -32,36 +29,93 @@ from shortfin.llm.impl.service_v1 import GenerateServiceV1
 from shortfin.llm.service import GenerateRequest
 
 
-def setup(vmfb_path, config_path, gguf_path):
+def setup(vmfb_path, config_path, gguf_path, draft_paths=None):
+    return setup_devices(
+        vmfb_path, config_path, gguf_path, ["local-sync"], draft_paths
+    )[0]
+
+
+def setup_devices(
+    vmfb_path,
+    config_path,
+    gguf_path,
+    device_uris: list[str],
+    draft_paths: Optional[tuple[str, str, str]] = None,
+):
+    """Sets up a service on each of the given devices.
+
+    The devices share the host-side mappings of the VMFB and parameters, and
+    each has its own attention block cache.
+
+    If `draft_paths` gives the (vmfb, config, parameters) of a draft model, it
+    is loaded into the same module set and the services decode speculatively.
+    The draft must be exported with its own module name and parameter scope.
+    """
     from iree.runtime._binding import disable_leak_checker  # type: ignore
 
     model_params = ModelParams.load_json(config_path)
+    draft_params = None
+    if draft_paths is not None:
+        draft_vmfb_path, draft_config_path, draft_gguf_path = draft_paths
+        draft_params = ModelParams.load_json(draft_config_path)
+        if draft_params.module_name == model_params.module_name:
+            raise ValueError(
+                f"Draft module name '{draft_params.module_name}' must differ from "
+                "the model's (export with --module-name)"
+            )
+        if draft_params.parameter_scope == model_params.parameter_scope:
+            raise ValueError(
+                f"Draft parameter scope '{draft_params.parameter_scope}' must "
+                "differ from the model's (export with --parameter-scope)"
+            )
 
     device_block_count = model_params.max_seq_len // model_params.block_seq_stride
     cache_params = CacheParams(
         model=model_params,
         device_block_count=device_block_count,
         block_pos_stride=model_params.block_seq_stride,
+        draft_model=draft_params,
     )
 
     disable_leak_checker()
-    session = DeviceSession(uri="local-sync", queue_count=2)
-    attn_block_cache = AttnBlockCache(session, cache_params)
-
-    lms = session.create_module_set(model_params.module_name, context_count=1)
-    lms.load_io_module(gguf_path)
-    lms.load_vmfb(vmfb_path)
-    lms.add(create_attn_block_cache_module(attn_block_cache))
-    lms.initialize()
-
-    params = ServiceParams(cache=cache_params, model=model_params)
-    service = GenerateServiceV1(session=session, params=params, cache=attn_block_cache)
-    return service
-
-
-def map_buffer(value):
-    mapped = value.map()
-    return mapped.asarray(value.shape, HalElementType.map_to_dtype(value.element_type))
+    group = DeviceSessionGroup(uris=device_uris, queue_count=2)
+    services = []
+    for session in group.sessions:
+        attn_block_cache = AttnBlockCache(session, cache_params)
+
+        lms = session.create_module_set(model_params.module_name, context_count=1)
+        if draft_params is None:
+            lms.load_io_module(gguf_path, model_params.parameter_scope)
+        else:
+            lms.load_io_module(
+                gguf_path,
+                model_params.parameter_scope,
+                (draft_gguf_path, draft_params.parameter_scope),
+            )
+            lms.load_vmfb(draft_vmfb_path)
+        lms.load_vmfb(vmfb_path)
+        lms.add(create_attn_block_cache_module(attn_block_cache))
+        lms.initialize()
+
+        params = ServiceParams(cache=cache_params, model=model_params)
+        services.append(
+            GenerateServiceV1(session=session, params=params, cache=attn_block_cache)
+        )
+    return services
+
+
+async def next_token(service, state, logits, seq_len: int) -> int:
+    """Selects the next token from a step's logits.
+
+    If the module can sample on the device and the step returned last-position
+    logits, only the token ids are read back. Otherwise the argmax is taken
+    over the logits of position `seq_len - 1` mapped to the host.
+    """
+    if service.sample_functions and logits.value.shape[1] == 1:
+        tokens = await state.sample(logits)
+        return int((await state.read_back(tokens, "sample"))[0, 0])
+    mapped_logits = await state.read_back(logits, "logits")
+    return int(numpy.argmax(mapped_logits[0, seq_len - 1], axis=-1))
 
 
 async def main(argv):
@@ -70,6 +124,11 @@ async def main(argv):
     parser.add_argument("--config", help="json config file with hyperparameters")
     parser.add_argument("--vmfb", help="vmfb with compiler LLM kernels")
     parser.add_argument("--gguf", help="gguf file containing modle coefficients")
+    parser.add_argument(
+        "--draft-vmfb", help="vmfb of a draft model to decode speculatively with"
+    )
+    parser.add_argument("--draft-config", help="json config file of the draft model")
+    parser.add_argument("--draft-gguf", help="parameter file of the draft model")
     parsed = parser.parse_args(argv)
 
     hf_path = parsed.tokenizer
@@ -77,7 +136,13 @@ async def main(argv):
     vmfb_path = parsed.vmfb
     gguf_path = parsed.gguf
 
-    service = setup(vmfb_path, config_path, gguf_path)
+    draft_paths = None
+    if parsed.draft_vmfb:
+        if not parsed.draft_config or not parsed.draft_gguf:
+            parser.error("--draft-vmfb requires --draft-config and --draft-gguf")
+        draft_paths = (parsed.draft_vmfb, parsed.draft_config, parsed.draft_gguf)
+
+    service = setup(vmfb_path, config_path, gguf_path, draft_paths)
     tokenizer = LlamaTokenizer.from_pretrained(hf_path)
     state = service.start()
 
@@ -93,22 +158,32 @@ async def main(argv):
         logits = await state.prefill()
 
         seq_len = len(input_ids)
-        mapped_logits = map_buffer(logits.value)
-        predicted_tokens = numpy.argmax(mapped_logits[0, :seq_len], axis=-1)
-        predicted_token = predicted_tokens[-1]
+        if service.params.model.prefill_last_logits:
+            seq_len = 1
+        predicted_token = await next_token(service, state, logits, seq_len)
         decoded_token = tokenizer.decode(predicted_token)
         print(f"Prefill predicted token: {predicted_token}, decoded: '{decoded_token}'")
 
         # TODO(scotttodd): sanity check tokenizer use, document inputs/outputs
         #   'prefill' is for initialization with multiple steps at once
         #   'decode' is for hypothesis exploration, one step at a time
-        await state.set_decode_step([predicted_token])
-        logits = await state.decode()
-        mapped_logits = map_buffer(logits.value)
-        predicted_tokens = numpy.argmax(mapped_logits, axis=-1)
-        predicted_token = predicted_tokens[0]
-        decoded_token = tokenizer.decode(predicted_token)
-        print(f"Decode predicted token: {predicted_token}, decoded: '{decoded_token}'")
+        if service.speculate_k > 0:
+            await state.set_speculative_step([predicted_token])
+            accepted_tokens = (await state.speculative_decode())[0]
+            decoded_tokens = tokenizer.decode(accepted_tokens)
+            print(
+                f"Speculative decode accepted tokens: {accepted_tokens}, "
+                f"decoded: '{decoded_tokens}'"
+            )
+        else:
+            await state.set_decode_step([predicted_token])
+            logits = await state.decode()
+            predicted_token = await next_token(service, state, logits, 1)
+            decoded_token = tokenizer.decode(predicted_token)
+            print(
+                f"Decode predicted token: {predicted_token}, "
+                f"decoded: '{decoded_token}'"
+            )
         await state.recycle()
 
     service.shutdown()
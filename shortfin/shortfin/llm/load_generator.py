@@ -0,0 +1,558 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Load generator and latency benchmark for LLM serving.
+
+Issues an open loop workload of requests (arrivals at a configurable rate,
+with prompt and output lengths drawn from distributions) and reports the
+time to first token (TTFT), inter-token latency (ITL), end-to-end latency
+and throughput percentiles.
+
+The workload can be driven against:
+
+* `--url`: a running `rest_server.py`, via `/generate` (streaming or not).
+* `--testing-mock-service`: the mock `GenerateService`, in-process.
+* `--vmfb/--config/--gguf`: a `GenerateServiceV1`, in-process, stepped with
+  continuous batching by the load generator itself. Comparing this with the
+  HTTP numbers separates the serving overhead from the cost of model steps.
+  With several `--device-uri`s, requests are dispatched across a service per
+  device.
+
+Usage:
+  python -m shortfin.llm.load_generator --url=http://localhost:8000 \\
+    --stream --request-count=200 --request-rate=4 --concurrency=16 \\
+    --prompt-len=uniform:32:512 --output-len=fixed:128 --output-json=out.json
+"""
+
+from typing import Optional, Sequence
+
+import argparse
+import asyncio
+from concurrent.futures import ThreadPoolExecutor
+from dataclasses import dataclass, field
+import json
+import math
+from pathlib import Path
+import random
+import statistics
+import sys
+import time
+
+from .service import (
+    GenerateRequest,
+    GenerateService,
+    create_mock_generate_service,
+)
+
+########################################################################################
+# Workload
+########################################################################################
+
+
+class LengthDistribution:
+    """Distribution of token lengths, parsed from a spec string.
+
+    * `fixed:N`
+    * `uniform:LOW:HIGH` (inclusive)
+    * `normal:MEAN:STDDEV` (clamped to at least 1)
+    """
+
+    def __init__(self, spec: str):
+        self.spec = spec
+        kind, *params = spec.split(":")
+        try:
+            values = [float(p) for p in params]
+        except ValueError:
+            raise ValueError(f"Illegal length distribution '{spec}'")
+        if kind == "fixed" and len(values) == 1:
+            self._sample = lambda rng: values[0]
+        elif kind == "uniform" and len(values) == 2:
+            self._sample = lambda rng: rng.randint(int(values[0]), int(values[1]))
+        elif kind == "normal" and len(values) == 2:
+            self._sample = lambda rng: rng.gauss(values[0], values[1])
+        else:
+            raise ValueError(f"Illegal length distribution '{spec}'")
+
+    def sample(self, rng: random.Random) -> int:
+        return max(1, int(round(self._sample(rng))))
+
+    def __repr__(self):
+        return f"LengthDistribution({self.spec})"
+
+
+@dataclass
+class LoadRequest:
+    """A request of the workload."""
+
+    index: int
+    # Seconds from the start of the run at which the request is issued.
+    arrival: float
+    prompt_len: int
+    output_len: int
+
+    @property
+    def request_id(self) -> str:
+        return f"load-{self.index}"
+
+    def prompt_text(self) -> str:
+        # Text prompts are measured in words, which is as close to tokens as
+        # we can get without the server's tokenizer.
+        return " ".join(["hello"] * self.prompt_len)
+
+    def prompt_token_ids(self) -> list[int]:
+        # Arbitrary ids, clear of the special tokens of common vocabularies.
+        rng = random.Random(self.index)
+        return [rng.randrange(100, 1000) for _ in range(self.prompt_len)]
+
+
+def create_workload(
+    request_count: int,
+    *,
+    request_rate: float,
+    prompt_len: LengthDistribution,
+    output_len: LengthDistribution,
+    seed: int = 0,
+) -> list[LoadRequest]:
+    """Creates requests arriving as a Poisson process of `request_rate` per
+    second. At an infinite rate, all requests arrive at once."""
+    rng = random.Random(seed)
+    requests = []
+    arrival = 0.0
+    for i in range(request_count):
+        requests.append(
+            LoadRequest(
+                index=i,
+                arrival=arrival,
+                prompt_len=prompt_len.sample(rng),
+                output_len=output_len.sample(rng),
+            )
+        )
+        if not math.isinf(request_rate):
+            arrival += rng.expovariate(request_rate)
+    return requests
+
+
+########################################################################################
+# Measurements
+########################################################################################
+
+
+@dataclass
+class RequestTiming:
+    """Times of a request, in seconds from the start of the run."""
+
+    request: LoadRequest
+    token_times: list[float] = field(default_factory=list)
+    end: Optional[float] = None
+    error: Optional[str] = None
+    # Number of generated tokens, if only the full response was observed. The
+    # single token time is then the end of the response, which is no TTFT.
+    token_count: Optional[int] = None
+
+    @property
+    def streamed(self) -> bool:
+        return self.token_count is None
+
+    @property
+    def output_tokens(self) -> int:
+        if self.token_count is not None:
+            return self.token_count
+        return len(self.token_times)
+
+    @property
+    def ttft(self) -> float:
+        return self.token_times[0] - self.request.arrival
+
+    @property
+    def itls(self) -> list[float]:
+        times = self.token_times
+        return [b - a for a, b in zip(times, times[1:])]
+
+    @property
+    def e2e(self) -> float:
+        assert self.end is not None
+        return self.end - self.request.arrival
+
+
+def percentiles(values: Sequence[float]) -> dict[str, Optional[float]]:
+    """Summarizes values (in seconds) as milliseconds."""
+    if not values:
+        return {"mean_ms": None, "p50_ms": None, "p90_ms": None, "p99_ms": None}
+    ordered = sorted(values)
+
+    def p(q: float) -> float:
+        # Nearest rank.
+        rank = max(0, math.ceil(q * len(ordered)) - 1)
+        return ordered[rank] * 1e3
+
+    return {
+        "mean_ms": statistics.mean(ordered) * 1e3,
+        "p50_ms": p(0.5),
+        "p90_ms": p(0.9),
+        "p99_ms": p(0.99),
+    }
+
+
+def summarize(timings: list[RequestTiming], duration: float) -> dict:
+    completed = [t for t in timings if t.error is None and t.token_times]
+    streamed = [t for t in completed if t.streamed]
+    output_tokens = sum(t.output_tokens for t in completed)
+    return {
+        "requests": len(timings),
+        "completed": len(completed),
+        "failed": len(timings) - len(completed),
+        "duration_s": duration,
+        "request_throughput": len(completed) / duration,
+        "output_token_throughput": output_tokens / duration,
+        "ttft": percentiles([t.ttft for t in streamed]),
+        "itl": percentiles([itl for t in streamed for itl in t.itls]),
+        "e2e_latency": percentiles([t.e2e for t in completed]),
+    }
+
+
+########################################################################################
+# HTTP driver
+########################################################################################
+
+
+def _http_request(
+    url: str, req: LoadRequest, timing: RequestTiming, start: float, stream: bool
+):
+    import requests
+
+    def now():
+        return time.perf_counter() - start
+
+    try:
+        body = {
+            "prompt": req.prompt_text(),
+            "max_tokens": req.output_len,
+            "stream": stream,
+        }
+        with requests.post(f"{url}/generate", json=body, stream=stream) as resp:
+            resp.raise_for_status()
+            if stream:
+                # Each response part is a JSON record terminated by a NUL.
+                pending = b""
+                for chunk in resp.iter_content(chunk_size=None):
+                    pending += chunk
+                    *records, pending = pending.split(b"\0")
+                    timing.token_times.extend(now() for _ in records)
+            else:
+                # Only the full response is observable, which is assumed to
+                # honor `max_tokens`.
+                resp.content
+                timing.token_times.append(now())
+                timing.token_count = req.output_len
+    except Exception as e:
+        timing.error = str(e)
+    timing.end = now()
+
+
+def run_http_load(
+    url: str, workload: list[LoadRequest], *, stream: bool, concurrency: int
+) -> tuple[list[RequestTiming], float]:
+    """Drives `/generate` of a REST server.
+
+    Requests that arrive while `concurrency` are in flight queue on the
+    client, which counts towards their latencies.
+    """
+    timings = [RequestTiming(req) for req in workload]
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=concurrency) as executor:
+        for req, timing in zip(workload, timings):
+            delay = req.arrival - (time.perf_counter() - start)
+            if delay > 0:
+                time.sleep(delay)
+            executor.submit(_http_request, url, req, timing, start, stream)
+    return timings, time.perf_counter() - start
+
+
+########################################################################################
+# In-process drivers
+########################################################################################
+
+
+async def _sleep_until(start: float, offset: float):
+    delay = offset - (time.perf_counter() - start)
+    if delay > 0:
+        await asyncio.sleep(delay)
+
+
+async def run_service_load(
+    service: GenerateService, workload: list[LoadRequest], *, concurrency: int
+) -> tuple[list[RequestTiming], float]:
+    """Drives `GenerateService.handle_request()`, counting each response part
+    as a token and stopping requests after their output length."""
+    timings = [RequestTiming(req) for req in workload]
+    semaphore = asyncio.Semaphore(concurrency)
+    start = time.perf_counter()
+
+    def now():
+        return time.perf_counter() - start
+
+    async def issue(req: LoadRequest, timing: RequestTiming):
+        await _sleep_until(start, req.arrival)
+        async with semaphore:
+            request = GenerateRequest(
+                request_id=req.request_id,
+                prompt=req.prompt_text(),
+                max_tokens=req.output_len,
+            )
+            try:
+                async for part in service.handle_request(request):
+                    timing.token_times.append(now())
+                    if len(timing.token_times) >= req.output_len:
+                        await service.abort(request.request_id)
+                        break
+            except Exception as e:
+                timing.error = str(e)
+            timing.end = now()
+
+    await asyncio.gather(*[issue(r, t) for r, t in zip(workload, timings)])
+    return timings, now()
+
+
+async def _read_tokens(service, state, logits, positions: list[int]) -> list[int]:
+    """Selects the next token of each row of a step's logits.
+
+    With sampling entry-points, tokens are sampled on the device. Otherwise
+    the argmax is taken at each row's position of the logits.
+    """
+    import numpy
+
+    if service.sample_functions and logits.value.shape[1] == 1:
+        tokens = await state.sample(logits)
+        tokens_host = await state.read_back(tokens, "sample")
+        return [int(tokens_host[i, 0]) for i in range(len(positions))]
+    logits_host = await state.read_back(logits, "logits")
+    last = logits_host.shape[1] - 1
+    return [
+        int(numpy.argmax(logits_host[i, min(pos, last)], axis=-1))
+        for i, pos in enumerate(positions)
+    ]
+
+
+async def run_batch_service_load(
+    services: list,
+    workload: list[LoadRequest],
+    *,
+    concurrency: Optional[int] = None,
+) -> tuple[list[RequestTiming], float]:
+    """Drives `GenerateServiceV1`s (one per device) with continuous batching.
+
+    Arrived requests are placed on the least loaded device by a
+    `BatchDispatcher`. Each device's scheduler admits the requests placed on
+    it up to the batch capacity (and `concurrency` sequences in flight, if
+    given) and prefills them between decode steps of its live batch.
+    Sequences retire once they have generated their output length. Prompts
+    are arbitrary token ids, so no tokenizer is involved.
+    """
+    from .impl.dispatcher import BatchDispatcher
+
+    timings = {req.request_id: RequestTiming(req) for req in workload}
+    generated: dict[str, list[int]] = {req.request_id: [] for req in workload}
+    arrivals = list(workload)
+    dispatcher = BatchDispatcher([service.start() for service in services])
+    start = time.perf_counter()
+    outstanding = len(workload)
+    # Wakes idle schedulers when requests are placed.
+    placed = asyncio.Event()
+
+    def now():
+        return time.perf_counter() - start
+
+    async def dispatch():
+        while arrivals:
+            await _sleep_until(start, arrivals[0].arrival)
+            while arrivals and arrivals[0].arrival <= now():
+                req = arrivals.pop(0)
+                dispatcher.place(
+                    GenerateRequest(
+                        request_id=req.request_id,
+                        prompt="",
+                        prompt_token_ids=req.prompt_token_ids(),
+                        max_tokens=req.output_len,
+                    )
+                )
+            placed.set()
+
+    async def schedule(index: int):
+        nonlocal outstanding
+        state = dispatcher.states[index]
+        service = state.service
+        while outstanding:
+            # Admit the requests placed on this device, as capacity allows.
+            limit = None
+            if concurrency is not None:
+                limit = concurrency - (
+                    len(state.requests) + len(state.pending_requests)
+                )
+            admit = dispatcher.take(index, limit)
+            if admit:
+                await state.add_sequences(admit)
+
+            if state.pending_requests:
+                rows = state.pending_requests
+                logits = await state.prefill()
+                # Prefill logits are at the last position of the prompt (plus
+                # the generated tokens of preempted sequences).
+                positions = [
+                    len(r.required_prompt_token_ids)
+                    + max(0, len(generated[r.request_id]) - 1)
+                    - 1
+                    for r in rows
+                ]
+            elif state.requests:
+                await state.set_decode_step(
+                    [generated[r.request_id][-1] for r in state.requests]
+                )
+                if not state.requests:
+                    # All live sequences were preempted.
+                    continue
+                rows = state.requests
+                logits = await state.decode()
+                positions = [0] * len(rows)
+            else:
+                placed.clear()
+                await placed.wait()
+                continue
+
+            tokens = await _read_tokens(service, state, logits, positions)
+            finished = []
+            for request, token in zip(rows, tokens):
+                timing = timings[request.request_id]
+                timing.token_times.append(now())
+                generated[request.request_id].append(token)
+                if len(timing.token_times) >= request.max_tokens:
+                    timing.end = now()
+                    finished.append(request.request_id)
+            if finished:
+                await state.retire_sequences(finished)
+                outstanding -= len(finished)
+                if not outstanding:
+                    # Wake the idle schedulers to exit.
+                    placed.set()
+        await state.recycle()
+
+    await asyncio.gather(
+        dispatch(), *[schedule(i) for i in range(len(dispatcher.states))]
+    )
+    return list(timings.values()), now()
+
+
+########################################################################################
+# CLI
+########################################################################################
+
+
+def main(clargs: Sequence[str]):
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("--url", help="URL of a running REST server")
+    target.add_argument(
+        "--testing-mock-service",
+        action="store_true",
+        help="Drive the mock testing service in-process",
+    )
+    target.add_argument(
+        "--vmfb", type=Path, help="Drive a GenerateServiceV1 of a vmfb in-process"
+    )
+    parser.add_argument("--config", type=Path, help="Model config of the --vmfb")
+    parser.add_argument("--gguf", type=Path, help="Parameters of the --vmfb")
+    parser.add_argument(
+        "--device-uri",
+        action="append",
+        help="Device to serve the --vmfb on (repeat to serve on several devices, "
+        "default: local-sync)",
+    )
+    parser.add_argument(
+        "--stream", action="store_true", help="Use streaming HTTP requests"
+    )
+    parser.add_argument("--request-count", type=int, default=100)
+    parser.add_argument(
+        "--request-rate",
+        type=float,
+        default=math.inf,
+        help="Mean requests per second (default: all at once)",
+    )
+    parser.add_argument(
+        "--concurrency",
+        type=int,
+        default=8,
+        help="Maximum requests in flight (with --vmfb, per device and capped by "
+        "its max batch size)",
+    )
+    parser.add_argument(
+        "--prompt-len",
+        type=LengthDistribution,
+        default=LengthDistribution("fixed:128"),
+        help="Prompt length distribution (fixed:N, uniform:LOW:HIGH, normal:MEAN:STD)",
+    )
+    parser.add_argument(
+        "--output-len",
+        type=LengthDistribution,
+        default=LengthDistribution("fixed:128"),
+        help="Output length distribution",
+    )
+    parser.add_argument("--seed", type=int, default=0)
+    parser.add_argument("--output-json", type=Path, help="Write the results to JSON")
+    args = parser.parse_args(clargs)
+
+    workload = create_workload(
+        args.request_count,
+        request_rate=args.request_rate,
+        prompt_len=args.prompt_len,
+        output_len=args.output_len,
+        seed=args.seed,
+    )
+    if args.url:
+        mode = "http-stream" if args.stream else "http"
+        timings, duration = run_http_load(
+            args.url, workload, stream=args.stream, concurrency=args.concurrency
+        )
+    elif args.testing_mock_service:
+        mode = "mock-service"
+        timings, duration = asyncio.run(
+            run_service_load(
+                create_mock_generate_service(),
+                workload,
+                concurrency=args.concurrency,
+            )
+        )
+    else:
+        from .impl.service_v1_cli import setup_devices
+
+        mode = "service-v1"
+        services = setup_devices(
+            args.vmfb, args.config, args.gguf, args.device_uri or ["local-sync"]
+        )
+        try:
+            timings, duration = asyncio.run(
+                run_batch_service_load(
+                    services, workload, concurrency=args.concurrency
+                )
+            )
+        finally:
+            for service in services:
+                service.shutdown()
+
+    summary = summarize(timings, duration)
+    summary["mode"] = mode
+    summary["workload"] = {
+        "request_rate": None if math.isinf(args.request_rate) else args.request_rate,
+        "concurrency": args.concurrency,
+        "prompt_len": args.prompt_len.spec,
+        "output_len": args.output_len.spec,
+        "seed": args.seed,
+    }
+    print(json.dumps(summary, indent=2))
+    if args.output_json is not None:
+        args.output_json.write_text(json.dumps(summary, indent=2))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -8,7 +8,7 @@ from typing import AsyncIterator, Callable, Optional
 
 from abc import abstractmethod, ABC
 import asyncio
-from dataclasses import dataclass
+from dataclasses import dataclass, field
 
 from ..framework.session import (
     HostContext,
@@ -19,6 +19,23 @@ from ..framework.session import (
 ########################################################################################
 
 
+@dataclass
+class SamplingParams:
+    """Parameters for sampling each next token of a request."""
+
+    # Softmax temperature. At 0, the most likely token is selected (greedy).
+    temperature: float = 0.0
+
+    # Number of most likely tokens to sample from (0 for all).
+    top_k: int = 0
+
+    # Smallest probability mass of the most likely tokens to sample from.
+    top_p: float = 1.0
+
+    # Seed of the request's random stream (None for a nondeterministic one).
+    seed: Optional[int] = None
+
+
 @dataclass
 class GenerateRequest:
     """Encapsulates a request to perform LLM generation.
@@ -34,6 +51,12 @@ class GenerateRequest:
     # Fields that are set as the request is processed.
     prompt_token_ids: Optional[list[int]] = None
 
+    # How next tokens are sampled (when sampled on the device).
+    sampling: SamplingParams = field(default_factory=SamplingParams)
+
+    # Maximum number of tokens to generate (None for the service's default).
+    max_tokens: Optional[int] = None
+
     @property
     def required_prompt_token_ids(self) -> list[int]:
         ids = self.prompt_token_ids
@@ -162,7 +185,8 @@ class DummyTokenizerService(SyncGenerateFilter):
 class EchoGenerateService(GenerateService):
     """Dummy implementation of a generate service.
 
-    It just echoes back the request five times after a delay.
+    It just echoes back the request five times (or `max_tokens` times) after a
+    delay.
     """
 
     def __init__(self, delay: float = 0.1):
@@ -173,7 +197,8 @@ class EchoGenerateService(GenerateService):
         request: GenerateRequest,
     ) -> AsyncIterator[GenerateResponsePart]:
         next = None
-        for i in range(5):
+        count = 5 if request.max_tokens is None else request.max_tokens
+        for i in range(count):
             if next:
                 yield next
             assert request.prompt_token_ids, "Request lacks prompt tokens"
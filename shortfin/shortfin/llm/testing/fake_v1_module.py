@@ -6,13 +6,19 @@
 
 """Implements a service_v1 compliant module in Python for testing.
 
-This uses a PyModuleInterface to define a fake VmModule that exposes 'prefill_bs{n}'
-and 'decode_bs{n}' such that the call sequence and args/results can be manipulated.
+This uses a PyModuleInterface to define a fake VmModule that exposes 'prefill_bs{n}',
+'decode_bs{n}', 'prefill_chunk_bs{n}', 'sample_bs{n}' and 'verify_bs{n}' such that
+the call sequence and args/results can be manipulated. If the model params have a
+dynamic batch size, '{name}_bs_dyn' variants are also exported, which take the batch
+size from their first input. If the model params request async invocations, the
+entry-points are instead exported as '{name}$async' variants taking trailing wait
+and signal fences.
 """
 
 import numpy as np
 import textwrap
 import threading
+from typing import Optional
 
 from iree.runtime import (  # type: ignore
     BufferUsage,
@@ -45,33 +51,76 @@ def create_fake_module(
             seq_lens_ref: VmRef,
             attn_block_indices_ref: VmRef,
             attn_block_buffer_view: VmRef,
+            wait_fence_ref: Optional[VmRef] = None,
+            signal_fence_ref: Optional[VmRef] = None,
         ):
-            result_array: np.ndarray = np.ndarray([bs, 1], dtype=np.int32)
+            return self._fake_tokens(
+                f"PREFILL bs={bs}",
+                bs,
+                wait_fence_ref,
+                signal_fence_ref,
+                token_ids=token_ids_ref,
+                seq_lens=seq_lens_ref,
+                attn_block_indices=attn_block_indices_ref,
+                attn_block_buffer_view=attn_block_buffer_view,
+            )
+
+        def prefill_chunk(
+            self,
+            bs: int,
+            token_ids_ref: VmRef,
+            start_positions_ref: VmRef,
+            seq_lens_ref: VmRef,
+            attn_block_indices_ref: VmRef,
+            attn_block_buffer_view: VmRef,
+            wait_fence_ref: Optional[VmRef] = None,
+            signal_fence_ref: Optional[VmRef] = None,
+        ):
+            return self._fake_tokens(
+                f"PREFILL_CHUNK bs={bs}",
+                bs,
+                wait_fence_ref,
+                signal_fence_ref,
+                token_ids=token_ids_ref,
+                start_positions=start_positions_ref,
+                seq_lens=seq_lens_ref,
+                attn_block_indices=attn_block_indices_ref,
+                attn_block_buffer_view=attn_block_buffer_view,
+            )
+
+        def _fake_tokens(
+            self,
+            label: str,
+            bs: int,
+            wait_fence_ref: Optional[VmRef],
+            signal_fence_ref: Optional[VmRef],
+            *,
+            width: int = 1,
+            **arg_refs: VmRef,
+        ):
+            # Row i produces token i + 1 at its first two positions and 100 + j
+            # at any later position j.
+            result_array: np.ndarray = np.ndarray([bs, width], dtype=np.int32)
 
             def run():
-                print(f"FAKE_V1_MODULE: PREFILL bs={bs} : WAIT")
+                print(f"FAKE_V1_MODULE: {label} : WAIT")
+                if wait_fence_ref is not None:
+                    wait_fence_ref.deref(HalFence).wait()
                 print("  - READY")
-                _format_device_buffer_view(
-                    lambda s: print("  token_ids =", s), token_ids_ref
-                )
-                _format_device_buffer_view(
-                    lambda s: print("  seq_lens =", s), seq_lens_ref
-                )
-                _format_device_buffer_view(
-                    lambda s: print("  attn_block_indices =", s),
-                    attn_block_indices_ref,
-                )
-                _format_device_buffer_view(
-                    lambda s: print("  attn_block_buffer_view =", s),
-                    attn_block_buffer_view,
-                )
+                for arg_name, arg_ref in arg_refs.items():
+                    _format_device_buffer_view(
+                        lambda s: print(f"  {arg_name} =", s), arg_ref
+                    )
 
                 # Async populate.
                 device_array = result_bv.map().asarray(
                     result_array.shape, result_array.dtype
                 )
                 for i in range(bs):
-                    device_array[i, 0] = i + 1
+                    for j in range(width):
+                        device_array[i, j] = i + 1 if j < 2 else 100 + j
+                if signal_fence_ref is not None:
+                    signal_fence_ref.deref(HalFence).signal()
 
             threading.Thread(target=run).start()
 
@@ -85,28 +134,153 @@ def create_fake_module(
             )
             return result_bv.ref
 
-        def decode(self, bs: int):
-            print(f"FAKE_V1_MODULE: DECODE bs={bs}")
+        def sample(
+            self,
+            bs: int,
+            logits_ref: VmRef,
+            temperature_ref: VmRef,
+            top_k_ref: VmRef,
+            top_p_ref: VmRef,
+            uniform_ref: VmRef,
+            wait_fence_ref: Optional[VmRef] = None,
+            signal_fence_ref: Optional[VmRef] = None,
+        ):
+            # The fake "logits" are token ids (see `_fake_tokens`), which are
+            # sampled as-is.
+            logits_bv = logits_ref.deref(HalBufferView)
+            result_buffer = device.allocator.allocate_buffer(
+                memory_type=MemoryType.DEVICE_LOCAL | MemoryType.HOST_VISIBLE,
+                allowed_usage=BufferUsage.DEFAULT,
+                allocation_size=bs * 8,
+            )
+            result_bv = HalBufferView(result_buffer, [bs, 1], HalElementType.SINT_64)
+
+            def run():
+                print(f"FAKE_V1_MODULE: SAMPLE bs={bs} : WAIT")
+                if wait_fence_ref is not None:
+                    wait_fence_ref.deref(HalFence).wait()
+                print("  - READY")
+                for arg_name, arg_ref in [
+                    ("temperature", temperature_ref),
+                    ("top_k", top_k_ref),
+                    ("top_p", top_p_ref),
+                    ("uniform", uniform_ref),
+                ]:
+                    _format_device_buffer_view(
+                        lambda s: print(f"  {arg_name} =", s), arg_ref
+                    )
+                logits = logits_bv.map().asarray(
+                    [bs, 1], HalElementType.map_to_dtype(logits_bv.element_type)
+                )
+                result_bv.map().asarray([bs, 1], np.int64)[...] = logits
+                if signal_fence_ref is not None:
+                    signal_fence_ref.deref(HalFence).signal()
+
+            threading.Thread(target=run).start()
+            return result_bv.ref
+
+        def decode(
+            self,
+            bs: int,
+            token_ids_ref: VmRef,
+            seq_lens_ref: VmRef,
+            start_positions_ref: VmRef,
+            attn_block_indices_ref: VmRef,
+            attn_block_buffer_view: VmRef,
+            wait_fence_ref: Optional[VmRef] = None,
+            signal_fence_ref: Optional[VmRef] = None,
+        ):
+            return self._fake_tokens(
+                f"DECODE bs={bs}",
+                bs,
+                wait_fence_ref,
+                signal_fence_ref,
+                token_ids=token_ids_ref,
+                seq_lens=seq_lens_ref,
+                start_positions=start_positions_ref,
+                attn_block_indices=attn_block_indices_ref,
+                attn_block_buffer_view=attn_block_buffer_view,
+            )
+
+        def verify(
+            self,
+            bs: int,
+            token_ids_ref: VmRef,
+            start_positions_ref: VmRef,
+            seq_lens_ref: VmRef,
+            attn_block_indices_ref: VmRef,
+            attn_block_buffer_view: VmRef,
+            wait_fence_ref: Optional[VmRef] = None,
+            signal_fence_ref: Optional[VmRef] = None,
+        ):
+            return self._fake_tokens(
+                f"VERIFY bs={bs}",
+                bs,
+                wait_fence_ref,
+                signal_fence_ref,
+                width=model_params.verify_chunk_len,
+                token_ids=token_ids_ref,
+                start_positions=start_positions_ref,
+                seq_lens=seq_lens_ref,
+                attn_block_indices=attn_block_indices_ref,
+                attn_block_buffer_view=attn_block_buffer_view,
+            )
 
     iface = PyModuleInterface(module_name=module_name, ctor=ServiceV1Module)
+    # Async variants take a wait and a signal fence after their inputs.
+    suffix, fence_sig = "", ""
+    if model_params.async_invocations:
+        suffix, fence_sig = "$async", "rr"
 
-    # Dynamically define prefill functions.
-    def add_prefill_bs(bs: int):
-        def trampoline(self, *args):
-            return self.prefill(bs, *args)
+    def add_batch_functions(name: str, method, batch_sizes: list[int], sig: str):
+        """Exports "{name}_bs{n}" for each batch size and "{name}_bs_dyn" if the
+        model has a dynamic batch size."""
 
-        iface.export(f"prefill_bs{bs}", "0rrrr_r", trampoline)
+        def add_bs(bs: int):
+            def trampoline(self, *args):
+                return method(self, bs, *args)
 
-    [add_prefill_bs(bs) for bs in model_params.prefill_batch_sizes]
+            iface.export(f"{name}_bs{bs}{suffix}", f"{sig}{fence_sig}_r", trampoline)
+
+        [add_bs(bs) for bs in batch_sizes]
+
+        def dynamic_trampoline(self, *args):
+            bs = args[0].deref(HalBufferView).shape[0]
+            return method(self, bs, *args)
+
+        if model_params.dynamic_batch_size > 0:
+            iface.export(
+                f"{name}_bs_dyn{suffix}", f"{sig}{fence_sig}_r", dynamic_trampoline
+            )
+
+    # Dynamically define prefill functions.
+    add_batch_functions(
+        "prefill", ServiceV1Module.prefill, model_params.prefill_batch_sizes, "0rrrr"
+    )
 
     # Dynamically define decode functions.
-    def add_decode_bs(bs: int):
-        def trampoline(self, *args):
-            return self.decode(bs, *args)
+    add_batch_functions(
+        "decode", ServiceV1Module.decode, model_params.decode_batch_sizes, "0rrrrr"
+    )
+
+    # Dynamically define chunked prefill functions.
+    add_batch_functions(
+        "prefill_chunk",
+        ServiceV1Module.prefill_chunk,
+        model_params.prefill_chunk_batch_sizes,
+        "0rrrrr",
+    )
 
-        iface.export(f"decode_bs{bs}", "0v_v", trampoline)
+    # Dynamically define sampling functions.
+    add_batch_functions(
+        "sample", ServiceV1Module.sample, model_params.decode_batch_sizes, "0rrrrr"
+    )
 
-    [add_decode_bs(bs) for bs in model_params.decode_batch_sizes]
+    # Dynamically define speculative verification functions, if enabled.
+    if model_params.verify_chunk_len > 0:
+        add_batch_functions(
+            "verify", ServiceV1Module.verify, model_params.decode_batch_sizes, "0rrrrr"
+        )
 
     return iface.create()
 
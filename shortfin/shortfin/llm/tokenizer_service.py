@@ -0,0 +1,191 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+"""Tokenization of requests on a worker pool.
+
+Tokenizing long prompts takes long enough to stall any event loop which runs
+it inline (delaying the scheduling of decode steps). The `TokenizerPool` runs
+the tokenizer on worker threads instead, coalescing the calls made during an
+iteration of the event loop into batched calls, and the `TokenizerService`
+uses it to tokenize requests and incrementally detokenize their response
+parts.
+"""
+
+from typing import AsyncIterator, Callable, Generic, TypeVar
+
+import asyncio
+import concurrent.futures
+
+from sharktank.utils.tokenizer import IncrementalDetokenizer, InferenceTokenizer
+
+from ..framework.metrics import REGISTRY
+
+from .service import (
+    GenerateRequest,
+    GenerateResponsePart,
+    GenerateService,
+)
+
+__all__ = [
+    "TokenizerPool",
+    "TokenizerService",
+]
+
+BATCH_SIZE = REGISTRY.histogram(
+    "shortfin_llm_tokenizer_batch_size",
+    "Calls coalesced into each batched tokenizer call",
+    ["op"],
+    buckets=(1, 2, 4, 8, 16, 32, 64),
+)
+BATCH_SECONDS = REGISTRY.histogram(
+    "shortfin_llm_tokenizer_batch_seconds",
+    "Seconds spent in each batched tokenizer call",
+    ["op"],
+)
+
+InputT = TypeVar("InputT")
+ResultT = TypeVar("ResultT")
+
+
+class _Batcher(Generic[InputT, ResultT]):
+    """Coalesces calls into batched calls of a function on an executor.
+
+    A batch starts with the first call made while none is pending and is
+    submitted once the event loop has run the callbacks already scheduled, so
+    that calls made by concurrently ready tasks join it (up to
+    `max_batch_size`).
+    """
+
+    def __init__(
+        self,
+        op: str,
+        function: Callable[[list[InputT]], list[ResultT]],
+        executor: concurrent.futures.Executor,
+        max_batch_size: int,
+    ):
+        self._op = op
+        self._function = function
+        self._executor = executor
+        self._max_batch_size = max_batch_size
+        self._inputs: list[InputT] = []
+        self._futures: list[asyncio.Future] = []
+
+    def __call__(self, value: InputT) -> "asyncio.Future[ResultT]":
+        loop = asyncio.get_running_loop()
+        future = loop.create_future()
+        if not self._inputs:
+            loop.call_soon(self._submit, loop)
+        self._inputs.append(value)
+        self._futures.append(future)
+        if len(self._inputs) >= self._max_batch_size:
+            self._submit(loop)
+        return future
+
+    def _submit(self, loop: asyncio.AbstractEventLoop):
+        inputs, futures = self._inputs, self._futures
+        if not inputs:
+            return
+        self._inputs, self._futures = [], []
+        BATCH_SIZE.labels(op=self._op).observe(len(inputs))
+
+        def run():
+            with BATCH_SECONDS.labels(op=self._op).time():
+                return self._function(inputs)
+
+        def resolve(batch: "asyncio.Future[list[ResultT]]"):
+            exc = batch.exception()
+            for i, future in enumerate(futures):
+                if future.cancelled():
+                    continue
+                if exc is not None:
+                    future.set_exception(exc)
+                else:
+                    future.set_result(batch.result()[i])
+
+        loop.run_in_executor(self._executor, run).add_done_callback(resolve)
+
+
+class TokenizerPool:
+    """Runs batched tokenizer calls on worker threads.
+
+    Calls must be made from a single event loop (i.e. the server's).
+    """
+
+    def __init__(
+        self,
+        tokenizer: InferenceTokenizer,
+        *,
+        max_workers: int = 2,
+        max_batch_size: int = 32,
+    ):
+        self.tokenizer = tokenizer
+        self._executor = concurrent.futures.ThreadPoolExecutor(
+            max_workers=max_workers, thread_name_prefix="tokenizer"
+        )
+        self._encode = _Batcher(
+            "encode", tokenizer.encode_rows, self._executor, max_batch_size
+        )
+        self._decode = _Batcher(
+            "decode", tokenizer.decode, self._executor, max_batch_size
+        )
+
+    async def encode(self, text: str) -> list[int]:
+        """Encodes a text into (unpadded) tokens."""
+        return await self._encode(text)
+
+    async def decode(self, token_ids: list[int]) -> str:
+        """Decodes tokens into text."""
+        return await self._decode(token_ids)
+
+    async def detokenize(
+        self,
+        detokenizer: IncrementalDetokenizer,
+        token_ids: list[int],
+        final: bool = False,
+    ) -> str:
+        """Appends new tokens to an incremental detokenizer, returning their
+        text."""
+        prefix_ids, ids = detokenizer.add_tokens(token_ids)
+        prefix_text, text = await asyncio.gather(
+            self.decode(prefix_ids), self.decode(ids)
+        )
+        return detokenizer.commit(prefix_text, text, final)
+
+    def shutdown(self):
+        self._executor.shutdown(wait=True)
+
+
+class TokenizerService(GenerateService):
+    """GenerateService filter which tokenizes on a TokenizerPool.
+
+    The text of each response part is that of its tokens, detokenized
+    incrementally after the tokens of the prompt and previous parts.
+    """
+
+    __slots__ = ["_next", "pool"]
+
+    def __init__(self, next: GenerateService, pool: TokenizerPool):
+        self._next = next
+        self.pool = pool
+
+    async def handle_request(
+        self,
+        request: GenerateRequest,
+    ) -> AsyncIterator[GenerateResponsePart]:
+        pool = self.pool
+        if request.prompt_token_ids is None:
+            request.prompt_token_ids = await pool.encode(request.prompt)
+        detokenizer = IncrementalDetokenizer(request.prompt_token_ids)
+        async for part in self._next.handle_request(request):
+            if part.text is None:
+                part.text = await pool.detokenize(
+                    detokenizer, part.token_ids, final=part.finished
+                )
+            yield part
+
+    async def abort(self, request_id: str) -> None:
+        """Aborts a submitted request."""
+        await self._next.abort(request_id)
@@ -8,6 +8,7 @@ import pytest
 
 from shortfin.framework.session import (
     DeviceSession,
+    DeviceSessionGroup,
 )
 
 
@@ -61,3 +62,19 @@ def test_host_context_scheduling(local_device_session: DeviceSession):
     print("[main] Waiting on semaphore payload 3")
     with pytest.raises(Exception, match="Fail from task2"):
         sem.wait(3)
+
+
+def test_device_session_group():
+    group = DeviceSessionGroup(uris=["local-task", "local-task"], queue_count=2)
+    try:
+        assert len(group) == 2
+        assert group[0].device is not group[1].device
+        # Sessions share the process' host-side mappings.
+        assert group[0].host_mappings is group[1].host_mappings
+        module_sets = group.create_module_sets("default")
+        assert [ms.session for ms in module_sets] == group.sessions
+        for ms in module_sets:
+            ms.initialize()
+        assert group[0].queues[1].outstanding_steps == 0
+    finally:
+        group.shutdown()
@@ -0,0 +1,82 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import pytest
+
+from shortfin.framework.metrics import (
+    MetricsRegistry,
+    WeakInstanceSet,
+)
+
+
+def test_counter_render():
+    registry = MetricsRegistry()
+    c = registry.counter("test_total", "A test counter", ["kind"])
+    c.labels(kind="a").inc()
+    c.labels(kind="a").inc(2)
+    c.labels(kind="b").inc()
+    assert registry.render().splitlines() == [
+        "# HELP test_total A test counter",
+        "# TYPE test_total counter",
+        'test_total{kind="a"} 3',
+        'test_total{kind="b"} 1',
+    ]
+
+
+def test_registry_get_or_create():
+    registry = MetricsRegistry()
+    c = registry.counter("test_total", "A test counter")
+    assert registry.counter("test_total", "A test counter") is c
+    with pytest.raises(AssertionError):
+        registry.gauge("test_total", "A test gauge")
+    with pytest.raises(AssertionError):
+        c.labels(kind="a")
+
+
+def test_gauge_function():
+    registry = MetricsRegistry()
+    g = registry.gauge("test_value", "A test gauge", ["state"])
+    g.labels(state="set").set(4)
+    g.labels(state="set").dec()
+    values = [1.5]
+    g.labels(state="read").set_function(lambda: values[0])
+    values[0] = 2.5
+    lines = registry.render().splitlines()
+    assert 'test_value{state="set"} 3' in lines
+    assert 'test_value{state="read"} 2.5' in lines
+
+
+def test_gauge_sums_weak_instances():
+    class Holder:
+        def __init__(self, count):
+            self.count = count
+
+    registry = MetricsRegistry()
+    g = registry.gauge("test_items", "A test gauge")
+    holders = WeakInstanceSet()
+    g.set_function(holders.sum(lambda holder: holder.count))
+    first, second = Holder(2), Holder(3)
+    holders.add(first)
+    holders.add(second)
+    assert "test_items 5" in registry.render().splitlines()
+    # Holders are not kept alive by the gauge.
+    del second
+    assert "test_items 2" in registry.render().splitlines()
+
+
+def test_histogram_buckets():
+    registry = MetricsRegistry()
+    h = registry.histogram("test_seconds", "A test histogram", buckets=(0.5, 1.0))
+    h.observe(0.25)
+    h.observe(1.0)
+    h.observe(3.0)
+    assert registry.render().splitlines()[2:] == [
+        'test_seconds_bucket{le="0.5"} 1',
+        'test_seconds_bucket{le="1"} 2',
+        'test_seconds_bucket{le="+Inf"} 3',
+        "test_seconds_sum 4.25",
+        "test_seconds_count 3",
+    ]
@@ -108,3 +108,14 @@ def test_generate_streaming(server: ServerRunner):
     assert (
         full_contents == expected_contents
     ), f"Expected {expected_contents!r} vs {full_contents!r}"
+
+
+def test_metrics(server: ServerRunner):
+    requests.post(f"{server.url}/generate", json={"prompt": "Hi"}).raise_for_status()
+    resp = requests.get(f"{server.url}/metrics")
+    resp.raise_for_status()
+    assert resp.headers["content-type"].startswith("text/plain")
+    lines = resp.text.splitlines()
+    assert "# TYPE shortfin_llm_requests_total counter" in lines
+    assert 'shortfin_llm_requests_total{stream="false"} 1' in lines
+    assert "shortfin_llm_requests_in_flight 0" in lines
@@ -0,0 +1,110 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import asyncio
+import math
+import random
+
+import pytest
+
+from shortfin.llm.load_generator import (
+    LengthDistribution,
+    RequestTiming,
+    create_workload,
+    percentiles,
+    run_service_load,
+    summarize,
+)
+from shortfin.llm.service import DummyTokenizerService, EchoGenerateService
+
+
+def test_length_distributions():
+    rng = random.Random(0)
+    assert LengthDistribution("fixed:7").sample(rng) == 7
+    for _ in range(100):
+        assert 3 <= LengthDistribution("uniform:3:5").sample(rng) <= 5
+        assert LengthDistribution("normal:1:10").sample(rng) >= 1
+    with pytest.raises(ValueError):
+        LengthDistribution("poisson:3")
+    with pytest.raises(ValueError):
+        LengthDistribution("uniform:3")
+
+
+def test_workload_arrivals():
+    kwargs = dict(
+        prompt_len=LengthDistribution("fixed:4"),
+        output_len=LengthDistribution("fixed:2"),
+    )
+    burst = create_workload(10, request_rate=math.inf, **kwargs)
+    assert [r.arrival for r in burst] == [0.0] * 10
+    paced = create_workload(1000, request_rate=100.0, **kwargs)
+    arrivals = [r.arrival for r in paced]
+    assert arrivals == sorted(arrivals)
+    # About 10s of arrivals at 100/s.
+    assert 8.0 < arrivals[-1] < 12.0
+
+
+def test_percentiles():
+    p = percentiles([i / 1000 for i in range(1, 101)])
+    assert p["p50_ms"] == pytest.approx(50.0)
+    assert p["p90_ms"] == pytest.approx(90.0)
+    assert p["p99_ms"] == pytest.approx(99.0)
+    assert p["mean_ms"] == pytest.approx(50.5)
+    assert percentiles([])["p50_ms"] is None
+
+
+def test_summarize_skips_failures():
+    (req,) = create_workload(
+        1,
+        request_rate=math.inf,
+        prompt_len=LengthDistribution("fixed:1"),
+        output_len=LengthDistribution("fixed:3"),
+    )
+    ok = RequestTiming(req, token_times=[0.1, 0.2, 0.4], end=0.4)
+    failed = RequestTiming(req, error="boom", end=0.1)
+    summary = summarize([ok, failed], duration=1.0)
+    assert summary["completed"] == 1
+    assert summary["failed"] == 1
+    assert summary["output_token_throughput"] == pytest.approx(3.0)
+    assert summary["ttft"]["p50_ms"] == pytest.approx(100.0)
+    assert summary["itl"]["p99_ms"] == pytest.approx(200.0)
+
+
+def test_summarize_skips_ttft_of_unstreamed():
+    (req,) = create_workload(
+        1,
+        request_rate=math.inf,
+        prompt_len=LengthDistribution("fixed:1"),
+        output_len=LengthDistribution("fixed:3"),
+    )
+    # Only the end of a non-streamed response is observed.
+    unstreamed = RequestTiming(req, token_times=[0.4], end=0.4, token_count=3)
+    summary = summarize([unstreamed], duration=1.0)
+    assert summary["completed"] == 1
+    assert summary["output_token_throughput"] == pytest.approx(3.0)
+    assert summary["ttft"]["p50_ms"] is None
+    assert summary["e2e_latency"]["p50_ms"] == pytest.approx(400.0)
+
+
+def test_mock_service_load():
+    workload = create_workload(
+        8,
+        request_rate=math.inf,
+        prompt_len=LengthDistribution("fixed:2"),
+        output_len=LengthDistribution("uniform:1:4"),
+    )
+    service = DummyTokenizerService(EchoGenerateService(delay=0.01))
+    timings, duration = asyncio.run(
+        run_service_load(service, workload, concurrency=4)
+    )
+    for t in timings:
+        assert t.error is None
+        assert len(t.token_times) == t.request.output_len
+        assert t.ttft > 0.0
+    summary = summarize(timings, duration)
+    assert summary["completed"] == 8
+    # Concurrency queues the second half of the burst behind the first.
+    assert max(t.ttft for t in timings) > min(t.e2e for t in timings)
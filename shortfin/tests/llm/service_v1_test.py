@@ -4,13 +4,16 @@
 # See https://llvm.org/LICENSE.txt for license information.
 # SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+import asyncio
+import dataclasses
+import numpy as np
 import pytest
 
 from iree.runtime import (  # type: ignore
     HalElementType,
 )
 
-from shortfin.framework.session import DeviceSession
+from shortfin.framework.session import DeviceSession, DeviceSessionGroup
 from shortfin.llm.config import (
     CacheParams,
     ModelParams,
@@ -20,13 +23,17 @@ from shortfin.llm.config import (
 from shortfin.llm.service import (
     GenerateRequest,
     GenerateResponsePart,
+    SamplingParams,
 )
 
 from shortfin.llm.attn_block_cache import (
     create_attn_block_cache_module,
     AttnBlockCache,
+    AttnBlocksUnavailableError,
+    KV_TRANSFERRED_BLOCKS_TOTAL,
 )
 
+from shortfin.llm.impl.dispatcher import BatchDispatcher
 from shortfin.llm.impl.service_v1 import (
     GenerateServiceV1,
 )
@@ -54,6 +61,7 @@ def model_params() -> ModelParams:
         block_seq_stride=16,
         prefill_batch_sizes=[1, 4, 16],
         decode_batch_sizes=[1, 4, 16],
+        prefill_chunk_batch_sizes=[1, 4, 16],
     )
 
 
@@ -129,3 +137,618 @@ def test_single(service: GenerateServiceV1):
         await state.recycle()
 
     state.host_context.run_sync(task())
+
+
+def test_continuous_admit_retire(service: GenerateServiceV1):
+    state = service.start()
+
+    async def task():
+        await state.set_sequences(
+            requests=[
+                GenerateRequest("1", "hello", [3, 4, 5, 12, 23]),
+                GenerateRequest("2", "goodbye", [9, 10]),
+            ]
+        )
+        assert [r.request_id for r in state.pending_requests] == ["1", "2"]
+        guarded_outputs = await state.prefill()
+        await guarded_outputs.resolve(state.host_context)
+        assert not state.pending_requests
+        assert [r.request_id for r in state.requests] == ["1", "2"]
+
+        # Admit a new sequence into the in-flight batch and prefill only it.
+        free_blocks = len(service.cache.attn_block_free)
+        await state.add_sequences([GenerateRequest("3", "again", [7, 8, 9])])
+        assert [r.request_id for r in state.pending_requests] == ["3"]
+        guarded_outputs = await state.prefill()
+        prefill_ids = await guarded_outputs.resolve(state.host_context)
+        assert prefill_ids.shape[0] == 1
+        assert [r.request_id for r in state.requests] == ["1", "2", "3"]
+
+        # Retire a finished sequence and verify its blocks are released.
+        await state.retire_sequences(["1"])
+        assert [r.request_id for r in state.requests] == ["2", "3"]
+        assert len(service.cache.attn_block_free) == free_blocks
+        await state.recycle()
+
+    state.host_context.run_sync(task())
+
+
+def test_prefix_cache_share_and_evict(attn_block_cache: AttnBlockCache):
+    cache = attn_block_cache
+    block_count = len(cache.attn_block_entries)
+    prompt = list(range(40))  # 2 whole blocks + a partial block of 8 positions.
+
+    async def task():
+        # First sequence populates 3 blocks and publishes its 2 whole blocks.
+        blocks = []
+        assert cache.match_prefix(prompt) == []
+        await cache.acquire_attn_blocks(3, blocks)
+        cache.publish_prefix(prompt, blocks)
+
+        # A second sequence with the same prefix shares them.
+        shared = cache.match_prefix(prompt[0:32] + [99, 98])
+        assert [b.index for b in shared] == [b.index for b in blocks[0:2]]
+        assert all(b.ref_count == 2 for b in shared)
+
+        # A diverging prefix only shares the first block.
+        diverged = cache.match_prefix(prompt[0:16] + [77] * 20)
+        assert [b.index for b in diverged] == [blocks[0].index]
+
+        # Releasing everything keeps the published blocks cached.
+        await cache.release_attn_blocks(blocks + shared + diverged)
+        assert cache.cached_block_count == 2
+        assert len(cache.attn_block_free) == block_count - 2
+
+        # Exhausting the free list evicts cached blocks, leaf first.
+        all_blocks = []
+        await cache.acquire_attn_blocks(block_count - 1, all_blocks)
+        assert cache.cached_block_count == 1
+        assert [b.index for b in cache.match_prefix(prompt)] == [blocks[0].index]
+
+    asyncio.run(task())
+
+
+def test_prefix_cache_concurrent_overlapping_prompts(
+    attn_block_cache: AttnBlockCache,
+):
+    cache = attn_block_cache
+    block_count = len(cache.attn_block_entries)
+    short_prompt = list(range(40))  # 2 whole blocks + 8 positions.
+    long_prompt = list(range(72))  # 4 whole blocks + 8 positions.
+
+    async def task():
+        # Both are prefilled before either publishes, so neither matches.
+        assert cache.match_prefix(short_prompt) == []
+        assert cache.match_prefix(long_prompt) == []
+        short_blocks, long_blocks = [], []
+        await cache.acquire_attn_blocks(3, short_blocks)
+        await cache.acquire_attn_blocks(5, long_blocks)
+        cache.publish_prefix(short_prompt, short_blocks)
+        cache.publish_prefix(long_prompt, long_blocks)
+
+        # The long prompt's private blocks are not published under the short
+        # prompt's.
+        assert all(b.prefix_node is None for b in long_blocks)
+        assert [b.index for b in cache.match_prefix(long_prompt)] == [
+            b.index for b in short_blocks[0:2]
+        ]
+        await cache.release_attn_blocks(short_blocks[0:2])
+
+        # Retiring the short prompt leaves its published blocks evictable.
+        await cache.release_attn_blocks(short_blocks)
+        assert cache.cached_block_count == 2
+        available = []
+        await cache.acquire_attn_blocks(cache.available_block_count, available)
+        assert cache.cached_block_count == 0
+
+        await cache.release_attn_blocks(long_blocks + available)
+        all_blocks = []
+        await cache.acquire_attn_blocks(block_count, all_blocks)
+
+    asyncio.run(task())
+
+
+def test_quantized_cache_state(
+    uninitialized_session: DeviceSession, model_params: ModelParams
+):
+    model_params.attn_dtype = HalElementType.INT_8
+    model_params.attn_scale_dtype = HalElementType.FLOAT_32
+    cache_params = CacheParams(
+        model=model_params, device_block_count=8, block_pos_stride=16
+    )
+    cache = AttnBlockCache(uninitialized_session, cache_params)
+    slab, scales = cache.cache_state_buffer_views
+    assert list(slab.shape) == [8, cache_params.attn_block_size_elements]
+    assert list(scales.shape) == [8, 32 * 2 * 32]
+
+
+def _create_fake_service(
+    session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+    **kwargs,
+) -> GenerateServiceV1:
+    """Creates a service for model params customized by the test."""
+    cache = AttnBlockCache(session, cache_params)
+    lms = session.create_module_set("AwesomeLLM", context_count=1)
+    lms.add(
+        create_attn_block_cache_module(cache),
+        create_fake_module(session.device, "AwesomeLLM", model_params=model_params),
+    )
+    draft = cache_params.draft_model
+    if draft is not None:
+        lms.add(create_fake_module(session.device, draft.module_name, draft))
+    lms.initialize()
+    params = ServiceParams(cache=cache_params, model=model_params)
+    return GenerateServiceV1(session=session, params=params, cache=cache, **kwargs)
+
+
+def test_pipelined_async_prefill(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+):
+    model_params.async_invocations = True
+    service = _create_fake_service(
+        uninitialized_session, cache_params, model_params, pipeline_depth=2
+    )
+    state = service.start()
+
+    async def task():
+        # The second prefill is staged into its own transfer buffers without
+        # waiting on the first, and is scheduled behind it on the queue.
+        await state.set_sequences([GenerateRequest("1", "hello", [3, 4, 5])])
+        first = await state.prefill()
+        await state.add_sequences([GenerateRequest("2", "again", [7, 8, 9])])
+        second = await state.prefill()
+        assert second.timeline > first.timeline
+        for guarded_outputs in [first, second]:
+            ids = await guarded_outputs.resolve(state.host_context)
+            ids_array = ids.map().asarray(
+                ids.shape, HalElementType.map_to_dtype(ids.element_type)
+            )
+            assert ids_array.tolist() == [[1]]
+        await state.recycle()
+
+    state.host_context.run_sync(task())
+
+
+def test_dynamic_batch_size_runs_exact_rows(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+):
+    model_params.prefill_batch_sizes = [1, 4]
+    model_params.decode_batch_sizes = [1, 4]
+    model_params.dynamic_batch_size = 8
+    service = _create_fake_service(uninitialized_session, cache_params, model_params)
+    functions = service.decode_functions
+    assert functions.max_batch_size == 8
+    # Specialized sizes are preferred, then exact dynamic ones.
+    assert [functions.select_batch_size(n) for n in [1, 3, 4, 6]] == [1, 3, 4, 6]
+    assert functions[3] is functions.dynamic
+    assert functions[4] is functions.static[4]
+    state = service.start()
+
+    async def task():
+        await state.set_sequences(
+            [GenerateRequest(str(i), "hello", [3, 4, i]) for i in range(3)]
+        )
+        ids = await (await state.prefill()).resolve(state.host_context)
+        assert list(ids.shape) == [3, 1]
+        await state.set_decode_step([1, 1, 1])
+        ids = await (await state.decode()).resolve(state.host_context)
+        assert list(ids.shape) == [3, 1]
+        await state.recycle()
+
+    state.host_context.run_sync(task())
+
+
+def test_sample_chains_after_prefill(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+):
+    model_params.async_invocations = True
+    model_params.prefill_last_logits = True
+    model_params.sampling = True
+    service = _create_fake_service(uninitialized_session, cache_params, model_params)
+    state = service.start()
+
+    async def task():
+        await state.set_sequences(
+            [
+                GenerateRequest("greedy", "hello", [3, 4, 5]),
+                GenerateRequest(
+                    "sampled",
+                    "goodbye",
+                    [9, 10],
+                    sampling=SamplingParams(temperature=0.7, top_k=5, seed=1),
+                ),
+            ]
+        )
+        logits = await state.prefill()
+        # The sampler consumes the prefill result on the device.
+        guarded_tokens = await state.sample(logits)
+        assert guarded_tokens.timeline > logits.timeline
+        tokens = await guarded_tokens.resolve(state.host_context)
+        assert tokens.element_type == HalElementType.SINT_64
+        tokens_array = tokens.map().asarray(tokens.shape, np.int64)
+        assert tokens_array[0:2].tolist() == [[1], [2]]
+        await state.recycle()
+
+    state.host_context.run_sync(task())
+
+
+# The draft module is invoked per its own params, whether or not they match
+# the served model's async invocations.
+@pytest.mark.parametrize("draft_async_invocations", [True, False])
+def test_speculative_decode_accepts_matching_prefix(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+    draft_async_invocations: bool,
+):
+    model_params.async_invocations = True
+    model_params.verify_chunk_len = 4
+    cache_params.draft_model = dataclasses.replace(
+        model_params,
+        module_name="Draft",
+        transformer_block_count=2,
+        sampling=True,
+        verify_chunk_len=0,
+        async_invocations=draft_async_invocations,
+    )
+    service = _create_fake_service(uninitialized_session, cache_params, model_params)
+    assert service.speculate_k == 3
+    state = service.start()
+
+    async def task():
+        await state.set_sequences([GenerateRequest("1", "hello", list(range(12)))])
+        await (await state.prefill()).resolve(state.host_context)
+        free_blocks = len(service.cache.attn_block_free)
+
+        # Speculated positions reach into a second block.
+        await state.set_speculative_step([1])
+        assert len(service.cache.attn_block_free) == free_blocks - 1
+
+        # The draft proposes [1, 1, 1] and the fake verification predicts
+        # [1, 1, 102, 103]: two proposed tokens are accepted followed by 102.
+        accepted = await state.speculative_decode()
+        assert accepted == [[1, 1, 102]]
+        assert len(service.cache.attn_block_free) == free_blocks
+        await state.recycle()
+
+    state.host_context.run_sync(task())
+
+
+def test_acquire_waits_in_fifo_order(attn_block_cache: AttnBlockCache):
+    cache = attn_block_cache
+    block_count = len(cache.attn_block_entries)
+
+    async def settle():
+        for _ in range(3):
+            await asyncio.sleep(0)
+
+    async def task():
+        all_blocks = []
+        await cache.acquire_attn_blocks(block_count, all_blocks)
+        assert not cache.can_acquire(1)
+
+        large, small = [], []
+        large_task = asyncio.create_task(cache.acquire_attn_blocks(4, large))
+        await settle()
+        small_task = asyncio.create_task(cache.acquire_attn_blocks(1, small))
+        await settle()
+        assert cache.waiting_block_count == 5
+
+        # The small request must not overtake the large one.
+        await cache.release_attn_blocks(all_blocks[0:1])
+        await settle()
+        assert not large_task.done() and not small_task.done()
+
+        await cache.release_attn_blocks(all_blocks[1:4])
+        await settle()
+        assert large_task.done() and len(large) == 4
+        assert not small_task.done()
+
+        # Cancelling a waiter withdraws its request.
+        cancelled = asyncio.create_task(cache.acquire_attn_blocks(2, []))
+        await settle()
+        await cache.release_attn_blocks(all_blocks[4:5])
+        await settle()
+        assert small_task.done() and len(small) == 1
+        cancelled.cancel()
+        await settle()
+        assert cache.waiting_block_count == 0
+
+    asyncio.run(task())
+
+
+def test_decode_preempts_youngest(service: GenerateServiceV1):
+    state = service.start()
+    cache = service.cache
+
+    async def task():
+        # Each prompt fills all but the last position of its first block.
+        await state.set_sequences(
+            requests=[
+                GenerateRequest("1", "first", list(range(15))),
+                GenerateRequest("2", "second", list(range(100, 115))),
+            ]
+        )
+        guarded_outputs = await state.prefill()
+        await guarded_outputs.resolve(state.host_context)
+
+        # Exhaust the cache so that the next decode step cannot grow both.
+        filler = []
+        await cache.acquire_attn_blocks(cache.available_block_count, filler)
+        await state.set_decode_step([1, 2])
+        assert [r.request_id for r in state.requests] == ["1"]
+        assert [r.request_id for r in state.pending_requests] == ["2"]
+
+        # Once blocks are available, the preempted sequence is recomputed.
+        await cache.release_attn_blocks(filler)
+        guarded_outputs = await state.prefill()
+        await guarded_outputs.resolve(state.host_context)
+        assert [r.request_id for r in state.requests] == ["1", "2"]
+        await state.recycle()
+        assert cache.available_block_count == len(cache.attn_block_entries)
+
+    state.host_context.run_sync(task())
+
+
+def test_prefill_fails_on_blocks_held_by_own_batch(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+):
+    cache_params.device_block_count = 2
+    service = _create_fake_service(uninitialized_session, cache_params, model_params)
+    state = service.start()
+    cache = service.cache
+
+    async def task():
+        await state.set_sequences(
+            requests=[
+                GenerateRequest("1", "first", list(range(15))),
+                GenerateRequest("2", "second", list(range(100, 115))),
+            ]
+        )
+        guarded_outputs = await state.prefill()
+        await guarded_outputs.resolve(state.host_context)
+
+        # Growing both takes the whole cache, so the youngest is preempted.
+        await state.set_decode_step([1, 2])
+        assert [r.request_id for r in state.pending_requests] == ["2"]
+        assert cache.available_block_count == 0
+
+        # Only the live sequence could release the blocks the preempted one
+        # needs, so the prefill fails rather than waiting forever.
+        with pytest.raises(AttnBlocksUnavailableError):
+            await state.prefill()
+        await state.retire_sequences(["1"])
+        guarded_outputs = await state.prefill()
+        await guarded_outputs.resolve(state.host_context)
+        assert [r.request_id for r in state.requests] == ["2"]
+        await state.recycle()
+        assert cache.available_block_count == len(cache.attn_block_entries)
+
+    state.host_context.run_sync(task())
+
+
+def test_preempted_blocks_offload_to_host(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+):
+    cache_params.host_block_count = 4
+    service = _create_fake_service(
+        uninitialized_session, cache_params, model_params, prefill_chunk_size=16
+    )
+    state = service.start()
+    cache = service.cache
+
+    async def task():
+        await state.set_sequences(
+            requests=[
+                GenerateRequest("1", "first", list(range(15))),
+                GenerateRequest("2", "second", list(range(100, 115))),
+            ]
+        )
+        await state.set_chunked_step([])
+        outputs = await state.chunked_step()
+        await outputs.resolve(state.host_context)
+
+        # The preempted sequence's block is copied to the host tier.
+        filler = []
+        await cache.acquire_attn_blocks(cache.available_block_count, filler)
+        await state.set_decode_step([1, 2])
+        assert [r.request_id for r in state.pending_requests] == ["2"]
+        assert len(cache.host_block_free) == 3
+        outputs = await state.decode()
+        await outputs.resolve(state.host_context)
+
+        # It is restored rather than recomputed: only its last position is left.
+        await cache.release_attn_blocks(filler)
+        await state.set_chunked_step([3])
+        assert [r.request_id for r in state.step_requests] == ["1", "2"]
+        assert len(cache.host_block_free) == 4
+        assert state._step_rows[1].start_position == 15
+        outputs = await state.chunked_step()
+        await outputs.resolve(state.host_context)
+        assert [r.request_id for r in state.requests] == ["1", "2"]
+        await state.recycle()
+        assert cache.available_block_count == len(cache.attn_block_entries)
+
+    state.host_context.run_sync(task())
+
+
+def test_prefill_drops_offloaded_blocks(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+):
+    cache_params.host_block_count = 4
+    service = _create_fake_service(
+        uninitialized_session, cache_params, model_params, prefill_chunk_size=16
+    )
+    state = service.start()
+    cache = service.cache
+    restored = KV_TRANSFERRED_BLOCKS_TOTAL.labels(direction="restore")
+
+    async def task():
+        await state.set_sequences(
+            requests=[
+                GenerateRequest("1", "first", list(range(15))),
+                GenerateRequest("2", "second", list(range(100, 115))),
+            ]
+        )
+        await state.set_chunked_step([])
+        outputs = await state.chunked_step()
+        await outputs.resolve(state.host_context)
+        filler = []
+        await cache.acquire_attn_blocks(cache.available_block_count, filler)
+        await state.set_decode_step([1, 2])
+        assert len(cache.host_block_free) == 3
+        outputs = await state.decode()
+        await outputs.resolve(state.host_context)
+
+        # A plain prefill recomputes every position, so the offloaded block is
+        # released without being copied back.
+        await cache.release_attn_blocks(filler)
+        restored_count = restored.value
+        outputs = await state.prefill()
+        await outputs.resolve(state.host_context)
+        assert len(cache.host_block_free) == 4
+        assert restored.value == restored_count
+        assert [r.request_id for r in state.requests] == ["1", "2"]
+        await state.recycle()
+        assert cache.available_block_count == len(cache.attn_block_entries)
+
+    state.host_context.run_sync(task())
+
+
+@pytest.mark.parametrize("prefill_chunk_size", [0, 16])
+def test_prefill_does_not_write_shared_prefix_blocks(
+    uninitialized_session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+    prefill_chunk_size: int,
+):
+    service = _create_fake_service(
+        uninitialized_session,
+        cache_params,
+        model_params,
+        prefill_chunk_size=prefill_chunk_size,
+    )
+    state = service.start()
+    cache = service.cache
+    prompt = list(range(40))  # 2 whole blocks + a partial block of 8 positions.
+
+    async def task():
+        published = []
+        await cache.acquire_attn_blocks(3, published)
+        cache.publish_prefix(prompt, published)
+
+        # Only a service running chunked steps starts after the shared prefix.
+        await state.set_sequences([GenerateRequest("1", "first", prompt)])
+        seq = state._pending_sequences[0]
+        assert seq.cached_prefix_length == (32 if prefill_chunk_size > 0 else 0)
+
+        # A plain prefill computes the prefix into blocks of its own.
+        outputs = await state.prefill()
+        await outputs.resolve(state.host_context)
+        published_indices = {b.index for b in published}
+        assert not any(b.index in published_indices for b in seq.attn_blocks)
+        assert all(b.ref_count == 1 for b in published)
+
+        await state.recycle()
+        await cache.release_attn_blocks(published)
+        assert cache.available_block_count == len(cache.attn_block_entries)
+
+    state.host_context.run_sync(task())
+
+
+def test_dispatcher_places_on_least_loaded(
+    cache_params: CacheParams, model_params: ModelParams
+):
+    from iree.runtime._binding import disable_leak_checker  # type: ignore
+
+    disable_leak_checker()
+    group = DeviceSessionGroup(uris=["local-task", "local-task"])
+    services = [
+        _create_fake_service(session, cache_params, model_params)
+        for session in group.sessions
+    ]
+    dispatcher = BatchDispatcher([service.start() for service in services])
+    try:
+        # Requests alternate between the devices as their load evens out.
+        requests = [GenerateRequest(str(i), "hello", [3, 4, i]) for i in range(3)]
+        assert [dispatcher.place(r) for r in requests] == [0, 1, 0]
+        assert dispatcher.placed_count() == 3
+        state = dispatcher.states[0]
+        assert [r.request_id for r in dispatcher.take(1, limit=0)] == []
+        admit = dispatcher.take(0)
+        assert [r.request_id for r in admit] == ["0", "2"]
+
+        async def task():
+            await state.add_sequences(admit)
+
+        state.host_context.run_sync(task())
+        # Admitted sequences still count towards the load of their device.
+        assert dispatcher.place(GenerateRequest("3", "hello", [5])) == 1
+        state.host_context.run_sync(state.recycle())
+    finally:
+        group.shutdown()
+
+
+def test_chunked_prefill_mixes_with_decode(
+    session: DeviceSession,
+    cache_params: CacheParams,
+    model_params: ModelParams,
+    attn_block_cache: AttnBlockCache,
+):
+    params = ServiceParams(cache=cache_params, model=model_params)
+    service = GenerateServiceV1(
+        session=session, params=params, cache=attn_block_cache, prefill_chunk_size=16
+    )
+    state = service.start()
+
+    async def task():
+        await state.add_sequences(
+            [
+                GenerateRequest("long", "long prompt", list(range(40))),
+                GenerateRequest("short", "short prompt", [9, 10, 11]),
+            ]
+        )
+
+        # Both prompts are chunked; only the short one completes.
+        await state.set_chunked_step([])
+        assert [r.request_id for r in state.step_requests] == ["long", "short"]
+        assert state.step_token_rows == [1]
+        assert state.step_row_lengths == [16, 3]
+        outputs = await state.chunked_step()
+        await outputs.resolve(state.host_context)
+        assert [r.request_id for r in state.requests] == ["short"]
+        assert [r.request_id for r in state.pending_requests] == ["long"]
+
+        # The short sequence decodes alongside the next chunk.
+        await state.set_chunked_step([7])
+        assert [r.request_id for r in state.step_requests] == ["short", "long"]
+        assert state.step_token_rows == [0]
+        assert state.step_row_lengths == [1, 16]
+        outputs = await state.chunked_step()
+        await outputs.resolve(state.host_context)
+
+        # The final chunk completes the long prompt.
+        await state.set_chunked_step([8])
+        assert state.step_token_rows == [0, 1]
+        assert state.step_row_lengths == [1, 8]
+        outputs = await state.chunked_step()
+        await outputs.resolve(state.host_context)
+        assert [r.request_id for r in state.requests] == ["short", "long"]
+        assert not state.pending_requests
+        await state.recycle()
+
+    state.host_context.run_sync(task())
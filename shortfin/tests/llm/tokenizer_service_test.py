@@ -0,0 +1,60 @@
+# Copyright 2024 Advanced Micro Devices, Inc
+#
+# Licensed under the Apache License v2.0 with LLVM Exceptions.
+# See https://llvm.org/LICENSE.txt for license information.
+# SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+
+import asyncio
+
+from sharktank.utils.tokenizer import InferenceTokenizer
+
+from shortfin.llm.service import (
+    EchoGenerateService,
+    GenerateRequest,
+)
+from shortfin.llm.tokenizer_service import (
+    TokenizerPool,
+    TokenizerService,
+)
+
+
+class Utf8Tokenizer(InferenceTokenizer):
+    def __init__(self):
+        self.encode_batches: list[list[str]] = []
+
+    def _encode(self, texts: list[str]) -> list[list[int]]:
+        self.encode_batches.append(list(texts))
+        return [list(t.encode()) for t in texts]
+
+    def _decode(self, tokens: list[list[int]]) -> list[str]:
+        return [bytes(row).decode(errors="replace") for row in tokens]
+
+
+def test_batched_encode():
+    tokenizer = Utf8Tokenizer()
+    pool = TokenizerPool(tokenizer)
+
+    async def run():
+        return await asyncio.gather(*[pool.encode(t) for t in ["a", "bc", "d"]])
+
+    try:
+        assert asyncio.run(run()) == [[97], [98, 99], [100]]
+    finally:
+        pool.shutdown()
+    assert tokenizer.encode_batches == [["a", "bc", "d"]]
+
+
+def test_tokenizer_service():
+    pool = TokenizerPool(Utf8Tokenizer())
+    service = TokenizerService(EchoGenerateService(delay=0.0), pool)
+
+    async def run():
+        request = GenerateRequest(request_id="a", prompt="Hé!", max_tokens=3)
+        return [part async for part in service.handle_request(request)]
+
+    try:
+        parts = asyncio.run(run())
+    finally:
+        pool.shutdown()
+    assert [p.text for p in parts] == ["Hé!"] * 3
+    assert parts[-1].finished